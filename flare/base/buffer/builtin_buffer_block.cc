@@ -82,10 +82,36 @@ RefPtr<NativeBufferBlock> MakeNativeBufferBlock() {
   return make_native_buffer_block();
 }
 
+RefPtr<NativeBufferBlock> MakeNativeBufferBlock(NativeBufferBlockSize size) {
+  switch (size) {
+    case NativeBufferBlockSize::k1K:
+      return MakeNativeBufferBlockOfBytes<1024>();
+    case NativeBufferBlockSize::k4K:
+      return MakeNativeBufferBlockOfBytes<4096>();
+    case NativeBufferBlockSize::k64K:
+      return MakeNativeBufferBlockOfBytes<65536>();
+    case NativeBufferBlockSize::k1M:
+      return MakeNativeBufferBlockOfBytes<1048576>();
+  }
+  FLARE_UNREACHABLE("Unexpected buffer block size class [{}].",
+                    static_cast<int>(size));
+}
+
 }  // namespace flare
 
 namespace flare {
 
+template <>
+struct PoolTraits<FixedNativeBufferBlock<1024>> {
+  static constexpr auto kType = PoolType::MemoryNodeShared;
+  static constexpr auto kLowWaterMark = 16384;  // 16M per node.
+  static constexpr auto kHighWaterMark =
+      std::numeric_limits<std::size_t>::max();
+  static constexpr auto kMaxIdle = std::chrono::seconds(10);
+  static constexpr auto kMinimumThreadCacheSize = 4096;  // 4M per thread.
+  static constexpr auto kTransferBatchSize = 1024;       // Extra 1M.
+};
+
 template <>
 struct PoolTraits<FixedNativeBufferBlock<4096>> {
   static constexpr auto kType = PoolType::MemoryNodeShared;
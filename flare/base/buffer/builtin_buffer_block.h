@@ -34,12 +34,26 @@ class alignas(hardware_destructive_interference_size) NativeBufferBlock
   virtual char* mutable_data() noexcept = 0;
 };
 
+// Size classes of native buffer blocks. Blocks of each size class are pooled
+// separately.
+//
+// Note that (slightly) less bytes than the nominal size is usable, as part of
+// the block is occupied by the block's header.
+enum class NativeBufferBlockSize { k1K, k4K, k64K, k1M };
+
 // Allocate a buffer block.
 //
 // Size of the buffer block is determined by GFlags on startup, see
 // implementation for detail.
 RefPtr<NativeBufferBlock> MakeNativeBufferBlock();
 
+// Allocate a buffer block of the given size class.
+//
+// This is useful if the caller has some knowledge of how much data is going to
+// be filled in (e.g., when reading from a connection that is known to carry
+// small / large messages.)
+RefPtr<NativeBufferBlock> MakeNativeBufferBlock(NativeBufferBlockSize size);
+
 // This buffer references a non-owning memory region.
 //
 // The buffer creator is responsible for making sure the memory region
@@ -27,8 +27,10 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -136,6 +138,11 @@ bool operator==(const Endpoint& left, const Endpoint& right) {
   return memcmp(left.Get(), right.Get(), left.Length()) == 0;
 }
 
+std::size_t EndpointHash::operator()(const Endpoint& endpoint) const noexcept {
+  return std::hash<std::string_view>{}(
+      {reinterpret_cast<const char*>(endpoint.Get()), endpoint.Length()});
+}
+
 Endpoint EndpointFromIpv4(const std::string& ip, std::uint16_t port) {
   EndpointRetriever er;
   auto addr = er.RetrieveAddr();
@@ -18,6 +18,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 
+#include <cstddef>
 #include <cstring>
 #include <optional>
 #include <ostream>
@@ -133,6 +134,11 @@ static_assert(sizeof(Endpoint) == 32);
 
 bool operator==(const Endpoint& left, const Endpoint& right);
 
+// Hashes `Endpoint` by its socket address, for use with unordered containers.
+struct EndpointHash {
+  std::size_t operator()(const Endpoint& endpoint) const noexcept;
+};
+
 Endpoint EndpointFromIpv4(const std::string& ip, std::uint16_t port);
 Endpoint EndpointFromIpv6(const std::string& ip, std::uint16_t port);
 Endpoint EndpointFromUnix(std::string_view path);
@@ -20,6 +20,7 @@
 //
 // See headers below for more details.
 #include "flare/base/write_mostly/basic_ops.h"
+#include "flare/base/write_mostly/histogram.h"
 #include "flare/base/write_mostly/metrics.h"
 
 // In case you want to specialize for your own type, we also provide this basic
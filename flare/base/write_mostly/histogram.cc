@@ -0,0 +1,225 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/base/write_mostly/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+#include "flare/base/chrono.h"
+#include "flare/base/internal/logging.h"
+#include "flare/base/internal/time_keeper.h"
+#include "flare/base/never_destroyed.h"
+
+namespace flare {
+
+std::uint64_t WriteMostlyHistogram::Snapshot::GetPercentile(
+    double p) const noexcept {
+  if (!count_) {
+    return 0;
+  }
+  auto rank = static_cast<std::uint64_t>(std::ceil(p * count_));
+  rank = std::clamp<std::uint64_t>(rank, 1, count_);
+  std::uint64_t seen = 0;
+  for (auto&& [upper, cnt] : buckets_) {
+    seen += cnt;
+    if (seen >= rank) {
+      return upper;
+    }
+  }
+  return buckets_.back().first;  // Unreachable, really.
+}
+
+void WriteMostlyHistogram::Snapshot::Merge(const Snapshot& other) {
+  count_ += other.count_;
+  sum_ += other.sum_;
+
+  std::vector<std::pair<std::uint32_t, std::uint64_t>> merged;
+  merged.reserve(buckets_.size() + other.buckets_.size());
+  auto x = buckets_.cbegin();
+  auto y = other.buckets_.cbegin();
+  while (x != buckets_.cend() && y != other.buckets_.cend()) {
+    if (x->first < y->first) {
+      merged.push_back(*x++);
+    } else if (y->first < x->first) {
+      merged.push_back(*y++);
+    } else {
+      merged.emplace_back(x->first, x->second + y->second);
+      ++x, ++y;
+    }
+  }
+  merged.insert(merged.end(), x, buckets_.cend());
+  merged.insert(merged.end(), y, other.buckets_.cend());
+  buckets_ = std::move(merged);
+}
+
+class WriteMostlyHistogram::Ticker {
+ public:
+  static Ticker* Instance() {
+    static NeverDestroyedSingleton<Ticker> ticker;
+    return ticker.Get();
+  }
+
+  void Add(WriteMostlyHistogram* histogram) {
+    std::scoped_lock _(lock_);
+    histograms_.insert(histogram);
+  }
+
+  // Once returned, `histogram` is not touched by us any more.
+  void Remove(WriteMostlyHistogram* histogram) {
+    std::scoped_lock _(lock_);
+    histograms_.erase(histogram);
+  }
+
+ private:
+  friend class NeverDestroyedSingleton<Ticker>;
+
+  Ticker() {
+    // Never killed, we live as long as the process.
+    internal::TimeKeeper::Instance()->AddTimer(
+        ReadSteadyClock() + std::chrono::seconds(1), std::chrono::seconds(1),
+        [this](uint64_t) { OnTimer(); }, false);
+  }
+
+  void OnTimer() {
+    std::scoped_lock _(lock_);
+    for (auto&& e : histograms_) {
+      e->Rotate();
+    }
+  }
+
+ private:
+  std::mutex lock_;
+  std::unordered_set<WriteMostlyHistogram*> histograms_;
+};
+
+WriteMostlyHistogram::WriteMostlyHistogram(std::size_t sub_bucket_bits)
+    : sub_bucket_bits_(sub_bucket_bits),
+      buckets_(GetBucketCount(sub_bucket_bits)),
+      last_(buckets_),
+      exited_(buckets_),
+      tls_counters_([this] { return std::make_unique<ThreadCounters>(this); }) {
+  FLARE_CHECK_LE(sub_bucket_bits, kSubBucketBits);
+  Ticker::Instance()->Add(this);
+}
+
+WriteMostlyHistogram::~WriteMostlyHistogram() {
+  Ticker::Instance()->Remove(this);
+}
+
+WriteMostlyHistogram::Snapshot WriteMostlyHistogram::Get(
+    std::size_t seconds) const {
+  std::scoped_lock _(records_lock_);
+  seconds = std::min(seconds, kSlots * kSlots);
+
+  Snapshot result;
+  auto merge_seconds = [&](std::size_t n) {
+    for (std::size_t i = 1; i <= n && i <= ticks_; ++i) {
+      result.Merge(*seconds_[(ticks_ - i) % kSlots]);
+    }
+  };
+  if (seconds <= kSlots) {
+    merge_seconds(seconds);
+    return result;
+  }
+
+  // Seconds in current minute are not merged into `minutes_` yet.
+  auto partial = ticks_ % kSlots;
+  merge_seconds(partial);
+  auto minutes = (seconds - partial + kSlots - 1) / kSlots;
+  auto minutes_elapsed = ticks_ / kSlots;
+  for (std::size_t i = 1; i <= minutes && i <= minutes_elapsed; ++i) {
+    result.Merge(*minutes_[(minutes_elapsed - i) % kSlots]);
+  }
+  return result;
+}
+
+WriteMostlyHistogram::Snapshot WriteMostlyHistogram::GetAll() const {
+  std::scoped_lock _(records_lock_);
+  return total_;
+}
+
+std::uint64_t WriteMostlyHistogram::GetBucketUpperBound(
+    std::size_t index, std::size_t sub_bucket_bits) noexcept {
+  if (index < (1ULL << sub_bucket_bits)) {
+    return index;
+  }
+  auto shift = (index >> sub_bucket_bits) - 1;
+  auto sub_bucket = (index & ((1ULL << sub_bucket_bits) - 1)) +
+                    (1ULL << sub_bucket_bits);
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+WriteMostlyHistogram::ThreadCounters::~ThreadCounters() {
+  std::scoped_lock _(parent->exited_lock_);
+  auto&& exited = parent->exited_;
+  for (std::size_t i = 0; i != parent->buckets_; ++i) {
+    exited.buckets[i] += counters.buckets[i].load(std::memory_order_relaxed);
+  }
+  exited.count += counters.count.load(std::memory_order_relaxed);
+  exited.sum += counters.sum.load(std::memory_order_relaxed);
+  // We're still visible to `ForEach` until we're fully destroyed. Don't let
+  // `ReadCumulative` count us twice.
+  merged.store(true, std::memory_order_relaxed);
+}
+
+WriteMostlyHistogram::Cumulative WriteMostlyHistogram::ReadCumulative() const {
+  // `exited_lock_` is held throughout so that counters of a thread exiting
+  // concurrently are seen exactly once.
+  std::scoped_lock _(exited_lock_);
+  Cumulative result = exited_;
+  tls_counters_.ForEach([&](const ThreadCounters* tc) {
+    if (tc->merged.load(std::memory_order_relaxed)) {
+      return;
+    }
+    for (std::size_t i = 0; i != buckets_; ++i) {
+      result.buckets[i] +=
+          tc->counters.buckets[i].load(std::memory_order_relaxed);
+    }
+    result.count += tc->counters.count.load(std::memory_order_relaxed);
+    result.sum += tc->counters.sum.load(std::memory_order_relaxed);
+  });
+  return result;
+}
+
+void WriteMostlyHistogram::Rotate() {
+  std::scoped_lock _(records_lock_);
+  auto current = ReadCumulative();
+
+  auto entry = std::make_unique<Snapshot>();
+  for (std::size_t i = 0; i != buckets_; ++i) {
+    // Unsigned arithmetic takes care of wrap-around.
+    std::uint32_t delta = current.buckets[i] - last_.buckets[i];
+    if (delta) {
+      entry->buckets_.emplace_back(GetBucketUpperBound(i, sub_bucket_bits_),
+                                   delta);
+    }
+  }
+  entry->count_ = current.count - last_.count;
+  entry->sum_ = current.sum - last_.sum;
+  last_ = current;
+
+  total_.Merge(*entry);
+  seconds_[ticks_ % kSlots] = std::move(entry);
+  if (++ticks_ % kSlots == 0) {
+    auto minute = std::make_unique<Snapshot>();
+    for (auto&& e : seconds_) {
+      minute->Merge(*e);
+    }
+    minutes_[(ticks_ / kSlots - 1) % kSlots] = std::move(minute);
+  }
+}
+
+}  // namespace flare
@@ -0,0 +1,199 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_BASE_WRITE_MOSTLY_HISTOGRAM_H_
+#define FLARE_BASE_WRITE_MOSTLY_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "flare/base/align.h"
+#include "flare/base/internal/test_prod.h"
+#include "flare/base/likely.h"
+#include "flare/base/thread/thread_local.h"
+
+namespace flare {
+
+// A log-linear (HDR-style) histogram optimized for writers, for recording
+// latencies and calculating percentiles of them.
+//
+// Values in [0, 32) are recorded exactly. Larger ones are recorded into one of
+// the 32 equal-width buckets of the power-of-two range they fall in, so the
+// value reported for a percentile (the upper bound of a bucket) is at most
+// ~3% (1/32) larger than the real one. Values that do not fit in 32 bits are
+// clamped.
+//
+// The precision can be lowered in exchange for memory by passing a smaller
+// `sub_bucket_bits` to the constructor: each power-of-two range is then split
+// into `2^sub_bucket_bits` buckets, and each thread reporting values keeps
+// `4 * GetBucketCount(sub_bucket_bits)` bytes of counters (~3.5K by default,
+// ~1K with 3 bits, which is accurate to ~12%).
+//
+// Each thread increments its own counters without any lock or atomic RMW.
+// Counters are never reset, every second the difference since last second is
+// taken as a snapshot, and snapshots are rotated to serve the past hour.
+//
+// All histograms in the process are rotated by a single timer, so it's fine to
+// have lots of them (e.g., one per method).
+class WriteMostlyHistogram {
+ public:
+  static constexpr std::size_t kSubBucketBits = 5;
+  static constexpr std::size_t kValueBits = 32;
+  static constexpr std::size_t kBuckets = (kValueBits - kSubBucketBits + 1)
+                                          << kSubBucketBits;
+
+  // Counts of values recorded in a period. Snapshots are mergeable.
+  class Snapshot {
+   public:
+    std::uint64_t count() const noexcept { return count_; }
+    std::uint64_t sum() const noexcept { return sum_; }
+    std::uint64_t average() const noexcept {
+      return count_ ? sum_ / count_ : 0;
+    }
+
+    // Returns the value at percentile `p` (in [0, 1]), e.g. `0.999` for p999.
+    // Zero is returned if nothing was recorded.
+    std::uint64_t GetPercentile(double p) const noexcept;
+
+    void Merge(const Snapshot& other);
+
+   private:
+    friend class WriteMostlyHistogram;
+
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    // Non-empty buckets, keyed and sorted by their upper bounds. This keeps
+    // snapshots of histograms of different precisions mergeable.
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> buckets_;
+  };
+
+  // `sub_bucket_bits` may not be greater than `kSubBucketBits`.
+  explicit WriteMostlyHistogram(std::size_t sub_bucket_bits = kSubBucketBits);
+  ~WriteMostlyHistogram();
+
+  // Record a value.
+  void Report(std::uint64_t value) noexcept {
+    auto&& counters = tls_counters_->counters;
+    auto&& bucket = counters.buckets[GetBucketIndex(value, sub_bucket_bits_)];
+    // We're the only writer, no RMW is required.
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    counters.count.store(counters.count.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    counters.sum.store(counters.sum.load(std::memory_order_relaxed) + value,
+                       std::memory_order_relaxed);
+  }
+
+  // Get values recorded in recent `seconds` (at most an hour).
+  //
+  // For periods longer than a minute, values are read at a granularity of
+  // minutes (rounded up).
+  Snapshot Get(std::size_t seconds) const;
+
+  // Get all values ever recorded (up to last rotation.)
+  Snapshot GetAll() const;
+
+  // Number of buckets of a histogram of the given precision.
+  static constexpr std::size_t GetBucketCount(
+      std::size_t sub_bucket_bits) noexcept {
+    return (kValueBits - sub_bucket_bits + 1) << sub_bucket_bits;
+  }
+
+  // Exposed for testing purpose.
+  static std::size_t GetBucketIndex(
+      std::uint64_t value,
+      std::size_t sub_bucket_bits = kSubBucketBits) noexcept {
+    if (FLARE_UNLIKELY(value >= (1ULL << kValueBits))) {
+      return GetBucketCount(sub_bucket_bits) - 1;
+    }
+    if (value < (1ULL << sub_bucket_bits)) {
+      return value;
+    }
+    auto exp = 63 - __builtin_clzll(value);  // >= sub_bucket_bits.
+    auto shift = exp - sub_bucket_bits;
+    return ((shift + 1) << sub_bucket_bits) +
+           ((value >> shift) - (1ULL << sub_bucket_bits));
+  }
+
+  // Largest value that falls into bucket `index`.
+  static std::uint64_t GetBucketUpperBound(
+      std::size_t index, std::size_t sub_bucket_bits = kSubBucketBits) noexcept;
+
+ private:
+  FLARE_FRIEND_TEST(WriteMostlyHistogram, Precision);
+  FLARE_FRIEND_TEST(WriteMostlyHistogram, Rotation);
+
+  static constexpr std::size_t kSlots = 60;
+
+  // Rotates all histograms every second.
+  class Ticker;
+
+  // Monotonic, wraps around (which does not matter as we only care about
+  // differences.)
+  struct Cumulative {
+    explicit Cumulative(std::size_t buckets) : buckets(buckets) {}
+
+    std::vector<std::uint32_t> buckets;
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+  };
+
+  struct AtomicCumulative {
+    explicit AtomicCumulative(std::size_t buckets)
+        : buckets(std::make_unique<std::atomic<std::uint32_t>[]>(buckets)) {}
+
+    std::unique_ptr<std::atomic<std::uint32_t>[]> buckets;
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> sum{0};
+  };
+
+  // Merged into `exited_` when the thread leaves.
+  struct alignas(hardware_destructive_interference_size) ThreadCounters {
+    explicit ThreadCounters(WriteMostlyHistogram* parent)
+        : parent(parent), counters(parent->buckets_) {}
+    ~ThreadCounters();
+
+    WriteMostlyHistogram* parent;
+    std::atomic<bool> merged{false};  // Set once merged into `exited_`.
+    AtomicCumulative counters;
+  };
+
+  Cumulative ReadCumulative() const;
+  void Rotate();
+
+  const std::size_t sub_bucket_bits_;
+  const std::size_t buckets_;  // Number of buckets.
+
+  mutable std::mutex records_lock_;
+  Cumulative last_;
+  std::unique_ptr<Snapshot> seconds_[kSlots];
+  std::unique_ptr<Snapshot> minutes_[kSlots];
+  std::size_t ticks_ = 0;  // Number of seconds elapsed.
+  Snapshot total_;
+
+  // Counters of exited threads. Declared before `tls_counters_` so that it's
+  // still alive when `tls_counters_` is destroyed.
+  mutable std::mutex exited_lock_;
+  Cumulative exited_;
+  ThreadLocal<ThreadCounters> tls_counters_;
+};
+
+}  // namespace flare
+
+#endif  // FLARE_BASE_WRITE_MOSTLY_HISTOGRAM_H_
@@ -0,0 +1,154 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/base/write_mostly/histogram.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare {
+
+TEST(WriteMostlyHistogram, Bucket) {
+  for (std::uint64_t i = 0; i != 100000; ++i) {
+    auto index = WriteMostlyHistogram::GetBucketIndex(i);
+    ASSERT_LT(index, WriteMostlyHistogram::kBuckets);
+    auto upper = WriteMostlyHistogram::GetBucketUpperBound(index);
+    ASSERT_GE(upper, i);
+    ASSERT_LE(upper - i, i / 32);
+    ASSERT_EQ(index, WriteMostlyHistogram::GetBucketIndex(upper));
+  }
+  EXPECT_EQ(WriteMostlyHistogram::kBuckets - 1,
+            WriteMostlyHistogram::GetBucketIndex(0xffff'ffff));
+  EXPECT_EQ(WriteMostlyHistogram::kBuckets - 1,
+            WriteMostlyHistogram::GetBucketIndex(1ULL << 40));
+  EXPECT_EQ(0xffff'ffff, WriteMostlyHistogram::GetBucketUpperBound(
+                             WriteMostlyHistogram::kBuckets - 1));
+}
+
+TEST(WriteMostlyHistogram, CoarseBucket) {
+  constexpr auto kBits = 3;
+  constexpr auto kBuckets = WriteMostlyHistogram::GetBucketCount(kBits);
+  for (std::uint64_t i = 0; i != 100000; ++i) {
+    auto index = WriteMostlyHistogram::GetBucketIndex(i, kBits);
+    ASSERT_LT(index, kBuckets);
+    auto upper = WriteMostlyHistogram::GetBucketUpperBound(index, kBits);
+    ASSERT_GE(upper, i);
+    ASSERT_LE(upper - i, i / 8);
+    ASSERT_EQ(index, WriteMostlyHistogram::GetBucketIndex(upper, kBits));
+  }
+  EXPECT_EQ(kBuckets - 1, WriteMostlyHistogram::GetBucketIndex(1ULL << 40, kBits));
+  EXPECT_EQ(0xffff'ffff,
+            WriteMostlyHistogram::GetBucketUpperBound(kBuckets - 1, kBits));
+}
+
+TEST(WriteMostlyHistogram, Precision) {
+  WriteMostlyHistogram fine, coarse(3);
+  for (int i = 1; i <= 10000; ++i) {
+    fine.Report(i);
+    coarse.Report(i);
+  }
+  fine.Rotate();
+  coarse.Rotate();
+
+  auto s = coarse.GetAll();
+  EXPECT_EQ(10000, s.count());
+  EXPECT_EQ(50005000, s.sum());
+  EXPECT_NEAR(5000, s.GetPercentile(0.5), 5000 / 8);
+  EXPECT_NEAR(9900, s.GetPercentile(0.99), 9900 / 8);
+
+  // Snapshots of different precisions can be merged.
+  s.Merge(fine.GetAll());
+  EXPECT_EQ(20000, s.count());
+  EXPECT_NEAR(5000, s.GetPercentile(0.5), 5000 / 8);
+  EXPECT_NEAR(10000, s.GetPercentile(1), 10000 / 32);
+}
+
+TEST(WriteMostlyHistogram, Basic) {
+  WriteMostlyHistogram h;
+  std::vector<std::thread> ts;
+  for (int i = 0; i != 10; ++i) {
+    ts.emplace_back([&, i] {
+      for (int j = 1; j <= 1000; ++j) {
+        h.Report(i * 1000 + j);
+      }
+    });
+  }
+  for (auto&& t : ts) {
+    t.join();
+  }
+  std::this_thread::sleep_for(1500ms);
+
+  for (auto&& s : {h.Get(1), h.Get(60), h.Get(3600), h.GetAll()}) {
+    EXPECT_EQ(10000, s.count());
+    EXPECT_EQ(50005000, s.sum());
+    EXPECT_NEAR(5000, s.GetPercentile(0.5), 5000 / 32);
+    EXPECT_NEAR(9900, s.GetPercentile(0.99), 9900 / 32);
+    EXPECT_NEAR(9990, s.GetPercentile(0.999), 9990 / 32);
+    EXPECT_NEAR(10000, s.GetPercentile(1), 10000 / 32);
+    EXPECT_EQ(1, s.GetPercentile(0));
+  }
+
+  std::this_thread::sleep_for(1s);
+  EXPECT_EQ(0, h.Get(1).count());
+  EXPECT_EQ(0, h.Get(1).GetPercentile(0.99));
+  EXPECT_EQ(10000, h.Get(60).count());
+}
+
+TEST(WriteMostlyHistogram, ManyInstances) {
+  // They share a single timer.
+  std::vector<std::unique_ptr<WriteMostlyHistogram>> hs;
+  for (int i = 0; i != 10000; ++i) {
+    hs.push_back(std::make_unique<WriteMostlyHistogram>());
+    hs.back()->Report(i);
+  }
+  std::this_thread::sleep_for(1500ms);
+  for (int i = 0; i != 10000; ++i) {
+    auto s = hs[i]->Get(60);
+    ASSERT_EQ(1, s.count());
+    ASSERT_EQ(i, s.sum());
+  }
+  // Destroying them while they're being rotated is safe.
+  hs.clear();
+}
+
+TEST(WriteMostlyHistogram, Rotation) {
+  WriteMostlyHistogram h;
+  // Well, we're racing with the timer here. This test should finish in far
+  // less than a second though.
+  for (int i = 0; i != 61; ++i) {
+    h.Report(i);
+    h.Rotate();
+  }
+  EXPECT_EQ(61, h.ticks_);
+  EXPECT_EQ(1, h.Get(1).count());
+  EXPECT_EQ(60, h.Get(1).GetPercentile(0.5));
+  EXPECT_EQ(60, h.Get(60).count());
+  EXPECT_EQ(1, h.Get(60).GetPercentile(0));
+  // 1 second + (rounded up) 1 minute.
+  EXPECT_EQ(61, h.Get(61).count());
+  EXPECT_EQ(61, h.Get(3600).count());
+  EXPECT_EQ(61, h.GetAll().count());
+  EXPECT_EQ(30, h.GetAll().GetPercentile(0.5));
+}
+
+}  // namespace flare
+
+FLARE_TEST_MAIN
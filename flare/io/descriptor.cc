@@ -47,6 +47,21 @@ ExposedMetrics<std::uint64_t, flare::detail::TscToDuration<std::uint64_t>>
     error_event_fire_to_completion_latency(
         "flare/io/latency/event_fire_to_completion/error");
 
+namespace {
+
+// Either starts a fiber to run `start_proc` or defers it to the caller, as
+// requested by `batch`.
+void StartEventHandler(std::vector<Function<void()>>* batch,
+                       Function<void()>&& start_proc) {
+  if (batch) {
+    batch->push_back(std::move(start_proc));
+  } else {
+    fiber::internal::StartFiberDetached(std::move(start_proc));
+  }
+}
+
+}  // namespace
+
 struct Descriptor::SeldomlyUsed {
   std::string name;
 
@@ -146,26 +161,28 @@ const std::string& Descriptor::GetName() const {
   return read_mostly_.seldomly_used->name;
 }
 
-void Descriptor::FireEvents(int mask, std::uint64_t polled_at) {
+void Descriptor::FireEvents(int mask, std::uint64_t polled_at,
+                            std::vector<Function<void()>>* batch) {
   if (FLARE_UNLIKELY(mask & kPollerError)) {
     // `kPollerError` is handled first. In this case other events are ignored.
     // You don't want to read from / write to a file descriptor in error state.
     //
     // @sa: https://stackoverflow.com/a/37079607
-    FireErrorEvent(polled_at);
+    FireErrorEvent(polled_at, batch);
     return;
   }
   if (mask & kPollerRead) {
     // TODO(luobogao): For the moment `EPOLLRDHUP` is not enabled in
     // `EventLoop`.
-    FireReadEvent(polled_at);
+    FireReadEvent(polled_at, batch);
   }
   if (mask & kPollerWrite) {
-    FireWriteEvent(polled_at);
+    FireWriteEvent(polled_at, batch);
   }
 }
 
-void Descriptor::FireReadEvent(std::uint64_t fired_at) {
+void Descriptor::FireReadEvent(std::uint64_t fired_at,
+                               std::vector<Function<void()>>* batch) {
   ScopedDeferred _([&] {
     read_event_fire_to_completion_latency->Report(
         TscElapsed(fired_at, ReadTsc()));
@@ -177,7 +194,7 @@ void Descriptor::FireReadEvent(std::uint64_t fired_at) {
   if (read_events_.fetch_add(1, std::memory_order_acquire) == 0) {
     // `read_events_` was 0, so no fiber was calling `OnReadable`. Let's call
     // it then.
-    fiber::internal::StartFiberDetached([this] {
+    StartEventHandler(batch, [this, fired_at] {
       // The reference we keep here keeps us alive until we leave.
       //
       // The reason why we can be destroyed while executing is that if someone
@@ -192,6 +209,7 @@ void Descriptor::FireReadEvent(std::uint64_t fired_at) {
       // fibers like us, the overhead is the same (in both case it's a atomic
       // increment).
       RefPtr self_ref(ref_ptr, this);
+      GetEventLoop()->ReportHandlerStartDelay(fired_at);
 
       do {
         auto rc = OnReadable();
@@ -232,15 +250,17 @@ void Descriptor::FireReadEvent(std::uint64_t fired_at) {
   }  // Otherwise someone else is calling `OnReadable`. Nothing to do then.
 }
 
-void Descriptor::FireWriteEvent(std::uint64_t fired_at) {
+void Descriptor::FireWriteEvent(std::uint64_t fired_at,
+                                std::vector<Function<void()>>* batch) {
   ScopedDeferred _([&] {
     write_event_fire_to_completion_latency->Report(
         TscElapsed(fired_at, ReadTsc()));
   });
 
   if (write_events_.fetch_add(1, std::memory_order_acquire) == 0) {
-    fiber::internal::StartFiberDetached([this] {
+    StartEventHandler(batch, [this, fired_at] {
       RefPtr self_ref(ref_ptr, this);  // @sa: `FireReadEvent()`.
+      GetEventLoop()->ReportHandlerStartDelay(fired_at);
       do {
         auto rc = OnWritable();
         if (FLARE_LIKELY(rc == EventAction::Ready)) {
@@ -266,7 +286,8 @@ void Descriptor::FireWriteEvent(std::uint64_t fired_at) {
   }
 }
 
-void Descriptor::FireErrorEvent(std::uint64_t fired_at) {
+void Descriptor::FireErrorEvent(std::uint64_t fired_at,
+                                std::vector<Function<void()>>* batch) {
   ScopedDeferred _([&] {
     error_event_fire_to_completion_latency->Report(
         TscElapsed(fired_at, ReadTsc()));
@@ -280,7 +301,7 @@ void Descriptor::FireErrorEvent(std::uint64_t fired_at) {
 
   if (read_mostly_.seldomly_used->error_events.fetch_add(
           1, std::memory_order_acquire) == 0) {
-    fiber::internal::StartFiberDetached([this] {
+    StartEventHandler(batch, [this] {
       RefPtr self_ref(ref_ptr, this);  // @sa: `FireReadEvent()`.
       OnError(io::util::GetSocketError(fd()));
       FLARE_CHECK_EQ(read_mostly_.seldomly_used->error_events.fetch_sub(
@@ -18,9 +18,11 @@
 #include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "flare/base/align.h"
 #include "flare/base/enum.h"
+#include "flare/base/function.h"
 #include "flare/base/handle.h"
 #include "flare/base/internal/test_prod.h"
 #include "flare/base/ref_ptr.h"
@@ -138,10 +140,18 @@ class alignas(hardware_destructive_interference_size) Descriptor
   bool Enabled() const { return read_mostly_.enabled; }
 
   // Start one or more fibers to run events in `mask`.
-  void FireEvents(int mask, std::uint64_t polled_at);
-  void FireReadEvent(std::uint64_t fired_at);
-  void FireWriteEvent(std::uint64_t fired_at);
-  void FireErrorEvent(std::uint64_t fired_at);
+  //
+  // If `batch` is given, instead of starting fibers immediately, their start
+  // procedures are appended to it. The caller is responsible for starting them
+  // (in batch) afterwards.
+  void FireEvents(int mask, std::uint64_t polled_at,
+                  std::vector<Function<void()>>* batch = nullptr);
+  void FireReadEvent(std::uint64_t fired_at,
+                     std::vector<Function<void()>>* batch);
+  void FireWriteEvent(std::uint64_t fired_at,
+                      std::vector<Function<void()>>* batch);
+  void FireErrorEvent(std::uint64_t fired_at,
+                      std::vector<Function<void()>>* batch);
 
   void SuppressReadAndClearReadEventCount();
   void SuppressWriteAndClearWriteEventCount();
@@ -41,9 +41,9 @@ namespace {
 // Note that, though, if the packets are large, and there are not so many
 // connections, using more `iovec`s per `readv` actually boost performance.
 //
-// TODO(luobogao): Once variable-sized buffer blocks are implemented, we may
-// want to use larger blocks on read, to improve performance in face of large
-// packets.
+// Once variable-sized buffer blocks are used (@sa: `ReadSizeHint`), more
+// `iovec`s are used only for large blocks, which are only used for connections
+// carrying large packets.
 //
 // The same applies to `writev` (@sa: `writing_buffer_list.cc`). However, when
 // we're writing something, we know exactly how many bytes will be written, and
@@ -51,19 +51,77 @@ namespace {
 // allocation should be not-so-great.
 constexpr auto kMaxBlocksPerRead = 8;
 
+static_assert(kMaxBlocksPerRead <= kMaxBlocksPerReadHint);
+
+// Number of size classes in `NativeBufferBlockSize`.
+constexpr auto kBlockSizeClasses = 4;
+
+// If the last block used by a read has at least so many bytes left, it's kept
+// in the cache, and the next read continues from where this one stopped.
+constexpr auto kMinReusableTail = 4096;
+
+// A buffer block in thread-local cache. Bytes before `offset` have been handed
+// out by a previous read.
+struct CachedBlock {
+  RefPtr<NativeBufferBlock> block;
+  std::size_t offset = 0;
+};
+
+using BlockCache = std::vector<CachedBlock>;
+
+// Appends blocks to `cache` until it has `blocks` entries. Blocks are used from
+// back to front, so the one at back (which might have been partly used) is kept
+// there.
+template <class F>
+void RefillBlocks(std::size_t blocks, F&& make_block, BlockCache* cache) {
+  auto size = cache->size();
+  while (cache->size() < blocks) {
+    cache->push_back({make_block()});
+  }
+  if (size && size != cache->size()) {
+    std::swap((*cache)[size - 1], cache->back());
+  }
+}
+
 // Refill thread-local cache of buffer blocks (if there are less than
 // `kMaxBlocksPerRead` entries.) and returns a pointer to it.
-std::vector<RefPtr<NativeBufferBlock>>* RefillAndGetBlocks() {
-  FLARE_INTERNAL_TLS_MODEL thread_local std::vector<RefPtr<NativeBufferBlock>>
-      cache;
-  while (cache.size() < kMaxBlocksPerRead) {
-    cache.push_back(MakeNativeBufferBlock());
-  }
+BlockCache* RefillAndGetBlocks() {
+  FLARE_INTERNAL_TLS_MODEL thread_local BlockCache cache;
+  RefillBlocks(
+      kMaxBlocksPerRead, [] { return MakeNativeBufferBlock(); }, &cache);
   return &cache;
 }
 
-// Due to technical limitations, we can only read up to `kMaxBlocksPerRead`
-// blocks per call.
+// Same as above, except that blocks of the given size class are returned, and
+// there are at least `blocks` entries in the cache.
+BlockCache* RefillAndGetBlocks(NativeBufferBlockSize size,
+                               std::size_t blocks) {
+  FLARE_INTERNAL_TLS_MODEL thread_local BlockCache caches[kBlockSizeClasses];
+  FLARE_CHECK_LT(static_cast<std::size_t>(size), std::size(caches));
+  auto&& cache = caches[static_cast<std::size_t>(size)];
+  RefillBlocks(
+      blocks, [&] { return MakeNativeBufferBlock(size); }, &cache);
+  return &cache;
+}
+
+// Blocks of large size classes are not kept in thread-local cache for long,
+// otherwise each I/O thread pins 8 x 1M or 16 x 64K blocks for its lifetime.
+// Except for the next one to use, they're returned to the object pool (which
+// frees them once they've been idle for a while).
+void TrimBlocks(NativeBufferBlockSize size) {
+  if (size != NativeBufferBlockSize::k64K &&
+      size != NativeBufferBlockSize::k1M) {
+    return;
+  }
+  auto&& cache = *RefillAndGetBlocks(size, 0);
+  if (cache.size() > 1) {
+    // Blocks are used from back to front.
+    cache.erase(cache.begin(), cache.end() - 1);
+  }
+}
+
+// Due to technical limitations, we can only read up to `max_blocks` blocks per
+// call.
 //
 // `short_read` helps detecting for draining system buffer. This eliminates an
 // unnecessary `readv`.
@@ -78,22 +136,24 @@ std::vector<RefPtr<NativeBufferBlock>>* RefillAndGetBlocks() {
 // > exhausted the read I/O space for the file descriptor.  The same is true
 // > when writing using write(2).
 ssize_t ReadAtMostPartial(std::size_t max_bytes, AbstractStreamIo* io,
+                          BlockCache* block_cache, std::size_t max_blocks,
                           NoncontiguousBuffer* to, bool* short_read) {
-  auto&& block_cache = RefillAndGetBlocks();
-  iovec iov[kMaxBlocksPerRead];
-  FLARE_CHECK_EQ(block_cache->size(), std::size(iov));
+  iovec iov[kMaxBlocksPerReadHint];
+  auto cached = block_cache->size();
+  auto blocks = std::min(max_blocks, cached);
+  FLARE_CHECK_LE(blocks, std::size(iov));
 
   std::size_t iov_elements = 0;
   std::size_t bytes_to_read = 0;
-  while (bytes_to_read != max_bytes && iov_elements != kMaxBlocksPerRead) {
+  while (bytes_to_read != max_bytes && iov_elements != blocks) {
     auto&& iove = iov[iov_elements];
     // Use blocks from back to front. This helps when we removes used blocks
     // from the cache (popping from back of a vector is cheaper.).
-    auto&& block = (*block_cache)[kMaxBlocksPerRead - 1 - iov_elements];
-    auto len =
-        std::min(block->size(), max_bytes - bytes_to_read /* Bytes left */);
+    auto&& [block, offset] = (*block_cache)[cached - 1 - iov_elements];
+    auto len = std::min(block->size() - offset,
+                        max_bytes - bytes_to_read /* Bytes left */);
 
-    iove.iov_base = block->mutable_data();
+    iove.iov_base = block->mutable_data() + offset;
     iove.iov_len = len;
     bytes_to_read += len;
     ++iov_elements;
@@ -110,29 +170,36 @@ ssize_t ReadAtMostPartial(std::size_t max_bytes, AbstractStreamIo* io,
 
   // Remove used blocks from the cache and move them into `to`.
   while (bytes_left) {
-    auto current = std::move(block_cache->back());
-    auto len = std::min(bytes_left, current->size());
-    to->Append(PolymorphicBuffer(std::move(current), 0, len));
+    auto&& [block, offset] = block_cache->back();
+    auto len = std::min(bytes_left, block->size() - offset);
     bytes_left -= len;
-
-    // FIXME: Even if the last block is not fully occupied, we still remove it
-    // from the cache. This hurt memory utilization.
+    if (!bytes_left && block->size() - offset - len >= kMinReusableTail) {
+      // Only partly used. The rest of it is left for the next read. This
+      // matters for large blocks, a short read into a 1M block would otherwise
+      // waste most of it.
+      to->Append(PolymorphicBuffer(block, offset, len));
+      offset += len;
+      break;
+    }
+    to->Append(PolymorphicBuffer(std::move(block), offset, len));
     block_cache->pop_back();
   }
   return result;
 }
 
-}  // namespace
-
-ReadStatus ReadAtMost(std::size_t max_bytes, AbstractStreamIo* io,
-                      NoncontiguousBuffer* to, std::size_t* bytes_read) {
+// `get_blocks` is called before each `readv` to get a (refilled) block cache.
+template <class F>
+ReadStatus ReadAtMostImpl(std::size_t max_bytes, F&& get_blocks,
+                          std::size_t max_blocks, AbstractStreamIo* io,
+                          NoncontiguousBuffer* to, std::size_t* bytes_read) {
   auto bytes_left = max_bytes;
   *bytes_read = 0;
   while (bytes_left) {
     // Read from the socket.
     bool short_read = false;  // GCC 10 reports a spurious uninitialized-var.
     auto bytes_to_read = bytes_left;
-    auto read = ReadAtMostPartial(bytes_to_read, io, to, &short_read);
+    auto read = ReadAtMostPartial(bytes_to_read, io, get_blocks(), max_blocks,
+                                  to, &short_read);
     if (FLARE_UNLIKELY(read == 0)) {  // The remote side closed the connection.
       return ReadStatus::PeerClosing;
     }
@@ -159,4 +226,53 @@ ReadStatus ReadAtMost(std::size_t max_bytes, AbstractStreamIo* io,
   return ReadStatus::MaxBytesRead;
 }
 
+}  // namespace
+
+ReadStatus ReadAtMost(std::size_t max_bytes, AbstractStreamIo* io,
+                      NoncontiguousBuffer* to, std::size_t* bytes_read) {
+  return ReadAtMostImpl(
+      max_bytes, [] { return RefillAndGetBlocks(); }, kMaxBlocksPerRead, io,
+      to, bytes_read);
+}
+
+ReadStatus ReadAtMost(std::size_t max_bytes, const ReadSizeHint& hint,
+                      AbstractStreamIo* io, NoncontiguousBuffer* to,
+                      std::size_t* bytes_read) {
+  FLARE_CHECK(hint.blocks_per_read > 0 &&
+              hint.blocks_per_read <= kMaxBlocksPerReadHint);
+  auto status = ReadAtMostImpl(
+      max_bytes,
+      [&] { return RefillAndGetBlocks(hint.block_size, hint.blocks_per_read); },
+      hint.blocks_per_read, io, to, bytes_read);
+  TrimBlocks(hint.block_size);
+  return status;
+}
+
+void ReadSizeAdvisor::Report(std::size_t bytes_read) noexcept {
+  // alpha = 1/8. Not using floating point arithmetic here, precision is not a
+  // concern.
+  average_ = average_ - average_ / 8 + bytes_read / 8;
+}
+
+ReadSizeHint ReadSizeAdvisor::GetHint() const noexcept {
+  // Small packets, likely RPCs with tiny payload (or heartbeats). Use small
+  // blocks and few `iovec`s to keep memory footprint small.
+  if (average_ < 1024) {
+    return {NativeBufferBlockSize::k1K, kMaxBlocksPerRead};
+  }
+  if (average_ < 32768) {
+    return {NativeBufferBlockSize::k4K, kMaxBlocksPerRead};
+  }
+  // Bulk transfers. The more bytes we can read with a single `readv`, the less
+  // syscalls are made.
+  //
+  // Blocks of these size classes are allocated for each read and, except for
+  // one, returned to the object pool afterwards (@sa: `TrimBlocks`), so idle
+  // connections / threads do not pin up to 16 x 64K or 8 x 1M blocks each.
+  if (average_ < 1048576) {
+    return {NativeBufferBlockSize::k64K, kMaxBlocksPerReadHint};
+  }
+  return {NativeBufferBlockSize::k1M, kMaxBlocksPerRead};
+}
+
 }  // namespace flare::io::detail
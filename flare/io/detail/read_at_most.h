@@ -15,7 +15,10 @@
 #ifndef FLARE_IO_DETAIL_READ_AT_MOST_H_
 #define FLARE_IO_DETAIL_READ_AT_MOST_H_
 
+#include <cstddef>
+
 #include "flare/base/buffer.h"
+#include "flare/base/buffer/builtin_buffer_block.h"
 #include "flare/io/util/stream_io.h"
 
 namespace flare::io::detail {
@@ -44,6 +47,50 @@ enum class ReadStatus {
 ReadStatus ReadAtMost(std::size_t max_bytes, AbstractStreamIo* io,
                       NoncontiguousBuffer* to, std::size_t* bytes_read);
 
+// Describes how buffers should be allocated for a read.
+struct ReadSizeHint {
+  // Size class of buffer blocks to read into.
+  NativeBufferBlockSize block_size;
+
+  // Number of buffer blocks (i.e., `iovec`s) to use for a single `readv`. Must
+  // be in range [1, `kMaxBlocksPerReadHint`].
+  std::size_t blocks_per_read;
+};
+
+inline constexpr std::size_t kMaxBlocksPerReadHint = 16;
+
+// Same as above, except that buffer blocks are allocated as `hint` suggests
+// rather than using the default buffer block (whose size is determined by
+// `flare_buffer_block_size`).
+ReadStatus ReadAtMost(std::size_t max_bytes, const ReadSizeHint& hint,
+                      AbstractStreamIo* io, NoncontiguousBuffer* to,
+                      std::size_t* bytes_read);
+
+// Tracks an exponentially-weighted moving average of bytes read from a
+// connection on each readiness event, and suggests buffer blocks for reading
+// from it subsequently.
+//
+// Connections carrying small messages are served with small blocks (so as not
+// to waste memory), while those carrying bulk transfers are served with large
+// blocks and more `iovec`s (so as to reduce number of syscalls.)
+//
+// Not thread-safe. This is not a problem as reads from a given connection are
+// always serialized.
+class ReadSizeAdvisor {
+ public:
+  // Report number of bytes read on a readiness event.
+  void Report(std::size_t bytes_read) noexcept;
+
+  // Get suggestion for the next read.
+  ReadSizeHint GetHint() const noexcept;
+
+  // For testing purpose.
+  std::size_t GetAverage() const noexcept { return average_; }
+
+ private:
+  std::size_t average_ = 0;
+};
+
 }  // namespace flare::io::detail
 
 #endif  // FLARE_IO_DETAIL_READ_AT_MOST_H_
@@ -98,6 +98,54 @@ TEST_F(ReadAtMostTest, PeerClosing) {
   EXPECT_EQ("1234567", FlattenSlow(buffer_));
 }
 
+TEST_F(ReadAtMostTest, WithHint) {
+  for (auto size :
+       {NativeBufferBlockSize::k1K, NativeBufferBlockSize::k4K,
+        NativeBufferBlockSize::k64K, NativeBufferBlockSize::k1M}) {
+    NoncontiguousBuffer buffer;
+    ASSERT_EQ(ReadStatus::Drained, ReadAtMost(8, ReadSizeHint{size, 1},
+                                              io_.get(), &buffer, &bytes_read_));
+    EXPECT_EQ("1234567", FlattenSlow(buffer));
+    EXPECT_EQ(7, bytes_read_);
+    PCHECK(write(fd_[1], "1234567", 7) == 7);
+  }
+}
+
+TEST_F(ReadAtMostTest, ShortReadsShareBlock) {
+  NoncontiguousBuffer first, second;
+  ReadSizeHint hint = {NativeBufferBlockSize::k1M, 8};
+  ASSERT_EQ(ReadStatus::Drained,
+            ReadAtMost(8, hint, io_.get(), &first, &bytes_read_));
+  PCHECK(write(fd_[1], "abcdefg", 7) == 7);
+  ASSERT_EQ(ReadStatus::Drained,
+            ReadAtMost(8, hint, io_.get(), &second, &bytes_read_));
+
+  // The second read continues from where the first one stopped, instead of
+  // wasting (almost) an entire block.
+  EXPECT_EQ(first.FirstContiguous().data() + 7,
+            second.FirstContiguous().data());
+  EXPECT_EQ("1234567", FlattenSlow(first));
+  EXPECT_EQ("abcdefg", FlattenSlow(second));
+}
+
+TEST(ReadSizeAdvisor, All) {
+  ReadSizeAdvisor advisor;
+  EXPECT_EQ(NativeBufferBlockSize::k1K, advisor.GetHint().block_size);
+  for (int i = 0; i != 100; ++i) {
+    advisor.Report(4 * 1048576);
+  }
+  EXPECT_EQ(NativeBufferBlockSize::k1M, advisor.GetHint().block_size);
+  for (int i = 0; i != 100; ++i) {
+    advisor.Report(65536);
+  }
+  EXPECT_EQ(NativeBufferBlockSize::k64K, advisor.GetHint().block_size);
+  EXPECT_EQ(kMaxBlocksPerReadHint, advisor.GetHint().blocks_per_read);
+  for (int i = 0; i != 100; ++i) {
+    advisor.Report(64);
+  }
+  EXPECT_EQ(NativeBufferBlockSize::k1K, advisor.GetHint().block_size);
+}
+
 TEST(ReadAtMost, LargeChunk) {
   // @sa: https://man7.org/linux/man-pages/man2/fcntl.2.html
   //
@@ -137,9 +185,13 @@ TEST(ReadAtMost, LargeChunk) {
     if (Random() % 2 == 0) {
       ASSERT_EQ(ReadStatus::Drained,
                 ReadAtMost(i + 1, io.get(), &buffer, &bytes_read));
-    } else {
+    } else if (Random() % 2 == 0) {
       ASSERT_EQ(ReadStatus::MaxBytesRead,
                 ReadAtMost(i, io.get(), &buffer, &bytes_read));
+    } else {
+      ReadSizeHint hint = {NativeBufferBlockSize::k64K, kMaxBlocksPerReadHint};
+      ASSERT_EQ(ReadStatus::MaxBytesRead,
+                ReadAtMost(i, hint, io.get(), &buffer, &bytes_read));
     }
     EXPECT_EQ(i, bytes_read);
     // Not using `EXPECT_EQ` as diagnostics on error is potentially large, so we
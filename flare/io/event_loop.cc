@@ -14,6 +14,8 @@
 
 #include "flare/io/event_loop.h"
 
+#include <sys/socket.h>
+
 #include <memory>
 #include <utility>
 #include <vector>
@@ -23,6 +25,7 @@
 #include "flare/base/exposed_var.h"
 #include "flare/base/logging.h"
 #include "flare/base/random.h"
+#include "flare/base/string.h"
 #include "flare/fiber/fiber.h"
 #include "flare/fiber/fiber_local.h"
 #include "flare/fiber/latch.h"
@@ -43,6 +46,25 @@ DEFINE_bool(flare_enable_watchdog, true,
 DEFINE_int32(flare_event_loop_per_scheduling_group, 1,
              "Number of event loops per scheduling group. Normally the default "
              "setting is sufficient.");
+DEFINE_bool(flare_event_loop_batch_dispatch, false,
+            "If set, event loops start fibers for running event handlers in "
+            "batch (once per poll), instead of starting them one by one. This "
+            "reduces overhead of waking up workers when there are plenty of "
+            "events per poll.");
+DEFINE_int32(
+    flare_event_loop_busy_poll_budget_us, 0,
+    "If non-zero, once an event loop sees an event, it keeps polling (without "
+    "blocking) for new events for up to this many microseconds before falling "
+    "back to blocking wait. This trades CPU for lower wake-up latency. It "
+    "applies to all event loops (in all scheduling groups), and effectively "
+    "occupies a core for each event loop while there's traffic. Combine it "
+    "with `flare_event_loop_per_scheduling_group` (and the number of "
+    "scheduling groups) to control how many cores are burnt.");
+DEFINE_int32(flare_event_loop_busy_poll_socket_us, 0,
+             "If non-zero and busy-polling is enabled, `SO_BUSY_POLL` is set to "
+             "this value on each socket attached to event loops, so that the "
+             "kernel busy polls the device queue on read. Increasing this "
+             "value above `net.core.busy_read` requires `CAP_NET_ADMIN`.");
 
 namespace flare {
 
@@ -71,6 +93,17 @@ ExposedMetrics<std::uint64_t, flare::detail::TscToDuration<std::uint64_t>>
     run_user_tasks_latency("flare/io/latency/run_user_tasks");
 ExposedMetrics<std::uint64_t> events_per_poll("flare/io/events_per_poll");
 ExposedCounter<std::uint64_t> user_tasks_run("flare/io/user_tasks_run");
+ExposedCounter<std::uint64_t> batched_handlers(
+    "flare/io/batched_event_handlers");
+ExposedCounter<std::uint64_t> busy_polls("flare/io/busy_poll/polls");
+ExposedCounter<std::uint64_t> empty_busy_polls(
+    "flare/io/busy_poll/empty_polls");
+// CPU time spent in busy-polling. A single poll usually takes less than a
+// microsecond, so it's accumulated in nanoseconds and exposed in microseconds.
+WriteMostlyCounter<std::uint64_t> busy_poll_time_ns;
+ExposedVarDynamic<std::uint64_t> busy_poll_time_us(
+    "flare/io/busy_poll/time_us",
+    [] { return busy_poll_time_ns.Read() / 1000; });
 
 // Shamelessly copied from https://stackoverflow.com/a/57556517
 std::uint32_t HashFd(int fd) {
@@ -80,9 +113,27 @@ std::uint32_t HashFd(int fd) {
   return c * xorshift(p * xorshift(fd, 32), 32);
 }
 
+std::atomic<std::size_t> next_event_loop_id{};
+
 }  // namespace
 
-EventLoop::EventLoop() {
+struct EventLoop::Metrics {
+  explicit Metrics(std::size_t id)
+      : events_per_poll(Format("flare/io/event_loop/{}/events_per_poll", id)),
+        handler_start_delay(
+            Format("flare/io/event_loop/{}/latency/handler_start", id)) {}
+
+  ExposedMetrics<std::uint64_t> events_per_poll;
+
+  // Delay between an event is returned by the poller and its handler starts
+  // running.
+  ExposedMetrics<std::uint64_t, flare::detail::TscToDuration<std::uint64_t>>
+      handler_start_delay;
+};
+
+EventLoop::EventLoop()
+    : metrics_(std::make_unique<Metrics>(next_event_loop_id.fetch_add(
+          1, std::memory_order_relaxed))) {
   poller_ = io::detail::CreatePoller();
 
   // `EventLoopNotifier` is different in that its `OnReadable` must be called
@@ -104,6 +155,16 @@ void EventLoop::AttachDescriptor(Descriptor* desc, bool enabled) {
   desc->SetEventMask(desc->GetEventMask() | kPollerErrorMask |
                      kExtraPollerFlags);
 
+#ifdef SO_BUSY_POLL
+  if (FLAGS_flare_event_loop_busy_poll_budget_us &&
+      FLAGS_flare_event_loop_busy_poll_socket_us) {
+    int value = FLAGS_flare_event_loop_busy_poll_socket_us;
+    // Failure is ignored, `desc` is not necessarily a socket.
+    (void)setsockopt(desc->fd(), SOL_SOCKET, SO_BUSY_POLL, &value,
+                     sizeof(value));
+  }
+#endif
+
   // We must call `SetEventLoop()` **before** adding the descriptor into the
   // event loop. Otherwise the descriptor may get a `nullptr` from
   // `GetEventLoop()` in its `OnXxx` callback.
@@ -174,7 +235,22 @@ void EventLoop::Run() {
     // Could be woke up if `notifier_` fires, or new event on fds appears.
     //
     // Only returns once all events (including those deferred) are handled.
-    WaitAndRunEvents(5ms);
+    //
+    // If busy-polling is enabled and we've seen events recently, this won't
+    // block.
+    auto start_tsc = ReadTsc();
+    auto wait_for = GetWaitTimeout(start_tsc);
+    auto events = WaitAndRunEvents(wait_for);
+    if (FLARE_UNLIKELY(wait_for == 0ms)) {
+      busy_polls->Increment();
+      if (!events) {
+        empty_busy_polls->Increment();
+      }
+      busy_poll_time_ns.Add(DurationFromTsc(start_tsc, ReadTsc()) / 1ns);
+    }
+    if (events) {
+      last_event_tsc_ = ReadTsc();
+    }
 
     // Use's callbacks should be run after `Descriptor`'s callbacks are run.
     // @sa: Comments on `AddTask`.
@@ -214,7 +290,7 @@ void EventLoop::Join() {
 
 EventLoop* EventLoop::Current() { return *current_event_loop; }
 
-void EventLoop::WaitAndRunEvents(std::chrono::milliseconds wait_for) {
+std::size_t EventLoop::WaitAndRunEvents(std::chrono::milliseconds wait_for) {
   constexpr auto kDescriptorsPerLoop = 128;
   io::detail::PollerEvent evs[kDescriptorsPerLoop];
   auto nfds = poller_->Wait(evs, std::size(evs), wait_for / 1ms);
@@ -223,6 +299,24 @@ void EventLoop::WaitAndRunEvents(std::chrono::milliseconds wait_for) {
   // Run event handlers.
   io::detail::TimedCall([&] { RunEventHandlers(evs, evs + nfds); }, 5ms,
                         "RunEventHandlers()");
+  return nfds;
+}
+
+std::chrono::milliseconds EventLoop::GetWaitTimeout(
+    std::uint64_t now_tsc) const {
+  if (FLARE_LIKELY(!FLAGS_flare_event_loop_busy_poll_budget_us)) {
+    return 5ms;
+  }
+  // Keep spinning so long as the last event was seen recently enough.
+  if (DurationFromTsc(last_event_tsc_, now_tsc) <
+      FLAGS_flare_event_loop_busy_poll_budget_us * 1us) {
+    return 0ms;
+  }
+  return 5ms;
+}
+
+void EventLoop::ReportHandlerStartDelay(std::uint64_t polled_at) {
+  metrics_->handler_start_delay->Report(TscElapsed(polled_at, ReadTsc()));
 }
 
 void EventLoop::RunUserTasks() {
@@ -253,6 +347,15 @@ void EventLoop::RunEventHandlers(io::detail::PollerEvent* begin,
     run_event_handlers_latency->Report(TscElapsed(start_tsc, ReadTsc()));
   });
   events_per_poll->Report(end - begin);
+  metrics_->events_per_poll->Report(end - begin);
+
+  // If batch dispatch is enabled, handlers are collected here and started all
+  // at once after all events are processed.
+  std::vector<Function<void()>>* batch = nullptr;
+  if (FLAGS_flare_event_loop_batch_dispatch) {
+    batch = &pending_handlers_;
+    batch->clear();
+  }
 
   while (begin != end) {
     // FIXME: This `if` is ugly.
@@ -266,9 +369,14 @@ void EventLoop::RunEventHandlers(io::detail::PollerEvent* begin,
 
     auto desc = reinterpret_cast<Descriptor*>(begin->user_data);
     FLARE_CHECK(desc);
-    desc->FireEvents(begin->events, start_tsc);
+    desc->FireEvents(begin->events, start_tsc, batch);
     ++begin;
   }
+
+  if (batch && !batch->empty()) {
+    batched_handlers->Add(batch->size());
+    fiber::internal::BatchStartFiberDetached(std::move(*batch));
+  }
 }
 
 void StartAllEventLoops() {
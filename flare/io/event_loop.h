@@ -20,6 +20,7 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "flare/base/function.h"
 #include "flare/base/handle.h"
@@ -107,13 +108,36 @@ class EventLoop {
   static EventLoop* Current();
 
  private:
-  void WaitAndRunEvents(std::chrono::milliseconds wait_for);
+  friend class Descriptor;
+  struct Metrics;
+
+  // Called by `Descriptor` once its event handler (`OnReadable`, etc.) starts
+  // running.
+  void ReportHandlerStartDelay(std::uint64_t polled_at);
+
+  // Returns number of events fired (including wake-ups of the notifier).
+  std::size_t WaitAndRunEvents(std::chrono::milliseconds wait_for);
+
+  // Determines how long we should block in the poller, taking busy-polling
+  // (if enabled) into consideration.
+  std::chrono::milliseconds GetWaitTimeout(std::uint64_t now_tsc) const;
   void RunUserTasks();
   void RunEventHandlers(io::detail::PollerEvent* begin,
                         io::detail::PollerEvent* end);
 
  private:
   std::atomic<bool> exiting_{false};
+
+  // TSC of the last time we saw any event. Used for busy-polling.
+  std::uint64_t last_event_tsc_{0};
+
+  // Per-event-loop statistics.
+  std::unique_ptr<Metrics> metrics_;
+
+  // Used only if `flare_event_loop_batch_dispatch` is set. Start procedures of
+  // event handlers (collected by `RunEventHandlers`) are moved here and then
+  // started in batch.
+  std::vector<Function<void()>> pending_handlers_;
   std::unique_ptr<io::detail::Poller> poller_;
 
   // `notifier_` is used for waking the worker. (e.g. in the case there's a new
@@ -20,6 +20,8 @@
 #include <utility>
 #include <vector>
 
+#include "gflags/gflags.h"
+
 #include "flare/base/exposed_var.h"
 #include "flare/base/likely.h"
 #include "flare/base/logging.h"
@@ -29,6 +31,22 @@
 #include "flare/io/detail/read_at_most.h"
 #include "flare/io/util/socket.h"
 
+DEFINE_bool(flare_io_adaptive_read_buffer, false,
+            "If set, each connection tracks how many bytes it typically "
+            "receives on each read, and chooses buffer block size (from "
+            "1K/4K/64K/1M) and number of blocks to read into accordingly. "
+            "This reduces memory footprint of connections carrying small "
+            "messages and number of syscalls for bulk transfers. Otherwise "
+            "`flare_buffer_block_size` is always used.");
+
+DEFINE_int32(
+    flare_io_read_budget_per_event, 0,
+    "If non-zero, at most this many bytes are read from a connection each time "
+    "it's found readable. If there's still data to read once the budget is "
+    "exhausted, the connection is re-queued to its event loop, giving other "
+    "connections a chance to be served first. This prevents a few bulk "
+    "connections from monopolizing workers. Zero means no limit.");
+
 using namespace std::literals;
 
 namespace flare {
@@ -48,6 +66,10 @@ ExposedMetrics<std::uint64_t, flare::detail::TscToDuration<std::uint64_t>>
 ExposedCounter<std::uint64_t> immediate_writeouts(
     "flare/io/immediate_writeouts");
 ExposedCounter<std::uint64_t> deferred_writeouts("flare/io/deferred_writeouts");
+ExposedCounter<std::uint64_t> read_budget_exhausted(
+    "flare/io/read_budget_exhausted");
+ExposedCounter<std::uint64_t> rx_throttled("flare/io/rate_limiter/rx_throttled");
+ExposedCounter<std::uint64_t> tx_throttled("flare/io/rate_limiter/tx_throttled");
 
 using HandshakingStatus = AbstractStreamIo::HandshakingStatus;
 
@@ -92,6 +114,9 @@ bool NativeStreamConnection::Write(NoncontiguousBuffer buffer,
     writeout_latency->Report(TscElapsed(start, ReadTsc()));
   });
 
+  // Must be increased before appending the buffer, otherwise the counter could
+  // go negative once the buffer is flushed (by someone else).
+  pending_write_bytes_.fetch_add(buffer.ByteSize(), std::memory_order_relaxed);
   if (FLARE_LIKELY(writing_buffers_.Append(std::move(buffer), ctx))) {
     if (FLARE_UNLIKELY(
             !handshaking_state_.done.load(std::memory_order_acquire))) {
@@ -193,6 +218,13 @@ Descriptor::EventAction NativeStreamConnection::OnReadable() {
 
   std::size_t bytes_left = options_.read_rate_limiter->GetQuota();
   bool rate_limited = bytes_left != std::numeric_limits<std::size_t>::max();
+  bool budget_limited = false;
+  if (FLAGS_flare_io_read_budget_per_event > 0 &&
+      bytes_left > FLAGS_flare_io_read_budget_per_event) {
+    bytes_left = FLAGS_flare_io_read_budget_per_event;
+    budget_limited = true;
+  }
+  bool adaptive_read = FLAGS_flare_io_adaptive_read_buffer;
 
   // We might use `readv` if excessive `read` turns out to be a performance
   // bottleneck.
@@ -200,8 +232,18 @@ Descriptor::EventAction NativeStreamConnection::OnReadable() {
     auto bytes_to_read = std::min(
         bytes_left, options_.read_buffer_size - read_buffer_.ByteSize());
     std::size_t bytes_read;
-    auto status = io::detail::ReadAtMost(
-        bytes_to_read, options_.stream_io.Get(), &read_buffer_, &bytes_read);
+    io::detail::ReadStatus status;
+    if (adaptive_read) {
+      status = io::detail::ReadAtMost(
+          bytes_to_read, read_size_advisor_.GetHint(),
+          options_.stream_io.Get(), &read_buffer_, &bytes_read);
+      if (bytes_read) {
+        read_size_advisor_.Report(bytes_read);
+      }
+    } else {
+      status = io::detail::ReadAtMost(bytes_to_read, options_.stream_io.Get(),
+                                      &read_buffer_, &bytes_read);
+    }
 
     bytes_left -= bytes_read;
     options_.read_rate_limiter->ConsumeBytes(bytes_read);
@@ -249,10 +291,19 @@ Descriptor::EventAction NativeStreamConnection::OnReadable() {
         continue;
       }
 
+      if (budget_limited) {
+        // We've used up our budget. Yield to other connections by re-queueing
+        // ourselves to the event loop, which will emulate a read event for us.
+        read_budget_exhausted->Increment();
+        RestartReadIn(0ns);
+        return EventAction::Suppress;
+      }
+
       // Well we're really throttled then.
       FLARE_CHECK_EQ(bytes_left, 0);  // No more quota.
       FLARE_CHECK(rate_limited);  // Otherwise we should have drained system's
                                   // buffer.
+      rx_throttled->Increment();
       RestartReadIn(1ms);
       return EventAction::Suppress;
     }
@@ -261,6 +312,7 @@ Descriptor::EventAction NativeStreamConnection::OnReadable() {
 
   // This is a really rare case. The reason why we would get here is
   // `bytes_left` was never non-zero (i.e., `GetQuota()` returned zero).
+  rx_throttled->Increment();
   RestartReadIn(1ms);
   return EventAction::Suppress;
 }
@@ -377,6 +429,7 @@ NativeStreamConnection::FlushStatus NativeStreamConnection::FlushWritingBuffer(
     // Let's update the statistics.
     ever_succeeded = true;
     bytes_quota -= written;
+    pending_write_bytes_.fetch_sub(written, std::memory_order_relaxed);
     options_.write_rate_limiter->ConsumeBytes(written);
 
     // Call user's callbacks.
@@ -393,7 +446,11 @@ NativeStreamConnection::FlushStatus NativeStreamConnection::FlushWritingBuffer(
     }
   }
 
-  return rate_limited ? FlushStatus::RateLimited : FlushStatus::QuotaExceeded;
+  if (rate_limited) {
+    tx_throttled->Increment();
+    return FlushStatus::RateLimited;
+  }
+  return FlushStatus::QuotaExceeded;
 }
 
 AbstractStreamIo::HandshakingStatus NativeStreamConnection::DoHandshake(
@@ -15,12 +15,14 @@
 #ifndef FLARE_IO_NATIVE_STREAM_CONNECTION_H_
 #define FLARE_IO_NATIVE_STREAM_CONNECTION_H_
 
+#include <atomic>
 #include <mutex>
 
 #include "flare/base/align.h"
 #include "flare/base/buffer.h"
 #include "flare/base/maybe_owning.h"
 #include "flare/io/descriptor.h"
+#include "flare/io/detail/read_at_most.h"
 #include "flare/io/detail/writing_buffer_list.h"
 #include "flare/io/stream_connection.h"
 #include "flare/io/util/rate_limiter.h"
@@ -72,6 +74,11 @@ class NativeStreamConnection final : public Descriptor,
   // Restart reading data.
   void RestartRead() override;
 
+  // Number of bytes passed to `Write` but not written out yet.
+  std::size_t GetPendingWriteBytes() const noexcept {
+    return pending_write_bytes_.load(std::memory_order_relaxed);
+  }
+
   void Stop() override;
   void Join() override;
 
@@ -126,9 +133,13 @@ class NativeStreamConnection final : public Descriptor,
   alignas(hardware_destructive_interference_size)
       NoncontiguousBuffer read_buffer_;
 
+  // Used only if `flare_io_adaptive_read_buffer` is set. Accessed by reader.
+  io::detail::ReadSizeAdvisor read_size_advisor_;
+
   // Accessed by writers, usually a different thread.
   alignas(hardware_destructive_interference_size) io::detail::WritingBufferList
       writing_buffers_;
+  std::atomic<std::size_t> pending_write_bytes_{0};
 };
 
 }  // namespace flare
@@ -14,7 +14,10 @@
 
 #include "flare/io/util/rate_limiter.h"
 
+#include <netinet/in.h>
+
 #include <algorithm>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -25,6 +28,7 @@
 
 #include "flare/base/chrono.h"
 #include "flare/base/logging.h"
+#include "flare/base/never_destroyed.h"
 #include "flare/base/string.h"
 
 // These two flags control bandwidth usage of the program. If set to zero, no
@@ -41,6 +45,30 @@ DEFINE_string(flare_io_cap_tx_bandwidth, "0",
               "Same as `flare_io_cap_rx_bandwitch`, except for this one "
               "controls send speed.");
 
+// Flags below apply limits in finer granularity. Limits specified here are
+// applied in addition to the program-wide ones above.
+DEFINE_string(
+    flare_io_cap_rx_bandwidth_per_peer, "0",
+    "If non-zero, this flag caps receive speed of all connections from the same "
+    "peer (or subnet, see `flare_io_rate_limit_peer_ipv4_prefix_length`). "
+    "Units are the same as `flare_io_cap_rx_bandwidth`.");
+DEFINE_string(flare_io_cap_tx_bandwidth_per_peer, "0",
+              "Same as `flare_io_cap_rx_bandwidth_per_peer`, except for this "
+              "one controls send speed.");
+DEFINE_string(
+    flare_io_cap_rx_bandwidth_per_connection, "0",
+    "If non-zero, this flag caps receive speed of each connection. Units are "
+    "the same as `flare_io_cap_rx_bandwidth`.");
+DEFINE_string(flare_io_cap_tx_bandwidth_per_connection, "0",
+              "Same as `flare_io_cap_rx_bandwidth_per_connection`, except for "
+              "this one controls send speed.");
+DEFINE_int32(flare_io_rate_limit_peer_ipv4_prefix_length, 32,
+             "IPv4 peers sharing the same prefix of this length are treated as "
+             "the same peer by `flare_io_cap_*_bandwidth_per_peer`.");
+DEFINE_int32(flare_io_rate_limit_peer_ipv6_prefix_length, 128,
+             "Same as `flare_io_rate_limit_peer_ipv4_prefix_length`, for IPv6 "
+             "peers.");
+
 using namespace std::literals;
 
 namespace flare {
@@ -75,6 +103,18 @@ std::uint64_t ParseToBps(std::string s) {
   return *base * scale / 8;
 }
 
+// Quota replenished each millisecond. Never returns zero, as required by
+// `TokenBucketRateLimiter`.
+std::size_t QuotaPerMs(std::uint64_t bps) {
+  return std::max<std::uint64_t>(bps / (1s / 1ms), 1);
+}
+
+// Each thread grabs (at most) this fraction of per-second quota at a time. This
+// is large enough for the lock in the underlying limiter not to be touched on
+// each read / write, and small enough not to hurt burst bandwidth control much.
+// (Quota cached by idle threads is reclaimed anyway.)
+constexpr auto kThreadCachedQuotaFraction = 100;
+
 template <class Tag>
 RateLimiter* GetRateLimiterOf(std::uint64_t bps) {
   if (!bps) {
@@ -82,12 +122,27 @@ RateLimiter* GetRateLimiterOf(std::uint64_t bps) {
     return &null_limiter;
   } else {
     static ThreadSafeRateLimiter limiter(
-        std::make_unique<TokenBucketRateLimiter>(bps, bps / (1s / 1ms)),
-        bps / 10);
-    return &limiter;
+        std::make_unique<TokenBucketRateLimiter>(bps, QuotaPerMs(bps)),
+        std::max<std::size_t>(bps / 10, 1));
+    static ThreadCachedRateLimiter cached(
+        MaybeOwning<RateLimiter>(non_owning, &limiter),
+        std::max<std::size_t>(bps / kThreadCachedQuotaFraction, 1));
+    return &cached;
   }
 }
 
+template <class Tag>
+io::util::detail::PeerRateLimiterRegistry* GetPeerRateLimiterRegistryOf(
+    std::uint64_t bps) {
+  if (!bps) {
+    return nullptr;
+  }
+  static NeverDestroyed<io::util::detail::PeerRateLimiterRegistry> registry(
+      bps, FLAGS_flare_io_rate_limit_peer_ipv4_prefix_length,
+      FLAGS_flare_io_rate_limit_peer_ipv6_prefix_length);
+  return registry.Get();
+}
+
 }  // namespace
 
 RateLimiter* RateLimiter::GetDefaultRxRateLimiter() {
@@ -104,6 +159,28 @@ RateLimiter* RateLimiter::GetDefaultTxRateLimiter() {
   return limiter;
 }
 
+MaybeOwning<RateLimiter> RateLimiter::NewRxRateLimiterFor(
+    const Endpoint& peer) {
+  struct Tag;
+  static auto peer_registry = GetPeerRateLimiterRegistryOf<Tag>(
+      ParseToBps(FLAGS_flare_io_cap_rx_bandwidth_per_peer));
+  static auto conn_bps =
+      ParseToBps(FLAGS_flare_io_cap_rx_bandwidth_per_connection);
+  return io::util::detail::NewRateLimiterFor(peer, GetDefaultRxRateLimiter(),
+                                             peer_registry, conn_bps);
+}
+
+MaybeOwning<RateLimiter> RateLimiter::NewTxRateLimiterFor(
+    const Endpoint& peer) {
+  struct Tag;
+  static auto peer_registry = GetPeerRateLimiterRegistryOf<Tag>(
+      ParseToBps(FLAGS_flare_io_cap_tx_bandwidth_per_peer));
+  static auto conn_bps =
+      ParseToBps(FLAGS_flare_io_cap_tx_bandwidth_per_connection);
+  return io::util::detail::NewRateLimiterFor(peer, GetDefaultTxRateLimiter(),
+                                             peer_registry, conn_bps);
+}
+
 TokenBucketRateLimiter::TokenBucketRateLimiter(std::size_t burst_quota,
                                                std::size_t quota_per_tick,
                                                std::chrono::nanoseconds tick,
@@ -156,6 +233,88 @@ void ThreadSafeRateLimiter::ConsumeBytes(std::size_t consumed) {
   return impl_->ConsumeBytes(consumed);
 }
 
+ThreadCachedRateLimiter::ThreadCachedRateLimiter(
+    MaybeOwning<RateLimiter> upper, std::size_t batch,
+    std::chrono::nanoseconds reclaim_interval)
+    : batch_(batch),
+      reclaim_interval_(reclaim_interval),
+      upper_(std::move(upper)) {
+  FLARE_CHECK_GT(batch, 0);
+}
+
+std::size_t ThreadCachedRateLimiter::GetQuota() {
+  auto&& cache = *cached_.Get();
+  if (FLARE_UNLIKELY(!cache.active.load(std::memory_order_relaxed))) {
+    cache.active.store(true, std::memory_order_relaxed);
+  }
+  auto cached = cache.quota.load(std::memory_order_relaxed);
+  if (cached > 0) {
+    return cached;
+  }
+
+  // Refill our cache, from quota reclaimed from idle threads first. Quota we
+  // got from `upper_` is "consumed" from it immediately, it's our own business
+  // to use it.
+  ReclaimIdleCaches(&cache);
+  std::size_t quota = TakeReclaimedQuota();
+  if (!quota) {
+    quota = std::min(upper_->GetQuota(), batch_);
+    if (!quota) {
+      return 0;
+    }
+    upper_->ConsumeBytes(quota);
+  }
+  cached = cache.quota.fetch_add(quota, std::memory_order_relaxed) + quota;
+  // Still in debt (caused by over-consumption) if it's not positive.
+  return std::max<std::int64_t>(cached, 0);
+}
+
+void ThreadCachedRateLimiter::ConsumeBytes(std::size_t consumed) {
+  // Note that the caller may have been migrated to another thread since its
+  // call to `GetQuota()` (this is possible for fibers), or the quota may have
+  // been reclaimed in the meantime. In either case this thread's cache would
+  // become negative and the debt is paid on next refill.
+  cached_->quota.fetch_sub(consumed, std::memory_order_relaxed);
+}
+
+void ThreadCachedRateLimiter::ReclaimIdleCaches(Cache* self) {
+  auto now = ReadSteadyClock().time_since_epoch().count();
+  auto expected = next_reclaim_.load(std::memory_order_relaxed);
+  if (now < expected ||
+      !next_reclaim_.compare_exchange_strong(expected,
+                                             now + reclaim_interval_.count(),
+                                             std::memory_order_relaxed)) {
+    return;  // Not yet, or someone else is doing this.
+  }
+  // A thread is considered idle if it has not been using us since last round.
+  cached_.ForEach([&](Cache* cache) {
+    if (cache == self || cache->active.exchange(false)) {
+      return;
+    }
+    auto quota = cache->quota.load(std::memory_order_relaxed);
+    while (quota > 0 && !cache->quota.compare_exchange_weak(
+                            quota, 0, std::memory_order_relaxed)) {
+      // Retry then.
+    }
+    if (quota > 0) {
+      reclaimed_.fetch_add(quota, std::memory_order_relaxed);
+    }
+  });
+}
+
+std::size_t ThreadCachedRateLimiter::TakeReclaimedQuota() {
+  auto avail = reclaimed_.load(std::memory_order_relaxed);
+  std::int64_t taken = 0;
+  do {
+    if (avail <= 0) {
+      return 0;
+    }
+    taken = std::min<std::int64_t>(avail, batch_);
+  } while (!reclaimed_.compare_exchange_weak(avail, avail - taken,
+                                             std::memory_order_relaxed));
+  return taken;
+}
+
 LayeredRateLimiter::LayeredRateLimiter(RateLimiter* upper,
                                        MaybeOwning<RateLimiter> ours)
     : upper_(upper), ours_(std::move(ours)) {}
@@ -169,4 +328,123 @@ void LayeredRateLimiter::ConsumeBytes(std::size_t consumed) {
   ours_->ConsumeBytes(consumed);
 }
 
+namespace io::util::detail {
+
+PeerRateLimiterRegistry::PeerRateLimiterRegistry(std::uint64_t bytes_per_sec,
+                                                 int ipv4_prefix_length,
+                                                 int ipv6_prefix_length)
+    : bytes_per_sec_(bytes_per_sec),
+      ipv4_prefix_length_(ipv4_prefix_length),
+      ipv6_prefix_length_(ipv6_prefix_length) {}
+
+std::shared_ptr<RateLimiter> PeerRateLimiterRegistry::Get(
+    const Endpoint& peer) {
+  auto key = GetPeerKey(peer);
+  std::scoped_lock _(lock_);
+  if (auto ptr = limiters_[key].lock()) {
+    return ptr;
+  }
+  auto ptr = std::make_shared<ThreadSafeRateLimiter>(
+      std::make_unique<TokenBucketRateLimiter>(bytes_per_sec_,
+                                               QuotaPerMs(bytes_per_sec_)),
+      std::max<std::size_t>(bytes_per_sec_ / 10, 1));
+  limiters_[key] = ptr;
+  // Purge expired entries once in a while, so as not to accumulate entries for
+  // peers we no longer talk with.
+  if (limiters_.size() >= next_purge_at_) {
+    for (auto iter = limiters_.begin(); iter != limiters_.end();) {
+      if (iter->second.expired()) {
+        iter = limiters_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    next_purge_at_ = std::max<std::size_t>(limiters_.size() * 2, 64);
+  }
+  return ptr;
+}
+
+// Identifies a peer (or subnet) for per-peer rate limiting.
+std::string PeerRateLimiterRegistry::GetPeerKey(const Endpoint& peer) const {
+  auto mask = [](auto* bytes, std::size_t size, int prefix_length) {
+    auto bits = std::clamp<int>(prefix_length, 0, size * 8);
+    for (std::size_t i = bits / 8; i != size; ++i) {
+      auto keep = i == bits / 8 ? bits % 8 : 0;
+      bytes[i] &= keep ? static_cast<std::uint8_t>(0xff << (8 - keep)) : 0;
+    }
+  };
+
+  if (peer.Family() == AF_INET) {
+    auto addr = peer.UnsafeGet<sockaddr_in>()->sin_addr;
+    auto bytes = reinterpret_cast<std::uint8_t*>(&addr);
+    mask(bytes, sizeof(addr), ipv4_prefix_length_);
+    return std::string(reinterpret_cast<const char*>(bytes), sizeof(addr));
+  } else if (peer.Family() == AF_INET6) {
+    auto addr = peer.UnsafeGet<sockaddr_in6>()->sin6_addr;
+    auto bytes = reinterpret_cast<std::uint8_t*>(&addr);
+    mask(bytes, sizeof(addr), ipv6_prefix_length_);
+    return std::string(reinterpret_cast<const char*>(bytes), sizeof(addr));
+  }
+  // Unix sockets and the like. Treat them all as from the same peer.
+  return {};
+}
+
+MaybeOwning<RateLimiter> NewRateLimiterFor(
+    const Endpoint& peer, RateLimiter* root,
+    PeerRateLimiterRegistry* peer_registry, std::uint64_t conn_bytes_per_sec) {
+  if (!peer_registry && !conn_bytes_per_sec) {
+    return MaybeOwning<RateLimiter>(non_owning, root);
+  }
+  std::shared_ptr<RateLimiter> peer_limiter;
+  std::unique_ptr<RateLimiter> conn_limiter;
+  if (peer_registry) {
+    peer_limiter = peer_registry->Get(peer);
+  }
+  if (conn_bytes_per_sec) {
+    // Accessed by the connection itself only, no synchronization needed.
+    conn_limiter = std::make_unique<TokenBucketRateLimiter>(
+        conn_bytes_per_sec, QuotaPerMs(conn_bytes_per_sec));
+  }
+  return std::make_unique<SharedLayeredRateLimiter>(
+      root, std::move(peer_limiter), std::move(conn_limiter));
+}
+
+SharedLayeredRateLimiter::SharedLayeredRateLimiter(
+    RateLimiter* root, std::shared_ptr<RateLimiter> peer_limiter,
+    std::unique_ptr<RateLimiter> conn_limiter)
+    : root_(root),
+      peer_limiter_(std::move(peer_limiter)),
+      conn_limiter_(std::move(conn_limiter)) {}
+
+std::size_t SharedLayeredRateLimiter::GetQuota() {
+  // Check the innermost (the cheapest one) first, there's no point in asking
+  // the others if the connection itself is throttled.
+  auto quota = std::numeric_limits<std::size_t>::max();
+  if (conn_limiter_) {
+    quota = conn_limiter_->GetQuota();
+    if (!quota) {
+      return 0;
+    }
+  }
+  if (peer_limiter_) {
+    quota = std::min(quota, peer_limiter_->GetQuota());
+    if (!quota) {
+      return 0;
+    }
+  }
+  return std::min(quota, root_->GetQuota());
+}
+
+void SharedLayeredRateLimiter::ConsumeBytes(std::size_t consumed) {
+  root_->ConsumeBytes(consumed);
+  if (peer_limiter_) {
+    peer_limiter_->ConsumeBytes(consumed);
+  }
+  if (conn_limiter_) {
+    conn_limiter_->ConsumeBytes(consumed);
+  }
+}
+
+}  // namespace io::util::detail
+
 }  // namespace flare
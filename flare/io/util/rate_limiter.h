@@ -15,10 +15,19 @@
 #ifndef FLARE_IO_UTIL_RATE_LIMITER_H_
 #define FLARE_IO_UTIL_RATE_LIMITER_H_
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
+#include "flare/base/align.h"
 #include "flare/base/maybe_owning.h"
+#include "flare/base/net/endpoint.h"
+#include "flare/base/thread/thread_local.h"
 
 namespace flare {
 
@@ -58,6 +67,20 @@ class RateLimiter {
   static RateLimiter* GetDefaultRxRateLimiter();
   // Same as `GetDefaultRxRateLimiter()` but this one controls tx speed.
   static RateLimiter* GetDefaultTxRateLimiter();
+
+  // Creates a rate limiter for a new connection with `peer`. The limiter
+  // respects all of the following limits:
+  //
+  // - Program-wide limit (i.e., `GetDefaultRxRateLimiter()`);
+  // - Per-peer limit, shared by all connections with peers in the same subnet
+  //   (@sa: `flare_io_cap_rx_bandwidth_per_peer`);
+  // - Per-connection limit (@sa: `flare_io_cap_rx_bandwidth_per_connection`).
+  //
+  // If neither per-peer nor per-connection limit is configured, this method
+  // returns `GetDefaultRxRateLimiter()` (not owning) and adds no overhead.
+  static MaybeOwning<RateLimiter> NewRxRateLimiterFor(const Endpoint& peer);
+  // Same as `NewRxRateLimiterFor()` but this one controls tx speed.
+  static MaybeOwning<RateLimiter> NewTxRateLimiterFor(const Endpoint& peer);
 };
 
 // Rate limiter implemented via token bucket.
@@ -116,6 +139,53 @@ class ThreadSafeRateLimiter : public RateLimiter {
   MaybeOwning<RateLimiter> impl_;
 };
 
+// This class caches quota got from `upper` in each thread, so that in most
+// cases calls to `GetQuota()` / `ConsumeBytes()` are served from thread-local
+// cache without touching (the lock of) `upper`.
+//
+// At most `batch` bytes are fetched from `upper` by each thread at a time. The
+// larger `batch` is, the less `upper` is touched. However, quota cached in each
+// thread is invisible to others, so a large `batch` hurts precision of burst
+// bandwidth control.
+//
+// Quota cached by threads that have not been using this limiter for (roughly)
+// `reclaim_interval` is reclaimed, and handed out to other threads refilling
+// their cache. This way quota is not lost by threads going idle.
+class ThreadCachedRateLimiter : public RateLimiter {
+ public:
+  // `upper` must be thread-safe.
+  ThreadCachedRateLimiter(
+      MaybeOwning<RateLimiter> upper, std::size_t batch,
+      std::chrono::nanoseconds reclaim_interval = std::chrono::milliseconds(10));
+
+  std::size_t GetQuota() override;
+
+  void ConsumeBytes(std::size_t consumed) override;
+
+ private:
+  struct alignas(hardware_destructive_interference_size) Cache {
+    // Can be negative if the quota was over-consumed.
+    std::atomic<std::int64_t> quota{0};
+    // Set on each use, cleared each time `ReclaimIdleCaches` runs.
+    std::atomic<bool> active{false};
+  };
+
+  // Move quota cached by idle threads into `reclaimed_`. `self` is skipped.
+  void ReclaimIdleCaches(Cache* self);
+
+  // Takes at most `batch_` bytes from `reclaimed_`.
+  std::size_t TakeReclaimedQuota();
+
+ private:
+  std::size_t batch_;
+  std::chrono::nanoseconds reclaim_interval_;
+  MaybeOwning<RateLimiter> upper_;
+
+  std::atomic<std::int64_t> reclaimed_{0};
+  std::atomic<std::chrono::steady_clock::rep> next_reclaim_{0};
+  ThreadLocal<Cache> cached_;
+};
+
 // Multiple layered rate limiter. It does not only respect its own limitation,
 // but also it's upper layer's.
 //
@@ -139,6 +209,56 @@ class LayeredRateLimiter : public RateLimiter {
   MaybeOwning<RateLimiter> ours_;
 };
 
+namespace io::util::detail {
+
+// Per-peer limiters are shared by all connections with the same peer (or
+// subnet, as specified by prefix lengths). They're destroyed once all such
+// connections are gone.
+class PeerRateLimiterRegistry {
+ public:
+  PeerRateLimiterRegistry(std::uint64_t bytes_per_sec, int ipv4_prefix_length,
+                          int ipv6_prefix_length);
+
+  std::shared_ptr<RateLimiter> Get(const Endpoint& peer);
+
+ private:
+  std::string GetPeerKey(const Endpoint& peer) const;
+
+ private:
+  std::uint64_t bytes_per_sec_;
+  int ipv4_prefix_length_;
+  int ipv6_prefix_length_;
+  std::mutex lock_;
+  std::size_t next_purge_at_ = 64;
+  std::unordered_map<std::string, std::weak_ptr<RateLimiter>> limiters_;
+};
+
+// Creates a limiter layering `root`, per-peer limiter from `peer_registry` (if
+// not `nullptr`) and a per-connection limiter (if `conn_bytes_per_sec` is not
+// zero). `root` is returned if neither of the latter two is applicable.
+MaybeOwning<RateLimiter> NewRateLimiterFor(
+    const Endpoint& peer, RateLimiter* root,
+    PeerRateLimiterRegistry* peer_registry, std::uint64_t conn_bytes_per_sec);
+
+// Same as `LayeredRateLimiter`, except that it also shares ownership of the
+// limiters in upper layers. Used by `RateLimiter::NewXxxRateLimiterFor()`.
+class SharedLayeredRateLimiter : public RateLimiter {
+ public:
+  SharedLayeredRateLimiter(RateLimiter* root,
+                           std::shared_ptr<RateLimiter> peer_limiter,
+                           std::unique_ptr<RateLimiter> conn_limiter);
+
+  std::size_t GetQuota() override;
+  void ConsumeBytes(std::size_t consumed) override;
+
+ private:
+  RateLimiter* root_;
+  std::shared_ptr<RateLimiter> peer_limiter_;  // Can be `nullptr`.
+  std::unique_ptr<RateLimiter> conn_limiter_;  // Can be `nullptr`.
+};
+
+}  // namespace io::util::detail
+
 }  // namespace flare
 
 #endif  // FLARE_IO_UTIL_RATE_LIMITER_H_
@@ -23,6 +23,7 @@
 #include "gtest/gtest.h"
 
 #include "flare/base/chrono.h"
+#include "flare/base/net/endpoint.h"
 #include "flare/base/random.h"
 
 using namespace std::literals;
@@ -209,4 +210,98 @@ TEST(RateLimiter, LayeredRateLimiter4) {
   ASSERT_NEAR(60000, total.load(), 5000);  // `tbsrl` takes effect.
 }
 
+TEST(RateLimiter, ThreadCachedRateLimiter) {
+  ThreadSafeRateLimiter base_limiter(
+      std::make_unique<TokenBucketRateLimiter>(1000, 1));
+  ThreadCachedRateLimiter limiter(
+      MaybeOwning<RateLimiter>(non_owning, &base_limiter), 10);
+  std::atomic<std::size_t> total = 0;
+  std::vector<std::thread> ts;
+
+  for (int i = 0; i != 10; ++i) {
+    ts.emplace_back() = std::thread([&] {
+      auto start = ReadSteadyClock();
+      while (ReadSteadyClock() - start < 5s) {
+        auto current = limiter.GetQuota();
+        ASSERT_LE(current, 10);
+        total += current;
+        limiter.ConsumeBytes(current);
+        std::this_thread::sleep_for(1ms * Random(10));
+      }
+    });
+  }
+
+  for (auto&& t : ts) {
+    t.join();
+  }
+
+  // Quota cached by each thread (at most 10 bytes) is not counted.
+  ASSERT_NEAR(6000, total.load(), 500);
+}
+
+TEST(RateLimiter, ThreadCachedRateLimiterReclaim) {
+  ThreadSafeRateLimiter base_limiter(
+      std::make_unique<TokenBucketRateLimiter>(1000, 1));
+  ThreadCachedRateLimiter limiter(
+      MaybeOwning<RateLimiter>(non_owning, &base_limiter), 500, 10ms);
+
+  // Grab some quota and go idle (without leaving, as quota cached by a thread
+  // is lost once it leaves).
+  std::atomic<bool> leaving{false};
+  std::thread t([&] {
+    ASSERT_EQ(500, limiter.GetQuota());
+    while (!leaving) {
+      std::this_thread::sleep_for(1ms);
+    }
+  });
+  std::this_thread::sleep_for(10ms);
+  ASSERT_EQ(500, limiter.GetQuota());
+  limiter.ConsumeBytes(500);
+  std::this_thread::sleep_for(50ms);
+
+  // Quota cached by the idle thread is given to us (instead of the underlying
+  // limiter, whose bucket is nearly empty now).
+  std::size_t total = 0;
+  for (int i = 0; i != 3; ++i) {
+    auto current = limiter.GetQuota();
+    total += current;
+    limiter.ConsumeBytes(current);
+    std::this_thread::sleep_for(20ms);
+  }
+  ASSERT_GE(total, 500);
+  leaving = true;
+  t.join();
+}
+
+TEST(RateLimiter, PerPeerRateLimiter) {
+  // 1000 bytes per second, shared by peers in the same /24 subnet.
+  io::util::detail::PeerRateLimiterRegistry registry(1000, 24, 128);
+
+  auto drain = [](RateLimiter* limiter) {
+    std::size_t total = 0;
+    while (auto current = limiter->GetQuota()) {
+      total += current;
+      limiter->ConsumeBytes(current);
+      if (total > 2000) {
+        break;  // Not throttled at all?
+      }
+    }
+    return total;
+  };
+
+  auto new_limiter = [&](const Endpoint& peer) {
+    return io::util::detail::NewRateLimiterFor(
+        peer, RateLimiter::GetDefaultRxRateLimiter(), &registry, 0);
+  };
+  auto l1 = new_limiter(EndpointFromIpv4("10.0.0.1", 1));
+  auto l2 = new_limiter(EndpointFromIpv4("10.0.0.2", 2));
+  auto l3 = new_limiter(EndpointFromIpv4("10.0.1.1", 1));
+
+  ASSERT_NEAR(1000, drain(l1.Get()), 50);
+  // `l2` shares quota with `l1` (they're in the same /24 subnet.)
+  ASSERT_LE(drain(l2.Get()), 50);
+  // While `l3` is not affected.
+  ASSERT_NEAR(1000, drain(l3.Get()), 50);
+}
+
 }  // namespace flare
@@ -14,28 +14,176 @@
 
 #include "flare/io/util/ssl_stream_io.h"
 
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
 #include <algorithm>
+#include <cstring>
 #include <utility>
 
+#include "gflags/gflags.h"
+#include "openssl/evp.h"
+
+#ifndef FLARE_WITH_BORINGSSL
+#include "openssl/kdf.h"
+#endif
+
+#include "flare/base/endian.h"
 #include "flare/base/logging.h"
 #include "flare/io/util/http_proxy_stream_io.h"
 
+DEFINE_bool(flare_io_ssl_enable_ktls, false,
+            "If set, once TLS handshake completes, session keys are installed "
+            "into the kernel (kTLS) so that encryption / decryption is done by "
+            "the kernel, saving a copy of every byte transferred. Only TLS 1.2 "
+            "AES-GCM cipher suites are supported. For other cipher suites, or "
+            "if the kernel does not support kTLS, we fall back to user-space "
+            "encryption silently.");
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
 namespace flare {
 
+namespace {
+
+// Layout of TLS 1.2 key block for AEAD ciphers (MAC keys are empty):
+//
+// client_write_key | server_write_key | client_write_IV | server_write_IV
+//
+// @sa: https://tools.ietf.org/html/rfc5246#section-6.3
+constexpr std::size_t kGcmImplicitIvSize = 4;
+
+template <class T>
+void FillCryptoInfo(const std::uint8_t* key, const std::uint8_t* salt,
+                    std::uint64_t seq, T* info) {
+  static_assert(sizeof(info->salt) == kGcmImplicitIvSize);
+  static_assert(sizeof(info->iv) == sizeof(seq) &&
+                sizeof(info->rec_seq) == sizeof(seq));
+  memset(info, 0, sizeof(*info));
+  info->info.version = TLS_1_2_VERSION;
+  memcpy(info->key, key, sizeof(info->key));
+  memcpy(info->salt, salt, sizeof(info->salt));
+  // Explicit nonce is only required to be unique. Using the record sequence
+  // number as its initial value is what most implementations do.
+  auto be_seq = ToBigEndian<std::uint64_t>(seq);
+  memcpy(info->iv, &be_seq, sizeof(be_seq));
+  memcpy(info->rec_seq, &be_seq, sizeof(be_seq));
+}
+
+// Derives TLS 1.2 key block from master secret.
+bool GenerateKeyBlock(SSL* ssl, std::uint8_t* out, std::size_t size) {
+#ifdef FLARE_WITH_BORINGSSL
+  return SSL_generate_key_block(ssl, out, size) == 1;
+#else
+  std::uint8_t master_key[SSL_MAX_MASTER_KEY_LENGTH];
+  auto master_key_size = SSL_SESSION_get_master_key(
+      SSL_get_session(ssl), master_key, sizeof(master_key));
+  std::uint8_t randoms[SSL3_RANDOM_SIZE * 2];
+  // Note that server random goes first for key expansion.
+  if (SSL_get_server_random(ssl, randoms, SSL3_RANDOM_SIZE) !=
+          SSL3_RANDOM_SIZE ||
+      SSL_get_client_random(ssl, randoms + SSL3_RANDOM_SIZE,
+                            SSL3_RANDOM_SIZE) != SSL3_RANDOM_SIZE) {
+    return false;
+  }
+  auto md = SSL_CIPHER_get_handshake_digest(SSL_get_current_cipher(ssl));
+  if (!md || !master_key_size) {
+    return false;
+  }
+
+  std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx{
+      EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr), &EVP_PKEY_CTX_free};
+  static constexpr std::uint8_t kLabel[] = "key expansion";
+  return ctx && EVP_PKEY_derive_init(ctx.get()) > 0 &&
+         EVP_PKEY_CTX_set_tls1_prf_md(ctx.get(), md) > 0 &&
+         EVP_PKEY_CTX_set1_tls1_prf_secret(ctx.get(), master_key,
+                                           master_key_size) > 0 &&
+         EVP_PKEY_CTX_add1_tls1_prf_seed(ctx.get(), kLabel,
+                                         sizeof(kLabel) - 1) > 0 &&
+         EVP_PKEY_CTX_add1_tls1_prf_seed(ctx.get(), randoms,
+                                         sizeof(randoms)) > 0 &&
+         EVP_PKEY_derive(ctx.get(), out, &size) > 0;
+#endif
+}
+
+// Returns sequence numbers of the next record to be read / written.
+std::pair<std::uint64_t, std::uint64_t> GetRecordSequences(SSL* ssl) {
+#ifdef FLARE_WITH_BORINGSSL
+  return {SSL_get_read_sequence(ssl), SSL_get_write_sequence(ssl)};
+#else
+  // OpenSSL 1.1.1 does not expose record sequence numbers. We're called
+  // immediately after the handshake completes, at which point the only
+  // record protected by the new keys in either direction is `Finished`
+  // (which used sequence number 0).
+  return {1, 1};
+#endif
+}
+
+enum class KeyInstallation {
+  // Both directions are handled by the kernel.
+  Succeeded,
+
+  // Nothing is installed, the socket can still be used as a plain one.
+  Failed,
+
+  // RX key is installed but TX is not. Neither the kernel nor OpenSSL is able
+  // to handle the connection any more.
+  Broken
+};
+
+template <class T>
+KeyInstallation InstallKeys(int fd, SSL* ssl, std::size_t key_size) {
+  std::uint8_t key_block[2 * (sizeof(T::key) + kGcmImplicitIvSize)];
+  static_assert(sizeof(T::key) == 16 || sizeof(T::key) == 32);
+  if (key_size != sizeof(T::key) ||
+      !GenerateKeyBlock(ssl, key_block, sizeof(key_block))) {
+    return KeyInstallation::Failed;
+  }
+  auto client_key = key_block;
+  auto server_key = client_key + key_size;
+  auto client_iv = server_key + key_size;
+  auto server_iv = client_iv + kGcmImplicitIvSize;
+  bool server = SSL_is_server(ssl);
+  auto [read_seq, write_seq] = GetRecordSequences(ssl);
+
+  T tx, rx;
+  FillCryptoInfo(server ? server_key : client_key,
+                 server ? server_iv : client_iv, write_seq, &tx);
+  FillCryptoInfo(server ? client_key : server_key,
+                 server ? client_iv : server_iv, read_seq, &rx);
+  // RX goes first. Older kernels support TX only, in which case we bail out
+  // before anything is installed. Once RX is installed, failing to install TX
+  // leaves the connection unusable (there's no way to uninstall RX).
+  auto result = KeyInstallation::Failed;
+  if (setsockopt(fd, SOL_TLS, TLS_RX, &rx, sizeof(rx)) == 0) {
+    result = setsockopt(fd, SOL_TLS, TLS_TX, &tx, sizeof(tx)) == 0
+                 ? KeyInstallation::Succeeded
+                 : KeyInstallation::Broken;
+  }
+  OPENSSL_cleanse(key_block, sizeof(key_block));
+  OPENSSL_cleanse(&tx, sizeof(tx));
+  OPENSSL_cleanse(&rx, sizeof(rx));
+  return result;
+}
+
+}  // namespace
+
 SslStreamIo::SslStreamIo(std::unique_ptr<AbstractStreamIo> base,
                          std::unique_ptr<SSL, decltype(&SSL_free)> ssl)
     : ssl_(std::move(ssl)), base_(std::move(base)) {
-  int fd = -1;
   SystemStreamIo* system_io = dynamic_cast<SystemStreamIo*>(base_.get());
   if (system_io) {
-    fd = system_io->GetFd();
+    fd_ = system_io->GetFd();
   } else {
     HttpProxyStreamIo* proxy_io = dynamic_cast<HttpProxyStreamIo*>(base_.get());
     FLARE_CHECK(proxy_io, "Ssl should have underlying system or proxy io");
-    fd = proxy_io->GetFd();
+    fd_ = proxy_io->GetFd();
   }
 
-  SSL_set_fd(ssl_.get(), fd);
+  SSL_set_fd(ssl_.get(), fd_);
   SSL_set_connect_state(ssl_.get());
 }
 
@@ -64,10 +212,23 @@ SslStreamIo::HandshakingStatus SslStreamIo::Handshake() {
       return SslStreamIo::HandshakingStatus::Error;
     }
   }
+  if (FLAGS_flare_io_ssl_enable_ktls) {
+    auto status = TryEnableKernelTls();
+    if (status == KernelTlsStatus::Error) {
+      return SslStreamIo::HandshakingStatus::Error;
+    }
+    ktls_enabled_ = status == KernelTlsStatus::Enabled;
+  }
   return SslStreamIo::HandshakingStatus::Success;
 }
 
 ssize_t SslStreamIo::ReadV(const iovec* iov, int iovcnt) {
+  if (ktls_enabled_) {
+    // Records other than application data (e.g. alerts) are reported as
+    // `EIO` by the kernel, which is treated as an error by our caller. Given
+    // that renegotiation is not supported anyway, this is what we want.
+    return base_->ReadV(iov, iovcnt);
+  }
   ssize_t ret = DoReadV(iov, iovcnt);
   if (ret <= 0) {
     HandleSslError("Read", ret);
@@ -149,6 +310,9 @@ ssize_t SslStreamIo::DoWriteV(const iovec* vector, int count) {
 }
 
 ssize_t SslStreamIo::WriteV(const iovec* iov, int iovcnt) {
+  if (ktls_enabled_) {
+    return base_->WriteV(iov, iovcnt);
+  }
   ssize_t ret = DoWriteV(iov, iovcnt);
   if (ret <= 0) {
     HandleSslError("Write", ret);
@@ -156,6 +320,60 @@ ssize_t SslStreamIo::WriteV(const iovec* iov, int iovcnt) {
   return ret;
 }
 
+SslStreamIo::KernelTlsStatus SslStreamIo::TryEnableKernelTls() {
+  auto ssl = ssl_.get();
+  if (SSL_version(ssl) != TLS1_2_VERSION) {
+    FLARE_VLOG(10, "Kernel TLS is only supported for TLS 1.2.");
+    return KernelTlsStatus::Unavailable;
+  }
+  // If OpenSSL has already read something beyond the handshake, we can't hand
+  // the connection over to the kernel without losing that data.
+  if (SSL_has_pending(ssl)) {
+    FLARE_VLOG(10, "Data pending in OpenSSL, kernel TLS is not enabled.");
+    return KernelTlsStatus::Unavailable;
+  }
+
+  auto cipher = SSL_get_current_cipher(ssl);
+  auto nid = SSL_CIPHER_get_cipher_nid(cipher);
+  if (nid != NID_aes_128_gcm && nid != NID_aes_256_gcm) {
+    FLARE_VLOG(10, "Cipher [{}] is not supported by kernel TLS.",
+               SSL_CIPHER_get_name(cipher));
+    return KernelTlsStatus::Unavailable;
+  }
+
+  // Attach TLS ULP to the socket. This fails if `tls` module is not loaded.
+  if (setsockopt(fd_, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+    FLARE_LOG_WARNING_ONCE(
+        "Failed to enable kernel TLS: {}. Is `tls` kernel module loaded? "
+        "Falling back to user-space encryption.",
+        strerror(errno));
+    return KernelTlsStatus::Unavailable;
+  }
+
+  // Once TLS ULP is attached, there's no way back. Until a key is installed,
+  // the socket behaves as a plain one and user-space encryption still works.
+  // Once the RX key is installed, however, records are decrypted by the
+  // kernel, so we can't fall back if installing TX key fails.
+  auto key_size = EVP_CIPHER_key_length(EVP_get_cipherbynid(nid));
+  auto result =
+      nid == NID_aes_128_gcm
+          ? InstallKeys<tls12_crypto_info_aes_gcm_128>(fd_, ssl, key_size)
+          : InstallKeys<tls12_crypto_info_aes_gcm_256>(fd_, ssl, key_size);
+  if (result == KeyInstallation::Broken) {
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Failed to install TX key into kernel: {}. Closing the connection.",
+        strerror(errno));
+    return KernelTlsStatus::Error;
+  } else if (result == KeyInstallation::Failed) {
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Failed to install session keys into kernel: {}. Falling back to "
+        "user-space encryption.",
+        strerror(errno));
+    return KernelTlsStatus::Unavailable;
+  }
+  return KernelTlsStatus::Enabled;
+}
+
 int SslStreamIo::HandleSslError(const char* operation, int ret) {
   int ssle = SSL_get_error(ssl_.get(), ret);
   if (ssle == SSL_ERROR_WANT_READ || ssle == SSL_ERROR_WANT_WRITE) {
@@ -37,7 +37,30 @@ class SslStreamIo : public AbstractStreamIo {
 
   ssize_t WriteV(const iovec* iov, int iovcnt) override;
 
+  // Returns true if kernel TLS has been installed on the underlying socket.
+  // Once enabled, encryption / decryption is done by the kernel and reads /
+  // writes go through the underlying IO directly.
+  //
+  // Kernel TLS is enabled (if `flare_io_ssl_enable_ktls` is set) after the
+  // handshake is done. It's only available for TLS 1.2 AES-GCM cipher suites.
+  // For all other cipher suites, encryption is done in user space as before.
+  bool IsKernelTlsEnabled() const noexcept { return ktls_enabled_; }
+
  private:
+  enum class KernelTlsStatus {
+    Enabled,
+
+    // The negotiated cipher suite is not supported by kernel TLS, or the
+    // kernel refused to do so. User-space encryption should be used.
+    Unavailable,
+
+    // Session keys are partially installed, the connection must be closed.
+    Error
+  };
+
+  // Installs session keys into the kernel.
+  KernelTlsStatus TryEnableKernelTls();
+
   ssize_t DoReadV(const iovec* iov, int iovcnt);
   ssize_t DoWriteV(const iovec* iov, int iovcnt);
 
@@ -46,7 +69,9 @@ class SslStreamIo : public AbstractStreamIo {
  private:
   std::unique_ptr<SSL, decltype(&SSL_free)> ssl_;
   std::unique_ptr<AbstractStreamIo> base_;
+  int fd_;
   bool base_handshake_done_{false};
+  bool ktls_enabled_{false};
 };
 
 }  // namespace flare
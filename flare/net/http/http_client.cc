@@ -235,6 +235,12 @@ class HttpEngineWrapper : public detail::HttpChannel {
                                         request_options.http_version,
                                         request_options.no_automatic_upgrade)),
                    CURLE_OK);
+    if (request_options.no_automatic_upgrade ||
+        request_options.http_version == HttpVersion::V_2) {
+      // Wait for an existing HTTP/2 connection to multiplex on, instead of
+      // opening a new one.
+      FLARE_CHECK_EQ(curl_easy_setopt(h, CURLOPT_PIPEWAIT, 1L), CURLE_OK);
+    }
     for (auto&& s : request_options.headers) {
       task.AddHeader(s);
     }
@@ -97,6 +97,9 @@ class HttpClient {
     bool verbose = false;              // Use for debug, print info to stderr.
 
     // http version we want to use.
+    //
+    // If HTTP/2 is used (either way), concurrent requests to the same host are
+    // multiplexed on a single connection.
     bool no_automatic_upgrade = false;  // use http2 without 1.1 upgrade
     // http_version valid if no_automatic_upgrade is false
     HttpVersion http_version = HttpVersion::Unspecified;
@@ -191,6 +191,9 @@ class CurlClient {
     curl_multi_setopt(
         multi_handle_, CURLMOPT_MAX_HOST_CONNECTIONS,
         FLAGS_flare_http_engine_max_connections_per_host_per_worker);
+    // Requests to the same host share a single HTTP/2 connection (if the
+    // server speaks HTTP/2).
+    curl_multi_setopt(multi_handle_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
     notifier_ = notifier;
     group_ = group;
     call_context_queue_ = call_context_queue;
@@ -22,6 +22,7 @@
 #include <utility>
 
 #include "flare/base/casting.h"
+#include "flare/base/chrono.h"
 #include "flare/base/encoding/hex.h"
 #include "flare/base/string.h"
 #include "flare/net/redis/message.h"
@@ -132,10 +133,18 @@ void RedisChannel::Execute(const RedisCommand& command,
   // Make CKV call.
   auto handle = CreateCallGate(peer);
   RefPtr gate_ref(ref_ptr, handle.Get());
-  auto internal_cb = [handle = std::move(handle), cb = std::move(cb)](
+  auto internal_cb = [handle = std::move(handle), cb = std::move(cb),
+                      msg_dispatcher = impl_->msg_dispatcher.get(), peer,
+                      msg_disp_ctx, start = ReadSteadyClock()](
                          StreamCallGate::CompletionStatus status,
                          std::unique_ptr<Message> msg,
                          const StreamCallGate::Timestamps& ts) {
+    // Errors returned by Redis itself are not peer failures.
+    msg_dispatcher->Report(peer,
+                           status == StreamCallGate::CompletionStatus::Success
+                               ? LoadBalancer::Status::Success
+                               : LoadBalancer::Status::Failed,
+                           ReadSteadyClock() - start, msg_disp_ctx);
     if (status == StreamCallGate::CompletionStatus::Success) {
       FLARE_CHECK(msg);
       cb(std::move(cast<redis::RedisResponse>(*msg)->object));
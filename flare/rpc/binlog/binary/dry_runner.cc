@@ -0,0 +1,202 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/dry_runner.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "google/protobuf/message.h"
+
+#include "flare/base/endian.h"
+#include "flare/base/logging.h"
+#include "flare/net/http/http_request.h"
+#include "flare/net/http/http_response.h"
+#include "flare/net/http/packet_desc.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/testing.h"
+#include "flare/rpc/binlog/util/proto_dry_runner.h"
+
+namespace flare::binlog {
+
+namespace {
+
+constexpr std::uint32_t kFrameMagic = 0x46424452;  // "FBDR"
+
+// Frames larger than this are treated as an error.
+constexpr std::uint32_t kMaxFrameSize = 256 * 1024 * 1024;
+
+struct FrameHeader {
+  std::uint32_t magic;
+  std::uint32_t size;
+};
+
+std::string SerializePacket(const PacketDesc& packet) {
+  if (auto p = dyn_cast<ProtoPacketDesc>(packet)) {
+    if (p->message.index() == 0) {
+      return std::get<0>(p->message)->SerializeAsString();
+    } else {
+      return FlattenSlow(*std::get<1>(p->message));
+    }
+  } else if (auto p = dyn_cast<TestingPacketDesc>(packet)) {
+    return p->str;
+  } else if (auto p = dyn_cast<http::PacketDesc>(packet)) {
+    if (p->message.index() == 0) {
+      return *std::get<0>(p->message)->body();
+    } else {
+      return *std::get<1>(p->message)->body();
+    }
+  }
+  return packet.Describe().Evaluate();
+}
+
+// Collects what's sent out during dry-run.
+struct Report {
+  std::mutex lock;
+  binary::DryRunReport report;
+};
+
+class BinaryDryRunIncomingCall : public ProtoDryRunIncomingCall {
+ public:
+  void SetReport(Report* report) { report_ = report; }
+
+  void CaptureOutgoingPacket(const PacketDesc& packet) override {
+    auto bytes = SerializePacket(packet);
+    std::scoped_lock _(report_->lock);
+    report_->report.add_responses(std::move(bytes));
+  }
+
+ private:
+  Report* report_;
+};
+
+class BinaryDryRunOutgoingCall : public ProtoDryRunOutgoingCall {
+ public:
+  void SetReport(Report* report) { report_ = report; }
+
+  void CaptureOutgoingPacket(const PacketDesc& packet) override {
+    auto bytes = SerializePacket(packet);
+    std::scoped_lock _(report_->lock);
+    auto&& req = report_->report.add_outgoing_requests();
+    req->set_correlation_id(GetCorrelationId());
+    req->set_body(std::move(bytes));
+  }
+
+ private:
+  Report* report_;
+};
+
+class BinaryDryRunContext : public DryRunContext {
+ public:
+  explicit BinaryDryRunContext(const binary::Log& log) {
+    incoming_.Init(log.incoming_call());
+    incoming_.SetReport(&report_);
+    for (auto&& e : log.outgoing_calls()) {
+      auto&& call = outgoings_[e.correlation_id()];
+      call.Init(e);
+      call.SetReport(&report_);
+    }
+  }
+
+  DryRunIncomingCall* GetIncomingCall() override { return &incoming_; }
+
+  Expected<DryRunOutgoingCall*, Status> TryGetOutgoingCall(
+      const std::string& correlation_id) override {
+    if (auto iter = outgoings_.find(correlation_id);
+        iter != outgoings_.end()) {
+      return &iter->second;
+    }
+    return Status{STATUS_NOT_FOUND};
+  }
+
+  void SetInvocationStatus(std::string status) override {
+    std::scoped_lock _(report_.lock);
+    report_.report.set_invocation_status(std::move(status));
+  }
+
+  void WriteReport(NoncontiguousBuffer* buffer) const override {
+    NoncontiguousBufferBuilder builder;
+    {
+      std::scoped_lock _(report_.lock);
+      WriteBinaryDryRunFrame(report_.report.SerializeAsString(), &builder);
+    }
+    *buffer = builder.DestructiveGet();
+  }
+
+ private:
+  BinaryDryRunIncomingCall incoming_;
+  std::unordered_map<std::string, BinaryDryRunOutgoingCall> outgoings_;
+  mutable Report report_;
+};
+
+}  // namespace
+
+DryRunner::ByteStreamParseStatus BinaryDryRunner::ParseByteStream(
+    NoncontiguousBuffer* buffer, std::unique_ptr<DryRunContext>* context) {
+  std::string payload;
+  if (auto rc = ReadBinaryDryRunFrame(buffer, &payload); rc != Success) {
+    return rc;
+  }
+  binary::Log log;
+  if (!log.ParseFromString(payload)) {
+    FLARE_LOG_WARNING_EVERY_SECOND("Failed to parse RPC log for dry-run.");
+    return Error;
+  }
+  *context = std::make_unique<BinaryDryRunContext>(log);
+  return Success;
+}
+
+void WriteBinaryDryRunFrame(std::string_view payload,
+                            NoncontiguousBufferBuilder* builder) {
+  FrameHeader header = {
+      .magic = FromBigEndian<std::uint32_t>(kFrameMagic),
+      .size = FromBigEndian<std::uint32_t>(payload.size())};
+  builder->Append(&header, sizeof(header));
+  builder->Append(payload.data(), payload.size());
+}
+
+DryRunner::ByteStreamParseStatus ReadBinaryDryRunFrame(
+    NoncontiguousBuffer* buffer, std::string* payload) {
+  FrameHeader header;
+  if (buffer->ByteSize() < sizeof(header)) {
+    return DryRunner::NeedMore;
+  }
+  FlattenToSlow(*buffer, &header, sizeof(header));
+  if (ToBigEndian<std::uint32_t>(header.magic) != kFrameMagic) {
+    FLARE_LOG_WARNING_EVERY_SECOND("Unexpected magic in dry-run request.");
+    return DryRunner::Error;
+  }
+  auto size = ToBigEndian<std::uint32_t>(header.size);
+  if (size > kMaxFrameSize) {
+    FLARE_LOG_WARNING_EVERY_SECOND("Dry-run request of {} bytes is too large.",
+                                   size);
+    return DryRunner::Error;
+  }
+  if (buffer->ByteSize() < sizeof(header) + size) {
+    return DryRunner::NeedMore;
+  }
+  buffer->Skip(sizeof(header));
+  *payload = FlattenSlow(*buffer, size);
+  buffer->Skip(size);
+  return DryRunner::Success;
+}
+
+FLARE_RPC_BINLOG_REGISTER_DRY_RUNNER("binary", [] {
+  return std::make_unique<BinaryDryRunner>();
+});
+
+}  // namespace flare::binlog
@@ -0,0 +1,52 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_BINLOG_BINARY_DRY_RUNNER_H_
+#define FLARE_RPC_BINLOG_BINARY_DRY_RUNNER_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "flare/base/buffer.h"
+#include "flare/rpc/binlog/dry_runner.h"
+
+namespace flare::binlog {
+
+// This dry-runner replays RPCs dumped by `BinaryDumper`.
+//
+// Request generator sends records read by `BinaryLogReader` (i.e., serialized
+// `binary::Log`) to the server, each in a frame. For each of them, a
+// serialized `binary::DryRunReport` is sent back, in the same framing.
+//
+// Frame: [u32 magic] [u32 payload size] [payload], integers in big-endian.
+class BinaryDryRunner : public DryRunner {
+ public:
+  ByteStreamParseStatus ParseByteStream(
+      NoncontiguousBuffer* buffer,
+      std::unique_ptr<DryRunContext>* context) override;
+};
+
+// Frames `payload` as described above.
+void WriteBinaryDryRunFrame(std::string_view payload,
+                            NoncontiguousBufferBuilder* builder);
+
+// Cuts a frame from `buffer`. `NeedMore` is returned if `buffer` does not
+// contain a complete frame yet.
+DryRunner::ByteStreamParseStatus ReadBinaryDryRunFrame(
+    NoncontiguousBuffer* buffer, std::string* payload);
+
+}  // namespace flare::binlog
+
+#endif  // FLARE_RPC_BINLOG_BINARY_DRY_RUNNER_H_
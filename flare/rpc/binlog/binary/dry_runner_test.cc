@@ -0,0 +1,103 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/dry_runner.h"
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/buffer.h"
+#include "flare/base/future.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/testing.h"
+#include "flare/testing/main.h"
+
+namespace flare::binlog {
+
+TEST(BinaryDryRunner, Frame) {
+  NoncontiguousBufferBuilder builder;
+  WriteBinaryDryRunFrame("hello", &builder);
+  WriteBinaryDryRunFrame("world", &builder);
+  auto buffer = builder.DestructiveGet();
+
+  std::string payload;
+  auto partial = CreateBufferSlow(FlattenSlow(buffer, 10));
+  EXPECT_EQ(DryRunner::NeedMore, ReadBinaryDryRunFrame(&partial, &payload));
+  EXPECT_EQ(10, partial.ByteSize());  // Left untouched.
+
+  ASSERT_EQ(DryRunner::Success, ReadBinaryDryRunFrame(&buffer, &payload));
+  EXPECT_EQ("hello", payload);
+  ASSERT_EQ(DryRunner::Success, ReadBinaryDryRunFrame(&buffer, &payload));
+  EXPECT_EQ("world", payload);
+  EXPECT_EQ(DryRunner::NeedMore, ReadBinaryDryRunFrame(&buffer, &payload));
+
+  auto garbage = CreateBufferSlow("GET / HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(DryRunner::Error, ReadBinaryDryRunFrame(&garbage, &payload));
+}
+
+TEST(BinaryDryRunner, All) {
+  binary::Log log;
+  auto&& incoming = *log.mutable_incoming_call();
+  incoming.set_correlation_id("incoming");
+  incoming.add_incoming_pkts()->set_system_context("incoming req");
+  auto&& outgoing = *log.add_outgoing_calls();
+  outgoing.set_correlation_id("outgoing");
+  outgoing.add_incoming_pkts()->set_system_context("outgoing resp");
+
+  NoncontiguousBufferBuilder builder;
+  WriteBinaryDryRunFrame(log.SerializeAsString(), &builder);
+  auto buffer = builder.DestructiveGet();
+
+  BinaryDryRunner runner;
+  std::unique_ptr<DryRunContext> ctx;
+  ASSERT_EQ(DryRunner::Success, runner.ParseByteStream(&buffer, &ctx));
+  EXPECT_TRUE(buffer.Empty());
+
+  auto&& incoming_call = ctx->GetIncomingCall();
+  EXPECT_EQ("incoming", incoming_call->GetCorrelationId());
+  ASSERT_EQ(1, incoming_call->GetIncomingPackets().size());
+  EXPECT_EQ("incoming req",
+            incoming_call->GetIncomingPackets()[0].system_ctx);
+
+  EXPECT_FALSE(ctx->TryGetOutgoingCall("not-existing"));
+  auto outgoing_call = ctx->TryGetOutgoingCall("outgoing");
+  ASSERT_TRUE(outgoing_call);
+  auto pkt = future::BlockingGet((*outgoing_call)->TryGetIncomingPacket(0));
+  ASSERT_TRUE(pkt);
+  EXPECT_EQ("outgoing resp", pkt->system_ctx);
+  EXPECT_FALSE(future::BlockingGet((*outgoing_call)->TryGetIncomingPacket(1)));
+
+  (*outgoing_call)->CaptureOutgoingPacket(TestingPacketDesc("outgoing req"));
+  incoming_call->CaptureOutgoingPacket(TestingPacketDesc("incoming resp"));
+  ctx->SetInvocationStatus("ok");
+
+  NoncontiguousBuffer report_bytes;
+  ctx->WriteReport(&report_bytes);
+  std::string payload;
+  ASSERT_EQ(DryRunner::Success, ReadBinaryDryRunFrame(&report_bytes, &payload));
+  binary::DryRunReport report;
+  ASSERT_TRUE(report.ParseFromString(payload));
+  EXPECT_EQ("ok", report.invocation_status());
+  ASSERT_EQ(1, report.responses_size());
+  EXPECT_EQ("incoming resp", report.responses(0));
+  ASSERT_EQ(1, report.outgoing_requests_size());
+  EXPECT_EQ("outgoing", report.outgoing_requests(0).correlation_id());
+  EXPECT_EQ("outgoing req", report.outgoing_requests(0).body());
+}
+
+}  // namespace flare::binlog
+
+FLARE_TEST_MAIN
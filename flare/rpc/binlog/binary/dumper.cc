@@ -0,0 +1,449 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/dumper.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gflags/gflags.h"
+
+#include "flare/base/align.h"
+#include "flare/base/chrono.h"
+#include "flare/base/compression.h"
+#include "flare/base/internal/time_keeper.h"
+#include "flare/base/logging.h"
+#include "flare/base/string.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/binary/format.h"
+#include "flare/rpc/binlog/util/proto_binlog.pb.h"
+
+using namespace std::literals;
+
+DEFINE_string(flare_binlog_binary_dumper_path_prefix, "../log/rpc_dump",
+              "Path prefix of segment files for dumping RPCs.");
+DEFINE_int32(flare_binlog_binary_dumper_segment_size, 256,
+             "Size of each segment file, in megabytes.");
+DEFINE_int32(flare_binlog_binary_dumper_block_size, 64,
+             "RPCs dumped are buffered per thread, and are written out once "
+             "the buffer reaches this size, in kilobytes.");
+DEFINE_int32(flare_binlog_binary_dumper_flush_interval, 1000,
+             "Interval between two flushes of per-thread buffers, in "
+             "milliseconds.");
+DEFINE_bool(flare_binlog_binary_dumper_compression, false,
+            "If set, blocks written to segment files are compressed by zstd.");
+
+namespace flare::binlog {
+
+namespace {
+
+template <class T>
+void MoveTags(DumpingCall::Tags* from, T* to) {
+  for (auto&& [k, v] : *from) {
+    (*to)[k] = std::move(v);
+  }
+}
+
+template <class T>
+void MovePackets(std::vector<DumpingPacket>* from, T* to) {
+  to->Reserve(from->size());
+  for (auto&& e : *from) {
+    auto&& pkt = to->Add();
+    pkt->set_time_since_start(e.time_since_start / 1ns);
+    pkt->set_provider_context(std::move(e.provider_context));
+    pkt->set_system_context(std::move(e.system_context));
+  }
+}
+
+// Fills `proto::Call` directly, no intermediate copy is made.
+class BinaryCall : public DumpingCall {
+ public:
+  explicit BinaryCall(proto::Call* call) : call_(call) {}
+
+  // Nothing is captured here. What's needed for performing dry-run has been
+  // saved by the framework as system context anyway.
+  void CaptureIncomingPacket(
+      const PacketDesc& packet, experimental::LazyEval<std::any>* dumper_ctx,
+      experimental::LazyEval<std::string>* prov_ctx) override {}
+  void CaptureOutgoingPacket(
+      const PacketDesc& packet, experimental::LazyEval<std::any>* dumper_ctx,
+      experimental::LazyEval<std::string>* prov_ctx) override {}
+
+  void SetCorrelationId(std::string cid) override {
+    call_->set_correlation_id(std::move(cid));
+  }
+  void SetTimestamps(std::chrono::steady_clock::time_point start_ts,
+                     std::chrono::steady_clock::time_point finish_ts) override {
+    start_ts_ = start_ts;
+    finish_ts_ = finish_ts;
+  }
+  void SetSystemTags(Tags tags) override {
+    MoveTags(&tags, call_->mutable_system_tags());
+  }
+  void SetUserTags(Tags tags) override {
+    MoveTags(&tags, call_->mutable_user_tags());
+  }
+  void SetLogs(std::vector<std::string> logs) override {
+    // Dropped. They're for debugging purpose only.
+  }
+  void SetSystemContext(std::string ctx) override {
+    call_->set_system_context(std::move(ctx));
+  }
+  void SetIncomingPackets(std::vector<DumpingPacket> pkts) override {
+    MovePackets(&pkts, call_->mutable_incoming_pkts());
+  }
+  void SetOutgoingPackets(std::vector<DumpingPacket> pkts) override {
+    MovePackets(&pkts, call_->mutable_outgoing_pkts());
+  }
+
+  std::chrono::steady_clock::time_point GetStartTimestamp() const noexcept {
+    return start_ts_;
+  }
+  std::chrono::steady_clock::time_point GetFinishTimestamp() const noexcept {
+    return finish_ts_;
+  }
+
+ private:
+  proto::Call* call_;
+  std::chrono::steady_clock::time_point start_ts_, finish_ts_;
+};
+
+class BinaryLog : public DumpingLog {
+ public:
+  explicit BinaryLog(BinaryDumper* dumper)
+      : dumper_(dumper), incoming_call_(log_.mutable_incoming_call()) {}
+
+  DumpingCall* GetIncomingCall() override { return &incoming_call_; }
+
+  DumpingCall* StartOutgoingCall() override {
+    std::scoped_lock _(lock_);
+    return &outgoing_calls_.emplace_back(log_.add_outgoing_calls());
+  }
+
+  void Dump() override {
+    auto start = incoming_call_.GetStartTimestamp();
+    if (start != std::chrono::steady_clock::time_point()) {
+      // Steady clock makes no sense outside of this process.
+      auto start_ts = ReadSystemClock() - (ReadSteadyClock() - start);
+      log_.set_start_timestamp(start_ts.time_since_epoch() / 1ns);
+      log_.set_duration((incoming_call_.GetFinishTimestamp() - start) / 1ns);
+    }
+    dumper_->Write(log_);
+  }
+
+ private:
+  BinaryDumper* dumper_;
+  binary::Log log_;
+  BinaryCall incoming_call_;
+  std::mutex lock_;
+  std::list<BinaryCall> outgoing_calls_;
+};
+
+}  // namespace
+
+struct BinaryDumper::Segment {
+  std::string path;
+  int fd = -1;
+  char* base = nullptr;
+  std::size_t size = 0;
+  std::atomic<std::size_t> used{0};
+
+  // Number of threads reserving or writing into this segment.
+  std::atomic<std::size_t> writers{0};
+  // Set once this segment is replaced by a new one.
+  std::atomic<bool> sealed{false};
+  std::atomic<bool> closed{true};  // Not opened yet.
+
+  ~Segment() { Close(); }
+
+  char* TryReserve(std::size_t bytes) {
+    auto offset = used.fetch_add(bytes, std::memory_order_relaxed);
+    return offset + bytes <= size ? base + offset : nullptr;
+  }
+
+  void Close() {
+    if (closed.exchange(true)) {
+      return;
+    }
+    // `used` can go beyond `size` due to failed reservations.
+    auto actual = std::min(used.load(std::memory_order_relaxed), size);
+    FLARE_PCHECK(munmap(base, size) == 0);
+    FLARE_PCHECK(ftruncate(fd, actual) == 0,
+                 "Failed to truncate segment file [{}].", path);
+    FLARE_PCHECK(close(fd) == 0);
+  }
+};
+
+struct alignas(hardware_destructive_interference_size)
+    BinaryDumper::ThreadBuffer {
+  BinaryDumper* dumper;
+  std::mutex lock;  // Contends with `Flush()` only.
+  std::string buffer;
+  std::unique_ptr<Compressor> compressor;
+
+  // Called on thread exit. We can't write the block here (compressor may
+  // touch thread-local variables), so leave it to `Flush()`.
+  ~ThreadBuffer() {
+    std::scoped_lock _(lock);
+    if (!buffer.empty()) {
+      std::scoped_lock __(dumper->orphans_lock_);
+      dumper->orphans_.push_back(std::move(buffer));
+    }
+  }
+};
+
+BinaryDumper::BinaryDumper(const Options& options)
+    : options_(options), buffers_([this] {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->dumper = this;
+        buffer->buffer.reserve(options_.block_size);
+        if (options_.compression) {
+          buffer->compressor = MakeCompressor("zstd");
+          FLARE_CHECK(buffer->compressor);
+        }
+        return buffer;
+      }) {
+  FLARE_CHECK_GT(options_.segment_size,
+                 sizeof(detail::BinaryLogFileHeader) +
+                     sizeof(detail::BinaryLogBlockHeader));
+  name_prefix_ = Format("{}.{}.{}", options_.path_prefix,
+                        ReadSystemClock().time_since_epoch() / 1s, getpid());
+  auto segment = OpenSegment();
+  FLARE_CHECK(segment, "Failed to open segment file for dumping RPCs.");
+  current_.store(segment.get(), std::memory_order_relaxed);
+  segments_.push_back(std::move(segment));
+
+  if (options_.flush_interval != 0ns) {
+    flush_timer_ = internal::TimeKeeper::Instance()->AddTimer(
+        ReadCoarseSteadyClock() + options_.flush_interval,
+        options_.flush_interval, [this](auto) { Flush(); }, true);
+  }
+}
+
+BinaryDumper::~BinaryDumper() {
+  if (flush_timer_) {
+    internal::TimeKeeper::Instance()->KillTimer(flush_timer_);
+  }
+  Flush();
+  // Segments are closed on destruction.
+}
+
+std::unique_ptr<DumpingLog> BinaryDumper::StartDumping() {
+  return std::make_unique<BinaryLog>(this);
+}
+
+void BinaryDumper::Write(const google::protobuf::MessageLite& record) {
+  auto size = record.ByteSizeLong();
+  if (FLARE_UNLIKELY(size + sizeof(std::uint32_t) +
+                         sizeof(detail::BinaryLogBlockHeader) +
+                         sizeof(detail::BinaryLogFileHeader) >
+                     std::min<std::size_t>(
+                         options_.segment_size,
+                         std::numeric_limits<std::uint32_t>::max()))) {
+    FLARE_LOG_ERROR_EVERY_SECOND(
+        "RPC log of {} bytes is too large to fit in a segment, dropped.", size);
+    return;
+  }
+
+  auto buffer = buffers_.Get();
+  std::scoped_lock _(buffer->lock);
+  auto&& bytes = buffer->buffer;
+  auto offset = bytes.size();
+  auto length = static_cast<std::uint32_t>(size);
+  bytes.resize(offset + sizeof(length) + size);
+  memcpy(bytes.data() + offset, &length, sizeof(length));
+  record.SerializeWithCachedSizesToArray(reinterpret_cast<std::uint8_t*>(
+      bytes.data() + offset + sizeof(length)));
+  if (bytes.size() >= options_.block_size) {
+    WriteBlock(&bytes, buffer->compressor.get());
+  }
+}
+
+void BinaryDumper::Flush() {
+  buffers_.ForEach([&](ThreadBuffer* buffer) {
+    std::scoped_lock _(buffer->lock);
+    WriteBlock(&buffer->buffer, buffer->compressor.get());
+  });
+
+  std::vector<std::string> orphans;
+  {
+    std::scoped_lock _(orphans_lock_);
+    orphans.swap(orphans_);
+  }
+  if (!orphans.empty()) {
+    auto compressor = options_.compression ? MakeCompressor("zstd") : nullptr;
+    for (auto&& e : orphans) {
+      WriteBlock(&e, compressor.get());
+    }
+  }
+}
+
+void BinaryDumper::WriteBlock(std::string* raw, Compressor* compressor) {
+  if (raw->empty()) {
+    return;
+  }
+
+  detail::BinaryLogBlockHeader header = {
+      .magic = detail::kBinaryLogBlockMagic,
+      .flags = 0,
+      .raw_size = static_cast<std::uint32_t>(raw->size()),
+      .stored_size = static_cast<std::uint32_t>(raw->size())};
+  std::optional<NoncontiguousBuffer> compressed;
+  if (compressor) {
+    compressed = Compress(compressor, *raw);
+    if (compressed && compressed->ByteSize() < raw->size()) {
+      header.flags |= detail::kBinaryLogBlockZstd;
+      header.stored_size = compressed->ByteSize();
+    } else {
+      compressed = std::nullopt;  // Store it as-is then.
+    }
+  }
+
+  char* ptr;
+  auto segment = ReserveSpace(sizeof(header) + header.stored_size, &ptr);
+  if (!segment) {
+    FLARE_LOG_ERROR_EVERY_SECOND(
+        "Failed to write {} bytes of RPC logs to segment file, dropped.",
+        raw->size());
+    raw->clear();
+    return;
+  }
+  memcpy(ptr, &header, sizeof(header));
+  ptr += sizeof(header);
+  if (compressed) {
+    for (auto&& e : *compressed) {
+      memcpy(ptr, e.data(), e.size());
+      ptr += e.size();
+    }
+  } else {
+    memcpy(ptr, raw->data(), raw->size());
+  }
+  LeaveSegment(segment);
+  raw->clear();
+}
+
+BinaryDumper::Segment* BinaryDumper::ReserveSpace(std::size_t bytes,
+                                                  char** ptr) {
+  if (bytes + sizeof(detail::BinaryLogFileHeader) > options_.segment_size) {
+    return nullptr;  // It never fits.
+  }
+  while (true) {
+    auto segment = current_.load(std::memory_order_acquire);
+
+    // Pairs with `Rotate`: Either we see `sealed` set, or the rotator sees us
+    // (and leaves closing the segment to us.).
+    segment->writers.fetch_add(1);
+    if (!segment->sealed.load()) {
+      if ((*ptr = segment->TryReserve(bytes))) {
+        return segment;
+      }
+    }
+    LeaveSegment(segment);
+    if (!Rotate(segment)) {
+      return nullptr;
+    }
+  }
+}
+
+void BinaryDumper::LeaveSegment(Segment* segment) {
+  if (segment->writers.fetch_sub(1) == 1 && segment->sealed.load()) {
+    segment->Close();  // We're the last one.
+  }
+}
+
+bool BinaryDumper::Rotate(Segment* full) {
+  std::scoped_lock _(rotation_lock_);
+  if (current_.load(std::memory_order_relaxed) != full) {
+    return true;  // Someone else has done it for us.
+  }
+  auto segment = OpenSegment();
+  if (!segment) {
+    return false;
+  }
+  current_.store(segment.get(), std::memory_order_release);
+  // Segments are kept alive until we're destroyed, as writers may still be
+  // holding pointers to them.
+  segments_.push_back(std::move(segment));
+  full->sealed.store(true);
+  if (full->writers.load() == 0) {
+    full->Close();
+  }
+  return true;
+}
+
+std::unique_ptr<BinaryDumper::Segment> BinaryDumper::OpenSegment() {
+  auto segment = std::make_unique<Segment>();
+  segment->path = Format("{}.{:06}", name_prefix_, next_seq_++);
+  segment->size = options_.segment_size;
+
+  int fd = open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    FLARE_LOG_ERROR("Failed to open [{}] for dumping RPCs: {}", segment->path,
+                    strerror(errno));
+    return nullptr;
+  }
+  // Allocate disk space beforehand, so that we won't get a `SIGBUS` when
+  // writing to the mapping if the disk is full.
+  if (auto rc = posix_fallocate(fd, 0, segment->size); rc != 0) {
+    FLARE_LOG_ERROR("Failed to allocate {} bytes for [{}]: {}", segment->size,
+                    segment->path, strerror(rc));
+    FLARE_PCHECK(close(fd) == 0);
+    return nullptr;
+  }
+  auto ptr = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  if (ptr == MAP_FAILED) {
+    FLARE_LOG_ERROR("Failed to map [{}] into memory: {}", segment->path,
+                    strerror(errno));
+    FLARE_PCHECK(close(fd) == 0);
+    return nullptr;
+  }
+
+  detail::BinaryLogFileHeader header = {.version = detail::kBinaryLogVersion};
+  memcpy(header.magic, detail::kBinaryLogFileMagic, sizeof(header.magic));
+  memcpy(ptr, &header, sizeof(header));
+
+  segment->fd = fd;
+  segment->base = reinterpret_cast<char*>(ptr);
+  segment->used.store(sizeof(header), std::memory_order_relaxed);
+  segment->closed.store(false, std::memory_order_relaxed);
+  return segment;
+}
+
+FLARE_RPC_BINLOG_REGISTER_DUMPER("binary", [] {
+  return std::make_unique<BinaryDumper>(BinaryDumper::Options{
+      .path_prefix = FLAGS_flare_binlog_binary_dumper_path_prefix,
+      .segment_size = static_cast<std::size_t>(
+                          FLAGS_flare_binlog_binary_dumper_segment_size) *
+                      1024 * 1024,
+      .block_size =
+          static_cast<std::size_t>(FLAGS_flare_binlog_binary_dumper_block_size) *
+          1024,
+      .flush_interval = FLAGS_flare_binlog_binary_dumper_flush_interval * 1ms,
+      .compression = FLAGS_flare_binlog_binary_dumper_compression});
+});
+
+}  // namespace flare::binlog
@@ -0,0 +1,122 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_BINLOG_BINARY_DUMPER_H_
+#define FLARE_RPC_BINLOG_BINARY_DUMPER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "flare/base/compression.h"
+#include "flare/base/thread/thread_local.h"
+#include "flare/rpc/binlog/dumper.h"
+
+namespace google::protobuf {
+
+class MessageLite;
+
+}  // namespace google::protobuf
+
+namespace flare::binlog {
+
+// This dumper appends RPCs, in binary form, to segment files. It's designed
+// to capture all (or at least, a large portion) of traffic for a while, e.g.,
+// during an incident.
+//
+// Serialized logs are buffered per thread and written in blocks (optionally
+// compressed by zstd) to pre-allocated segment files mapped into memory. Space
+// in the current segment is reserved atomically, so no lock is grabbed in
+// writing blocks, except for when a new segment is opened.
+//
+// Segment files can be read by `BinaryLogReader` (@sa: `reader.h`), and be
+// replayed by `BinaryDryRunner` (@sa: `dry_runner.h`).
+class BinaryDumper : public Dumper {
+ public:
+  struct Options {
+    // Segments are named as `{path_prefix}.{timestamp}.{pid}.{seq}`.
+    std::string path_prefix;
+
+    // Size of each segment file. Segments are truncated to the size actually
+    // used once they're closed.
+    std::size_t segment_size = 256 * 1024 * 1024;
+
+    // Per-thread buffer is written out once it reaches this size.
+    std::size_t block_size = 64 * 1024;
+
+    // Per-thread buffers are written out periodically regardless of their
+    // size. Zero disables this behavior, in this case you need to call
+    // `Flush()` yourself.
+    std::chrono::nanoseconds flush_interval = std::chrono::seconds(1);
+
+    // Compress blocks with zstd.
+    bool compression = false;
+  };
+
+  explicit BinaryDumper(const Options& options);
+  ~BinaryDumper();
+
+  std::unique_ptr<DumpingLog> StartDumping() override;
+
+  // Appends `record` to the per-thread buffer.
+  void Write(const google::protobuf::MessageLite& record);
+
+  // Writes out all buffered records.
+  void Flush();
+
+ private:
+  struct Segment;
+  struct ThreadBuffer;
+
+  // Writes records in `raw` out as a block, and clears `raw`.
+  void WriteBlock(std::string* raw, Compressor* compressor);
+
+  // Reserves `bytes` bytes in current segment. The caller is responsible for
+  // calling `LeaveSegment` once it has finished writing into the space
+  // reserved.
+  //
+  // `nullptr` is returned on failure.
+  Segment* ReserveSpace(std::size_t bytes, char** ptr);
+  void LeaveSegment(Segment* segment);
+
+  // Replaces `full` with a new segment (unless someone else has done it).
+  bool Rotate(Segment* full);
+  std::unique_ptr<Segment> OpenSegment();
+
+ private:
+  Options options_;
+  std::string name_prefix_;
+  std::uint64_t flush_timer_ = 0;
+  std::atomic<Segment*> current_{};
+
+  std::mutex rotation_lock_;
+  std::size_t next_seq_ = 0;
+  std::vector<std::unique_ptr<Segment>> segments_;
+
+  // Records left by exited threads, written out on next `Flush()`.
+  std::mutex orphans_lock_;
+  std::vector<std::string> orphans_;
+
+  // Declared last, so that it's destroyed before everything else.
+  ThreadLocal<ThreadBuffer> buffers_;
+};
+
+}  // namespace flare::binlog
+
+#endif  // FLARE_RPC_BINLOG_BINARY_DUMPER_H_
@@ -0,0 +1,162 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/dumper.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/string.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/binary/reader.h"
+#include "flare/rpc/binlog/tags.h"
+#include "flare/rpc/binlog/testing.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare::binlog {
+
+namespace {
+
+void DumpLog(BinaryDumper* dumper, const std::string& body) {
+  auto log = dumper->StartDumping();
+  auto&& outgoing = log->StartOutgoingCall();
+  outgoing->SetCorrelationId("outgoing-" + body);
+  outgoing->SetSystemTags({{tags::kOperationName, "outgoing method"}});
+  outgoing->SetOutgoingPackets({NewOutgoingPacket(
+      outgoing, TestingPacketDesc("outgoing_req"), "outgoing-req-ctx")});
+
+  auto&& incoming = log->GetIncomingCall();
+  auto now = ReadSteadyClock();
+  incoming->SetCorrelationId(body);
+  incoming->SetTimestamps(now - 10ms, now);
+  incoming->SetSystemTags({{tags::kOperationName, "incoming method"}});
+  incoming->SetUserTags({{"user", "tag"}});
+  incoming->SetLogs({"some log"});
+  incoming->SetIncomingPackets({NewIncomingPacket(
+      incoming, TestingPacketDesc("incoming_req"), "incoming-req-" + body)});
+  incoming->SetSystemContext("sys-ctx");
+  log->Dump();
+}
+
+std::vector<binary::Log> ReadAll(const std::string& prefix) {
+  std::vector<binary::Log> logs;
+  for (auto&& e : ListBinaryLogSegments(prefix)) {
+    BinaryLogReader reader;
+    EXPECT_TRUE(reader.Open(e));
+    std::string_view record;
+    while (reader.Read(&record)) {
+      EXPECT_TRUE(logs.emplace_back().ParseFromArray(record.data(),
+                                                     record.size()));
+    }
+  }
+  return logs;
+}
+
+void RemoveAll(const std::string& prefix) {
+  for (auto&& e : ListBinaryLogSegments(prefix)) {
+    unlink(e.c_str());
+  }
+}
+
+void TestDumpAndRead(bool compression) {
+  static constexpr auto kThreads = 8;
+  static constexpr auto kLogsPerThread = 1000;
+  const std::string kPrefix = Format("./binary_dump_{}", compression);
+
+  RemoveAll(kPrefix);
+  {
+    BinaryDumper dumper(BinaryDumper::Options{.path_prefix = kPrefix,
+                                              .segment_size = 64 * 1024,
+                                              .block_size = 1024,
+                                              .flush_interval = 0ns,
+                                              .compression = compression});
+    std::vector<std::thread> ts;
+    for (int i = 0; i != kThreads; ++i) {
+      ts.emplace_back([&, i] {
+        for (int j = 0; j != kLogsPerThread; ++j) {
+          DumpLog(&dumper, Format("{}-{}", i, j));
+        }
+      });
+    }
+    for (auto&& t : ts) {
+      t.join();
+    }
+  }  // Everything is flushed on destruction.
+
+  // Segments should have been rotated.
+  EXPECT_GT(ListBinaryLogSegments(kPrefix).size(), 1);
+
+  auto logs = ReadAll(kPrefix);
+  ASSERT_EQ(kThreads * kLogsPerThread, logs.size());
+  std::unordered_set<std::string> cids;
+  for (auto&& e : logs) {
+    auto&& incoming = e.incoming_call();
+    cids.insert(incoming.correlation_id());
+    EXPECT_EQ("incoming method",
+              incoming.system_tags().at(tags::kOperationName));
+    EXPECT_EQ("tag", incoming.user_tags().at("user"));
+    EXPECT_EQ(0, incoming.logs_size());  // Dropped.
+    ASSERT_EQ(1, incoming.incoming_pkts_size());
+    EXPECT_EQ("incoming-req-" + incoming.correlation_id(),
+              incoming.incoming_pkts(0).system_context());
+    EXPECT_EQ("sys-ctx", incoming.system_context());
+    EXPECT_EQ(10ms / 1ns, e.duration());
+    EXPECT_NEAR(ReadSystemClock().time_since_epoch() / 1s,
+                e.start_timestamp() * 1ns / 1s, 60);
+
+    ASSERT_EQ(1, e.outgoing_calls_size());
+    EXPECT_EQ("outgoing-" + incoming.correlation_id(),
+              e.outgoing_calls(0).correlation_id());
+    EXPECT_EQ("outgoing-req-ctx",
+              e.outgoing_calls(0).outgoing_pkts(0).system_context());
+  }
+  EXPECT_EQ(kThreads * kLogsPerThread, cids.size());
+  RemoveAll(kPrefix);
+}
+
+}  // namespace
+
+TEST(BinaryDumper, Plain) { TestDumpAndRead(false); }
+
+TEST(BinaryDumper, Compressed) { TestDumpAndRead(true); }
+
+TEST(BinaryDumper, Flush) {
+  const std::string kPrefix = "./binary_dump_flush";
+
+  RemoveAll(kPrefix);
+  BinaryDumper dumper(BinaryDumper::Options{.path_prefix = kPrefix,
+                                            .segment_size = 1024 * 1024,
+                                            .flush_interval = 0ns});
+  DumpLog(&dumper, "1");
+  // Segment files are left with zeros at the end until they're closed.
+  EXPECT_EQ(0, ReadAll(kPrefix).size());
+  dumper.Flush();
+  auto logs = ReadAll(kPrefix);
+  ASSERT_EQ(1, logs.size());
+  EXPECT_EQ("1", logs[0].incoming_call().correlation_id());
+  RemoveAll(kPrefix);
+}
+
+}  // namespace flare::binlog
+
+FLARE_TEST_MAIN
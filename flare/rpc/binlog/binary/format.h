@@ -0,0 +1,60 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_BINLOG_BINARY_FORMAT_H_
+#define FLARE_RPC_BINLOG_BINARY_FORMAT_H_
+
+#include <cstdint>
+
+// Layout of segment files written by `BinaryDumper`. Integers are stored in
+// native byte order (i.e., little-endian on all platforms we support).
+//
+// Segment:  [FileHeader] [Block] [Block] ... [Zeros, if not fully used]
+// Block:    [BlockHeader] [Payload, possibly compressed]
+// Payload:  [u32 size] [Record] [u32 size] [Record] ...
+//
+// Each record is a serialized `binary::Log`. A block header whose `magic` does
+// not match `kBinaryLogBlockMagic` (normally zero) marks end of the segment.
+//
+// NOT INTENDED FOR PUBLIC USE.
+
+namespace flare::binlog::detail {
+
+inline constexpr char kBinaryLogFileMagic[8] = {'F', 'L', 'A', 'R',
+                                                'E', 'B', 'L', 'G'};
+inline constexpr std::uint32_t kBinaryLogVersion = 1;
+inline constexpr std::uint32_t kBinaryLogBlockMagic = 0x4b4c4246;  // "FBLK"
+
+// Flags in `BinaryLogBlockHeader::flags`.
+inline constexpr std::uint32_t kBinaryLogBlockZstd = 1;
+
+struct BinaryLogFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t reserved;
+};
+
+struct BinaryLogBlockHeader {
+  std::uint32_t magic;
+  std::uint32_t flags;
+  std::uint32_t raw_size;     // Size of payload after decompression.
+  std::uint32_t stored_size;  // Size of payload in the segment.
+};
+
+static_assert(sizeof(BinaryLogFileHeader) == 16);
+static_assert(sizeof(BinaryLogBlockHeader) == 16);
+
+}  // namespace flare::binlog::detail
+
+#endif  // FLARE_RPC_BINLOG_BINARY_FORMAT_H_
@@ -0,0 +1,158 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/reader.h"
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "flare/base/logging.h"
+#include "flare/rpc/binlog/binary/format.h"
+
+namespace flare::binlog {
+
+BinaryLogReader::~BinaryLogReader() { Close(); }
+
+bool BinaryLogReader::Open(const std::string& path) {
+  Close();
+  path_ = path;
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    FLARE_LOG_WARNING("Failed to open [{}]: {}", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  FLARE_PCHECK(fstat(fd, &st) == 0);
+  if (st.st_size < 0 || static_cast<std::size_t>(st.st_size) <
+                            sizeof(detail::BinaryLogFileHeader)) {
+    FLARE_LOG_WARNING("[{}] is not a segment file.", path);
+    FLARE_PCHECK(close(fd) == 0);
+    return false;
+  }
+  auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  FLARE_PCHECK(close(fd) == 0);  // The mapping is still valid.
+  if (ptr == MAP_FAILED) {
+    FLARE_LOG_WARNING("Failed to map [{}] into memory: {}", path,
+                      strerror(errno));
+    return false;
+  }
+  base_ = reinterpret_cast<const char*>(ptr);
+  size_ = st.st_size;
+
+  detail::BinaryLogFileHeader header;
+  memcpy(&header, base_, sizeof(header));
+  if (memcmp(header.magic, detail::kBinaryLogFileMagic, sizeof(header.magic)) ||
+      header.version != detail::kBinaryLogVersion) {
+    FLARE_LOG_WARNING("[{}] is not a segment file, or its version is not "
+                      "supported.",
+                      path);
+    Close();
+    return false;
+  }
+  offset_ = sizeof(header);
+  return true;
+}
+
+bool BinaryLogReader::Read(std::string_view* record) {
+  std::uint32_t length;
+  while (block_.size() < sizeof(length)) {
+    if (!block_.empty()) {
+      FLARE_LOG_WARNING("Unexpected trailing bytes in block of [{}].", path_);
+    }
+    if (!ReadBlock()) {
+      return false;
+    }
+  }
+  memcpy(&length, block_.data(), sizeof(length));
+  if (block_.size() - sizeof(length) < length) {
+    FLARE_LOG_WARNING("Record in [{}] is truncated.", path_);
+    block_ = {};
+    return false;
+  }
+  *record = block_.substr(sizeof(length), length);
+  block_.remove_prefix(sizeof(length) + length);
+  return true;
+}
+
+bool BinaryLogReader::ReadBlock() {
+  detail::BinaryLogBlockHeader header;
+  if (!base_ || size_ - offset_ < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, base_ + offset_, sizeof(header));
+  if (header.magic != detail::kBinaryLogBlockMagic) {
+    return false;  // End of segment.
+  }
+  if (size_ - offset_ - sizeof(header) < header.stored_size) {
+    FLARE_LOG_WARNING("Block at offset {} of [{}] is truncated.", offset_,
+                      path_);
+    return false;
+  }
+  std::string_view stored(base_ + offset_ + sizeof(header),
+                          header.stored_size);
+  offset_ += sizeof(header) + header.stored_size;
+
+  if (header.flags & detail::kBinaryLogBlockZstd) {
+    if (!decompressor_) {
+      decompressor_ = MakeDecompressor("zstd");
+      FLARE_CHECK(decompressor_);
+    }
+    auto decompressed = Decompress(decompressor_.get(), stored);
+    if (!decompressed || decompressed->ByteSize() != header.raw_size) {
+      FLARE_LOG_WARNING("Failed to decompress block at offset {} of [{}].",
+                        offset_ - sizeof(header) - header.stored_size, path_);
+      return false;
+    }
+    decompressed_ = FlattenSlow(*decompressed);
+    block_ = decompressed_;
+  } else {
+    block_ = stored;
+  }
+  return true;
+}
+
+void BinaryLogReader::Close() {
+  if (base_) {
+    FLARE_PCHECK(munmap(const_cast<char*>(base_), size_) == 0);
+  }
+  base_ = nullptr;
+  size_ = offset_ = 0;
+  block_ = {};
+}
+
+std::vector<std::string> ListBinaryLogSegments(const std::string& path_prefix) {
+  // @sa: `BinaryDumper::OpenSegment` for naming of segment files.
+  auto pattern = path_prefix + ".[0-9]*.[0-9]*.[0-9]*";
+  glob_t result = {};
+  std::vector<std::string> segments;
+  if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+    for (std::size_t i = 0; i != result.gl_pathc; ++i) {
+      segments.emplace_back(result.gl_pathv[i]);
+    }
+  }
+  globfree(&result);  // Results are already sorted by `glob`.
+  return segments;
+}
+
+}  // namespace flare::binlog
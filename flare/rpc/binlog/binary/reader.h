@@ -0,0 +1,71 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_BINLOG_BINARY_READER_H_
+#define FLARE_RPC_BINLOG_BINARY_READER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flare/base/compression.h"
+
+namespace flare::binlog {
+
+// Reads records from a segment file written by `BinaryDumper`.
+//
+// Each record is a serialized `binary::Log`.
+class BinaryLogReader {
+ public:
+  BinaryLogReader() = default;
+  ~BinaryLogReader();
+
+  // Returns `false` if `path` cannot be opened, or it's not a segment file.
+  bool Open(const std::string& path);
+
+  // Reads next record. `false` is returned on end of segment, or if the rest
+  // of the segment is corrupted.
+  //
+  // The resulting view is valid until next call to `Read`.
+  bool Read(std::string_view* record);
+
+  // Noncopyable, nonmovable.
+  BinaryLogReader(const BinaryLogReader&) = delete;
+  BinaryLogReader& operator=(const BinaryLogReader&) = delete;
+
+ private:
+  bool ReadBlock();
+  void Close();
+
+ private:
+  std::string path_;
+  const char* base_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t offset_ = 0;  // Offset in segment of next block.
+
+  // Current block.
+  std::string_view block_;
+  std::string decompressed_;
+  std::unique_ptr<Decompressor> decompressor_;
+};
+
+// Lists segment files written by `BinaryDumper` with `path_prefix`, sorted in
+// the order they were written.
+std::vector<std::string> ListBinaryLogSegments(const std::string& path_prefix);
+
+}  // namespace flare::binlog
+
+#endif  // FLARE_RPC_BINLOG_BINARY_READER_H_
@@ -0,0 +1,103 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+// Replays traffic recorded by `BinaryDumper` as load against a server running
+// with `--flare_binlog_dry_runner=binary`.
+//
+// E.g.: ./replay --path_prefix=../log/rpc_dump --target=127.0.0.1:5567
+//                --speed_percent=200 --concurrency=64 --report=report.json
+
+#include <fstream>
+
+#include "gflags/gflags.h"
+#include "jsoncpp/json.h"
+
+#include "flare/base/net/endpoint.h"
+#include "flare/base/string.h"
+#include "flare/init.h"
+#include "flare/init/override_flag.h"
+#include "flare/rpc/binlog/binary/reader.h"
+#include "flare/rpc/binlog/binary/replayer.h"
+
+using namespace std::literals;
+
+DEFINE_string(path_prefix, "",
+              "Path prefix of segment files to replay, the same as "
+              "`--flare_binlog_binary_dumper_path_prefix` used in recording.");
+DEFINE_string(target, "", "IP:port of the server to replay calls against.");
+DEFINE_int32(concurrency, 16, "Maximum number of outstanding calls.");
+DEFINE_int32(speed_percent, 100,
+             "Playback speed, in percentage of the original rate. Set it to 0 "
+             "to replay calls as fast as possible.");
+DEFINE_int32(timeout, 1000, "Timeout for each call, in milliseconds.");
+DEFINE_int32(reorder_window, 5000,
+             "Records are reordered by their start time within this window, "
+             "in milliseconds.");
+DEFINE_int64(max_calls, 0, "If non-zero, stop after so many calls.");
+DEFINE_string(report, "",
+              "If non-empty, the report (in JSON) is also written to this "
+              "file, for comparison with other runs.");
+
+FLARE_OVERRIDE_FLAG(logtostderr, true);
+
+namespace flare::binlog {
+
+int Entry(int, char**) {
+  auto target = TryParse<Endpoint>(FLAGS_target);
+  if (!target) {
+    FLARE_LOG_ERROR("Invalid target [{}].", FLAGS_target);
+    return 1;
+  }
+  auto segments = ListBinaryLogSegments(FLAGS_path_prefix);
+  if (segments.empty()) {
+    FLARE_LOG_ERROR("No segment is found with prefix [{}].",
+                    FLAGS_path_prefix);
+    return 1;
+  }
+  FLARE_LOG_INFO("Replaying {} segment(s) against [{}].", segments.size(),
+                 target->ToString());
+
+  BinaryLogReplayer::Options opts;
+  opts.target = *target;
+  opts.segments = std::move(segments);
+  opts.concurrency = FLAGS_concurrency;
+  opts.speed = FLAGS_speed_percent / 100.0;
+  opts.timeout = FLAGS_timeout * 1ms;
+  opts.reorder_window = FLAGS_reorder_window * 1ms;
+  opts.max_calls = FLAGS_max_calls;
+  BinaryLogReplayer replayer(std::move(opts));
+  auto report = replayer.Run();
+
+  auto jsv = report.ToJson();
+  jsv["options"]["speed_percent"] = FLAGS_speed_percent;
+  jsv["options"]["concurrency"] = FLAGS_concurrency;
+  jsv["options"]["timeout_ms"] = FLAGS_timeout;
+  auto str = jsv.toStyledString();
+  FLARE_LOG_INFO("Replay completed:\n{}", str);
+  if (!FLAGS_report.empty()) {
+    std::ofstream ofs(FLAGS_report);
+    ofs << str;
+    if (!ofs) {
+      FLARE_LOG_ERROR("Failed to write report to [{}].", FLAGS_report);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace flare::binlog
+
+int main(int argc, char** argv) {
+  return flare::Start(argc, argv, flare::binlog::Entry);
+}
@@ -0,0 +1,425 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/replayer.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <tuple>
+#include <utility>
+
+#include "flare/base/buffer.h"
+#include "flare/base/chrono.h"
+#include "flare/base/logging.h"
+#include "flare/base/ref_ptr.h"
+#include "flare/fiber/fiber.h"
+#include "flare/fiber/runtime.h"
+#include "flare/fiber/this_fiber.h"
+#include "flare/io/event_loop.h"
+#include "flare/io/native/stream_connection.h"
+#include "flare/io/util/socket.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/binary/dry_runner.h"
+#include "flare/rpc/binlog/binary/reader.h"
+
+using namespace std::literals;
+
+namespace flare::binlog {
+
+namespace {
+
+// Upper bound of `binary::DryRunReport` we accept.
+constexpr auto kMaximumReportSize = 64 * 1024 * 1024;
+
+BinaryLogReplayer::Percentiles ComputePercentiles(
+    std::vector<std::chrono::nanoseconds>* samples) {
+  BinaryLogReplayer::Percentiles result;
+  if (samples->empty()) {
+    return result;
+  }
+  std::sort(samples->begin(), samples->end());
+  auto at = [&](std::size_t n, std::size_t of) {
+    return (*samples)[std::min(samples->size() * n / of, samples->size() - 1)];
+  };
+  std::chrono::nanoseconds sum{};
+  for (auto&& e : *samples) {
+    sum += e;
+  }
+  result.avg = sum / samples->size();
+  result.p50 = at(50, 100);
+  result.p90 = at(90, 100);
+  result.p99 = at(99, 100);
+  result.p999 = at(999, 1000);
+  result.max = samples->back();
+  return result;
+}
+
+Json::Value PercentilesToJson(const BinaryLogReplayer::Percentiles& p) {
+  Json::Value jsv;
+  jsv["avg"] = static_cast<Json::UInt64>(p.avg / 1us);
+  jsv["p50"] = static_cast<Json::UInt64>(p.p50 / 1us);
+  jsv["p90"] = static_cast<Json::UInt64>(p.p90 / 1us);
+  jsv["p99"] = static_cast<Json::UInt64>(p.p99 / 1us);
+  jsv["p999"] = static_cast<Json::UInt64>(p.p999 / 1us);
+  jsv["max"] = static_cast<Json::UInt64>(p.max / 1us);
+  return jsv;
+}
+
+}  // namespace
+
+// A connection to the server. It carries at most one call at a time, as
+// reports sent back by `BinaryDryRunner` carry nothing to identify the calls
+// they belong to.
+class BinaryLogReplayer::Connection : public StreamConnectionHandler {
+ public:
+  enum class Result { Succeeded, TimedOut, Failed };
+
+  ~Connection() {
+    if (conn_) {
+      conn_->Stop();
+      conn_->Join();
+    }
+  }
+
+  bool Connect(const Endpoint& ep) {
+    auto fd = io::util::CreateStreamSocket(ep.Family());
+    if (!fd) {
+      FLARE_LOG_ERROR_EVERY_SECOND("Failed to create socket with AF {}.",
+                                   ep.Family());
+      return false;
+    }
+    io::util::SetCloseOnExec(fd.Get());
+    io::util::SetNonBlocking(fd.Get());
+    io::util::SetTcpNoDelay(fd.Get());
+    if (!io::util::StartConnect(fd.Get(), ep)) {
+      FLARE_LOG_WARNING_EVERY_SECOND("Failed to connect to [{}].",
+                                     ep.ToString());
+      return false;
+    }
+
+    NativeStreamConnection::Options opts;
+    opts.handler =
+        MaybeOwning(non_owning, static_cast<StreamConnectionHandler*>(this));
+    opts.read_buffer_size = kMaximumReportSize;
+    conn_ =
+        MakeRefCounted<NativeStreamConnection>(std::move(fd), std::move(opts));
+    auto event_loop = GetGlobalEventLoop(
+        fiber::GetCurrentSchedulingGroupIndex(), conn_->fd());
+    event_loop->AttachDescriptor(conn_.Get(), false);
+    event_loop->EnableDescriptor(conn_.Get());
+    conn_->StartHandshaking();
+    return true;
+  }
+
+  // Sends `frame` and waits for the report.
+  //
+  // Unless `Succeeded` is returned, the connection should not be used any
+  // more, as a late report would otherwise be mistaken for the next call's.
+  Result Call(NoncontiguousBuffer frame,
+              std::chrono::steady_clock::time_point expires_at,
+              std::string* report) {
+    if (!conn_ || !conn_->Write(std::move(frame), 0)) {
+      return Result::Failed;
+    }
+    std::unique_lock lk(lock_);
+    if (!cv_.wait_until(lk, expires_at,
+                        [&] { return report_.has_value() || broken_; })) {
+      return Result::TimedOut;
+    }
+    if (!report_) {
+      return Result::Failed;
+    }
+    *report = std::move(*report_);
+    report_ = std::nullopt;
+    return Result::Succeeded;
+  }
+
+  void OnAttach(StreamConnection* conn) override {}
+  void OnDetach() override {}
+  void OnWriteBufferEmpty() override {}
+  void OnDataWritten(std::uintptr_t ctx) override {}
+
+  DataConsumptionStatus OnDataArrival(NoncontiguousBuffer* buffer) override {
+    while (true) {
+      std::string payload;
+      auto status = ReadBinaryDryRunFrame(buffer, &payload);
+      if (status == DryRunner::ByteStreamParseStatus::NeedMore) {
+        return DataConsumptionStatus::Ready;
+      } else if (status == DryRunner::ByteStreamParseStatus::Error) {
+        return DataConsumptionStatus::Error;
+      }
+      std::scoped_lock _(lock_);
+      report_ = std::move(payload);
+      cv_.notify_one();
+    }
+  }
+
+  void OnClose() override { SetBroken(); }
+  void OnError() override { SetBroken(); }
+
+ private:
+  void SetBroken() {
+    std::scoped_lock _(lock_);
+    broken_ = true;
+    cv_.notify_one();
+  }
+
+ private:
+  RefPtr<NativeStreamConnection> conn_;
+
+  fiber::Mutex lock_;
+  fiber::ConditionVariable cv_;
+  bool broken_ = false;
+  std::optional<std::string> report_;
+};
+
+// Reads records from segments, ordered by the time they were started.
+class BinaryLogReplayer::Schedule {
+ public:
+  Schedule(const std::vector<std::string>& segments,
+           std::chrono::nanoseconds reorder_window)
+      : segments_(segments), reorder_window_(reorder_window / 1ns) {}
+
+  // Returns `false` once all records have been read.
+  bool Next(std::uint64_t* timestamp, std::string* record) {
+    // Fill the window up.
+    while (pending_.empty() ||
+           newest_ - pending_.top().timestamp < reorder_window_) {
+      std::string_view bytes;
+      if (!ReadOne(&bytes)) {
+        break;
+      }
+      if (!log_.ParseFromArray(bytes.data(), bytes.size())) {
+        FLARE_LOG_WARNING_EVERY_SECOND("Failed to parse record in [{}].",
+                                       segments_[current_]);
+        continue;
+      }
+      newest_ = std::max<std::uint64_t>(newest_, log_.start_timestamp());
+      pending_.push(Pending{.timestamp = log_.start_timestamp(),
+                            .seq = seq_++,
+                            .record = std::string(bytes)});
+    }
+    if (pending_.empty()) {
+      return false;
+    }
+    // `std::priority_queue::top` returns a const reference, we can't move
+    // from it.
+    auto&& top = const_cast<Pending&>(pending_.top());
+    *timestamp = top.timestamp;
+    *record = std::move(top.record);
+    pending_.pop();
+    return true;
+  }
+
+ private:
+  struct Pending {
+    std::uint64_t timestamp;
+    std::uint64_t seq;  // Keeps records with the same timestamp in order.
+    std::string record;
+
+    bool operator>(const Pending& other) const noexcept {
+      return std::tie(timestamp, seq) > std::tie(other.timestamp, other.seq);
+    }
+  };
+
+  bool ReadOne(std::string_view* record) {
+    while (true) {
+      if (reader_ && reader_->Read(record)) {
+        return true;
+      }
+      if (next_ == segments_.size()) {
+        return false;
+      }
+      current_ = next_++;
+      reader_ = std::make_unique<BinaryLogReader>();
+      if (!reader_->Open(segments_[current_])) {
+        FLARE_LOG_WARNING("Failed to open segment [{}], skipped.",
+                          segments_[current_]);
+        reader_ = nullptr;
+      }
+    }
+  }
+
+ private:
+  const std::vector<std::string>& segments_;
+  std::uint64_t reorder_window_;
+
+  std::size_t current_ = 0, next_ = 0;
+  std::unique_ptr<BinaryLogReader> reader_;
+  binary::Log log_;
+
+  std::uint64_t seq_ = 0;
+  std::uint64_t newest_ = 0;
+  std::priority_queue<Pending, std::vector<Pending>, std::greater<>> pending_;
+};
+
+double BinaryLogReplayer::Report::GetThroughput() const noexcept {
+  if (elapsed == 0ns) {
+    return 0;
+  }
+  return static_cast<double>(calls) / (elapsed / 1ns) * (1s / 1ns);
+}
+
+Json::Value BinaryLogReplayer::Report::ToJson() const {
+  Json::Value jsv;
+  jsv["calls"] = static_cast<Json::UInt64>(calls);
+  jsv["succeeded"] = static_cast<Json::UInt64>(succeeded);
+  jsv["timed_out"] = static_cast<Json::UInt64>(timed_out);
+  jsv["failed"] = static_cast<Json::UInt64>(failed);
+  for (auto&& [k, v] : invocation_statuses) {
+    jsv["invocation_statuses"][k] = static_cast<Json::UInt64>(v);
+  }
+  jsv["elapsed_ms"] = static_cast<Json::UInt64>(elapsed / 1ms);
+  jsv["recorded_ms"] = static_cast<Json::UInt64>(recorded / 1ms);
+  jsv["throughput"] = GetThroughput();
+  jsv["latency_us"] = PercentilesToJson(latency);
+  jsv["lag_us"] = PercentilesToJson(lag);
+  return jsv;
+}
+
+BinaryLogReplayer::BinaryLogReplayer(Options options)
+    : options_(std::move(options)) {
+  FLARE_CHECK_GT(options_.concurrency, 0);
+  FLARE_CHECK_GE(options_.speed, 0);
+}
+
+BinaryLogReplayer::~BinaryLogReplayer() = default;
+
+BinaryLogReplayer::Report BinaryLogReplayer::Run() {
+  for (std::size_t i = 0; i != options_.concurrency; ++i) {
+    idle_conns_.push_back(OpenConnection());
+  }
+
+  Schedule schedule(options_.segments, options_.reorder_window);
+  std::uint64_t timestamp;
+  std::string record;
+  std::optional<std::uint64_t> first_timestamp;
+  std::uint64_t last_timestamp = 0;
+  std::size_t issued = 0;
+  auto start = ReadSteadyClock();
+
+  while ((!options_.max_calls || issued != options_.max_calls) &&
+         schedule.Next(&timestamp, &record)) {
+    if (!first_timestamp) {
+      first_timestamp = timestamp;
+    }
+    // Records slightly out of order (beyond `reorder_window`) are replayed
+    // immediately.
+    auto since_first =
+        timestamp > *first_timestamp ? timestamp - *first_timestamp : 0;
+    last_timestamp = std::max(last_timestamp, timestamp);
+
+    auto scheduled = start;
+    if (options_.speed) {
+      scheduled += std::chrono::nanoseconds(
+          static_cast<std::int64_t>(since_first / options_.speed));
+      this_fiber::SleepUntil(scheduled);
+    } else {
+      scheduled = ReadSteadyClock();
+    }
+    auto conn = AcquireConnection();
+    {
+      std::scoped_lock _(stats_lock_);
+      lags_.push_back(ReadSteadyClock() - scheduled);
+    }
+    ++issued;
+    fiber::internal::StartFiberDetached(
+        [this, conn = std::move(conn), record = std::move(record)]() mutable {
+          Replay(std::move(conn), std::move(record));
+        });
+  }
+
+  // Wait for outstanding calls.
+  {
+    std::unique_lock lk(conns_lock_);
+    conns_cv_.wait(
+        lk, [&] { return idle_conns_.size() == options_.concurrency; });
+    idle_conns_.clear();
+  }
+
+  std::scoped_lock _(stats_lock_);
+  report_.calls = issued;
+  report_.elapsed = ReadSteadyClock() - start;
+  if (first_timestamp) {
+    report_.recorded =
+        std::chrono::nanoseconds(last_timestamp - *first_timestamp);
+  }
+  report_.latency = ComputePercentiles(&latencies_);
+  report_.lag = ComputePercentiles(&lags_);
+  return std::exchange(report_, Report());
+}
+
+std::unique_ptr<BinaryLogReplayer::Connection>
+BinaryLogReplayer::AcquireConnection() {
+  std::unique_lock lk(conns_lock_);
+  conns_cv_.wait(lk, [&] { return !idle_conns_.empty(); });
+  auto conn = std::move(idle_conns_.back());
+  idle_conns_.pop_back();
+  return conn;
+}
+
+void BinaryLogReplayer::ReleaseConnection(std::unique_ptr<Connection> conn) {
+  std::scoped_lock _(conns_lock_);
+  idle_conns_.push_back(std::move(conn));
+  conns_cv_.notify_all();
+}
+
+std::unique_ptr<BinaryLogReplayer::Connection>
+BinaryLogReplayer::OpenConnection() {
+  auto conn = std::make_unique<Connection>();
+  // On failure, calls made on this connection fail, and it's reopened then.
+  (void)conn->Connect(options_.target);
+  return conn;
+}
+
+void BinaryLogReplayer::Replay(std::unique_ptr<Connection> conn,
+                               std::string record) {
+  NoncontiguousBufferBuilder builder;
+  WriteBinaryDryRunFrame(record, &builder);
+
+  std::string bytes;
+  auto start = ReadSteadyClock();
+  auto result = conn->Call(builder.DestructiveGet(), start + options_.timeout,
+                           &bytes);
+  auto latency = ReadSteadyClock() - start;
+
+  binary::DryRunReport report;
+  if (result == Connection::Result::Succeeded &&
+      !report.ParseFromString(bytes)) {
+    FLARE_LOG_WARNING_EVERY_SECOND("Failed to parse dry-run report.");
+    result = Connection::Result::Failed;
+  }
+  {
+    std::scoped_lock _(stats_lock_);
+    if (result == Connection::Result::Succeeded) {
+      ++report_.succeeded;
+      ++report_.invocation_statuses[report.invocation_status()];
+      latencies_.push_back(latency);
+    } else if (result == Connection::Result::TimedOut) {
+      ++report_.timed_out;
+    } else {
+      ++report_.failed;
+    }
+  }
+
+  if (result != Connection::Result::Succeeded) {
+    conn = nullptr;  // Closed before a new one is made.
+    conn = OpenConnection();
+  }
+  ReleaseConnection(std::move(conn));
+}
+
+}  // namespace flare::binlog
@@ -0,0 +1,143 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_BINLOG_BINARY_REPLAYER_H_
+#define FLARE_RPC_BINLOG_BINARY_REPLAYER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jsoncpp/value.h"
+
+#include "flare/base/net/endpoint.h"
+#include "flare/fiber/condition_variable.h"
+#include "flare/fiber/mutex.h"
+
+namespace flare::binlog {
+
+// Replays segment files written by `BinaryDumper` as load, against a server
+// running with `--flare_binlog_dry_runner=binary` (@sa: `dry_runner.h`).
+//
+// Calls are issued in the order they were started when recorded, either with
+// their original intervals (optionally scaled), or as fast as possible. At most
+// `Options::concurrency` calls are outstanding at the same time. If the server
+// cannot keep up, calls are delayed, and the delay is reported as lag.
+class BinaryLogReplayer {
+ public:
+  struct Options {
+    // Server to replay calls against.
+    Endpoint target;
+
+    // Segment files to replay, in the order they were written. (@sa:
+    // `ListBinaryLogSegments`.)
+    std::vector<std::string> segments;
+
+    // Maximum number of outstanding calls. A connection is made to `target`
+    // for each of them.
+    std::size_t concurrency = 16;
+
+    // Playback speed relative to the recording. E.g., `2` replays calls twice
+    // as fast as they were recorded. `0` replays calls as fast as possible.
+    double speed = 1;
+
+    // Calls not completed in this period are counted as timed out.
+    std::chrono::nanoseconds timeout = std::chrono::seconds(1);
+
+    // Records are not strictly ordered in segment files, as they're buffered
+    // per thread before being written out. Records are reordered within this
+    // window (in terms of time they were recorded) before being replayed.
+    std::chrono::nanoseconds reorder_window = std::chrono::seconds(5);
+
+    // Stop after issuing this many calls. `0` for no limit.
+    std::size_t max_calls = 0;
+  };
+
+  struct Percentiles {
+    std::chrono::nanoseconds avg{}, p50{}, p90{}, p99{}, p999{}, max{};
+  };
+
+  struct Report {
+    std::size_t calls = 0;      // Number of calls issued.
+    std::size_t succeeded = 0;  // Number of calls whose report was received.
+    std::size_t timed_out = 0;
+    std::size_t failed = 0;  // Connection failure, malformed report, etc.
+
+    // Invocation status (@sa: `binary::DryRunReport`) -> number of calls.
+    std::map<std::string, std::size_t> invocation_statuses;
+
+    // Time spent in replaying the calls.
+    std::chrono::nanoseconds elapsed{};
+
+    // Time span of the calls replayed, as they were recorded.
+    std::chrono::nanoseconds recorded{};
+
+    // Latency of calls that succeeded.
+    Percentiles latency;
+
+    // How late calls were issued compared to their schedule. With `speed` set
+    // to `0`, this is the time calls spent waiting for a free connection.
+    Percentiles lag;
+
+    // Calls issued per second.
+    double GetThroughput() const noexcept;
+
+    // For exposition, or for being compared with other runs.
+    Json::Value ToJson() const;
+  };
+
+  explicit BinaryLogReplayer(Options options);
+  ~BinaryLogReplayer();
+
+  // Replays the calls and waits for them to complete.
+  //
+  // Must be called in fiber environment.
+  Report Run();
+
+  // Noncopyable, nonmovable.
+  BinaryLogReplayer(const BinaryLogReplayer&) = delete;
+  BinaryLogReplayer& operator=(const BinaryLogReplayer&) = delete;
+
+ private:
+  class Connection;
+  class Schedule;
+
+  // Blocks until a connection is available.
+  std::unique_ptr<Connection> AcquireConnection();
+  void ReleaseConnection(std::unique_ptr<Connection> conn);
+  std::unique_ptr<Connection> OpenConnection();
+
+  void Replay(std::unique_ptr<Connection> conn, std::string record);
+
+ private:
+  Options options_;
+
+  fiber::Mutex conns_lock_;
+  fiber::ConditionVariable conns_cv_;
+  std::vector<std::unique_ptr<Connection>> idle_conns_;
+
+  std::mutex stats_lock_;  // Protects fields below.
+  Report report_;
+  std::vector<std::chrono::nanoseconds> latencies_;
+  std::vector<std::chrono::nanoseconds> lags_;
+};
+
+}  // namespace flare::binlog
+
+#endif  // FLARE_RPC_BINLOG_BINARY_REPLAYER_H_
@@ -0,0 +1,181 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/binlog/binary/replayer.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+#include "flare/init/override_flag.h"
+#include "flare/rpc/binlog/binary/binlog.pb.h"
+#include "flare/rpc/binlog/binary/dumper.h"
+#include "flare/rpc/binlog/binary/reader.h"
+#include "flare/rpc/binlog/tags.h"
+#include "flare/rpc/protocol/protobuf/binlog.pb.h"
+#include "flare/rpc/rpc_server_controller.h"
+#include "flare/rpc/server.h"
+#include "flare/testing/echo_service.flare.pb.h"
+#include "flare/testing/endpoint.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+DECLARE_string(flare_binlog_dry_runner);
+
+FLARE_OVERRIDE_FLAG(flare_binlog_dry_runner, "binary");
+
+namespace flare::binlog {
+
+namespace {
+
+constexpr auto kPathPrefix = "./replayer_test_dump";
+
+class EchoServiceImpl : public testing::SyncEchoService {
+ public:
+  void Echo(const testing::EchoRequest& request,
+            testing::EchoResponse* response,
+            RpcServerController* controller) override {
+    EXPECT_TRUE(controller->InDryRunEnvironment());
+    response->set_body(request.body());
+  }
+};
+
+binary::Log MakeLog(std::chrono::nanoseconds start,
+                    const std::string& handler_uuid) {
+  binary::Log log;
+  auto&& incoming = *log.mutable_incoming_call();
+  incoming.set_correlation_id(std::to_string(start / 1ns));
+  // @sa: `protobuf::Service::GetUuid()`.
+  (*incoming.mutable_system_tags())[tags::kHandlerUuid] = handler_uuid;
+
+  testing::EchoRequest req;
+  req.set_body("echo");
+  rpc::SerializedServerPacket pkt;
+  pkt.set_method("flare.testing.EchoService.Echo");
+  pkt.set_body(req.SerializeAsString());
+  incoming.add_incoming_pkts()->set_system_context(pkt.SerializeAsString());
+
+  log.set_start_timestamp(start / 1ns);
+  log.set_duration(1ms / 1ns);
+  return log;
+}
+
+class BinaryLogReplayerTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    server_.ListenOn(listening_on_);
+    server_.AddProtocol("flare");
+    server_.AddService(std::make_unique<EchoServiceImpl>());
+    server_.Start();
+  }
+
+  void TearDown() override {
+    server_.Stop();
+    server_.Join();
+    for (auto&& e : ListBinaryLogSegments(kPathPrefix)) {
+      unlink(e.c_str());
+    }
+  }
+
+  // Records `count` calls, 10ms apart, in shuffled order.
+  std::vector<std::string> Record(std::size_t count,
+                                  const std::string& handler_uuid =
+                                      "7D3B4ED4-D35E-46E0-87BD-2A03915D1760") {
+    BinaryDumper dumper(BinaryDumper::Options{.path_prefix = kPathPrefix,
+                                              .flush_interval = 0ns});
+    for (std::size_t i = 0; i != count; ++i) {
+      // 1, 0, 3, 2, 5, 4, ...
+      auto index = (i % 2 == 0 && i + 1 != count) ? i + 1 : i - i % 2;
+      dumper.Write(MakeLog(1s + index * 10ms, handler_uuid));
+    }
+    dumper.Flush();
+    return ListBinaryLogSegments(kPathPrefix);
+  }
+
+  BinaryLogReplayer::Options GetOptions(std::vector<std::string> segments) {
+    BinaryLogReplayer::Options opts;
+    opts.target = listening_on_;
+    opts.segments = std::move(segments);
+    opts.concurrency = 4;
+    return opts;
+  }
+
+ protected:
+  Endpoint listening_on_ = testing::PickAvailableEndpoint();
+  Server server_;
+};
+
+}  // namespace
+
+TEST_F(BinaryLogReplayerTest, MaxRate) {
+  auto opts = GetOptions(Record(100));
+  opts.speed = 0;
+  auto report = BinaryLogReplayer(opts).Run();
+  EXPECT_EQ(100, report.calls);
+  EXPECT_EQ(100, report.succeeded);
+  EXPECT_EQ(0, report.timed_out);
+  EXPECT_EQ(0, report.failed);
+  ASSERT_EQ(1, report.invocation_statuses.size());
+  EXPECT_EQ(100, report.invocation_statuses["0"]);  // `STATUS_SUCCESS`.
+  EXPECT_EQ(990ms, report.recorded);
+  EXPECT_LT(report.elapsed, 900ms);
+  EXPECT_GT(report.latency.max, 0ns);
+  EXPECT_GT(report.GetThroughput(), 0);
+  EXPECT_EQ(100, report.ToJson()["calls"].asUInt64());
+}
+
+TEST_F(BinaryLogReplayerTest, OriginalRate) {
+  auto opts = GetOptions(Record(100));
+  auto report = BinaryLogReplayer(opts).Run();
+  EXPECT_EQ(100, report.succeeded);
+  EXPECT_NEAR(990, report.elapsed / 1ms, 100);
+}
+
+TEST_F(BinaryLogReplayerTest, ScaledRate) {
+  auto opts = GetOptions(Record(100));
+  opts.speed = 2;
+  auto report = BinaryLogReplayer(opts).Run();
+  EXPECT_EQ(100, report.succeeded);
+  EXPECT_NEAR(495, report.elapsed / 1ms, 100);
+}
+
+TEST_F(BinaryLogReplayerTest, MaxCalls) {
+  auto opts = GetOptions(Record(100));
+  opts.speed = 0;
+  opts.max_calls = 10;
+  auto report = BinaryLogReplayer(opts).Run();
+  EXPECT_EQ(10, report.calls);
+  EXPECT_EQ(10, report.succeeded);
+}
+
+TEST_F(BinaryLogReplayerTest, Timeout) {
+  // The server does not respond to calls it can't find a handler for.
+  auto opts = GetOptions(Record(10, "00000000-0000-0000-0000-000000000000"));
+  opts.speed = 0;
+  opts.timeout = 100ms;
+  auto report = BinaryLogReplayer(opts).Run();
+  EXPECT_EQ(10, report.calls);
+  EXPECT_EQ(0, report.succeeded);
+  EXPECT_EQ(10, report.timed_out);
+}
+
+}  // namespace flare::binlog
+
+FLARE_TEST_MAIN
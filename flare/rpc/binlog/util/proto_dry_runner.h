@@ -103,7 +103,7 @@ class ProtoDryRunOutgoingCall
   // `proto::Call::incoming_pkts` when `Init` was called.
   Future<Expected<DryRunPacket, Status>> TryGetIncomingPacket(
       std::size_t index) override {
-    if (index > incoming_pkts_.size()) {
+    if (index >= incoming_pkts_.size()) {
       return Status{STATUS_EOF};
     }
     return incoming_pkts_[index];
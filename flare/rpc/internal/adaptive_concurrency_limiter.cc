@@ -0,0 +1,132 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/adaptive_concurrency_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "flare/base/logging.h"
+#include "flare/base/tsc.h"
+
+namespace flare::rpc::detail {
+
+AdaptiveConcurrencyLimiter::AdaptiveConcurrencyLimiter(const Options& options)
+    : options_(options),
+      limit_(std::clamp(options.initial_limit, options.min_limit,
+                        options.max_limit)),
+      window_start_tsc_(ReadTsc()),
+      min_latency_ns_(std::numeric_limits<std::uint64_t>::max()) {
+  FLARE_CHECK_LE(options_.min_limit, options_.max_limit);
+  FLARE_CHECK_GT(options_.min_limit, 0);
+  FLARE_CHECK_GE(options_.tolerance, 1.0);
+}
+
+bool AdaptiveConcurrencyLimiter::TryAcquire() {
+  if (FLARE_UNLIKELY(inflight_.fetch_add(1, std::memory_order_relaxed) >=
+                     limit_.load(std::memory_order_relaxed))) {
+    inflight_.fetch_sub(1, std::memory_order_relaxed);
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void AdaptiveConcurrencyLimiter::Release(std::chrono::nanoseconds latency) {
+  FLARE_CHECK_GT(inflight_.fetch_sub(1, std::memory_order_relaxed), 0);
+  if (latency <= std::chrono::nanoseconds::zero()) {
+    return;
+  }
+
+  latency_sum_ns_.fetch_add(latency.count(), std::memory_order_relaxed);
+  auto samples = samples_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (samples < options_.min_samples_per_window) {
+    return;
+  }
+  auto now = ReadTsc();
+  if (DurationFromTsc(window_start_tsc_.load(std::memory_order_relaxed),
+                      now) < options_.window) {
+    return;
+  }
+  // Only one thread is needed to update the limit.
+  std::unique_lock lk(update_lock_, std::try_to_lock);
+  if (lk.owns_lock()) {
+    UpdateLimitLocked(now);
+  }
+}
+
+Json::Value AdaptiveConcurrencyLimiter::Dump() const {
+  Json::Value jsv;
+  jsv["limit"] = static_cast<Json::UInt64>(GetLimit());
+  jsv["inflight"] = static_cast<Json::UInt64>(GetInflight());
+  jsv["rejected"] = static_cast<Json::UInt64>(GetRejected());
+  return jsv;
+}
+
+void AdaptiveConcurrencyLimiter::UpdateLimitLocked(std::uint64_t now) {
+  // Someone else has started a new window before we grabbed the lock.
+  if (DurationFromTsc(window_start_tsc_.load(std::memory_order_relaxed),
+                      now) < options_.window) {
+    return;
+  }
+  window_start_tsc_.store(now, std::memory_order_relaxed);
+  // Samples reported between these two `exchange`s can be slightly off. It
+  // doesn't matter.
+  auto samples = samples_.exchange(0, std::memory_order_relaxed);
+  auto sum = latency_sum_ns_.exchange(0, std::memory_order_relaxed);
+  if (!samples) {
+    return;
+  }
+  auto avg_latency = std::max<std::uint64_t>(sum / samples, 1);
+  auto limit = limit_.load(std::memory_order_relaxed);
+
+  if (probing_) {
+    // We've lowered the limit in the last window, queueing should have been
+    // eliminated and `avg_latency` is a good estimation of minimum latency.
+    probing_ = false;
+    min_latency_ns_ = avg_latency;
+  } else if (++windows_since_probe_ >= options_.windows_per_probe) {
+    windows_since_probe_ = 0;
+    probing_ = true;
+    limit_.store(std::max(options_.min_limit, limit * 3 / 4),
+                 std::memory_order_relaxed);
+    return;
+  } else {
+    min_latency_ns_ = std::min(min_latency_ns_, avg_latency);
+  }
+
+  // Ratio of latency with no queueing to recent latency. If recent latency
+  // goes up, so does the ratio go down.
+  auto gradient = std::clamp(options_.tolerance * min_latency_ns_ / avg_latency,
+                             0.5, 1.0);
+  // Leave some room for the limit to grow.
+  auto headroom = std::max(std::sqrt(static_cast<double>(limit)), 1.0);
+  auto desired = limit * gradient + headroom;
+  // Don't be too aggressive.
+  auto new_limit =
+      static_cast<std::size_t>(std::lround(limit * 0.8 + desired * 0.2));
+  if (new_limit > limit &&
+      inflight_.load(std::memory_order_relaxed) < limit / 2) {
+    // We're not limited by the limit at all. Raising it further only makes it
+    // slower to react once we're really overloaded.
+    new_limit = limit;
+  }
+  new_limit = std::clamp(new_limit, options_.min_limit, options_.max_limit);
+  FLARE_VLOG(10, "Concurrency limit updated: {} -> {} (latency {}/{} ns).",
+             limit, new_limit, avg_latency, min_latency_ns_);
+  limit_.store(new_limit, std::memory_order_relaxed);
+}
+
+}  // namespace flare::rpc::detail
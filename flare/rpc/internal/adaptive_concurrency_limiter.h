@@ -0,0 +1,109 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_INTERNAL_ADAPTIVE_CONCURRENCY_LIMITER_H_
+#define FLARE_RPC_INTERNAL_ADAPTIVE_CONCURRENCY_LIMITER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "jsoncpp/value.h"
+
+namespace flare::rpc::detail {
+
+// This class limits number of concurrent requests adaptively.
+//
+// The limit is derived from latency observed: The minimum latency observed
+// (i.e., latency with no queueing) is compared with recent latency. If recent
+// latency goes up, requests are likely being queued somewhere, and the limit
+// is lowered. Otherwise the limit is raised, slowly.
+//
+// Every once in a while the limit is lowered for a short period so that
+// minimum latency can be re-measured, in case it has changed.
+//
+// This class is thread-safe.
+class AdaptiveConcurrencyLimiter {
+ public:
+  struct Options {
+    std::size_t initial_limit = 64;
+    std::size_t min_limit = 8;
+    std::size_t max_limit = 65536;
+
+    // Latency up to `tolerance` times of the minimum latency is not considered
+    // as a sign of overload.
+    double tolerance = 1.5;
+
+    // The limit is re-evaluated once per window (provided that enough samples
+    // have been collected).
+    std::chrono::nanoseconds window = std::chrono::milliseconds(100);
+    std::size_t min_samples_per_window = 16;
+
+    // The minimum latency is re-measured every so many windows.
+    std::size_t windows_per_probe = 600;
+  };
+
+  explicit AdaptiveConcurrencyLimiter(const Options& options);
+
+  // Returns `false` if the request should be rejected. Otherwise `Release()`
+  // must be called once the request completes.
+  bool TryAcquire();
+
+  // Called once a request allowed by `TryAcquire()` completes. If `latency` is
+  // zero, the request is not sampled (e.g., for streaming RPCs, whose latency
+  // is not meaningful.)
+  void Release(std::chrono::nanoseconds latency);
+
+  // Current limit.
+  std::size_t GetLimit() const noexcept {
+    return limit_.load(std::memory_order_relaxed);
+  }
+
+  // Number of requests being processed.
+  std::size_t GetInflight() const noexcept {
+    return inflight_.load(std::memory_order_relaxed);
+  }
+
+  // Number of requests rejected so far.
+  std::uint64_t GetRejected() const noexcept {
+    return rejected_.load(std::memory_order_relaxed);
+  }
+
+  // Dumps internal state for exposition.
+  Json::Value Dump() const;
+
+ private:
+  void UpdateLimitLocked(std::uint64_t now);
+
+ private:
+  Options options_;
+  std::atomic<std::size_t> limit_;
+  std::atomic<std::size_t> inflight_{0};
+  std::atomic<std::uint64_t> rejected_{0};
+
+  // Latency samples collected in current window.
+  std::atomic<std::uint64_t> latency_sum_ns_{0};
+  std::atomic<std::uint64_t> samples_{0};
+  std::atomic<std::uint64_t> window_start_tsc_;
+
+  std::mutex update_lock_;  // Protects fields below.
+  std::uint64_t min_latency_ns_;
+  std::size_t windows_since_probe_ = 0;
+  bool probing_ = false;
+};
+
+}  // namespace flare::rpc::detail
+
+#endif  // FLARE_RPC_INTERNAL_ADAPTIVE_CONCURRENCY_LIMITER_H_
@@ -0,0 +1,108 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/adaptive_concurrency_limiter.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+AdaptiveConcurrencyLimiter::Options GetTestOptions(std::size_t initial_limit) {
+  AdaptiveConcurrencyLimiter::Options opts;
+  opts.initial_limit = initial_limit;
+  opts.min_limit = 4;
+  opts.max_limit = 1000;
+  opts.window = 1ms;
+  opts.min_samples_per_window = 1;
+  opts.windows_per_probe = 100000;  // Not tested here.
+  return opts;
+}
+
+TEST(AdaptiveConcurrencyLimiter, Reject) {
+  AdaptiveConcurrencyLimiter limiter(GetTestOptions(4));
+  for (int i = 0; i != 4; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+  }
+  ASSERT_FALSE(limiter.TryAcquire());
+  EXPECT_EQ(4, limiter.GetInflight());
+  EXPECT_EQ(1, limiter.GetRejected());
+
+  limiter.Release(0ns);
+  EXPECT_TRUE(limiter.TryAcquire());
+  for (int i = 0; i != 4; ++i) {
+    limiter.Release(0ns);
+  }
+  EXPECT_EQ(0, limiter.GetInflight());
+  EXPECT_EQ(4, limiter.GetLimit());  // No sample, no change.
+}
+
+TEST(AdaptiveConcurrencyLimiter, ShrinkOnLatencyIncrease) {
+  AdaptiveConcurrencyLimiter limiter(GetTestOptions(100));
+
+  // Let the limiter learn the minimum latency.
+  for (int i = 0; i != 5; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    std::this_thread::sleep_for(2ms);
+    limiter.Release(1ms);
+  }
+  auto limit = limiter.GetLimit();
+
+  // Requests start queueing.
+  for (int i = 0; i != 20; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    std::this_thread::sleep_for(2ms);
+    limiter.Release(10ms);
+  }
+  EXPECT_LT(limiter.GetLimit(), limit);
+  EXPECT_GE(limiter.GetLimit(), 4);
+}
+
+TEST(AdaptiveConcurrencyLimiter, GrowIfSaturated) {
+  AdaptiveConcurrencyLimiter limiter(GetTestOptions(16));
+
+  // Keep the limiter (almost) saturated.
+  for (int i = 0; i != 15; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+  }
+  for (int i = 0; i != 20; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    std::this_thread::sleep_for(2ms);
+    limiter.Release(1ms);  // Latency is stable.
+  }
+  EXPECT_GT(limiter.GetLimit(), 16);
+  for (int i = 0; i != 15; ++i) {
+    limiter.Release(0ns);
+  }
+}
+
+TEST(AdaptiveConcurrencyLimiter, NoGrowIfIdle) {
+  AdaptiveConcurrencyLimiter limiter(GetTestOptions(16));
+
+  for (int i = 0; i != 20; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    std::this_thread::sleep_for(2ms);
+    limiter.Release(1ms);
+  }
+  EXPECT_EQ(16, limiter.GetLimit());
+}
+
+}  // namespace flare::rpc::detail
+
+FLARE_TEST_MAIN
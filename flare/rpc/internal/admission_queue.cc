@@ -0,0 +1,162 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/admission_queue.h"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "flare/base/logging.h"
+#include "flare/base/string.h"
+#include "flare/base/tsc.h"
+#include "flare/fiber/fiber.h"
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+AdmissionQueue::AdmissionQueue(const Options& options)
+    : options_(options),
+      interval_start_tsc_(ReadTsc()),
+      min_delay_in_interval_(std::chrono::nanoseconds::max()) {
+  FLARE_CHECK_GT(options_.max_executing, 0);
+}
+
+void AdmissionQueue::Submit(Task task) {
+  bool admitted;
+  {
+    std::scoped_lock _(lock_);
+    if (executing_ < options_.max_executing) {
+      ++executing_;
+      ++admitted_;
+      // Not queued at all. This is a sign that the queue is not standing.
+      OnDequeueLocked(ReadTsc(), 0ns, 0ns);
+      admitted = true;
+    } else if (queue_.size() < options_.max_queue_length) {
+      queue_.push_back(Entry{ReadTsc(), std::move(task)});
+      return;
+    } else {
+      ++dropped_;
+      admitted = false;
+    }
+  }
+
+  if (admitted) {
+    fiber::internal::StartFiberDetached(
+        [task = std::move(task)]() mutable { task(true); });
+  } else {
+    task(false);
+  }
+}
+
+void AdmissionQueue::OnCompletion() {
+  std::vector<Task> dropping;
+  std::optional<Task> next;
+  {
+    std::scoped_lock _(lock_);
+    auto now = ReadTsc();
+    auto sojourn = [&](const Entry& e) {
+      return DurationFromTsc(e.enqueued_tsc, now);
+    };
+
+    if (overloaded_) {
+      // The oldest requests are likely to be timed out by the time they're
+      // processed. Dropping them now.
+      while (!queue_.empty() &&
+             sojourn(queue_.front()) > options_.target * 2) {
+        dropping.push_back(std::move(queue_.front().task));
+        queue_.pop_front();
+      }
+    }
+    if (!queue_.empty()) {
+      // Whether the queue is standing is determined by the oldest request in
+      // it, regardless of the order we're using.
+      auto oldest = sojourn(queue_.front());
+      auto&& e = overloaded_ ? queue_.back() : queue_.front();
+      auto delay = sojourn(e);
+      next = std::move(e.task);
+      if (overloaded_) {
+        queue_.pop_back();
+        ++dequeued_lifo_;
+      } else {
+        queue_.pop_front();
+      }
+      OnDequeueLocked(now, oldest, delay);
+      ++admitted_;
+    } else {
+      --executing_;
+    }
+    dropped_ += dropping.size();
+  }
+
+  for (auto&& e : dropping) {
+    e(false);
+  }
+  if (next) {
+    fiber::internal::StartFiberDetached(
+        [task = std::move(*next)]() mutable { task(true); });
+  }
+}
+
+Json::Value AdmissionQueue::Dump() const {
+  std::scoped_lock _(lock_);
+  Json::Value jsv;
+  jsv["executing"] = static_cast<Json::UInt64>(executing_);
+  jsv["queued"] = static_cast<Json::UInt64>(queue_.size());
+  jsv["overloaded"] = overloaded_;
+  jsv["admitted"] = static_cast<Json::UInt64>(admitted_);
+  jsv["dropped"] = static_cast<Json::UInt64>(dropped_);
+  jsv["dequeued_lifo"] = static_cast<Json::UInt64>(dequeued_lifo_);
+  auto&& histogram = jsv["queueing_delay_us"];
+  for (int i = 0; i != kHistogramBuckets; ++i) {
+    auto key = i + 1 == kHistogramBuckets ? "inf"s : Format("<{}", 1 << i);
+    histogram[key] = static_cast<Json::UInt64>(delay_histogram_[i]);
+  }
+  return jsv;
+}
+
+void AdmissionQueue::OnDequeueLocked(std::uint64_t now,
+                                     std::chrono::nanoseconds oldest,
+                                     std::chrono::nanoseconds delay) {
+  // Determine if we're overloaded once per interval.
+  if (DurationFromTsc(interval_start_tsc_, now) >= options_.interval) {
+    // `min_delay_in_interval_` is `max()` if nothing was dequeued in the last
+    // interval, nothing can be learnt in this case.
+    auto overloaded =
+        min_delay_in_interval_ != std::chrono::nanoseconds::max() &&
+        min_delay_in_interval_ > options_.target;
+    FLARE_LOG_WARNING_IF_EVERY_SECOND(
+        overloaded && !overloaded_,
+        "Requests are being queued for too long (at least {} ms), switching "
+        "to LIFO and dropping stale requests.",
+        min_delay_in_interval_ / 1ms);
+    overloaded_ = overloaded;
+    min_delay_in_interval_ = oldest;
+    interval_start_tsc_ = now;
+  } else {
+    min_delay_in_interval_ = std::min(min_delay_in_interval_, oldest);
+  }
+
+  auto us = static_cast<std::uint64_t>(delay / 1us);
+  auto bucket = 0;
+  while (bucket + 1 < kHistogramBuckets && (1ULL << bucket) <= us) {
+    ++bucket;
+  }
+  ++delay_histogram_[bucket];
+}
+
+}  // namespace flare::rpc::detail
@@ -0,0 +1,118 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_INTERNAL_ADMISSION_QUEUE_H_
+#define FLARE_RPC_INTERNAL_ADMISSION_QUEUE_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "jsoncpp/value.h"
+
+#include "flare/base/function.h"
+
+namespace flare::rpc::detail {
+
+// This class bounds number of requests being processed concurrently, and
+// queues the rest.
+//
+// Simply queueing requests in FIFO order does not work well under overload:
+// Once a standing queue is formed, every request waits for the whole queue
+// and is likely to be timed out by the time it's processed. Therefore:
+//
+// - The queue is managed in a way similar to CoDel: If the queueing delay of
+//   the oldest request in the queue never dropped below `target` in the last
+//   interval, the queue is considered standing (i.e., we're overloaded), and
+//   requests that have been queued for longer than `2 * target` are dropped.
+//
+// - While the queue is standing, requests are dequeued in LIFO order. Newer
+//   requests are more likely to be completed before their callers give up.
+//
+// This class is thread-safe.
+class AdmissionQueue {
+ public:
+  struct Options {
+    // Maximum number of requests being processed concurrently.
+    std::size_t max_executing = 1;
+
+    // Requests exceeding this are dropped immediately.
+    std::size_t max_queue_length = 65536;
+
+    // @sa: Comments on the class.
+    std::chrono::nanoseconds target = std::chrono::milliseconds(5);
+    std::chrono::nanoseconds interval = std::chrono::milliseconds(100);
+  };
+
+  // `true` is passed if the request is admitted, `false` if it's dropped. In
+  // the latter case the callee should reply to the request with something like
+  // "overloaded".
+  using Task = Function<void(bool)>;
+
+  explicit AdmissionQueue(const Options& options);
+
+  // Submits a new request. Admitted requests are run in a dedicated fiber.
+  // Dropped ones are run in calling fiber of either this method or
+  // `OnCompletion()`.
+  //
+  // `OnCompletion()` must be called once an admitted request completes.
+  void Submit(Task task);
+
+  // Called once a request admitted has been completed. This may admit another
+  // request.
+  void OnCompletion();
+
+  // Dumps internal state (including histogram of queueing delay) for
+  // exposition.
+  Json::Value Dump() const;
+
+ private:
+  struct Entry {
+    std::uint64_t enqueued_tsc;
+    Task task;
+  };
+
+  // Updates CoDel state and statistics on dequeue. `oldest` is queueing delay
+  // of the oldest request in the queue, `delay` is that of the request being
+  // dequeued.
+  void OnDequeueLocked(std::uint64_t now, std::chrono::nanoseconds oldest,
+                       std::chrono::nanoseconds delay);
+
+ private:
+  // Bucket `i` counts requests queued less than `2^i` microseconds (except for
+  // the last one, which counts everything else).
+  static constexpr auto kHistogramBuckets = 24;
+
+  Options options_;
+
+  mutable std::mutex lock_;  // Protects everything below.
+  std::size_t executing_ = 0;
+  std::deque<Entry> queue_;
+
+  // CoDel state.
+  std::uint64_t interval_start_tsc_;
+  std::chrono::nanoseconds min_delay_in_interval_;
+  bool overloaded_ = false;  // Queue is standing, LIFO is used.
+
+  // Statistics.
+  std::uint64_t admitted_ = 0, dropped_ = 0, dequeued_lifo_ = 0;
+  std::array<std::uint64_t, kHistogramBuckets> delay_histogram_{};
+};
+
+}  // namespace flare::rpc::detail
+
+#endif  // FLARE_RPC_INTERNAL_ADMISSION_QUEUE_H_
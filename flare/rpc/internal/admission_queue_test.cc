@@ -0,0 +1,120 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/admission_queue.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "gtest/gtest.h"
+
+#include "flare/fiber/latch.h"
+#include "flare/fiber/this_fiber.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+TEST(AdmissionQueue, BoundedExecution) {
+  AdmissionQueue::Options opts;
+  opts.max_executing = 2;
+  opts.target = 10s;  // Never drop.
+  AdmissionQueue queue(opts);
+
+  constexpr auto kRequests = 20;
+  std::atomic<int> executing = 0, max_executing = 0, admitted = 0;
+  fiber::Latch latch(kRequests);
+  for (int i = 0; i != kRequests; ++i) {
+    queue.Submit([&](bool ok) {
+      if (ok) {
+        auto now = ++executing;
+        auto was = max_executing.load();
+        while (was < now && !max_executing.compare_exchange_weak(was, now)) {
+        }
+        this_fiber::SleepFor(5ms);
+        --executing;
+        ++admitted;
+        queue.OnCompletion();
+      }
+      latch.count_down();
+    });
+  }
+  latch.wait();
+  EXPECT_EQ(kRequests, admitted);
+  EXPECT_LE(max_executing, 2);
+  EXPECT_EQ(0, queue.Dump()["queued"].asUInt64());
+}
+
+TEST(AdmissionQueue, QueueFull) {
+  AdmissionQueue::Options opts;
+  opts.max_executing = 1;
+  opts.max_queue_length = 1;
+  AdmissionQueue queue(opts);
+
+  fiber::Latch blocker(1), done(1);
+  std::atomic<int> dropped = 0;
+  queue.Submit([&](bool ok) {
+    ASSERT_TRUE(ok);
+    blocker.wait();
+    queue.OnCompletion();
+  });
+  queue.Submit([&](bool ok) {  // Queued.
+    ASSERT_TRUE(ok);
+    queue.OnCompletion();
+    done.count_down();
+  });
+  queue.Submit([&](bool ok) {  // Dropped immediately.
+    ASSERT_FALSE(ok);
+    ++dropped;
+  });
+  EXPECT_EQ(1, dropped);
+  blocker.count_down();
+  done.wait();
+}
+
+TEST(AdmissionQueue, DropAndLifoOnOverload) {
+  AdmissionQueue::Options opts;
+  opts.max_executing = 1;
+  opts.target = 1ms;
+  opts.interval = 5ms;
+  AdmissionQueue queue(opts);
+
+  constexpr auto kRequests = 500;
+  std::atomic<int> admitted = 0, dropped = 0;
+  fiber::Latch latch(kRequests);
+  for (int i = 0; i != kRequests; ++i) {
+    queue.Submit([&](bool ok) {
+      if (ok) {
+        this_fiber::SleepFor(1ms);  // Way slower than requests come in.
+        ++admitted;
+        queue.OnCompletion();
+      } else {
+        ++dropped;
+      }
+      latch.count_down();
+    });
+    this_fiber::SleepFor(100us);
+  }
+  latch.wait();
+
+  // Standing queue should have been detected, and stale requests dropped.
+  EXPECT_GT(dropped, 0);
+  EXPECT_GT(queue.Dump()["dequeued_lifo"].asUInt64(), 0);
+  EXPECT_EQ(kRequests, admitted + dropped);
+}
+
+}  // namespace flare::rpc::detail
+
+FLARE_TEST_MAIN
@@ -0,0 +1,24 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/internal/correlation_map.h"
+
+#include "gflags/gflags.h"
+
+DEFINE_int32(flare_rpc_client_correlation_map_capacity, 65536,
+             "Number of slots in each (per scheduling group) correlation map "
+             "for outgoing RPCs. This should be well above the number of "
+             "outstanding RPCs of each scheduling group. Correlations that "
+             "can't be fit in are stored in a slower, locked map.");
@@ -15,12 +15,17 @@
 #ifndef FLARE_RPC_INTERNAL_CORRELATION_MAP_H_
 #define FLARE_RPC_INTERNAL_CORRELATION_MAP_H_
 
+#include <memory>
 #include <vector>
 
+#include "gflags/gflags_declare.h"
+
 #include "flare/base/id_alloc.h"
 #include "flare/base/never_destroyed.h"
 #include "flare/fiber/runtime.h"
-#include "flare/rpc/internal/sharded_call_map.h"
+#include "flare/rpc/internal/lockless_call_map.h"
+
+DECLARE_int32(flare_rpc_client_correlation_map_capacity);
 
 // Here we use a semi-global correlation map for all outgoing RPCs.
 //
@@ -40,26 +45,32 @@
 
 namespace flare::rpc::internal {
 
-// TODO(luobogao): Now that we're using a (semi-)global map, we can use a
-// fixed-sized lockless map instead of `ShardedCallMap` for more stable
-// performance.
+// Now that we're using a (semi-)global map, we can afford a fixed-sized
+// lockless map instead of `ShardedCallMap` for more stable performance. (We
+// couldn't do this previously as we can't afford to keep a large fixed-size
+// map for each connection.)
 //
-// The reason why we can't do this previously is that we can't afford to keep a
-// large fixed-size map for each connection. Now that it's semi-global, it's
-// affordable.
+// Size of the map is controlled by `flare_rpc_client_correlation_map_capacity`.
 //
 // TODO(luobogao): Expose statistics of each correlation map via `ExposedVar`.
 template <class T>
-using CorrelationMap = ShardedCallMap<T>;
+using CorrelationMap = LocklessCallMap<T>;
 
 // Get correlation map for the given scheduling group. The resulting map is
 // indexed by key generated via `MergeCorrelationId`.
 template <class T>
 CorrelationMap<T>* GetCorrelationMapFor(std::size_t scheduling_group_id) {
-  static NeverDestroyed<std::vector<CorrelationMap<T>>> maps(
-      fiber::GetSchedulingGroupCount());
+  static NeverDestroyed<std::vector<std::unique_ptr<CorrelationMap<T>>>> maps(
+      [] {
+        std::vector<std::unique_ptr<CorrelationMap<T>>> result;
+        for (std::size_t i = 0; i != fiber::GetSchedulingGroupCount(); ++i) {
+          result.push_back(std::make_unique<CorrelationMap<T>>(
+              FLAGS_flare_rpc_client_correlation_map_capacity));
+        }
+        return result;
+      }());
   FLARE_CHECK_LT(scheduling_group_id, maps->size());
-  return &(*maps)[scheduling_group_id];
+  return (*maps)[scheduling_group_id].get();
 }
 
 }  // namespace flare::rpc::internal
@@ -0,0 +1,210 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_INTERNAL_LOCKLESS_CALL_MAP_H_
+#define FLARE_RPC_INTERNAL_LOCKLESS_CALL_MAP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "flare/base/likely.h"
+#include "flare/base/logging.h"
+
+namespace flare::rpc::internal {
+
+// A fixed-size, open-addressing concurrent map. Unlike `ShardedCallMap`, no
+// lock is taken on insertion / removal (unless the table overflows, see
+// below).
+//
+// The table is pre-sized to `capacity` slots (rounded up to power of 2), and
+// each key is only probed within `kMaxProbes` slots following its "home"
+// slot. Were all of them in use, the correlation is stored in a (mutex
+// protected) overflow map instead. With a reasonably sized table (i.e., the
+// number of outstanding calls is well below `capacity`), this should rarely
+// happen.
+//
+// Removed slots are marked as deleted (tombstone) and reused by later
+// insertions.
+//
+// Unlike `ShardedCallMap`, duplicate `correlation_id`s are NOT detected.
+template <class T>
+class LocklessCallMap {
+  inline static constexpr auto kMaxProbes = 32;
+
+ public:
+  explicit LocklessCallMap(std::size_t capacity) {
+    std::size_t size = kMaxProbes;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mask_ = size - 1;
+    slots_ = std::make_unique<Slot[]>(size);
+  }
+
+  // Insert a new correlation.
+  void Insert(std::uint64_t correlation_id, T value) {
+    auto home = GetIndex(correlation_id);
+    for (int i = 0; i != kMaxProbes; ++i) {
+      auto&& slot = slots_[(home + i) & mask_];
+      auto state = slot.state.load(std::memory_order_relaxed);
+      if ((state == kEmpty || state == kDeleted) &&
+          slot.state.compare_exchange_strong(state, kBusy,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+        slot.key.store(correlation_id, std::memory_order_relaxed);
+        slot.value = std::move(value);
+        slot.state.store(kOccupied, std::memory_order_release);
+        return;
+      }
+    }
+
+    // Bad luck.
+    std::scoped_lock _(overflow_lock_);
+    auto&& [iter, inserted] =
+        overflow_.emplace(correlation_id, std::move(value));
+    FLARE_CHECK(inserted, "Duplicate correlation_id {}.", correlation_id);
+    overflow_size_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Returns pointer removed, or nullptr if nothing was removed.
+  T Remove(std::uint64_t correlation_id) {
+    auto home = GetIndex(correlation_id);
+    for (int i = 0; i != kMaxProbes; ++i) {
+      auto&& slot = slots_[(home + i) & mask_];
+      auto state = slot.state.load(std::memory_order_acquire);
+      if (state == kEmpty) {
+        // Insertion takes the first free slot, and a slot never becomes empty
+        // once used. So the key can't be found in slots after this one.
+        break;
+      }
+      if ((state != kOccupied && state != kVisiting) ||
+          slot.key.load(std::memory_order_relaxed) != correlation_id) {
+        continue;
+      }
+      if (!TryLockSlot(&slot)) {
+        continue;  // Removed by someone else in the mean time.
+      }
+      if (FLARE_UNLIKELY(slot.key.load(std::memory_order_relaxed) !=
+                         correlation_id)) {
+        // The slot was reused for another key before we locked it.
+        slot.state.store(kOccupied, std::memory_order_release);
+        continue;
+      }
+      auto v = std::move(slot.value);
+      slot.value = T();
+      slot.state.store(kDeleted, std::memory_order_release);
+      return v;
+    }
+
+    if (FLARE_LIKELY(!overflow_size_.load(std::memory_order_acquire))) {
+      return nullptr;
+    }
+    std::scoped_lock _(overflow_lock_);
+    if (auto iter = overflow_.find(correlation_id); iter != overflow_.end()) {
+      auto v = std::move(iter->second);
+      overflow_.erase(iter);
+      overflow_size_.fetch_sub(1, std::memory_order_relaxed);
+      return v;
+    }
+    return nullptr;
+  }
+
+  // Call this method concurrently to other modifications may lose those
+  // concurrent changes. Also note that you must not modify the map in the
+  // callback. Otherwise THE BEHAVIOR IS UNDEFINED.
+  template <class F>
+  void ForEach(F&& f) {
+    for (std::size_t i = 0; i != mask_ + 1; ++i) {
+      auto&& slot = slots_[i];
+      auto state = kOccupied;
+      // Removal of this slot (if any) waits until we're done with it.
+      if (slot.state.compare_exchange_strong(state, kVisiting,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+        std::forward<F>(f)(slot.key.load(std::memory_order_relaxed),
+                           slot.value);
+        slot.state.store(kOccupied, std::memory_order_release);
+      }
+    }
+
+    std::scoped_lock _(overflow_lock_);
+    for (auto&& [k, v] : overflow_) {
+      std::forward<F>(f)(k, v);
+    }
+  }
+
+  // Number of correlations currently stored in the overflow map.
+  std::size_t GetOverflowSize() const noexcept {
+    return overflow_size_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  enum SlotState : std::uint8_t {
+    kEmpty,
+    kBusy,  // Being inserted or removed.
+    kOccupied,
+    kVisiting,  // Being visited by `ForEach`.
+    kDeleted
+  };
+
+  struct Slot {
+    std::atomic<SlotState> state{kEmpty};
+    std::atomic<std::uint64_t> key{0};
+    T value{};
+  };
+
+  // Transitions `slot` from occupied to busy. Returns `false` if it's no longer
+  // occupied.
+  static bool TryLockSlot(Slot* slot) {
+    while (true) {
+      auto state = kOccupied;
+      if (slot->state.compare_exchange_weak(state, kBusy,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+        return true;
+      }
+      if (state != kOccupied && state != kVisiting) {
+        return false;
+      }
+      // Being visited (or spurious failure), retry.
+      std::this_thread::yield();
+    }
+  }
+
+  std::size_t GetIndex(std::uint64_t x) const noexcept {
+    // @sa: https://stackoverflow.com/a/12996028
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = (x >> 16) ^ x;
+    return x & mask_;
+  }
+
+ private:
+  std::size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  std::atomic<std::size_t> overflow_size_{0};
+  std::mutex overflow_lock_;
+  std::unordered_map<std::uint64_t, T> overflow_;
+};
+
+}  // namespace flare::rpc::internal
+
+#endif  // FLARE_RPC_INTERNAL_LOCKLESS_CALL_MAP_H_
@@ -0,0 +1,112 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/internal/lockless_call_map.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/main.h"
+
+namespace flare::rpc::internal {
+
+TEST(LocklessCallMap, Basic) {
+  LocklessCallMap<std::unique_ptr<int>> map(1024);
+  map.Insert(1, std::make_unique<int>(10));
+  map.Insert(2, std::make_unique<int>(20));
+  EXPECT_FALSE(map.Remove(3));
+  EXPECT_EQ(10, *map.Remove(1));
+  EXPECT_FALSE(map.Remove(1));
+  EXPECT_EQ(20, *map.Remove(2));
+}
+
+TEST(LocklessCallMap, Overflow) {
+  // Far more keys than the map can hold.
+  LocklessCallMap<std::unique_ptr<int>> map(64);
+  for (int i = 0; i != 1000; ++i) {
+    map.Insert(i, std::make_unique<int>(i));
+  }
+  EXPECT_GT(map.GetOverflowSize(), 0);
+
+  int visited = 0;
+  map.ForEach([&](auto k, auto&& v) {
+    EXPECT_EQ(k, *v);
+    ++visited;
+  });
+  EXPECT_EQ(1000, visited);
+
+  for (int i = 0; i != 1000; ++i) {
+    auto p = map.Remove(i);
+    ASSERT_TRUE(p);
+    EXPECT_EQ(i, *p);
+  }
+  EXPECT_EQ(0, map.GetOverflowSize());
+  map.ForEach([&](auto k, auto&& v) { ADD_FAILURE(); });
+}
+
+TEST(LocklessCallMap, Concurrent) {
+  constexpr auto kThreads = 16;
+  constexpr auto kKeysPerThread = 20000;
+  LocklessCallMap<std::unique_ptr<std::uint64_t>> map(1048576);
+  std::vector<std::thread> ts;
+
+  for (int i = 0; i != kThreads; ++i) {
+    ts.emplace_back([&, i] {
+      for (std::uint64_t j = 0; j != kKeysPerThread; ++j) {
+        auto key = static_cast<std::uint64_t>(i) << 32 | j;
+        map.Insert(key, std::make_unique<std::uint64_t>(key));
+      }
+    });
+  }
+  for (auto&& t : ts) {
+    t.join();
+  }
+  ts.clear();
+
+  // Two threads racing to remove the same set of keys, while someone else is
+  // traversing the map.
+  std::atomic<std::size_t> removed{};
+  std::atomic<bool> done{};
+  std::thread visitor([&] {
+    while (!done) {
+      map.ForEach([&](auto k, auto&& v) { ASSERT_EQ(k, *v); });
+    }
+  });
+  for (int i = 0; i != kThreads * 2; ++i) {
+    ts.emplace_back([&, i] {
+      for (std::uint64_t j = 0; j != kKeysPerThread; ++j) {
+        auto key = static_cast<std::uint64_t>(i / 2) << 32 | j;
+        if (auto p = map.Remove(key)) {
+          ASSERT_EQ(key, *p);
+          ++removed;
+        }
+      }
+    });
+  }
+  for (auto&& t : ts) {
+    t.join();
+  }
+  done = true;
+  visitor.join();
+  EXPECT_EQ(kThreads * kKeysPerThread, removed);
+}
+
+}  // namespace flare::rpc::internal
+
+FLARE_TEST_MAIN
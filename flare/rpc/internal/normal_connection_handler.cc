@@ -14,6 +14,7 @@
 
 #include "flare/rpc/internal/normal_connection_handler.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -21,6 +22,7 @@
 #include "gflags/gflags.h"
 #include "opentracing/ext/tags.h"
 
+#include "flare/base/casting.h"
 #include "flare/base/deferred.h"
 #include "flare/base/internal/dpc.h"
 #include "flare/base/tsc.h"
@@ -28,6 +30,7 @@
 #include "flare/fiber/latch.h"
 #include "flare/fiber/this_fiber.h"
 #include "flare/rpc/binlog/dumper.h"
+#include "flare/rpc/internal/admission_queue.h"
 #include "flare/rpc/internal/session_context.h"
 #include "flare/rpc/server.h"
 #include "flare/rpc/tracing/framework_tags.h"
@@ -36,6 +39,8 @@
 using namespace std::literals;
 
 DECLARE_int32(flare_rpc_server_stream_concurrency);
+DECLARE_int32(flare_rpc_server_stream_window);
+DECLARE_int32(flare_rpc_server_connection_window);
 
 DEFINE_bool(
     flare_rpc_start_new_trace_on_missing, false,
@@ -96,7 +101,12 @@ StreamConnectionHandler::DataConsumptionStatus
 NormalConnectionHandler::OnDataArrival(NoncontiguousBuffer* buffer) {
   FLARE_CHECK(conn_);  // This cannot fail.
 
-  ScopedDeferred _([&] { ConsiderUpdateCoarseLastEventTimestamp(); });
+  ScopedDeferred _([&] {
+    // Whatever the protocol wants to send (even if we're going to close the
+    // connection), let's send it before returning.
+    FlushPendingBytes();
+    ConsiderUpdateCoarseLastEventTimestamp();
+  });
   bool ever_suppressed = false;
   auto receive_tsc = ReadTsc();
 
@@ -191,6 +201,25 @@ NormalConnectionHandler::ProcessOnePacket(NoncontiguousBuffer* buffer,
       // finished.
       auto ctlr = NewController(*msg, protocol);
       ServiceOverloaded(std::move(msg), protocol, ctlr.get());
+    } else if (auto queue = owner_->admission_queue_.get();
+               FLARE_UNLIKELY(queue)) {
+      // The call is either called in separate fiber (admitted) or rejected
+      // (dropped by the queue) eventually.
+      queue->Submit([this, queue, msg = std::move(msg), protocol, receive_tsc,
+                     pkt_size](bool admitted) mutable {
+        auto ctlr = NewController(*msg, protocol);
+        if (!admitted) {
+          ServiceOverloaded(std::move(msg), protocol, ctlr.get());
+          OnCallCompletion();
+          return;
+        }
+        ServiceFastCall(std::move(msg), protocol, std::move(ctlr), receive_tsc,
+                        pkt_size);
+        // Must be done before `OnCallCompletion`, the server (and the queue)
+        // can be destroyed once all calls have completed.
+        queue->OnCompletion();
+        OnCallCompletion(DurationFromTsc(receive_tsc, ReadTsc()));
+      });
     } else {
       // FIXME: Too many captures hurts performance.
       fiber::internal::StartFiberDetached([this, msg = std::move(msg), protocol,
@@ -198,7 +227,7 @@ NormalConnectionHandler::ProcessOnePacket(NoncontiguousBuffer* buffer,
         auto ctlr = NewController(*msg, protocol);
         ServiceFastCall(std::move(msg), protocol, std::move(ctlr), receive_tsc,
                         pkt_size);
-        OnCallCompletion();
+        OnCallCompletion(DurationFromTsc(receive_tsc, ReadTsc()));
       });
     }
     return ProcessingStatus::Success;
@@ -214,6 +243,15 @@ NormalConnectionHandler::ProcessOnePacket(NoncontiguousBuffer* buffer,
       return ProcessingStatus::Success;
     }
 
+    // Flow control credit is consumed by the stream itself.
+    if (FLARE_UNLIKELY(isa<StreamWindowUpdateMessage>(*msg))) {
+      if (iter != streams_.end()) {
+        iter->second.io_adaptor->NotifyWindowUpdate(
+            msg->GetStreamWindowUpdate());
+      }  // The stream has gone otherwise, nothing to do.
+      return ProcessingStatus::Success;
+    }
+
     // Well we don't check for `StartOfStream` here. Indeed doing some basic
     // sanity checks would be great but some protocol (notably QZone) does not
     // support start-of-stream / end-of-stream indicator. Besides, given that
@@ -238,7 +276,7 @@ NormalConnectionHandler::ProcessOnePacket(NoncontiguousBuffer* buffer,
     }
 
     // Won't block, won't call user's code.
-    auto rc = iter->second.io_adaptor->NotifyRead(std::move(msg))
+    auto rc = iter->second.io_adaptor->NotifyRead(std::move(msg), pkt_size)
                   ? ProcessingStatus::SuppressRead
                   : ProcessingStatus::Success;
     if (!!(type == Message::Type::EndOfStream)) {
@@ -349,21 +387,77 @@ void NormalConnectionHandler::WriteOverloaded(const Message& corresponding_req,
                              corresponding_req.GetCorrelationId(), stream);
   if (msg) {  // Note that `MessageFactory::Create` may return `nullptr`.
     WriteMessage(*msg, protocol, controller, kFastCallReservedContextId);
+  } else {
+    AbandonCall(corresponding_req.GetCorrelationId(), protocol);
   }
 }
 
-std::size_t NormalConnectionHandler::WriteMessage(const Message& msg,
-                                                  StreamProtocol* protocol,
-                                                  Controller* controller,
-                                                  std::uintptr_t ctx) const {
+void NormalConnectionHandler::AbandonCall(std::uint64_t correlation_id,
+                                          StreamProtocol* protocol) {
+  if (FLARE_LIKELY(!protocol->GetCharacteristics().stateful_writes)) {
+    return;
+  }
+  std::scoped_lock _(write_lock_);
+  protocol->OnCallAbandoned(correlation_id);
+  NoncontiguousBuffer nb;
+  if (protocol->TryGetPendingBytes(&nb)) {
+    (void)conn_->Write(std::move(nb), kFastCallReservedContextId);
+  }
+}
+
+std::size_t NormalConnectionHandler::WriteMessage(
+    const Message& msg, StreamProtocol* protocol, Controller* controller,
+    std::uintptr_t ctx, StreamService::Context* call_context) const {
   ScopedDeferred _([&] { ConsiderUpdateCoarseLastEventTimestamp(); });
+  std::unique_lock<fiber::Mutex> lk;
+  if (FLARE_UNLIKELY(protocol->GetCharacteristics().stateful_writes)) {
+    lk = std::unique_lock(write_lock_);
+  }
   NoncontiguousBuffer nb;
   protocol->WriteMessage(msg, &nb, controller);
   auto bytes = nb.ByteSize();
+  if (call_context) {
+    call_context->serialized_tsc = ReadTsc();
+  }
+  if (FLARE_UNLIKELY(lk.owns_lock())) {
+    NoncontiguousBuffer pending;
+    if (protocol->TryGetPendingBytes(&pending)) {
+      nb.Append(std::move(pending));
+    }
+    if (nb.Empty()) {  // The message is dropped by the protocol.
+      return 0;
+    }
+  }
   (void)conn_->Write(std::move(nb), ctx);  // Failure is ignored.
+  if (call_context) {
+    call_context->written_tsc = ReadTsc();
+  }
   return bytes;
 }
 
+void NormalConnectionHandler::FlushPendingBytes() {
+  auto flush = [&](StreamProtocol* protocol) {
+    if (FLARE_LIKELY(!protocol->GetCharacteristics().stateful_writes)) {
+      return;
+    }
+    std::scoped_lock _(write_lock_);
+    NoncontiguousBuffer nb;
+    if (protocol->TryGetPendingBytes(&nb)) {
+      (void)conn_->Write(std::move(nb), kFastCallReservedContextId);
+    }
+  };
+
+  // Before the protocol is determined, any of the protocols may have consumed
+  // some bytes (and want to reply to them).
+  if (FLARE_LIKELY(ever_succeeded_cut_msg_)) {
+    flush(ctx_->protocols[last_protocol_].get());
+  } else {
+    for (auto&& e : ctx_->protocols) {
+      flush(e.get());
+    }
+  }
+}
+
 void NormalConnectionHandler::ServiceFastCall(
     std::unique_ptr<Message>&& msg, StreamProtocol* protocol,
     std::unique_ptr<Controller> controller, std::uint64_t receive_tsc,
@@ -385,6 +479,7 @@ void NormalConnectionHandler::ServiceFastCall(
   auto cid = msg->GetCorrelationId();
   if (FLARE_UNLIKELY(!protocol->TryParse(&msg, controller.get()))) {
     FLARE_LOG_WARNING_EVERY_SECOND("Failed to parse message #{}.", cid);
+    AbandonCall(cid, protocol);
     return;
   }
   auto parsed_tsc = ReadTsc();
@@ -412,6 +507,7 @@ void NormalConnectionHandler::ServiceFastCall(
         "any service. The message was successfully parsed by protocol [{}].",
         GetTypeName(*msg), ctx_->remote_peer.ToString(),
         protocol->GetCharacteristics().name);
+    AbandonCall(cid, protocol);
     return;
   }
 
@@ -423,7 +519,7 @@ void NormalConnectionHandler::ServiceFastCall(
     // Call user's code.
     auto writer = [&](auto&& m) {
       return WriteMessage(m, protocol, controller.get(),
-                          kFastCallReservedContextId);
+                          kFastCallReservedContextId, &call_context);
     };
 
     auto processing_status = handler->FastCall(&msg, writer, &call_context);
@@ -434,7 +530,9 @@ void NormalConnectionHandler::ServiceFastCall(
       call_context.status = -1;  // ...
       if (processing_status == StreamService::ProcessingStatus::Overloaded) {
         WriteOverloaded(*msg, protocol, &*controller);
-      }  // No special action required for other errors.
+      } else {
+        AbandonCall(cid, protocol);
+      }
     }
 
     WaitForRpcCompletion();
@@ -466,11 +564,27 @@ void NormalConnectionHandler::InitializeStreamContextLocked(
           [=, this](auto&& am) {
             return WriteMessage(am, protocol, pctlr, correlation_id);
           },
+      .write_window_update =
+          [=, this](auto increment) {
+            // Not associated with the stream, we don't want to complete
+            // user's write with this one.
+            WriteMessage(StreamWindowUpdateMessage(correlation_id, increment),
+                         protocol, pctlr, kFastCallReservedContextId);
+          },
       .restart_read = [=, this] { return conn_->RestartRead(); },
       .on_close = [=, this] { return OnStreamClosed(correlation_id); },
       .on_cleanup = [=, this] { return OnStreamCleanup(correlation_id); }};
+  // The client advertises its window in its first message, we grant ours in
+  // return.
+  StreamIoAdaptor::FlowControl flow_control = {
+      .stream_window = static_cast<std::size_t>(
+          std::max(0, FLAGS_flare_rpc_server_stream_window)),
+      .window_advertised = false,
+      .connection = &stream_connection_window_,
+      .connection_window = static_cast<std::size_t>(
+          std::max(0, FLAGS_flare_rpc_server_connection_window))};
   ctx.io_adaptor = std::make_unique<StreamIoAdaptor>(
-      FLAGS_flare_rpc_server_stream_concurrency, std::move(ops));
+      FLAGS_flare_rpc_server_stream_concurrency, std::move(ops), flow_control);
 }
 
 void NormalConnectionHandler::ServiceStreamCall(
@@ -745,8 +859,9 @@ bool NormalConnectionHandler::OnNewCall() {
   return true;
 }
 
-void NormalConnectionHandler::OnCallCompletion() {
-  owner_->OnCallCompletion();
+void NormalConnectionHandler::OnCallCompletion(
+    std::chrono::nanoseconds latency) {
+  owner_->OnCallCompletion(latency);
   // We must notify owner first, since we're waiting for our own counter to be
   // zero in `Join()`.
 
@@ -15,6 +15,7 @@
 #ifndef FLARE_RPC_INTERNAL_NORMAL_CONNECTION_HANDLER_H_
 #define FLARE_RPC_INTERNAL_NORMAL_CONNECTION_HANDLER_H_
 
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -92,9 +93,25 @@ class NormalConnectionHandler : public ServerConnectionHandler {
   void WriteOverloaded(const Message& corresponding_req,
                        StreamProtocol* protocol, Controller* controller);
 
+  // Called if no response is going to be sent for the request. Protocols with
+  // `stateful_writes` are notified so that they can tell the caller about this
+  // (instead of leaving the call to time out).
+  void AbandonCall(std::uint64_t correlation_id, StreamProtocol* protocol);
+
   // Serialize message and write it out.
-  std::size_t WriteMessage(const Message& msg, StreamProtocol* protocol,
-                           Controller* controller, std::uintptr_t ctx) const;
+  //
+  // If `call_context` is provided, its `serialized_tsc` and `written_tsc` are
+  // updated.
+  std::size_t WriteMessage(
+      const Message& msg, StreamProtocol* protocol, Controller* controller,
+      std::uintptr_t ctx,
+      StreamService::Context* call_context = nullptr) const;
+
+  // Write out bytes the protocol(s) want to send on their own. Only protocols
+  // with `stateful_writes` are asked.
+  //
+  // @sa: `StreamProtocol::TryGetPendingBytes`.
+  void FlushPendingBytes();
 
   // This method is executed in dedicated fiber, so blocking does not matter
   // much.
@@ -161,8 +178,8 @@ class NormalConnectionHandler : public ServerConnectionHandler {
   // first message in the stream.
   bool OnNewCall();
 
-  // Called when RPC has finished.
-  void OnCallCompletion();
+  // Called when RPC has finished. @sa: `Server::OnCallCompletion`.
+  void OnCallCompletion(std::chrono::nanoseconds latency = {});
 
   // Called when both input / output stream associated with the call has been
   // closed.
@@ -203,6 +220,16 @@ class NormalConnectionHandler : public ServerConnectionHandler {
   // Unfinished calls to services.
   std::atomic<std::size_t> ongoing_requests_{0};
 
+  // For protocols with `stateful_writes`, serialization of messages and
+  // writing them out are done with this lock held, so that bytes reach the
+  // connection in the same order as they're produced.
+  mutable fiber::Mutex write_lock_;
+
+  // Limits bytes of streaming RPC messages buffered by `streams_` and not read
+  // by the services yet. It must outlive `streams_`. @sa:
+  // `StreamIoAdaptor::FlowControl`.
+  StreamIoAdaptor::ConnectionWindow stream_connection_window_;
+
   // Only stream calls' context is saved here. For fast calls they're largely
   // stateless from our perspective.
   //
@@ -19,105 +19,143 @@
 #include <shared_mutex>
 #include <string>
 
+#include "flare/base/chrono.h"
+#include "flare/base/enum.h"
+#include "flare/base/internal/builtin_monitoring.h"
+#include "flare/base/internal/time_keeper.h"
+#include "flare/base/likely.h"
+
+using namespace std::literals;
+
 namespace flare::rpc::detail {
 namespace {
 
-Json::Value DumpMetricsCnt(const WriteMostlyMetrics<std::uint64_t>& metrics) {
+constexpr std::pair<int, const char*> kWindows[] = {
+    {3600, "last_hour"}, {60, "last_minute"}, {1, "last_second"}};
+
+constexpr std::pair<double, const char*> kPercentiles[] = {
+    {0.5, "p50"}, {0.9, "p90"}, {0.99, "p99"}, {0.999, "p999"},
+    {0.9999, "p9999"}};
+
+constexpr const char* kStageNames[] = {"queueing", "parsing", "handling",
+                                       "serializing", "writing"};
+static_assert(std::size(kStageNames) ==
+              underlying_value(RpcMetrics::Stage::Count));
+
+// If desired, user can report these timers to their monitoring system. They're
+// not broken down by method as reporting with tags is considerably slower.
+internal::BuiltinMonitoredTimer stage_latency_monitoring[] = {
+    internal::BuiltinMonitoredTimer("flare_rpc_server_latency_queueing", 1us),
+    internal::BuiltinMonitoredTimer("flare_rpc_server_latency_parsing", 1us),
+    internal::BuiltinMonitoredTimer("flare_rpc_server_latency_handling", 1us),
+    internal::BuiltinMonitoredTimer("flare_rpc_server_latency_serializing",
+                                    1us),
+    internal::BuiltinMonitoredTimer("flare_rpc_server_latency_writing", 1us)};
+
+template <class T>
+Json::Value ToJson(const write_mostly::detail::MetricsStats<T>& stats) {
   Json::Value j;
-  j["last_hour"] = static_cast<Json::Value::UInt64>(metrics.Get(3600).cnt);
-  j["last_minute"] = static_cast<Json::Value::UInt64>(metrics.Get(60).cnt);
-  j["last_second"] = static_cast<Json::Value::UInt64>(metrics.Get(1).cnt);
-  j["total"] = static_cast<Json::Value::UInt64>(metrics.GetAll().cnt);
+  j["average"] = static_cast<Json::UInt64>(stats.cnt ? stats.sum / stats.cnt
+                                                     : 0);
+  j["max"] = static_cast<Json::UInt64>(stats.cnt ? stats.max : 0);
+  j["min"] = static_cast<Json::UInt64>(stats.cnt ? stats.min : 0);
   return j;
 }
 
-Json::Value DumpMetricsLatency(const WriteMostlyMetrics<std::uint64_t>& m1,
-                               const WriteMostlyMetrics<std::uint64_t>& m2) {
-  auto combine_and_to_json = [](auto&& jsv, auto&& r1, auto&& r2) {
-    jsv["average"] = static_cast<Json::Value::UInt64>(
-        (r1.cnt + r2.cnt != 0)
-            ? (r1.average * r1.cnt + r2.average * r2.cnt) / (r1.cnt + r2.cnt)
-            : 0);
-    jsv["max"] = static_cast<Json::Value::UInt64>(std::max(r1.max, r2.max));
-    jsv["min"] = static_cast<Json::Value::UInt64>(
-        (r1.cnt == 0 || r2.cnt == 0) ? std::max(r1.min, r2.min)
-                                     : std::min(r1.min, r2.min));
-  };
+Json::Value ToJson(const WriteMostlyHistogram::Snapshot& latency) {
   Json::Value j;
-  for (auto&& [k, v] : std::map<int, std::string>(
-           {{3600, "last_hour"}, {60, "last_minute"}, {1, "last_second"}})) {
-    auto&& r1 = m1.Get(k);
-    auto&& r2 = m2.Get(k);
-    combine_and_to_json(j[v], r1, r2);
+  for (auto&& [p, name] : kPercentiles) {
+    j[name] = static_cast<Json::UInt64>(latency.GetPercentile(p));
   }
-  combine_and_to_json(j["total"], m1.GetAll(), m2.GetAll());
   return j;
 }
 
-Json::Value DumpPacketSize(const WriteMostlyMetrics<std::size_t>& m) {
-  Json::Value j;
-  for (auto&& [k, v] : std::map<int, std::string>(
-           {{3600, "last_hour"}, {60, "last_minute"}, {1, "last_second"}})) {
-    auto&& r = m.Get(k);
-    j[v]["average"] = static_cast<Json::UInt64>(r.average);
-    j[v]["min"] = static_cast<Json::UInt64>(r.min);
-    j[v]["max"] = static_cast<Json::UInt64>(r.max);
+}  // namespace
+
+RpcMetrics::CallStats::CallStats(const CallRecord& record) {
+  (FLARE_LIKELY(record.error_code == STATUS_SUCCESS) ? success : failure) =
+      Stats<std::uint64_t>(record.elapsed / 1ms);
+  pkt_size_in = Stats<std::size_t>(record.pkt_size_in);
+  pkt_size_out = Stats<std::size_t>(record.pkt_size_out);
+  if (record.has_stages) {
+    for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+      stages[i] = Stats<std::uint64_t>(record.stages[i] / 1us);
+    }
   }
-  auto&& r = m.GetAll();
-  j["total"]["average"] = static_cast<Json::UInt64>(r.average);
-  j["total"]["min"] = static_cast<Json::UInt64>(r.min);
-  j["total"]["max"] = static_cast<Json::UInt64>(r.max);
-  return j;
 }
 
-void MergeGlobal(Json::Value* global, const Json::Value& method_stat) {
-  // Latency should calc first, else g_cnt will change.
-  for (auto&& k : {"last_hour", "last_minute", "last_second", "total"}) {
-    auto&& g_latency = (*global)["latency"][k]["average"].asUInt64();
-    auto&& m_latency = method_stat["latency"][k]["average"].asUInt64();
-    auto&& g_cnt = (*global)["counter"]["total"][k].asUInt64();
-    auto&& m_cnt = method_stat["counter"]["total"][k].asUInt64();
-    (*global)["latency"][k]["average"] =
-        (g_cnt + m_cnt != 0)
-            ? (g_latency * g_cnt + m_latency * m_cnt) / (g_cnt + m_cnt)
-            : 0;
-    (*global)["latency"][k]["max"] = std::max((*global)["latency"][k]["max"],
-                                              method_stat["latency"][k]["max"]);
-    (*global)["latency"][k]["min"] =
-        (g_cnt == 0 || m_cnt == 0) ? std::max((*global)["latency"][k]["min"],
-                                              method_stat["latency"][k]["min"])
-                                   : std::min((*global)["latency"][k]["min"],
-                                              method_stat["latency"][k]["min"]);
+void RpcMetrics::CallStats::Merge(const CallStats& other) {
+  success.Merge(other.success);
+  failure.Merge(other.failure);
+  pkt_size_in.Merge(other.pkt_size_in);
+  pkt_size_out.Merge(other.pkt_size_out);
+  for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+    stages[i].Merge(other.stages[i]);
   }
-  for (auto&& pkt_size : {"packet_size_in", "packet_size_out"}) {
-    for (auto&& k : {"last_hour", "last_minute", "last_second", "total"}) {
-      auto&& g_pkt_size = (*global)[pkt_size][k]["average"].asUInt64();
-      auto&& m_pkg_size = method_stat[pkt_size][k]["average"].asUInt64();
-      auto&& g_cnt = (*global)["counter"]["total"][k].asUInt64();
-      auto&& m_cnt = method_stat["counter"]["total"][k].asUInt64();
-      (*global)[pkt_size][k]["average"] =
-          (g_cnt + m_cnt != 0)
-              ? (g_pkt_size * g_cnt + m_pkg_size * m_cnt) / (g_cnt + m_cnt)
-              : 0;
-      (*global)[pkt_size][k]["max"] = std::max((*global)[pkt_size][k]["max"],
-                                               method_stat[pkt_size][k]["max"]);
-      (*global)[pkt_size][k]["min"] =
-          (g_cnt == 0 || m_cnt == 0)
-              ? std::max((*global)[pkt_size][k]["min"],
-                         method_stat[pkt_size][k]["min"])
-              : std::min((*global)[pkt_size][k]["min"],
-                         method_stat[pkt_size][k]["min"]);
-    }
+}
+
+void RpcMetrics::LatencyStats::Merge(const LatencyStats& other) {
+  call.Merge(other.call);
+  for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+    stages[i].Merge(other.stages[i]);
   }
-  for (auto&& k1 : {"failure", "success", "total"}) {
-    for (auto&& k2 : {"last_hour", "last_minute", "last_second", "total"}) {
-      (*global)["counter"][k1][k2] = (*global)["counter"][k1][k2].asUInt64() +
-                                     method_stat["counter"][k1][k2].asUInt64();
+}
+
+RpcMetrics::MethodStats::MethodStats() : records_(kMaxWindowSize) {
+  timer_id_ = internal::TimeKeeper::Instance()->AddTimer(
+      ReadSteadyClock() + 1s, 1s, [this](auto) { Purge(); }, false);
+}
+
+RpcMetrics::MethodStats::~MethodStats() {
+  internal::TimeKeeper::Instance()->KillTimer(timer_id_);
+}
+
+RpcMetrics::CallStats RpcMetrics::MethodStats::Get(std::size_t seconds) const {
+  std::scoped_lock _(records_lock_);
+  seconds = std::min(seconds, kMaxWindowSize);
+  CallStats result;
+  auto pos = current_pos_;
+  for (std::size_t i = 0; i != seconds; ++i) {
+    pos = (pos + kMaxWindowSize - 1) % kMaxWindowSize;
+    if (!records_[pos]) {
+      break;
     }
+    result.Merge(*records_[pos]);
   }
+  return result;
 }
 
-}  // namespace
+RpcMetrics::CallStats RpcMetrics::MethodStats::GetAll() const {
+  std::scoped_lock _(records_lock_);
+  return total_;
+}
+
+RpcMetrics::LatencyStats RpcMetrics::MethodStats::GetLatency(
+    std::size_t seconds) const {
+  LatencyStats result;
+  result.call = latency_.Get(seconds);
+  for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+    result.stages[i] = stage_latency_[i].Get(seconds);
+  }
+  return result;
+}
+
+RpcMetrics::LatencyStats RpcMetrics::MethodStats::GetAllLatency() const {
+  LatencyStats result;
+  result.call = latency_.GetAll();
+  for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+    result.stages[i] = stage_latency_[i].GetAll();
+  }
+  return result;
+}
+
+void RpcMetrics::MethodStats::Purge() {
+  auto entry = std::make_unique<CallStats>(current_.Purge());
+  std::scoped_lock _(records_lock_);
+  total_.Merge(*entry);
+  records_[current_pos_] = std::move(entry);
+  current_pos_ = (current_pos_ + 1) % kMaxWindowSize;
+}
 
 void RpcMetrics::RegisterMethod(MethodDescriptorPtr method) {
   std::unique_lock lk(lock_);
@@ -129,31 +167,63 @@ void RpcMetrics::RegisterMethod(MethodDescriptorPtr method) {
 }
 
 void RpcMetrics::Dump(Json::Value* json_stat) const {
+  // Statistics of all methods in each window. The last one is for `total`.
+  constexpr auto kTotalIndex = std::size(kWindows);
+  CallStats global_stats[kTotalIndex + 1];
+  LatencyStats global_latency[kTotalIndex + 1];
+
+  auto to_json = [](auto&& jsv, auto&& key, const CallStats& stats,
+                    const LatencyStats& latency_stats) {
+    jsv["counter"]["success"][key] =
+        static_cast<Json::UInt64>(stats.success.cnt);
+    jsv["counter"]["failure"][key] =
+        static_cast<Json::UInt64>(stats.failure.cnt);
+    jsv["counter"]["total"][key] =
+        static_cast<Json::UInt64>(stats.success.cnt + stats.failure.cnt);
+    auto latency = stats.success;
+    latency.Merge(stats.failure);
+    jsv["latency"][key] = ToJson(latency);
+    jsv["latency_percentiles_us"][key] = ToJson(latency_stats.call);
+    jsv["packet_size_in"][key] = ToJson(stats.pkt_size_in);
+    jsv["packet_size_out"][key] = ToJson(stats.pkt_size_out);
+    for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+      jsv["stage_latency_us"][kStageNames[i]][key] = ToJson(stats.stages[i]);
+      jsv["stage_latency_percentiles_us"][kStageNames[i]][key] =
+          ToJson(latency_stats.stages[i]);
+    }
+  };
+
   std::shared_lock locker(lock_);
+  for (auto&& [method, method_stats] : method_map_) {
+    Json::Value jsv;
+    for (std::size_t i = 0; i != kTotalIndex; ++i) {
+      auto stats = method_stats->Get(kWindows[i].first);
+      auto latency = method_stats->GetLatency(kWindows[i].first);
+      to_json(jsv, kWindows[i].second, stats, latency);
+      global_stats[i].Merge(stats);
+      global_latency[i].Merge(latency);
+    }
+    auto stats = method_stats->GetAll();
+    auto latency = method_stats->GetAllLatency();
+    to_json(jsv, "total", stats, latency);
+    global_stats[kTotalIndex].Merge(stats);
+    global_latency[kTotalIndex].Merge(latency);
+    (*json_stat)[method->full_name()] = jsv;
+  }
+
   Json::Value global;
-  for (auto&& it = method_map_.begin(); it != method_map_.end(); ++it) {
-    auto&& method_stat = DumpMethodStats(it->second.get());
-    MergeGlobal(&global, method_stat);
-    (*json_stat)[it->first->full_name()] = method_stat;
+  for (std::size_t i = 0; i != kTotalIndex; ++i) {
+    to_json(global, kWindows[i].second, global_stats[i], global_latency[i]);
   }
+  to_json(global, "total", global_stats[kTotalIndex],
+          global_latency[kTotalIndex]);
   (*json_stat)["global"] = global;
 }
 
-Json::Value RpcMetrics::DumpMethodStats(const MethodStats* method_stats) const {
-  Json::Value j;
-  Json::Value& count_stat = j["counter"];
-  count_stat["failure"] = DumpMetricsCnt(method_stats->failure);
-  count_stat["success"] = DumpMetricsCnt(method_stats->success);
-  for (auto&& key : {"last_hour", "last_minute", "last_second", "total"}) {
-    count_stat["total"][key] = count_stat["failure"][key].asUInt64() +
-                               count_stat["success"][key].asUInt64();
+void RpcMetrics::ReportStagesToMonitoringSystem(const CallRecord& record) {
+  for (int i = 0; i != underlying_value(Stage::Count); ++i) {
+    stage_latency_monitoring[i].Report(record.stages[i]);
   }
-
-  j["latency"] =
-      DumpMetricsLatency(method_stats->success, method_stats->failure);
-  j["packet_size_in"] = DumpPacketSize(method_stats->pkt_size_in);
-  j["packet_size_out"] = DumpPacketSize(method_stats->pkt_size_out);
-  return j;
 }
 
 void RpcMetrics::RegisterMethod(MethodDescriptorPtr method,
@@ -15,8 +15,10 @@
 #ifndef FLARE_RPC_INTERNAL_RPC_METRICS_H_
 #define FLARE_RPC_INTERNAL_RPC_METRICS_H_
 
+#include <chrono>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <utility>
 #include <vector>
@@ -26,6 +28,7 @@
 
 #include "flare/base/internal/annotation.h"
 #include "flare/base/never_destroyed.h"
+#include "flare/base/thread/spinlock.h"
 #include "flare/base/write_mostly.h"
 #include "flare/rpc/protocol/protobuf/rpc_meta.pb.h"
 
@@ -37,6 +40,29 @@ class RpcMetrics {
   typedef const google::protobuf::MethodDescriptor* MethodDescriptorPtr;
 
  public:
+  // Stages a call goes through on the server side.
+  enum class Stage {
+    Queueing,     // Received -> dispatched to a fiber.
+    Parsing,      // Dispatched -> request parsed.
+    Handling,     // Parsed -> user's handler completed.
+    Serializing,  // Handler completed -> response serialized.
+    Writing,      // Serialized -> response handed to the connection.
+    Count
+  };
+
+  // Everything we know about a call.
+  struct CallRecord {
+    int error_code;
+    std::chrono::nanoseconds elapsed;
+    std::size_t pkt_size_in;
+    std::size_t pkt_size_out;
+
+    // Latency of each stage, indexed by `Stage`. Not all calls have them
+    // (e.g., streaming RPCs), `has_stages` must be set if they're filled.
+    bool has_stages = false;
+    std::chrono::nanoseconds stages[static_cast<int>(Stage::Count)];
+  };
+
   // Register a method.
   //
   // It's not strictly necessary to call this method before calling `Report`.
@@ -45,19 +71,27 @@ class RpcMetrics {
   // occurs.
   void RegisterMethod(MethodDescriptorPtr method);
 
-  // Update service method stats
+  // Update service method stats.
+  //
+  // All statistics of a call are updated together, with a single (per-thread,
+  // hence uncontended) lock held.
+  void Report(MethodDescriptorPtr method, const CallRecord& record) {
+    GetCached(method)->Report(record);
+    if (record.has_stages) {
+      ReportStagesToMonitoringSystem(record);
+    }
+  }
+
+  // Same as above, for callers that don't know latency of each stage.
+  // `elapsed_time` is in milliseconds.
   void Report(MethodDescriptorPtr method, int error_code, int elapsed_time,
               std::size_t pkt_size_in, std::size_t pkt_size_out) {
-    auto&& ms = GetCached(method);
-    auto&& metrics =
-        (FLARE_LIKELY(error_code == STATUS_SUCCESS) ? &ms->success
-                                                    : &ms->failure);
-    // TODO(luobogao): Too many reports slows thing down (mostly because of
-    // internal spinlock). See if we can grab a single lock and update all of
-    // them.
-    metrics->Report(elapsed_time);
-    ms->pkt_size_in.Report(pkt_size_in);
-    ms->pkt_size_out.Report(pkt_size_out);
+    CallRecord record;
+    record.error_code = error_code;
+    record.elapsed = std::chrono::milliseconds(elapsed_time);
+    record.pkt_size_in = pkt_size_in;
+    record.pkt_size_out = pkt_size_out;
+    Report(method, record);
   }
 
   void Dump(Json::Value* json_stat) const;
@@ -73,11 +107,120 @@ class RpcMetrics {
   RpcMetrics(const RpcMetrics&) = delete;
   RpcMetrics& operator=(const RpcMetrics&) = delete;
 
-  struct MethodStats {
-    WriteMostlyMetrics<std::uint64_t> success;
-    WriteMostlyMetrics<std::uint64_t> failure;
-    WriteMostlyMetrics<std::size_t> pkt_size_in;
-    WriteMostlyMetrics<std::size_t> pkt_size_out;
+  template <class T>
+  using Stats = write_mostly::detail::MetricsStats<T>;
+  using LatencyHistogram = WriteMostlyHistogram::Snapshot;
+
+  // Statistics of calls made in a given period.
+  struct CallStats {
+    constexpr CallStats() = default;
+    explicit CallStats(const CallRecord& record);
+
+    void Merge(const CallStats& other);
+
+    Stats<std::uint64_t> success;  // Latency, in milliseconds.
+    Stats<std::uint64_t> failure;  // Ditto.
+    Stats<std::size_t> pkt_size_in;
+    Stats<std::size_t> pkt_size_out;
+    Stats<std::uint64_t> stages[static_cast<int>(Stage::Count)];  // In us.
+  };
+
+  // Latency distributions (in microseconds) of calls made in a given period.
+  struct LatencyStats {
+    void Merge(const LatencyStats& other);
+
+    LatencyHistogram call;
+    LatencyHistogram stages[static_cast<int>(Stage::Count)];
+  };
+
+  struct CallStatsBuffer {
+    constexpr CallStatsBuffer() = default;
+    explicit CallStatsBuffer(const CallStats& stats) : stats(stats) {}
+
+    void Update(const CallStats& stats) {
+      std::scoped_lock _(splk);
+      this->stats.Merge(stats);
+    }
+
+    mutable Spinlock splk;
+    CallStats stats;
+  };
+
+  struct CallStatsTraits {
+    using Type = CallStats;
+    using WriteBuffer = CallStatsBuffer;
+    static constexpr auto kWriteBufferInitializer = WriteBuffer();
+    static void Update(WriteBuffer* wb, const CallStats& val) {
+      wb->Update(val);
+    }
+    static void Merge(WriteBuffer* wb1, const WriteBuffer& wb2) {
+      std::scoped_lock _(wb1->splk, wb2.splk);
+      wb1->stats.Merge(wb2.stats);
+    }
+    static void Copy(const WriteBuffer& src_wb, WriteBuffer* dst_wb) {
+      std::scoped_lock _(src_wb.splk, dst_wb->splk);
+      dst_wb->stats = src_wb.stats;
+    }
+    static CallStats Read(const WriteBuffer& wb) {
+      std::scoped_lock _(wb.splk);
+      return wb.stats;
+    }
+    static WriteBuffer Purge(WriteBuffer* wb) {
+      CallStats result;
+      std::scoped_lock _(wb->splk);
+      std::swap(wb->stats, result);
+      return WriteBuffer(result);
+    }
+  };
+
+  // Statistics of a method, in the past hour (at a granularity of 1s) and in
+  // total.
+  class MethodStats {
+   public:
+    MethodStats();
+    ~MethodStats();
+
+    void Report(const CallRecord& record) {
+      current_.Update(CallStats(record));
+      latency_.Report(record.elapsed / std::chrono::microseconds(1));
+      if (record.has_stages) {
+        for (int i = 0; i != static_cast<int>(Stage::Count); ++i) {
+          stage_latency_[i].Report(record.stages[i] /
+                                   std::chrono::microseconds(1));
+        }
+      }
+    }
+
+    // Get statistics of recent `seconds` (at most an hour).
+    CallStats Get(std::size_t seconds) const;
+
+    // Get statistics since we started.
+    CallStats GetAll() const;
+
+    // Same as above, for latency distributions.
+    LatencyStats GetLatency(std::size_t seconds) const;
+    LatencyStats GetAllLatency() const;
+
+   private:
+    static constexpr std::size_t kMaxWindowSize = 3600;
+
+    // Latencies of stages are only used for telling which stage is slow, so
+    // they're recorded at a lower precision (~12%) to save memory. This takes
+    // ~1K per thread for each stage of each method, instead of ~3.5K.
+    struct StageLatencyHistogram : WriteMostlyHistogram {
+      StageLatencyHistogram() : WriteMostlyHistogram(3) {}
+    };
+
+    void Purge();
+
+    mutable std::mutex records_lock_;
+    std::vector<std::unique_ptr<CallStats>> records_;
+    std::size_t current_pos_ = 0;
+    CallStats total_;
+    WriteMostly<CallStatsTraits> current_;
+    std::uint64_t timer_id_;
+    WriteMostlyHistogram latency_;
+    StageLatencyHistogram stage_latency_[static_cast<int>(Stage::Count)];
   };
 
   typedef std::pair<MethodDescriptorPtr, MethodStats*> MethodCachePair;
@@ -114,7 +257,7 @@ class RpcMetrics {
     }
   };
 
-  Json::Value DumpMethodStats(const MethodStats* method_stats) const;
+  static void ReportStagesToMonitoringSystem(const CallRecord& record);
 
   MethodStats* GetCached(MethodDescriptorPtr method) {
     // Hack an element so that we don't need to check vector.end() for
@@ -137,7 +280,6 @@ class RpcMetrics {
   // Protects method_map_.
   mutable std::shared_mutex lock_;
   MethodMap method_map_;
-  MethodStats ms;
 };
 
 }  // namespace flare::rpc::detail
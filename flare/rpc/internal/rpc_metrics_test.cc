@@ -20,6 +20,7 @@
 #include "gtest/gtest.h"
 #include "jsoncpp/json.h"
 
+#include "flare/base/enum.h"
 #include "flare/testing/echo_service.flare.pb.h"
 #include "flare/testing/main.h"
 
@@ -95,6 +96,89 @@ TEST(RpcServiceStatsTest, Global) {
             global_stat["packet_size_out"]["last_minute"]["min"].asUInt64());
 }
 
+TEST(RpcServiceStatsTest, Stages) {
+  const google::protobuf::MethodDescriptor* method =
+      testing::EchoService::descriptor()->method(2);
+
+  RpcMetrics::CallRecord record;
+  record.error_code = 0;
+  record.elapsed = std::chrono::milliseconds(1);
+  record.pkt_size_in = 100;
+  record.pkt_size_out = 100;
+  record.has_stages = true;
+  for (int i = 0; i != underlying_value(RpcMetrics::Stage::Count); ++i) {
+    record.stages[i] = std::chrono::microseconds(100 * (i + 1));
+  }
+  RpcMetrics::Instance()->Report(method, record);
+  for (int i = 0; i != underlying_value(RpcMetrics::Stage::Count); ++i) {
+    record.stages[i] = std::chrono::microseconds(300 * (i + 1));
+  }
+  RpcMetrics::Instance()->Report(method, record);
+  // Calls without stage latencies are not counted in stage statistics.
+  RpcMetrics::Instance()->Report(method, 0, 1, 100, 100);
+
+  Json::Value root;
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  RpcMetrics::Instance()->Dump(&root);
+
+  auto&& stats = root[method->full_name()];
+  EXPECT_EQ(3, stats["counter"]["success"]["total"].asUInt64());
+  auto&& stages = stats["stage_latency_us"];
+  EXPECT_EQ(200, stages["queueing"]["last_minute"]["average"].asUInt64());
+  EXPECT_EQ(100, stages["queueing"]["last_minute"]["min"].asUInt64());
+  EXPECT_EQ(300, stages["queueing"]["last_minute"]["max"].asUInt64());
+  EXPECT_EQ(400, stages["parsing"]["total"]["average"].asUInt64());
+  EXPECT_EQ(600, stages["handling"]["last_hour"]["average"].asUInt64());
+  EXPECT_EQ(800, stages["serializing"]["total"]["average"].asUInt64());
+  EXPECT_EQ(1500, stages["writing"]["last_hour"]["max"].asUInt64());
+  EXPECT_EQ(1500, root["global"]["stage_latency_us"]["writing"]["total"]["max"]
+                      .asUInt64());
+
+  // Percentiles of stages are accurate to ~12%.
+  auto&& percentiles = stats["stage_latency_percentiles_us"];
+  EXPECT_NEAR(100, percentiles["queueing"]["last_minute"]["p50"].asUInt64(),
+              12);
+  EXPECT_NEAR(300, percentiles["queueing"]["last_minute"]["p99"].asUInt64(),
+              36);
+  EXPECT_NEAR(1500, percentiles["writing"]["total"]["p99"].asUInt64(), 180);
+  EXPECT_NEAR(
+      1500,
+      root["global"]["stage_latency_percentiles_us"]["writing"]["total"]["p99"]
+          .asUInt64(),
+      180);
+}
+
+TEST(RpcServiceStatsTest, Percentiles) {
+  const google::protobuf::MethodDescriptor* method =
+      testing::EchoService::descriptor()->method(3);
+
+  RpcMetrics::CallRecord record;
+  record.error_code = 0;
+  record.pkt_size_in = 100;
+  record.pkt_size_out = 100;
+  for (int i = 1; i <= 10000; ++i) {
+    record.elapsed = std::chrono::microseconds(i);
+    RpcMetrics::Instance()->Report(method, record);
+  }
+
+  Json::Value root;
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  RpcMetrics::Instance()->Dump(&root);
+
+  // Percentiles are accurate to ~3%.
+  for (auto&& key : {"last_minute", "last_hour", "total"}) {
+    auto&& latency = root[method->full_name()]["latency_percentiles_us"][key];
+    EXPECT_NEAR(5000, latency["p50"].asUInt64(), 150);
+    EXPECT_NEAR(9000, latency["p90"].asUInt64(), 270);
+    EXPECT_NEAR(9900, latency["p99"].asUInt64(), 300);
+    EXPECT_NEAR(9990, latency["p999"].asUInt64(), 300);
+    EXPECT_NEAR(9999, latency["p9999"].asUInt64(), 300);
+  }
+  EXPECT_GE(root["global"]["latency_percentiles_us"]["total"]["p9999"]
+                .asUInt64(),
+            9999);
+}
+
 }  // namespace flare::rpc::detail
 
 FLARE_TEST_MAIN
@@ -0,0 +1,77 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/rpc_samples.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "gflags/gflags.h"
+
+#include "flare/base/never_destroyed.h"
+
+DEFINE_int32(flare_rpc_samples_interval, 100,
+             "At most one RPC is sampled into `/inspect/rpc_samples` every so "
+             "many milliseconds. Setting it to 0 (or a negative value) "
+             "disables sampling.");
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+RpcSamples::RpcSamples(std::chrono::nanoseconds interval)
+    : enabled_(interval > std::chrono::nanoseconds::zero()),
+      sampler_(std::max(interval, std::chrono::nanoseconds::zero())) {}
+
+void RpcSamples::Report(const RpcSample& sample) noexcept {
+  auto&& ring = *rings_;
+  auto seq = ring.next++;
+  auto&& slot = ring.slots[seq % kSamplesPerThread];
+
+  // A seqlock with a single writer (the owner thread).
+  slot.version.store(seq * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&slot.sample, &sample, sizeof(sample));
+  slot.version.store(seq * 2 + 2, std::memory_order_release);
+}
+
+std::vector<RpcSample> RpcSamples::GetSamples() const {
+  std::vector<RpcSample> result;
+  rings_.ForEach([&](const Ring* ring) {
+    for (auto&& slot : ring->slots) {
+      auto version = slot.version.load(std::memory_order_acquire);
+      if (version == 0 || version % 2 == 1) {
+        continue;  // Empty, or being written.
+      }
+      RpcSample copy;
+      memcpy(&copy, &slot.sample, sizeof(copy));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.version.load(std::memory_order_relaxed) == version) {
+        result.push_back(copy);
+      }  // Overwritten while we're copying it otherwise.
+    }
+  });
+  std::sort(result.begin(), result.end(), [](auto&& x, auto&& y) {
+    return x.timestamp > y.timestamp;
+  });
+  return result;
+}
+
+RpcSamples* RpcSamples::Instance() {
+  static NeverDestroyed<RpcSamples> samples(
+      FLAGS_flare_rpc_samples_interval * 1ms);
+  return samples.Get();
+}
+
+}  // namespace flare::rpc::detail
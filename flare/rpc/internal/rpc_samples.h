@@ -0,0 +1,105 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_INTERNAL_RPC_SAMPLES_H_
+#define FLARE_RPC_INTERNAL_RPC_SAMPLES_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+
+#include "flare/base/align.h"
+#include "flare/base/likely.h"
+#include "flare/base/thread/thread_local.h"
+#include "flare/rpc/internal/sampler.h"
+
+namespace flare::rpc::detail {
+
+// Metadata of a sampled RPC.
+//
+// This structure is kept trivially copyable so that it can be copied in and out
+// of the ring below without locking.
+struct RpcSample {
+  // When the call completed.
+  std::chrono::system_clock::time_point timestamp;
+  const google::protobuf::MethodDescriptor* method;
+  // NUL-terminated, truncated if too long.
+  char remote_peer[64];
+  int status;
+  std::size_t request_size;
+  std::size_t response_size;
+
+  // Latency breakdown. `total` is not necessarily the sum of the others as
+  // other stages (e.g., writing response out) may be involved.
+  std::chrono::nanoseconds queueing;    // Received -> dispatched.
+  std::chrono::nanoseconds parsing;     // Dispatched -> parsed.
+  std::chrono::nanoseconds processing;  // Parsed -> response written.
+  std::chrono::nanoseconds total;
+};
+
+static_assert(std::is_trivially_copyable_v<RpcSample>);
+
+// Samples a small fraction of RPCs into fixed-size per-thread rings, for
+// inspecting recent calls (@sa: `/inspect/rpc_samples`) without the cost of
+// dumping binlog or tracing.
+//
+// Writers only touch their own thread's ring, and readers never block writers.
+// Samples in a ring are overwritten once the ring is full, and are dropped
+// when the thread owning the ring exits.
+class RpcSamples {
+ public:
+  // At most one RPC is sampled every `interval`. Sampling is disabled if
+  // `interval` is not positive.
+  explicit RpcSamples(std::chrono::nanoseconds interval);
+
+  // Returns true if the caller should fill an `RpcSample` and `Report` it.
+  bool ShouldSample() noexcept {
+    return FLARE_UNLIKELY(enabled_ && sampler_.Sample());
+  }
+
+  // Save a sample into calling thread's ring.
+  void Report(const RpcSample& sample) noexcept;
+
+  // Returns samples in all rings, most recent first.
+  std::vector<RpcSample> GetSamples() const;
+
+  // Controlled by `flare_rpc_samples_interval`.
+  static RpcSamples* Instance();
+
+  static constexpr std::size_t kSamplesPerThread = 64;
+
+ private:
+  struct Slot {
+    // Odd while being written. Zero if nothing has been written yet.
+    std::atomic<std::uint64_t> version{0};
+    RpcSample sample;
+  };
+
+  struct alignas(hardware_destructive_interference_size) Ring {
+    std::uint64_t next = 0;  // Only accessed by the owner thread.
+    Slot slots[kSamplesPerThread];
+  };
+
+  bool enabled_;
+  LargeIntervalSampler sampler_;
+  ThreadLocal<Ring> rings_;
+};
+
+}  // namespace flare::rpc::detail
+
+#endif  // FLARE_RPC_INTERNAL_RPC_SAMPLES_H_
@@ -0,0 +1,104 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/rpc_samples.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/chrono.h"
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+namespace {
+
+RpcSample MakeSample(int status) {
+  RpcSample sample = {};
+  sample.timestamp = ReadSystemClock();
+  sample.status = status;
+  sample.total = status * 1ms;
+  return sample;
+}
+
+}  // namespace
+
+TEST(RpcSamples, Disabled) {
+  for (auto interval : {0ms, -1ms, -100ms}) {
+    RpcSamples samples(interval);
+    for (int i = 0; i != 1000; ++i) {
+      ASSERT_FALSE(samples.ShouldSample());
+    }
+  }
+}
+
+TEST(RpcSamples, ShouldSample) {
+  RpcSamples samples(100ms);
+  int count = 0;
+  auto stop = ReadCoarseSteadyClock() + 1s;
+  while (ReadCoarseSteadyClock() <= stop) {
+    count += samples.ShouldSample();
+  }
+  EXPECT_NEAR(count, 10, 2);
+}
+
+TEST(RpcSamples, Overwrite) {
+  RpcSamples samples(1ms);
+  for (std::size_t i = 0; i != RpcSamples::kSamplesPerThread * 2; ++i) {
+    samples.Report(MakeSample(i));
+  }
+  auto result = samples.GetSamples();
+  ASSERT_EQ(RpcSamples::kSamplesPerThread, result.size());
+  // Only the most recent ones are kept.
+  for (auto&& e : result) {
+    EXPECT_GE(e.status, static_cast<int>(RpcSamples::kSamplesPerThread));
+  }
+  for (std::size_t i = 1; i < result.size(); ++i) {
+    EXPECT_GE(result[i - 1].timestamp, result[i].timestamp);
+  }
+}
+
+TEST(RpcSamples, ConcurrentReadWrite) {
+  RpcSamples samples(1ms);
+  std::atomic<bool> leaving{false};
+  std::vector<std::thread> writers;
+  for (int i = 0; i != 4; ++i) {
+    writers.emplace_back([&, i] {
+      while (!leaving.load(std::memory_order_relaxed)) {
+        samples.Report(MakeSample(i + 1));
+      }
+    });
+  }
+  auto stop = ReadSteadyClock() + 1s;
+  while (ReadSteadyClock() < stop) {
+    for (auto&& e : samples.GetSamples()) {
+      // Torn samples should never be returned.
+      ASSERT_EQ(e.status * 1ms, e.total);
+    }
+  }
+  // Slots being written are skipped.
+  EXPECT_NEAR(RpcSamples::kSamplesPerThread * 4, samples.GetSamples().size(),
+              4);
+  leaving = true;
+  for (auto&& t : writers) {
+    t.join();
+  }
+}
+
+}  // namespace flare::rpc::detail
@@ -31,6 +31,7 @@ struct PoolTraits<rpc::SessionContext> {
   static constexpr auto kTransferBatchSize = 1024;
 
   static void OnPut(rpc::SessionContext* ctx) {
+    ctx->deadline = std::nullopt;
     ctx->binlog.correlation_id.clear();
     ctx->binlog.dumper = std::nullopt;
     ctx->binlog.dry_runner.reset();
@@ -69,6 +70,13 @@ bool IsTracedContextPresent() {
          rpc::session_context->tracing.server_span.Tracing();
 }
 
+std::optional<std::chrono::steady_clock::time_point> GetSessionDeadline() {
+  if (!fiber::ExecutionContext::Current()) {
+    return std::nullopt;
+  }
+  return rpc::session_context->deadline;
+}
+
 RefPtr<fiber::ExecutionContext> CaptureSessionContext() {
   return RefPtr(ref_ptr, fiber::ExecutionContext::Current());
 }
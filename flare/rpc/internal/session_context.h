@@ -15,6 +15,7 @@
 #ifndef FLARE_RPC_INTERNAL_SESSION_CONTEXT_H_
 #define FLARE_RPC_INTERNAL_SESSION_CONTEXT_H_
 
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
@@ -43,6 +44,13 @@ struct SessionContext {
   // behavior depending on this ID.
   std::string tracking_id;
 
+  // Deadline of the RPC being served, if the caller specified one.
+  //
+  // Outgoing RPCs made in this session have their timeout capped by this
+  // deadline, there's no point in waiting for a response after our own caller
+  // has given up.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
   // Vector clock is used for determining a logic order between RPCs in this
   // RPC-chain.
   //
@@ -106,6 +114,10 @@ bool IsDryRunContextPresent();
 // Tests if current session is being traced.
 bool IsTracedContextPresent();
 
+// Returns deadline of the RPC being served, if we're in one and the caller did
+// specify a timeout.
+std::optional<std::chrono::steady_clock::time_point> GetSessionDeadline();
+
 // Capture current session context (i.e., execution context), if we're indeed in
 // one.
 RefPtr<fiber::ExecutionContext> CaptureSessionContext();
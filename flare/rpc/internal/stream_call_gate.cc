@@ -14,6 +14,7 @@
 
 #include "flare/rpc/internal/stream_call_gate.h"
 
+#include <algorithm>
 #include <chrono>
 #include <limits>
 #include <utility>
@@ -21,14 +22,18 @@
 
 #include "gflags/gflags.h"
 
+#include "flare/base/casting.h"
+#include "flare/base/deferred.h"
 #include "flare/base/internal/early_init.h"
 #include "flare/base/logging.h"
+#include "flare/base/tsc.h"
 #include "flare/fiber/fiber.h"
 #include "flare/fiber/runtime.h"
 #include "flare/fiber/this_fiber.h"
 #include "flare/fiber/timer.h"
 #include "flare/io/event_loop.h"
 #include "flare/io/native/stream_connection.h"
+#include "flare/io/util/rate_limiter.h"
 #include "flare/io/util/socket.h"
 
 DEFINE_int32(
@@ -36,6 +41,17 @@ DEFINE_int32(
     "Maximum number of messages that is being or waiting for processing. "
     "Specifying a number too small may degrade overall performance if "
     "streaming rpcs and normal rpcs are performed on same connection.");
+DEFINE_int32(
+    flare_rpc_client_stream_window, 4 * 1024 * 1024,
+    "Flow control window (in bytes) of each streaming RPC, i.e., bytes the "
+    "server may send without them being read by us. It's advertised to the "
+    "server in the first message of the stream, and only enforced if the "
+    "server supports flow control. Setting it to 0 disables flow control.");
+DEFINE_int32(
+    flare_rpc_client_connection_window, 64 * 1024 * 1024,
+    "Maximum bytes of streaming RPC messages received on a connection but not "
+    "read by us yet. Once reached, reading from the connection is suppressed "
+    "until they're consumed. Setting it to 0 disables this limit.");
 
 namespace flare {
 
@@ -82,6 +98,7 @@ void StreamCallGate::SetUnhealthy() {
 }
 
 void StreamCallGate::Stop() {
+  healthy_.store(false, std::memory_order_release);
   UnsafeRaiseErrorGlobally();
   if (conn_) {
     conn_->Stop();
@@ -121,14 +138,36 @@ const StreamProtocol& StreamCallGate::GetProtocol() const {
   return *options_.protocol;
 }
 
+std::size_t StreamCallGate::GetUserCount() const noexcept {
+  return users_.load(std::memory_order_relaxed);
+}
+
+std::size_t StreamCallGate::GetPendingWriteBytes() const noexcept {
+  return conn_ ? conn_->GetPendingWriteBytes() : 0;
+}
+
+std::chrono::nanoseconds StreamCallGate::GetAverageRtt() const noexcept {
+  return std::chrono::nanoseconds(
+      average_rtt_ns_.load(std::memory_order_relaxed));
+}
+
 void StreamCallGate::FastCall(const Message& m, PooledPtr<FastCallArgs> args,
                               std::chrono::steady_clock::time_point timeout) {
   FLARE_CHECK_LE(m.GetCorrelationId(),
                  std::numeric_limits<std::uint32_t>::max(),
                  "Unsupported: 64-bit RPC correlation ID.");
 
+  // For protocols with stateful writes, the message must be written out in
+  // the same order as it's serialized.
+  auto write_lk = LockWriteIfStateful();
+
   // Serialization is done prior to fill `Timestamps.sent_tsc`.
   auto serialized = WriteMessage(m, args->controller);
+  if (FLARE_UNLIKELY(write_lk.owns_lock() && serialized.Empty())) {
+    // The protocol can't carry more calls on this connection (e.g., the peer
+    // is going away). Fail the call below, and let the pool replace us.
+    SetUnhealthy();
+  }
 
   {
     // This lock guarantees us that no one else races with us.
@@ -148,11 +187,23 @@ void StreamCallGate::FastCall(const Message& m, PooledPtr<FastCallArgs> args,
     std::uint64_t timeout_timer = 0;
 
     if (timeout != std::chrono::steady_clock::time_point::max()) {
+      RefPtr<StreamCallGate> self;
+      if (write_lk.owns_lock()) {  // Stateful writes.
+        self = RefPtr(ref_ptr, this);
+      }
       auto timeout_cb = [map = correlation_map_,
                          conn_cid = conn_correlation_id_,
-                         rpc_cid = m.GetCorrelationId()](auto) mutable {
+                         rpc_cid = m.GetCorrelationId(),
+                         self = std::move(self)](auto) mutable {
         RaiseErrorIfPresentFastCall(map, conn_cid, rpc_cid,
                                     CompletionStatus::Timeout);
+        if (self) {
+          // Let the peer know we're not interested in the response any more.
+          fiber::internal::StartFiberDetached(
+              [self = std::move(self), rpc_cid] {
+                self->AbandonFastCall(rpc_cid);
+              });
+        }
       };
       timeout_timer =
           fiber::internal::CreateTimer(timeout, std::move(timeout_cb));
@@ -225,15 +276,39 @@ StreamCallGate::StreamCall(std::uint64_t correlation_id,
             // `controller` must be alive. `write` is called synchronously from
             // `stream.Write()`. If the user destroyed the controller before
             // writing, he should be quite aware what he's doing.
-            return WriteOut(WriteMessage(e, controller), correlation_id);
+            auto lk = LockWriteIfStateful();
+            auto buffer = WriteMessage(e, controller);
+            auto bytes = buffer.ByteSize();
+            if (FLARE_UNLIKELY(buffer.Empty())) {  // Dropped by the protocol.
+              return std::size_t(0);
+            }
+            return WriteOut(std::move(buffer), correlation_id) ? bytes : 0;
+          },
+      .write_window_update =
+          [=, this](auto increment) {
+            // Not associated with the stream (`ctx` being 0), we don't want
+            // to complete user's write with this one.
+            auto lk = LockWriteIfStateful();
+            WriteOut(WriteMessage(StreamWindowUpdateMessage(correlation_id,
+                                                            increment),
+                                  controller),
+                     0);
           },
       .restart_read = [this] { conn_->RestartRead(); },
       .on_close = [this,
                    correlation_id] { return OnStreamClosed(correlation_id); },
       .on_cleanup =
           [this, correlation_id] { return OnStreamCleanup(correlation_id); }};
+  // Our window is advertised in the first message by `RpcChannel`.
+  rpc::detail::StreamIoAdaptor::FlowControl flow_control = {
+      .stream_window = static_cast<std::size_t>(
+          std::max(0, FLAGS_flare_rpc_client_stream_window)),
+      .window_advertised = true,
+      .connection = &stream_connection_window_,
+      .connection_window = static_cast<std::size_t>(
+          std::max(0, FLAGS_flare_rpc_client_connection_window))};
   auto adaptor = std::make_unique<rpc::detail::StreamIoAdaptor>(
-      FLAGS_flare_rpc_client_stream_concurrency, std::move(ops));
+      FLAGS_flare_rpc_client_stream_concurrency, std::move(ops), flow_control);
   auto adp = adaptor.get();
 
   AllocateRpcContextStream(correlation_id, [&](StreamContext& ctx) {
@@ -271,6 +346,8 @@ bool StreamCallGate::InitializeConnection(const Endpoint& ep) {
   opts.handler =
       MaybeOwning(non_owning, static_cast<StreamConnectionHandler*>(this));
   opts.read_buffer_size = options_.maximum_packet_size;
+  opts.read_rate_limiter = RateLimiter::NewRxRateLimiterFor(ep);
+  opts.write_rate_limiter = RateLimiter::NewTxRateLimiterFor(ep);
   conn_ =
       MakeRefCounted<NativeStreamConnection>(std::move(fd), std::move(opts));
 
@@ -413,6 +490,13 @@ void StreamCallGate::ServiceFastCallCompletion(std::unique_ptr<Message> msg,
     std::scoped_lock _(ctx->lock);
   }
 
+  // Update RTT estimation. This is racy, but it's only a hint anyway.
+  std::uint64_t rtt =
+      DurationFromTsc(ctx->timestamps.sent_tsc, tsc).count() | 1 /* Non-zero. */;
+  auto avg = average_rtt_ns_.load(std::memory_order_relaxed);
+  average_rtt_ns_.store(avg ? avg - avg / 8 + rtt / 8 : rtt,
+                        std::memory_order_relaxed);
+
   if (auto t = std::exchange(ctx->timeout_timer, 0)) {  // We set a timer.
     fiber::internal::KillTimer(t);
   }
@@ -454,10 +538,24 @@ void StreamCallGate::OnDataWritten(std::uintptr_t ctx) {
 
 StreamConnectionHandler::DataConsumptionStatus StreamCallGate::OnDataArrival(
     NoncontiguousBuffer* buffer) {
+  // Reply to whatever the protocol wants to (e.g., acknowledgements), even if
+  // we're going to close the connection.
+  ScopedDeferred _([&] {
+    FlushPendingBytes();
+    if (FLARE_UNLIKELY(
+            options_.protocol->GetCharacteristics().stateful_writes &&
+            !options_.protocol->AcceptsNewCalls())) {
+      SetUnhealthy();  // Stop making new calls on this connection.
+    }
+  });
   auto arrival_tsc = ReadTsc();
   bool ever_suppressed = false;
-  while (!buffer->Empty()) {
+  // Stateful protocols may have messages to yield without consuming any bytes
+  // (e.g., calls failed by the protocol itself).
+  auto stateful = options_.protocol->GetCharacteristics().stateful_writes;
+  while (!buffer->Empty() || FLARE_UNLIKELY(stateful)) {
     std::unique_ptr<Message> m;
+    auto buffer_size_was = buffer->ByteSize();
     auto rc = options_.protocol->TryCutMessage(buffer, &m);
 
     if (rc == StreamProtocol::MessageCutStatus::ProtocolMismatch ||
@@ -475,6 +573,15 @@ StreamConnectionHandler::DataConsumptionStatus StreamCallGate::OnDataArrival(
 
     // Dispatch the message.
     auto correlation_id = m->GetCorrelationId();
+    auto pkt_size = buffer_size_was - buffer->ByteSize();
+
+    // Flow control credit is consumed by the stream itself.
+    if (FLARE_UNLIKELY(isa<StreamWindowUpdateMessage>(*m))) {
+      LockRpcContextStreamIfPresent(correlation_id, [&](StreamContext* ctx) {
+        ctx->adaptor->NotifyWindowUpdate(m->GetStreamWindowUpdate());
+      });
+      continue;
+    }
 
     // TODO(luobogao): We could infer the message type (fast call or stream) by
     // examining `message->GetType()` and move the rest into dedicated fiber.
@@ -509,7 +616,7 @@ StreamConnectionHandler::DataConsumptionStatus StreamCallGate::OnDataArrival(
               return false;
             }
             auto type = m->GetType();  // `m` is moved away soon.
-            auto rc = ctx->adaptor->NotifyRead(std::move(m));
+            auto rc = ctx->adaptor->NotifyRead(std::move(m), pkt_size);
             // For multiple-request-single-response scenario, the response is
             // marked as `Single`.
             if (!options_.protocol->GetCharacteristics()
@@ -549,9 +656,46 @@ NoncontiguousBuffer StreamCallGate::WriteMessage(const Message& message,
   NoncontiguousBuffer serialized;
 
   options_.protocol->WriteMessage(message, &serialized, controller);
+  if (FLARE_UNLIKELY(options_.protocol->GetCharacteristics().stateful_writes) &&
+      !serialized.Empty()) {
+    NoncontiguousBuffer pending;
+    if (options_.protocol->TryGetPendingBytes(&pending)) {
+      // Bytes produced before `message` go first.
+      pending.Append(std::move(serialized));
+      serialized = std::move(pending);
+    }
+  }
   return serialized;
 }
 
+std::unique_lock<fiber::Mutex> StreamCallGate::LockWriteIfStateful() {
+  if (FLARE_LIKELY(!options_.protocol->GetCharacteristics().stateful_writes)) {
+    return {};
+  }
+  return std::unique_lock(write_lock_);
+}
+
+void StreamCallGate::FlushPendingBytes() {
+  if (FLARE_LIKELY(!options_.protocol->GetCharacteristics().stateful_writes)) {
+    return;
+  }
+  std::scoped_lock _(write_lock_);
+  NoncontiguousBuffer pending;
+  if (options_.protocol->TryGetPendingBytes(&pending)) {
+    WriteOut(std::move(pending), 0);
+  }
+}
+
+void StreamCallGate::AbandonFastCall(std::uint64_t correlation_id) {
+  std::scoped_lock _(write_lock_);
+  options_.protocol->OnCallAbandoned(correlation_id);
+  NoncontiguousBuffer pending;
+  if (options_.protocol->TryGetPendingBytes(&pending) &&
+      healthy_.load(std::memory_order_acquire)) {
+    WriteOut(std::move(pending), 0);
+  }
+}
+
 // CAUTION: THIS METHOD CAN BE CALLED EITHER FROM PTHREAD CONTEXT (ON TIMEOUT)
 // OR FIBER CONTEXT (ON IO ERROR.).
 void StreamCallGate::RaiseErrorIfPresentFastCall(
@@ -45,9 +45,12 @@
 #include "flare/rpc/protocol/stream_protocol.h"
 
 DECLARE_int32(flare_rpc_client_stream_concurrency);
+DECLARE_int32(flare_rpc_client_stream_window);
 
 namespace flare::rpc::internal {
 
+class StreamCallGateHandle;
+
 // A "call gate" owns a connection, i.e., no load balance / fault tolerance /
 // name resolving will be done here. Use `XxxChannel` instead if that's what
 // you want.
@@ -118,6 +121,18 @@ class StreamCallGate : private StreamConnectionHandler,
   const Endpoint& GetEndpoint() const;
   const StreamProtocol& GetProtocol() const;
 
+  // Load of this gate. These are used by `StreamCallGatePool` to choose among
+  // gates to the same peer.
+  //
+  // Number of `StreamCallGateHandle`s referencing this gate. For shared gates,
+  // this is (roughly) number of RPCs in progress on this gate.
+  std::size_t GetUserCount() const noexcept;
+  // Number of bytes not yet written out to the connection.
+  std::size_t GetPendingWriteBytes() const noexcept;
+  // Moving average of round-trip time of recent fast calls, or zero if no fast
+  // call has completed yet.
+  std::chrono::nanoseconds GetAverageRtt() const noexcept;
+
   // Fast path for simple RPCs (one request / one response).
   //
   // 64-bit correlation ID is NOT supported. AFAICT we don't generate 64-bit
@@ -147,6 +162,7 @@ class StreamCallGate : private StreamConnectionHandler,
 
  private:
   FLARE_FRIEND_TEST(StreamCallGatePoolTest, RemoveBrokenGate);
+  friend class StreamCallGateHandle;  // Maintains `users_`.
 
   struct alignas(hardware_destructive_interference_size) FastCallContext {
     fiber::Mutex lock;
@@ -253,9 +269,25 @@ class StreamCallGate : private StreamConnectionHandler,
   void ReclaimRpcContextStream(std::uint64_t correlation_id, F&& cb);
 
   // Serialize `message`.
+  //
+  // For protocols with `stateful_writes`, bytes pending in the protocol are
+  // prepended, and this method must be called with the lock returned by
+  // `LockWriteIfStateful()` held until the result is written out. An empty
+  // buffer is returned if the protocol dropped the message.
   NoncontiguousBuffer WriteMessage(const Message& message,
                                    Controller* controller) const;
 
+  // Returns an empty lock unless the protocol has `stateful_writes`.
+  std::unique_lock<fiber::Mutex> LockWriteIfStateful();
+
+  // Write out bytes the protocol wants to send on its own. @sa:
+  // `StreamProtocol::TryGetPendingBytes`.
+  void FlushPendingBytes();
+
+  // Tell the protocol (with `stateful_writes`) that the call is abandoned (due
+  // to timeout), and write out whatever it wants to tell the peer.
+  void AbandonFastCall(std::uint64_t correlation_id);
+
   // Raise an error if the corresponding RPC is found.
   static void RaiseErrorIfPresentFastCall(
       CorrelationMap<PooledPtr<FastCallContext>>* map,
@@ -280,10 +312,23 @@ class StreamCallGate : private StreamConnectionHandler,
   RefPtr<NativeStreamConnection> conn_;
   std::atomic<bool> healthy_{true};
 
+  // Held when serializing and writing out messages, for protocols with
+  // `stateful_writes` only.
+  fiber::Mutex write_lock_;
+
+  // Load statistics, @sa: `GetUserCount()` and `GetAverageRtt()`.
+  std::atomic<std::size_t> users_{0};
+  std::atomic<std::uint64_t> average_rtt_ns_{0};
+
   // Connection correlation ID. Fast-calls need this to access correlation map.
   std::uint32_t conn_correlation_id_{NewConnectionCorrelationId()};
   CorrelationMap<PooledPtr<FastCallContext>>* correlation_map_;
 
+  // Limits bytes of streaming RPC messages buffered by `stream_ctxs_` and not
+  // read by the user yet. It must outlive `stream_ctxs_`. @sa:
+  // `StreamIoAdaptor::FlowControl`.
+  rpc::detail::StreamIoAdaptor::ConnectionWindow stream_connection_window_;
+
   // FIXME: Stream calls are slow.
   //
   // Do NOT use `std::mutex` here, we'll be calling code that trigger fiber
@@ -16,10 +16,12 @@
 
 #include <memory>
 #include <mutex>
+#include <tuple>
 #include <utility>
 
 #include "gflags/gflags.h"
 
+#include "flare/base/chrono.h"
 #include "flare/base/exposed_var.h"
 #include "flare/base/hazptr.h"
 #include "flare/base/internal/hash_map.h"
@@ -45,6 +47,16 @@ DEFINE_int32(flare_rpc_client_remove_idle_connection_interval, 15,
 DEFINE_int32(
     flare_rpc_client_connection_max_idle, 45,
     "Time period before recycling a client-side idle connection, in seconds.");
+DEFINE_int32(flare_rpc_client_connection_congestion_bytes, 262144,
+             "If more than this many bytes are waiting to be written to a "
+             "(multiplexed) connection, the connection is considered "
+             "congested. New RPCs are sent via other connections to the same "
+             "server (which are created if necessary) whenever possible.");
+DEFINE_int32(flare_rpc_client_connection_congestion_rtt_percent, 200,
+             "If the average round-trip time of RPCs made via a (multiplexed) "
+             "connection exceeds this percent of the lowest one among all "
+             "connections to the same server, the connection is considered "
+             "congested. Setting it to 0 disables this check.");
 
 using namespace std::literals;
 
@@ -80,13 +92,6 @@ struct CopyableAtomic : public std::atomic<T> {
   }
 };
 
-struct EndpointHash {
-  std::size_t operator()(const Endpoint& ep) const {
-    return flare::internal::Hash<std::string_view>{}(
-        {reinterpret_cast<const char*>(ep.Get()), ep.Length()});
-  }
-};
-
 struct StreamCallGateEntry {
   CopyableAtomic<std::chrono::nanoseconds> last_used_since_epoch;
   RefPtr<StreamCallGate> gate;
@@ -131,8 +136,66 @@ void PurgeGatesUnsafe(
   }
 }
 
+// Returns the lowest (non-zero) average RTT among `gates`, or zero if there's
+// none.
+std::chrono::nanoseconds GetMinimumRtt(
+    const std::vector<StreamCallGateEntry>& gates) {
+  std::chrono::nanoseconds result{};
+  for (auto&& e : gates) {
+    auto rtt = e.gate->GetAverageRtt();
+    if (rtt.count() && (!result.count() || rtt < result)) {
+      result = rtt;
+    }
+  }
+  return result;
+}
+
+// Determines if `gate` is backed up, either by its write queue or, compared to
+// other gates to the same peer (whose lowest RTT is `min_rtt`), by its RTT.
+bool IsCongested(const StreamCallGate& gate, std::chrono::nanoseconds min_rtt) {
+  if (gate.GetPendingWriteBytes() >
+      static_cast<std::size_t>(
+          FLAGS_flare_rpc_client_connection_congestion_bytes)) {
+    return true;
+  }
+  auto percent = FLAGS_flare_rpc_client_connection_congestion_rtt_percent;
+  return percent && min_rtt.count() &&
+         gate.GetAverageRtt() * 100 > min_rtt * percent;
+}
+
+// Appends `entries` to `to[ep]`.
+void DumpGates(const Endpoint& ep,
+               const std::vector<StreamCallGateEntry>& entries,
+               Json::Value* to) {
+  auto now = ReadCoarseSteadyClock().time_since_epoch();
+  auto&& jsv = (*to)[ep.ToString()];
+  for (auto&& e : entries) {
+    Json::Value gate;
+    gate["users"] = static_cast<Json::UInt64>(e.gate->GetUserCount());
+    gate["pending_write_bytes"] =
+        static_cast<Json::UInt64>(e.gate->GetPendingWriteBytes());
+    gate["average_rtt_us"] =
+        static_cast<Json::UInt64>(e.gate->GetAverageRtt() / 1us);
+    gate["idle_ms"] = static_cast<Json::Int64>(
+        (now - e.last_used_since_epoch.load(std::memory_order_relaxed)) / 1ms);
+    gate["healthy"] = e.gate->Healthy();
+    jsv.append(gate);
+  }
+}
+
 ExposedCounter<std::uint64_t> new_conn_creation_in_shared_pool(
     "flare/rpc/client/new_conn_creation_in_shared_pool");
+ExposedCounter<std::uint64_t> congested_conn_in_shared_pool(
+    "flare/rpc/client/congested_conn_in_shared_pool");
+ExposedVarDynamic<Json::Value> call_gate_pools_exposer(
+    "flare/rpc/client/call_gate_pools", [] {
+      Json::Value jsv(Json::objectValue);
+      std::shared_lock lk(call_gate_pool_lock);
+      for (auto&& [k, v] : call_gate_pools) {
+        jsv[k] = v->Dump();
+      }
+      return jsv;
+    });
 
 }  // namespace
 
@@ -147,6 +210,7 @@ class StreamCallGatePool::SharedGatePool : public AbstractGatePool {
       FunctionView<RefPtr<StreamCallGate>()> creator) override;
   void Put(RefPtr<StreamCallGate> ptr) override;
   void Purge() override;
+  void Dump(Json::Value* to) const override;
   void Stop() override;
   void Join() override;
 
@@ -154,6 +218,10 @@ class StreamCallGatePool::SharedGatePool : public AbstractGatePool {
   RefPtr<StreamCallGate> ConsiderReuseGate(
       std::vector<StreamCallGateEntry>* gates);
 
+  // Returns the least loaded one in `gates`.
+  StreamCallGateEntry* PickLeastLoadedGate(
+      std::vector<StreamCallGateEntry>* gates);
+
  private:
   struct Impl : HazptrObject<Impl> {
     flare::internal::HashMap<Endpoint, std::vector<StreamCallGateEntry>,
@@ -163,7 +231,7 @@ class StreamCallGatePool::SharedGatePool : public AbstractGatePool {
 
   std::size_t max_conns_;
   std::mutex impl_mutation_lock_;
-  std::atomic<Impl*> impl_{std::make_unique<Impl>().release()};
+  mutable std::atomic<Impl*> impl_{std::make_unique<Impl>().release()};
 };
 
 // Pool for exclusive call gates.
@@ -174,11 +242,12 @@ class StreamCallGatePool::ExclusiveGatePool : public AbstractGatePool {
       FunctionView<RefPtr<StreamCallGate>()> creator) override;
   void Put(RefPtr<StreamCallGate> ptr) override;
   void Purge() override;
+  void Dump(Json::Value* to) const override;
   void Stop() override;
   void Join() override;
 
  private:
-  std::mutex lock_;
+  mutable std::mutex lock_;
   flare::internal::HashMap<Endpoint, std::vector<StreamCallGateEntry>,
                            EndpointHash>
       gates_;
@@ -202,6 +271,7 @@ class StreamCallGatePool::DedicatedGatePool : public AbstractGatePool {
 
   // We own nothing, so these methods are no-ops.
   void Purge() override {}
+  void Dump(Json::Value* to) const override {}
   void Stop() override {}
   void Join() override {}
 };
@@ -244,7 +314,7 @@ RefPtr<StreamCallGate> StreamCallGatePool::SharedGatePool::GetOrCreate(
   auto&& es = new_impl->gates[key];
   if (es.size() == max_conns_) {
     // Somebody else has already created a new one, drop our copy then.
-    auto&& rc = es[Random<std::size_t>(0, max_conns_ - 1)];
+    auto&& rc = *PickLeastLoadedGate(&es);
     rc.last_used_since_epoch.store(now, std::memory_order_relaxed);
     return rc.gate;
   }
@@ -324,6 +394,14 @@ void StreamCallGatePool::SharedGatePool::Purge() {
   }
 }
 
+void StreamCallGatePool::SharedGatePool::Dump(Json::Value* to) const {
+  Hazptr hazptr;
+  auto ptr = hazptr.Keep(&impl_);
+  for (auto&& [ep, es] : ptr->gates) {
+    DumpGates(ep, es, to);
+  }
+}
+
 void StreamCallGatePool::SharedGatePool::Stop() {
   Hazptr hazptr;
   auto ptr = hazptr.Keep(&impl_);
@@ -382,7 +460,7 @@ RefPtr<StreamCallGate> StreamCallGatePool::SharedGatePool::ConsiderReuseGate(
   };
 
   // If 1) we've created maximum connections and *2) the last connection is used
-  // soon enough*, we chose one randomly.
+  // soon enough*, we chose the least loaded one.
   //
   // The second condition is significant here. Even if we've had enough
   // connections, in case the load drops, it's possible that we no longer need
@@ -392,28 +470,62 @@ RefPtr<StreamCallGate> StreamCallGatePool::SharedGatePool::ConsiderReuseGate(
   // connections are busy (when the `if`-condition holds.).
   if (gates->size() == max_conns_ &&
       last_used(gates->back()) + kForceReuseThreshold > now) {
-    return update_timestamp_and_return(
-        &(*gates)[Random<std::size_t>(0, max_conns_ - 1)]);
+    return update_timestamp_and_return(PickLeastLoadedGate(gates));
   }
 
   // If there's a connection that has been idle for `kForceReuseThreshold`, or
-  // not currently used by more than `kMinimumUsers`, we don't bother creating a
-  // new one.
+  // not currently used by more than `kMinimumUsers` (and not congested), we
+  // don't bother creating a new one.
+  //
+  // Connections are always tried in order, so that under light load, the
+  // trailing ones become idle and are eventually removed by `Purge()`.
   static constexpr auto kMinimumUsers = 2;  // Hmmm, let's be conservative.
 
   // TBH This isn't quite efficient but I don't expect `max_conns_` to be too
   // large, unless we're under heavy load, in which case there should be
   // already `max_conns_` and shouldn't be here anyway.
+  auto min_rtt = GetMinimumRtt(*gates);
   for (auto&& e : *gates) {
-    if (e.gate->UnsafeRefCount() < kMinimumUsers + 1 /* Ourselves. */ ||
-        last_used(e) + kForceReuseThreshold < now) {
+    if (last_used(e) + kForceReuseThreshold < now) {
       return update_timestamp_and_return(&e);
     }
+    if (e.gate->GetUserCount() < kMinimumUsers) {
+      if (FLARE_LIKELY(!IsCongested(*e.gate, min_rtt))) {
+        return update_timestamp_and_return(&e);
+      }
+      congested_conn_in_shared_pool->Increment();
+    }
   }
 
+  // Let's create a new connection then.
   return nullptr;
 }
 
+StreamCallGateEntry*
+StreamCallGatePool::SharedGatePool::PickLeastLoadedGate(
+    std::vector<StreamCallGateEntry>* gates) {
+  auto min_rtt = GetMinimumRtt(*gates);
+  auto load_of = [&](const StreamCallGateEntry& e) {
+    // Congested connections are avoided whenever possible. Otherwise the one
+    // with the fewest RPCs in progress (and then, fewest bytes pending) wins.
+    return std::tuple(IsCongested(*e.gate, min_rtt), e.gate->GetUserCount(),
+                      e.gate->GetPendingWriteBytes());
+  };
+
+  // Start from a random position so that ties are broken randomly.
+  auto start = Random<std::size_t>(0, gates->size() - 1);
+  auto result = &(*gates)[start];
+  auto min_load = load_of(*result);
+  for (std::size_t i = 1; i != gates->size(); ++i) {
+    auto&& e = (*gates)[(start + i) % gates->size()];
+    if (auto load = load_of(e); load < min_load) {
+      min_load = load;
+      result = &e;
+    }
+  }
+  return result;
+}
+
 RefPtr<StreamCallGate> StreamCallGatePool::ExclusiveGatePool::GetOrCreate(
     const Endpoint& key, FunctionView<RefPtr<StreamCallGate>()> creator) {
   std::scoped_lock _(lock_);
@@ -455,6 +567,13 @@ void StreamCallGatePool::ExclusiveGatePool::Purge() {
   }
 }
 
+void StreamCallGatePool::ExclusiveGatePool::Dump(Json::Value* to) const {
+  std::scoped_lock _(lock_);
+  for (auto&& [ep, es] : gates_) {
+    DumpGates(ep, es, to);
+  }
+}
+
 void StreamCallGatePool::ExclusiveGatePool::Stop() {
   std::scoped_lock _(lock_);
   for (auto&& [_, es] : gates_) {
@@ -510,6 +629,19 @@ void StreamCallGatePool::Join() {
   // TODO(luobogao): Wait for cleanup timer to fully stop.
 }
 
+Json::Value StreamCallGatePool::Dump() const {
+  Json::Value jsv;
+  jsv["shared"] = Json::objectValue;
+  for (auto&& e : shared_pools_) {
+    e->Dump(&jsv["shared"]);
+  }
+  jsv["exclusive"] = Json::objectValue;
+  for (auto&& e : exclusive_pools_) {
+    e->Dump(&jsv["exclusive"]);
+  }
+  return jsv;
+}
+
 void StreamCallGatePool::OnCleanupTimer() {
   ForEachPool([&](auto&& p) { p->Purge(); });
 }
@@ -542,18 +674,31 @@ StreamCallGateHandle::StreamCallGateHandle() = default;
 
 StreamCallGateHandle::StreamCallGateHandle(
     StreamCallGatePool::AbstractGatePool* owner, RefPtr<StreamCallGate> p)
-    : owner_(owner), ptr_(std::move(p)) {}
+    : owner_(owner), ptr_(std::move(p)) {
+  if (ptr_) {
+    ptr_->users_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
 
 StreamCallGateHandle::~StreamCallGateHandle() { Close(); }
 
 StreamCallGateHandle::StreamCallGateHandle(StreamCallGateHandle&&) noexcept =
     default;
+
 StreamCallGateHandle& StreamCallGateHandle::operator=(
-    StreamCallGateHandle&&) noexcept = default;
+    StreamCallGateHandle&& other) noexcept {
+  if (&other != this) {
+    Close();
+    owner_ = other.owner_;
+    ptr_ = std::move(other.ptr_);
+  }
+  return *this;
+}
 
 void StreamCallGateHandle::Close() noexcept {
   if (ptr_) {
     FLARE_CHECK(owner_);
+    ptr_->users_.fetch_sub(1, std::memory_order_relaxed);
     owner_->Put(std::move(ptr_));
   }
 }
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "gflags/gflags_declare.h"
+#include "jsoncpp/value.h"
 
 #include "flare/base/function_view.h"
 #include "flare/base/internal/early_init.h"
@@ -79,6 +80,9 @@ class StreamCallGatePool {
   void Stop();
   void Join();
 
+  // Dumps gates in this pool (grouped by peer), with their load.
+  Json::Value Dump() const;
+
  private:
   void OnCleanupTimer();
 
@@ -102,6 +106,9 @@ class StreamCallGatePool {
     // that have been idle for a while.
     virtual void Purge() = 0;
 
+    // Appends gates in this pool to `to[peer]`.
+    virtual void Dump(Json::Value* to) const = 0;
+
     // For shutting down the pool.
     virtual void Stop() = 0;
     virtual void Join() = 0;
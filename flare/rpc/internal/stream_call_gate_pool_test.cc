@@ -17,6 +17,8 @@
 #include "gflags/gflags.h"
 #include "gtest/gtest.h"
 
+#include "flare/base/deferred.h"
+#include "flare/fiber/runtime.h"
 #include "flare/fiber/this_fiber.h"
 #include "flare/rpc/internal/stream_call_gate.h"
 #include "flare/rpc/server.h"
@@ -149,6 +151,44 @@ TEST_F(StreamCallGatePoolTest, RemoveBrokenGate) {
   ASSERT_EQ(0, CounterProtocol::alive_instances);  // Removed immediately.
 }
 
+TEST_F(StreamCallGatePoolTest, LoadAwareSelection) {
+  // Two gates per peer in each pool.
+  auto old_max_conns = FLAGS_flare_rpc_client_max_connections_per_server;
+  ScopedDeferred _([&] {
+    FLAGS_flare_rpc_client_max_connections_per_server = old_max_conns;
+  });
+  FLAGS_flare_rpc_client_max_connections_per_server =
+      2 * fiber::GetSchedulingGroupCount();
+  auto&& pool = GetGlobalStreamCallGatePool("load-aware");
+  auto get_gate = [&] {
+    return pool->GetOrCreateShared(listening_ep_, false,
+                                   [&] { return CreateGate(listening_ep_); });
+  };
+
+  auto h1 = get_gate(), h2 = get_gate();
+  ASSERT_EQ(h1.Get(), h2.Get());
+  EXPECT_EQ(2, h1->GetUserCount());
+
+  // The first gate is busy, so a new one is created.
+  auto h3 = get_gate(), h4 = get_gate();
+  ASSERT_NE(h1.Get(), h3.Get());
+  ASSERT_EQ(h3.Get(), h4.Get());
+
+  // Both gates are busy and we've reached the limit. The least loaded ones are
+  // chosen.
+  auto h5 = get_gate(), h6 = get_gate();
+  ASSERT_NE(h5.Get(), h6.Get());
+  EXPECT_EQ(3, h1->GetUserCount());
+  EXPECT_EQ(3, h3->GetUserCount());
+
+  h5.Close();
+  h6.Close();
+  EXPECT_EQ(2, h1->GetUserCount());
+
+  auto jsv = pool->Dump();
+  ASSERT_EQ(2, jsv["shared"][listening_ep_.ToString()].size());
+}
+
 TEST_F(StreamCallGatePoolTest, CreateExclusiveToUnreachable) {
   // Not sure if this UT still work when IPv6 is reachable.
   //
@@ -14,19 +14,49 @@
 
 #include "flare/rpc/internal/stream_io_adaptor.h"
 
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <utility>
 
+#include "flare/base/chrono.h"
+#include "flare/base/internal/builtin_monitoring.h"
+#include "flare/base/likely.h"
 #include "flare/base/maybe_owning.h"
 #include "flare/fiber/latch.h"
 #include "flare/fiber/this_fiber.h"
 
+using namespace std::literals;
+
 namespace flare::rpc::detail {
 
+namespace {
+
+// Writers blocked by exhausted flow control window.
+internal::BuiltinMonitoredCounter writer_stalls(
+    "flare_rpc_stream_writer_stalls");
+internal::BuiltinMonitoredGauge stalled_writers(
+    "flare_rpc_stream_writer_stalled");
+internal::BuiltinMonitoredTimer writer_stall_duration(
+    "flare_rpc_stream_writer_stall_duration", 1us);
+
+}  // namespace
+
 StreamIoAdaptor::StreamIoAdaptor(std::size_t buffer_size, Operations ops)
-    : buffer_size_(buffer_size), ops_(std::move(ops)) {
+    : StreamIoAdaptor(buffer_size, std::move(ops), FlowControl()) {}
+
+StreamIoAdaptor::StreamIoAdaptor(std::size_t buffer_size, Operations ops,
+                                 FlowControl flow_control)
+    : buffer_size_(buffer_size),
+      ops_(std::move(ops)),
+      flow_control_(flow_control) {
   CHECK_NE(buffer_size, 0);
+  if (!ops_.write_window_update) {
+    flow_control_.stream_window = 0;  // We can't grant credit then.
+  }
+  if (!flow_control_.connection_window) {
+    flow_control_.connection = nullptr;
+  }
   is_provider_ = MakeRefCounted<BufferedStreamReaderProvider<MessagePtr>>(
       buffer_size, [this] { OnInputStreamMessageConsumption(); },
       [this] { OnInputStreamClosed(); }, [this] { OnInputStreamCleanup(); });
@@ -48,10 +78,20 @@ StreamIoAdaptor::GetStreamWriter() {
   return output_stream_;
 }
 
-bool StreamIoAdaptor::NotifyRead(MessagePtr msg) {
+bool StreamIoAdaptor::NotifyRead(MessagePtr msg, std::size_t bytes) {
+  if (auto credit = msg->GetStreamWindowUpdate()) {
+    NotifyWindowUpdate(credit);
+  }
+
   // This must be tested before posting jobs into `work_queue_` to avoid race.
-  auto suppress =
-      unacked_msgs_.fetch_add(1, std::memory_order_relaxed) >= buffer_size_ - 1;
+  auto unacked = unacked_msgs_.fetch_add(1, std::memory_order_relaxed);
+  // Once flow control is enabled, the peer won't send more than we granted,
+  // there's no point in limiting number of messages.
+  auto suppress = !flow_control_enabled_.load(std::memory_order_relaxed) &&
+                  unacked >= buffer_size_ - 1;
+  if (OnBytesBuffered(bytes)) {
+    suppress = true;
+  }
 
   work_queue_.Push([this, msg = std::move(msg)]() mutable {
     // FIXME: If the stream is closed before the callback runs, we risk running
@@ -70,15 +110,39 @@ bool StreamIoAdaptor::NotifyRead(MessagePtr msg) {
 
 void StreamIoAdaptor::NotifyError(StreamError error) {
   unacked_msgs_.fetch_add(1, std::memory_order_relaxed);
+  OnBytesBuffered(0);  // Keeps `buffered_sizes_` in pace with the reader.
   work_queue_.Push([this, error] { is_provider_->OnDataAvailable(error); });
 }
 
+void StreamIoAdaptor::NotifyWindowUpdate(std::size_t increment) {
+  if (!flow_control_.stream_window) {
+    // Flow control is disabled on our side. Without credit from us the peer
+    // won't enforce our window, so we don't enforce its window either.
+    return;
+  }
+  bool first = !flow_control_enabled_.exchange(true, std::memory_order_relaxed);
+  bool flush;
+  {
+    std::scoped_lock _(send_lock_);
+    send_window_ += increment;
+    flush = send_window_ > 0 && !send_queue_.empty();
+  }
+  if (first && !flow_control_.window_advertised) {
+    ops_.write_window_update(flow_control_.stream_window);
+  }
+  if (flush) {
+    // Serialization is done in the work queue, not in (likely) I/O fiber.
+    work_queue_.Push([this] { FlushSendQueue(); });
+  }
+}
+
 void StreamIoAdaptor::NotifyWriteCompletion() {
   work_queue_.Push([=, this] { os_provider_->OnWriteCompletion(true); });
 }
 
 void StreamIoAdaptor::Break() {
   work_queue_.Push([this] {
+    DropSendQueue();
     is_provider_->OnDataAvailable(StreamError::EndOfStream);
     os_provider_->OnWriteCompletion(false);
   });
@@ -90,12 +154,39 @@ void StreamIoAdaptor::FlushPendingCalls() {
 }
 
 void StreamIoAdaptor::OnInputStreamMessageConsumption() {
+  std::size_t bytes = 0;
+  {
+    std::scoped_lock _(recv_lock_);
+    // It can be empty if the message was not fed by us (e.g., timeout error
+    // generated by the reader itself).
+    if (FLARE_LIKELY(!buffered_sizes_.empty())) {
+      bytes = buffered_sizes_.front();
+      buffered_sizes_.pop_front();
+    }
+  }
+  ReleaseConnectionWindow(bytes);
+  GrantWindow(bytes);
+
   if (unacked_msgs_.fetch_sub(1, std::memory_order_relaxed) == buffer_size_) {
     ops_.restart_read();
   }
 }
 
 void StreamIoAdaptor::OnInputStreamClosed() {
+  // Messages not read by the user are dropped. Their bytes are released now.
+  std::size_t dropped = 0;
+  {
+    std::scoped_lock _(recv_lock_);
+    input_closed_ = true;
+    for (auto&& e : buffered_sizes_) {
+      dropped += e;
+    }
+    buffered_sizes_.clear();
+  }
+  ReleaseConnectionWindow(dropped);
+  // No more bytes will be buffered, there's no point in withholding credit.
+  GrantWindow(dropped + TakeWithheldWindow());
+
   if (auto was = remaining_users_.fetch_sub(1, std::memory_order_relaxed);
       was == 1) {
     OnStreamClosed();
@@ -136,13 +227,22 @@ void StreamIoAdaptor::OnOutputStreamMessageProduced(MessagePtr msg_ptr) {
   // drained, user would block on `FlushPendingCalls`, and won't destroy us.
   auto blocking_task = PostWorkQueueBlockingTask();
 
-  if (ops_.write(*msg_ptr)) {
-    unacked_writes_.fetch_add(1, std::memory_order_relaxed);
-  } else {
-    // Write failed.
-    //
-    // FIXME: We should fail all further write since now.
-    work_queue_.Push([this] { os_provider_->OnWriteCompletion(false); });
+  {
+    std::scoped_lock _(send_lock_);
+    if (FLARE_UNLIKELY(flow_control_enabled_.load(std::memory_order_relaxed) &&
+                       (send_window_ <= 0 || !send_queue_.empty()))) {
+      // The peer's window is exhausted. The message is written out once more
+      // credit is granted. Until then the write is not completed, so the user
+      // blocks once `buffer_size_` writes are pending.
+      if (send_queue_.empty()) {
+        stalled_since_ = ReadSteadyClock();
+        writer_stalls.Increment();
+        stalled_writers.Increment();
+      }
+      send_queue_.push_back(std::move(msg_ptr));
+    } else {
+      WriteMessageLocked(*msg_ptr);
+    }
   }
   // I do think relaxed ordering on `blocking_task` should work but TSan keep
   // reporting race (when destroying this atomic.).
@@ -163,6 +263,7 @@ void StreamIoAdaptor::OnOutputStreamClosed() {
 
 void StreamIoAdaptor::OnOutputStreamCleanup() {
   work_queue_.Push([this] {
+    DropSendQueue();  // In case the stream expired while being stalled.
     if (!--alive_streams_) {
       OnStreamCleanup();
     } else {
@@ -175,6 +276,160 @@ void StreamIoAdaptor::OnStreamClosed() { ops_.on_close(); }
 
 void StreamIoAdaptor::OnStreamCleanup() { ops_.on_cleanup(); }
 
+bool StreamIoAdaptor::OnBytesBuffered(std::size_t bytes) {
+  bool closed;
+  {
+    std::scoped_lock _(recv_lock_);
+    closed = input_closed_;
+    if (FLARE_LIKELY(!closed)) {
+      buffered_sizes_.push_back(bytes);
+    }
+  }
+  if (FLARE_UNLIKELY(closed)) {
+    // The reader drops the message, it's never buffered.
+    GrantWindow(bytes);
+    return false;
+  }
+  auto conn = flow_control_.connection;
+  if (!conn || !bytes) {
+    return false;
+  }
+  auto exhausted =
+      conn->buffered_.fetch_add(bytes, std::memory_order_relaxed) + bytes >=
+      flow_control_.connection_window;
+  // Once flow control is enabled, the peer is stopped by withholding credit
+  // instead (@sa: `GrantWindow`). Suppressing reading would also block credit
+  // granted to our writers, and deadlock if the user is waiting for them before
+  // reading.
+  return exhausted && !flow_control_enabled_.load(std::memory_order_relaxed);
+}
+
+void StreamIoAdaptor::ReleaseConnectionWindow(std::size_t bytes) {
+  auto conn = flow_control_.connection;
+  if (!conn || !bytes) {
+    return;
+  }
+  auto was = conn->buffered_.fetch_sub(bytes, std::memory_order_relaxed);
+  if (was >= flow_control_.connection_window &&
+      was - bytes < flow_control_.connection_window) {
+    // Reading from the connection was (likely) suppressed by us.
+    ops_.restart_read();
+    GrantWithheldWindows();
+  }
+}
+
+void StreamIoAdaptor::GrantWindow(std::size_t bytes) {
+  if (!bytes || !flow_control_enabled_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::size_t increment;
+  {
+    std::scoped_lock _(recv_lock_);
+    ungranted_bytes_ += bytes;
+    // Granting credit for each message consumed would be too chatty.
+    if (ungranted_bytes_ < flow_control_.stream_window / 2) {
+      return;
+    }
+    increment = std::exchange(ungranted_bytes_, 0);
+  }
+  if (!TryWithholdWindow(increment)) {
+    ops_.write_window_update(increment);
+  }
+}
+
+bool StreamIoAdaptor::TryWithholdWindow(std::size_t increment) {
+  auto conn = flow_control_.connection;
+  if (!conn) {
+    return false;
+  }
+  std::scoped_lock _(conn->lock_);
+  // Tested with `conn->lock_` held. Otherwise we could miss the wakeup by
+  // `GrantWithheldWindows`.
+  if (conn->buffered_.load(std::memory_order_relaxed) <
+      flow_control_.connection_window) {
+    return false;
+  }
+  {
+    std::scoped_lock _(recv_lock_);
+    if (input_closed_) {
+      return false;  // @sa: `OnInputStreamClosed`.
+    }
+  }
+  if (!withheld_bytes_) {
+    conn->withheld_.push_back(this);
+  }
+  withheld_bytes_ += increment;
+  return true;
+}
+
+std::size_t StreamIoAdaptor::TakeWithheldWindow() {
+  auto conn = flow_control_.connection;
+  if (!conn) {
+    return 0;
+  }
+  std::scoped_lock _(conn->lock_);
+  if (withheld_bytes_) {
+    auto iter = std::find(conn->withheld_.begin(), conn->withheld_.end(), this);
+    FLARE_CHECK(iter != conn->withheld_.end());
+    conn->withheld_.erase(iter);
+  }
+  return std::exchange(withheld_bytes_, 0);
+}
+
+void StreamIoAdaptor::GrantWithheldWindows() {
+  auto conn = flow_control_.connection;
+  std::scoped_lock _(conn->lock_);
+  if (conn->buffered_.load(std::memory_order_relaxed) >=
+      flow_control_.connection_window) {
+    return;  // Exhausted again.
+  }
+  // Streams are removed from `withheld_` once their input stream is closed
+  // (@sa: `OnInputStreamClosed`), so they're still alive here.
+  for (auto&& e : std::exchange(conn->withheld_, {})) {
+    e->ops_.write_window_update(std::exchange(e->withheld_bytes_, 0));
+  }
+}
+
+void StreamIoAdaptor::WriteMessageLocked(const Message& msg) {
+  if (auto bytes = ops_.write(msg)) {
+    send_window_ -= bytes;
+    unacked_writes_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    // Write failed.
+    //
+    // FIXME: We should fail all further write since now.
+    work_queue_.Push([this] { os_provider_->OnWriteCompletion(false); });
+  }
+}
+
+void StreamIoAdaptor::FlushSendQueue() {
+  std::scoped_lock _(send_lock_);
+  if (send_queue_.empty()) {
+    return;  // Flushed by someone else.
+  }
+  while (send_window_ > 0 && !send_queue_.empty()) {
+    auto msg = std::move(send_queue_.front());
+    send_queue_.pop_front();
+    WriteMessageLocked(*msg);
+  }
+  if (send_queue_.empty()) {
+    OnWriterResumedLocked();
+  }
+}
+
+void StreamIoAdaptor::DropSendQueue() {
+  std::scoped_lock _(send_lock_);
+  if (!send_queue_.empty()) {
+    send_queue_.clear();
+    OnWriterResumedLocked();
+  }
+}
+
+void StreamIoAdaptor::OnWriterResumedLocked() {
+  stalled_writers.Decrement();
+  writer_stall_duration.Report(ReadSteadyClock() - stalled_since_);
+}
+
 std::atomic<bool>* StreamIoAdaptor::PostWorkQueueBlockingTask() {
   auto ptr = std::make_unique<std::atomic<bool>>(false);
   auto rc = ptr.get();
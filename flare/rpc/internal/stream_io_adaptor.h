@@ -16,10 +16,15 @@
 #define FLARE_RPC_INTERNAL_STREAM_IO_ADAPTOR_H_
 
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "flare/base/function.h"
 #include "flare/base/ref_ptr.h"
+#include "flare/fiber/mutex.h"
 #include "flare/fiber/work_queue.h"
 #include "flare/rpc/internal/buffered_stream_provider.h"
 #include "flare/rpc/internal/stream.h"
@@ -40,7 +45,13 @@ class StreamIoAdaptor {
 
   struct Operations {
     Function<bool(MessagePtr*)> try_parse;
-    Function<bool(const Message&)> write;
+
+    // Returns number of bytes written, or 0 on failure.
+    Function<std::size_t(const Message&)> write;
+
+    // Writes a `StreamWindowUpdateMessage` granting `increment` bytes to the
+    // peer. Only required if flow control is enabled (@sa: `FlowControl`).
+    Function<void(std::size_t increment)> write_window_update;
 
     // Note that `restart_read` can be called even before `NotifyRead()` is
     // returned, since, as stated in class's comments, `restart_read` is called
@@ -66,11 +77,69 @@ class StreamIoAdaptor {
     Function<void()> on_cleanup;
   };
 
+  // Credit-based flow control, in bytes.
+  //
+  // Each side grants its peer a window (`stream_window`) of bytes it may send
+  // without them being read by our user, and grants more credit as the user
+  // consumes messages. Writers are stalled (i.e., `Write()` does not complete)
+  // once the peer's window is exhausted.
+  //
+  // Flow control is enabled on a stream only after credit is received from the
+  // peer, so streams with peers not supporting it behave as before.
+  //
+  // Bytes buffered by all streams on the same connection are limited as well
+  // (`connection_window`). Once it's reached, streams with flow control enabled
+  // withhold credit (so their peers stop sending) until the user has consumed
+  // enough bytes. Reading from the connection goes on, so credit granted to our
+  // writers keeps being processed. Only streams without flow control suppress
+  // reading from the connection, as that's the only way to stop their peers.
+  class ConnectionWindow;
+
+  struct FlowControl {
+    // Window we grant to the peer. Zero disables flow control on this stream.
+    std::size_t stream_window = 0;
+
+    // Set if our window has been advertised along with the first message we
+    // send (i.e., we're the caller). Otherwise it's granted to the peer once we
+    // receive its credit.
+    bool window_advertised = false;
+
+    // Shared by all streams on the same connection. Not applicable if
+    // `nullptr`.
+    ConnectionWindow* connection = nullptr;
+    std::size_t connection_window = 0;
+  };
+
+  // State of `FlowControl::connection_window`, shared by all streams on the
+  // same connection. It must outlive the streams.
+  class ConnectionWindow {
+   public:
+    // Bytes of messages buffered (and not read by the user yet) by all streams
+    // on the connection.
+    std::size_t GetBufferedBytes() const noexcept {
+      return buffered_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    friend class StreamIoAdaptor;
+
+    std::atomic<std::size_t> buffered_{0};
+
+    // Credit is granted with this lock held, which may trigger fiber
+    // scheduling.
+    fiber::Mutex lock_;
+    // Streams withholding credit until the window is available again.
+    std::vector<StreamIoAdaptor*> withheld_;
+  };
+
   // `buffer_size` specifies maximum number of buffered messages not read by the
   // consumer (i.e., user of `GetStreamXxx()`). This is a soft limit. Once it's
   // reached, further calls to `NotifyRead()` will return false (but still
-  // buffer the new message).
+  // buffer the new message). It's not applied to received messages once flow
+  // control is enabled, their bytes are limited instead.
   StreamIoAdaptor(std::size_t buffer_size, Operations ops);
+  StreamIoAdaptor(std::size_t buffer_size, Operations ops,
+                  FlowControl flow_control);
 
   // It's allowed to move return value away.
   //
@@ -82,7 +151,14 @@ class StreamIoAdaptor {
 
   // Returns true if internal buffer is full. The caller should suspend feeding
   // in this case.
-  bool NotifyRead(MessagePtr msg);
+  //
+  // `bytes` is size of `msg` on the wire, for flow control purpose.
+  bool NotifyRead(MessagePtr msg, std::size_t bytes = 0);
+
+  // Called upon receiving flow control credit from the peer. Credit carried by
+  // messages passed to `NotifyRead` is handled there, and should not be passed
+  // to this method again.
+  void NotifyWindowUpdate(std::size_t increment);
 
   // Notifies the adaptor about an error (end-of-stream is treated as an error
   // here.).
@@ -123,6 +199,43 @@ class StreamIoAdaptor {
   // Called after all pending callbacks have finished.
   void OnStreamCleanup();
 
+  // Remembers `bytes` of a received message as buffered. Returns true if the
+  // connection's window is exhausted and reading from the connection should be
+  // suppressed.
+  bool OnBytesBuffered(std::size_t bytes);
+
+  // Called when `bytes` counted by `OnBytesBuffered` is consumed or dropped.
+  void ReleaseConnectionWindow(std::size_t bytes);
+
+  // Called when `bytes` received is consumed or dropped. Credit is granted to
+  // the peer once enough bytes are accumulated.
+  void GrantWindow(std::size_t bytes);
+
+  // Keeps `increment` to be granted once the connection's window is available
+  // again. Returns false if the window is available (or the input stream has
+  // been closed), in which case the caller should grant it now.
+  bool TryWithholdWindow(std::size_t increment);
+
+  // Removes us from streams withholding credit. Returns credit withheld.
+  std::size_t TakeWithheldWindow();
+
+  // Called when the connection's window becomes available, grants credit
+  // withheld by all streams on the connection.
+  void GrantWithheldWindows();
+
+  // Write `msg` out, consuming the peer's window. `send_lock_` must be held.
+  void WriteMessageLocked(const Message& msg);
+
+  // Write messages queued by exhausted window out, as long as the window
+  // permits.
+  void FlushSendQueue();
+
+  // Drop messages queued by exhausted window, on stream being broken.
+  void DropSendQueue();
+
+  // Called when `send_queue_` becomes empty. `send_lock_` must be held.
+  void OnWriterResumedLocked();
+
   // This method help us to prevent `work_queue_` from draining. This is
   // required in certain cases where we need to take measures to prevent us from
   // being destroyed.
@@ -153,6 +266,36 @@ class StreamIoAdaptor {
   // Number of writes (to `os_provider_`) that we have not acked.
   std::atomic<std::size_t> unacked_writes_ = 0;
 
+  FlowControl flow_control_;
+
+  // Set once credit is received from the peer (and we have a window to grant).
+  std::atomic<bool> flow_control_enabled_{false};
+
+  // Receiving side of flow control.
+  std::mutex recv_lock_;
+  bool input_closed_ = false;
+  // Sizes of messages we've buffered, in the order they're read by the user.
+  std::deque<std::size_t> buffered_sizes_;
+  // Bytes consumed by the user but not granted back to the peer yet.
+  std::size_t ungranted_bytes_ = 0;
+  // Credit withheld due to exhausted connection window. Protected by the lock
+  // in `flow_control_.connection`.
+  std::size_t withheld_bytes_ = 0;
+
+  // Sending side of flow control.
+  //
+  // Messages are written with this lock held, which may trigger fiber
+  // scheduling, so don't use `std::mutex` here.
+  fiber::Mutex send_lock_;
+  // Remaining credit granted by the peer. It can be negative, as bytes are
+  // counted before the peer grants its initial window, and the last message
+  // written may overdraw the window.
+  std::int64_t send_window_ = 0;
+  // Messages not written due to exhausted window, in order.
+  std::deque<MessagePtr> send_queue_;
+  // Set when `send_queue_` becomes non-empty.
+  std::chrono::steady_clock::time_point stalled_since_;
+
   // Decremented when `StreamReader` or `StreamWriter` is cleaned up.
   int alive_streams_{2};
 
@@ -0,0 +1,361 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/internal/stream_io_adaptor.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/fiber/async.h"
+#include "flare/fiber/future.h"
+#include "flare/fiber/this_fiber.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare::rpc::detail {
+
+struct DummyMessage : public Message {
+  std::uint64_t GetCorrelationId() const noexcept override { return 1; }
+  Type GetType() const noexcept override { return Type::Stream; }
+};
+
+class StreamIoAdaptorTest : public ::testing::Test {
+ public:
+  void TearDown() override {
+    if (!reader_closed_) {
+      CloseReader();
+    }
+    fiber::BlockingGet(adaptor_->GetStreamWriter().Close());
+    while (!cleaned_up_) {
+      this_fiber::Yield();
+    }
+    adaptor_->FlushPendingCalls();
+  }
+
+ protected:
+  void CreateAdaptor(std::size_t buffer_size,
+                     StreamIoAdaptor::FlowControl flow_control) {
+    StreamIoAdaptor::Operations ops = {
+        .try_parse = [](auto&&) { return true; },
+        .write =
+            [this](auto&&) {
+              ++written_;
+              adaptor_->NotifyWriteCompletion();
+              return 100;
+            },
+        .write_window_update =
+            [this](auto increment) {
+              std::scoped_lock _(lock_);
+              granted_.push_back(increment);
+            },
+        .restart_read = [this] { ++restarts_; },
+        .on_close = [] {},
+        .on_cleanup = [this] { cleaned_up_ = true; }};
+    adaptor_ = std::make_unique<StreamIoAdaptor>(buffer_size, std::move(ops),
+                                                 flow_control);
+  }
+
+  std::vector<std::size_t> GetGranted() {
+    std::scoped_lock _(lock_);
+    return granted_;
+  }
+
+  bool Write() {
+    return fiber::BlockingGet(
+        adaptor_->GetStreamWriter().Write(std::make_unique<DummyMessage>()));
+  }
+
+  void CloseReader() {
+    fiber::BlockingGet(adaptor_->GetStreamReader().Close());
+    reader_closed_ = true;
+  }
+
+  bool Read() {
+    return !!fiber::BlockingGet(adaptor_->GetStreamReader().Read());
+  }
+
+ protected:
+  std::atomic<int> written_{0};
+  std::atomic<int> restarts_{0};
+  std::atomic<bool> cleaned_up_{false};
+  bool reader_closed_ = false;
+  std::mutex lock_;
+  std::vector<std::size_t> granted_;
+  std::unique_ptr<StreamIoAdaptor> adaptor_;
+};
+
+TEST_F(StreamIoAdaptorTest, SendWindow) {
+  CreateAdaptor(10, {.stream_window = 1000, .window_advertised = false});
+
+  // Nothing is limited before the peer grants us credit.
+  ASSERT_TRUE(Write());
+  EXPECT_EQ(1, written_);
+
+  // 100 bytes has been sent, 150 bytes left.
+  adaptor_->NotifyWindowUpdate(250);
+  // Our window is granted in return.
+  EXPECT_EQ(std::vector<std::size_t>({1000}), GetGranted());
+
+  for (int i = 0; i != 4; ++i) {
+    ASSERT_TRUE(Write());  // Completed early, as we're buffering writes.
+  }
+  // The window is overdrawn by the third message, the rest is queued.
+  EXPECT_EQ(3, written_);
+
+  adaptor_->NotifyWindowUpdate(100);
+  this_fiber::SleepFor(100ms);
+  EXPECT_EQ(4, written_);
+
+  adaptor_->NotifyWindowUpdate(1000);
+  this_fiber::SleepFor(100ms);
+  EXPECT_EQ(5, written_);
+  EXPECT_EQ(1, GetGranted().size());  // Nothing read, nothing granted.
+}
+
+TEST_F(StreamIoAdaptorTest, GrantWindow) {
+  CreateAdaptor(2, {.stream_window = 1000, .window_advertised = true});
+  adaptor_->NotifyWindowUpdate(1000);
+  EXPECT_TRUE(GetGranted().empty());  // We've advertised our window already.
+
+  for (int i = 0; i != 10; ++i) {
+    // Number of messages is not limited once flow control is enabled.
+    EXPECT_FALSE(adaptor_->NotifyRead(std::make_unique<DummyMessage>(), 100));
+  }
+  for (int i = 0; i != 4; ++i) {
+    ASSERT_TRUE(Read());
+  }
+  EXPECT_TRUE(GetGranted().empty());
+  ASSERT_TRUE(Read());
+  EXPECT_EQ(std::vector<std::size_t>({500}), GetGranted());
+  for (int i = 0; i != 5; ++i) {
+    ASSERT_TRUE(Read());
+  }
+  EXPECT_EQ(std::vector<std::size_t>({500, 500}), GetGranted());
+}
+
+TEST_F(StreamIoAdaptorTest, ConnectionWindow) {
+  StreamIoAdaptor::ConnectionWindow conn;
+  CreateAdaptor(10, {.connection = &conn, .connection_window = 250});
+
+  EXPECT_FALSE(adaptor_->NotifyRead(std::make_unique<DummyMessage>(), 100));
+  EXPECT_FALSE(adaptor_->NotifyRead(std::make_unique<DummyMessage>(), 100));
+  EXPECT_TRUE(adaptor_->NotifyRead(std::make_unique<DummyMessage>(), 100));
+  EXPECT_EQ(300, conn.GetBufferedBytes());
+
+  ASSERT_TRUE(Read());
+  EXPECT_EQ(200, conn.GetBufferedBytes());
+  EXPECT_EQ(1, restarts_);
+
+  // Messages not read are released on close.
+  CloseReader();
+  EXPECT_EQ(0, conn.GetBufferedBytes());
+  EXPECT_TRUE(GetGranted().empty());  // Flow control is not enabled.
+}
+
+TEST_F(StreamIoAdaptorTest, ConnectionWindowWithholdCredit) {
+  StreamIoAdaptor::ConnectionWindow conn;
+  CreateAdaptor(10, {.stream_window = 200,
+                     .window_advertised = true,
+                     .connection = &conn,
+                     .connection_window = 250});
+  adaptor_->NotifyWindowUpdate(1000);
+
+  for (int i = 0; i != 4; ++i) {
+    // Reading from the connection is not suppressed once flow control is
+    // enabled.
+    EXPECT_FALSE(adaptor_->NotifyRead(std::make_unique<DummyMessage>(), 100));
+  }
+  EXPECT_EQ(400, conn.GetBufferedBytes());
+
+  // The connection's window is still exhausted, credit is withheld.
+  ASSERT_TRUE(Read());
+  EXPECT_TRUE(GetGranted().empty());
+
+  // Granted once the window is available again.
+  ASSERT_TRUE(Read());
+  EXPECT_EQ(std::vector<std::size_t>({100, 100}), GetGranted());
+}
+
+namespace {
+
+// Both ends of a connection carrying several streams. Messages (credit
+// included) are delivered in order, and delivery to an end is paused while it
+// suppresses reading, as what `StreamConnection` does.
+class Connection {
+ public:
+  Connection(std::size_t streams, StreamIoAdaptor::FlowControl flow_control) {
+    for (int i = 0; i != 2; ++i) {
+      auto self = &ends_[i];
+      auto peer = &ends_[1 - i];
+      flow_control.connection = &self->window;
+      for (std::size_t j = 0; j != streams; ++j) {
+        StreamIoAdaptor::Operations ops = {
+            .try_parse = [](auto&&) { return true; },
+            .write =
+                [self, peer, j](auto&&) {
+                  peer->Send({j, 0});
+                  self->streams[j]->NotifyWriteCompletion();
+                  return 100;
+                },
+            .write_window_update =
+                [peer, j](auto increment) { peer->Send({j, increment}); },
+            .restart_read = [self] { self->restarted = true; },
+            .on_close = [] {},
+            .on_cleanup = [self] { ++self->cleaned_up; }};
+        self->streams.push_back(std::make_unique<StreamIoAdaptor>(
+            2, std::move(ops), flow_control));
+      }
+    }
+    for (auto&& e : ends_) {
+      for (auto&& s : e.streams) {
+        s->NotifyWindowUpdate(flow_control.stream_window);
+      }
+      e.receiver = fiber::Async([e = &e] { e->Receive(); });
+    }
+  }
+
+  ~Connection() {
+    for (auto&& e : ends_) {
+      for (auto&& s : e.streams) {
+        fiber::BlockingGet(s->GetStreamReader().Close());
+        fiber::BlockingGet(s->GetStreamWriter().Close());
+      }
+    }
+    for (auto&& e : ends_) {
+      while (e.cleaned_up != e.streams.size()) {
+        this_fiber::Yield();
+      }
+      e.leaving = true;
+      fiber::BlockingGet(std::move(e.receiver));
+      for (auto&& s : e.streams) {
+        s->FlushPendingCalls();
+      }
+    }
+  }
+
+  StreamIoAdaptor* GetStream(int end, std::size_t index) {
+    return ends_[end].streams[index].get();
+  }
+
+ private:
+  struct Packet {
+    std::size_t stream;
+    std::size_t window_update;  // Data message if 0.
+  };
+
+  struct End {
+    StreamIoAdaptor::ConnectionWindow window;
+    std::vector<std::unique_ptr<StreamIoAdaptor>> streams;
+    std::atomic<bool> restarted{false};
+    std::atomic<std::size_t> cleaned_up{0};
+    std::atomic<bool> leaving{false};
+    Future<> receiver;
+
+    std::mutex lock;
+    std::deque<Packet> packets;
+
+    void Send(Packet packet) {
+      std::scoped_lock _(lock);
+      packets.push_back(packet);
+    }
+
+    void Receive() {
+      while (!leaving) {
+        std::optional<Packet> packet;
+        {
+          std::scoped_lock _(lock);
+          if (!packets.empty()) {
+            packet = packets.front();
+            packets.pop_front();
+          }
+        }
+        if (!packet) {
+          this_fiber::SleepFor(1ms);
+          continue;
+        }
+        auto&& stream = streams[packet->stream];
+        if (packet->window_update) {
+          stream->NotifyWindowUpdate(packet->window_update);
+          continue;
+        }
+        restarted = false;
+        if (stream->NotifyRead(std::make_unique<DummyMessage>(), 100)) {
+          while (!restarted && !leaving) {  // Reading is suppressed.
+            this_fiber::SleepFor(1ms);
+          }
+        }
+      }
+    }
+  };
+  End ends_[2];
+};
+
+}  // namespace
+
+TEST(StreamIoAdaptor, MultipleStreamsWriteBeforeRead) {
+  constexpr auto kStreams = 4;
+  // Messages are 100 bytes each, a stream's window fits 10 messages, and the
+  // connection's window fits 10 messages of all streams.
+  Connection conn(kStreams, {.stream_window = 1000,
+                             .window_advertised = true,
+                             .connection_window = 1000});
+
+  // The server writes 5 messages to each stream before reading 20 messages.
+  std::vector<Future<>> servers;
+  for (int i = 0; i != kStreams; ++i) {
+    servers.push_back(fiber::Async([&, i] {
+      auto stream = conn.GetStream(1, i);
+      for (int j = 0; j != 5; ++j) {
+        ASSERT_TRUE(fiber::BlockingGet(
+            stream->GetStreamWriter().Write(std::make_unique<DummyMessage>())));
+      }
+      for (int j = 0; j != 20; ++j) {
+        ASSERT_TRUE(fiber::BlockingGet(stream->GetStreamReader().Read()));
+      }
+    }));
+  }
+
+  // The client handles the streams one by one, each by writing 20 messages
+  // before reading 5 messages.
+  //
+  // Messages from the server exhausts client's connection window, but credit
+  // granted by the server to client's writers must get through.
+  auto client = fiber::Async([&] {
+    for (int i = 0; i != kStreams; ++i) {
+      auto stream = conn.GetStream(0, i);
+      for (int j = 0; j != 20; ++j) {
+        ASSERT_TRUE(fiber::BlockingGet(
+            stream->GetStreamWriter().Write(std::make_unique<DummyMessage>())));
+      }
+      for (int j = 0; j != 5; ++j) {
+        ASSERT_TRUE(fiber::BlockingGet(stream->GetStreamReader().Read()));
+      }
+    }
+  });
+  ASSERT_TRUE(fiber::BlockingTryGet(std::move(client), 10s));
+  for (auto&& e : servers) {
+    fiber::BlockingGet(std::move(e));
+  }
+}
+
+}  // namespace flare::rpc::detail
+
+FLARE_TEST_MAIN
@@ -13,6 +13,13 @@
 // the License.
 
 #include "flare/rpc/load_balancer/consistent_hash.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
 #include "flare/base/string.h"
 
 namespace flare::load_balancer {
@@ -22,18 +29,70 @@ FLARE_RPC_REGISTER_LOAD_BALANCER("chash", ConsistentHash);
 ConsistentHash::~ConsistentHash() { endpoints_.load()->Retire(); }
 
 void ConsistentHash::SetPeers(std::vector<Endpoint> addresses) {
-  std::map<std::uint64_t, Endpoint> peers_circle;
-  for (auto&& addr : addresses) {
-    // Take the same weight for each Endpoint
-    for (std::uint64_t i = 0; i < kVirtualNodePeerEndpoint; i++) {
-      std::uint64_t key = hash_(Format("{},{}", addr, i));
-      peers_circle.emplace(key, std::move(addr));
-    }
+  auto new_peers = std::make_unique<Peers>();
+  for (std::uint32_t i = 0; i != addresses.size(); ++i) {
+    AddVirtualNodes(addresses[i], i, &new_peers->ring);
+  }
+  std::sort(new_peers->ring.begin(), new_peers->ring.end());
+  new_peers->peers = std::move(addresses);
+  endpoints_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+}
+
+bool ConsistentHash::ApplyPeerDelta(const PeerDelta& delta) {
+  constexpr auto kRemoved = std::numeric_limits<std::uint32_t>::max();
+
+  // Attributes of peers are not used by us, so `delta.updated` is ignored.
+  std::unordered_set<std::string> removed;
+  for (auto&& e : delta.removed) {
+    removed.insert(e.ToString());
   }
 
+  // It's safe to access `endpoints_` here, as no one else replaces it
+  // concurrently.
+  auto&& current = *endpoints_.load(std::memory_order_acquire);
   auto new_peers = std::make_unique<Peers>();
-  new_peers->peers_circle_ = std::move(peers_circle);
+
+  // Indices of peers in `new_peers->peers`.
+  std::vector<std::uint32_t> new_indices(current.peers.size());
+  std::unordered_set<std::string> present;
+  for (std::size_t i = 0; i != current.peers.size(); ++i) {
+    auto key = current.peers[i].ToString();
+    if (!removed.empty() && removed.count(key)) {
+      new_indices[i] = kRemoved;
+    } else {
+      new_indices[i] = new_peers->peers.size();
+      new_peers->peers.push_back(current.peers[i]);
+      present.insert(std::move(key));
+    }
+  }
+  std::vector<VirtualNode> added;
+  for (auto&& e : delta.added) {
+    // Peers already present (the delta may overlap with what we were given
+    // last time) are not added twice.
+    if (!present.insert(e.address.ToString()).second) {
+      continue;
+    }
+    AddVirtualNodes(e.address, new_peers->peers.size(), &added);
+    new_peers->peers.push_back(e.address);
+  }
+  std::sort(added.begin(), added.end());
+
+  // Virtual nodes of existing peers are still sorted after being renumbered,
+  // as the relative order of the peers is kept. Hashes of them need not to be
+  // recalculated either.
+  auto&& ring = new_peers->ring;
+  ring.reserve(current.ring.size() + added.size());
+  for (auto&& [hash, index] : current.ring) {
+    if (new_indices[index] != kRemoved) {
+      ring.emplace_back(hash, new_indices[index]);
+    }
+  }
+  auto mid = ring.size();
+  ring.insert(ring.end(), added.begin(), added.end());
+  std::inplace_merge(ring.begin(), ring.begin() + mid, ring.end());
+
   endpoints_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+  return true;
 }
 
 bool ConsistentHash::GetPeer(std::uint64_t key, Endpoint* addr,
@@ -41,12 +100,13 @@ bool ConsistentHash::GetPeer(std::uint64_t key, Endpoint* addr,
   Hazptr hazptr;
   auto kept = hazptr.Keep(&endpoints_);
 
-  if (FLARE_UNLIKELY(kept->peers_circle_.empty())) {
+  auto&& ring = kept->ring;
+  if (FLARE_UNLIKELY(ring.empty())) {
     return false;
   }
-  auto itr = kept->peers_circle_.lower_bound(hash_(std::to_string(key)));
-  *addr = itr == kept->peers_circle_.end() ? kept->peers_circle_.begin()->second
-                                           : itr->second;
+  auto itr = std::lower_bound(ring.begin(), ring.end(),
+                              VirtualNode(hash_(std::to_string(key)), 0));
+  *addr = kept->peers[itr == ring.end() ? ring.front().second : itr->second];
   return true;
 }
 
@@ -55,4 +115,13 @@ void ConsistentHash::Report(const Endpoint& addr, Status status,
                             std::uintptr_t ctx) {
   // TODO(yinghaoyu): ...
 }
+
+void ConsistentHash::AddVirtualNodes(const Endpoint& addr, std::uint32_t index,
+                                     std::vector<VirtualNode>* nodes) const {
+  // Take the same weight for each Endpoint
+  for (std::uint64_t i = 0; i < kVirtualNodePeerEndpoint; i++) {
+    nodes->emplace_back(hash_(Format("{},{}", addr, i)), index);
+  }
+}
+
 }  // namespace flare::load_balancer
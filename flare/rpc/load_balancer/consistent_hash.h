@@ -15,8 +15,8 @@
 #ifndef FLARE_RPC_LOAD_BALANCER_CONSISTENT_HASH_H_
 #define FLARE_RPC_LOAD_BALANCER_CONSISTENT_HASH_H_
 
-#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "flare/base/hazptr.h"
@@ -31,6 +31,7 @@ class ConsistentHash : public LoadBalancer {
   ~ConsistentHash();
 
   void SetPeers(std::vector<Endpoint> addresses) override;
+  bool ApplyPeerDelta(const PeerDelta& delta) override;
 
   bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
 
@@ -38,10 +39,19 @@ class ConsistentHash : public LoadBalancer {
               std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
 
  private:
+  // (Hash, index into `Peers::peers`).
+  using VirtualNode = std::pair<std::uint64_t, std::uint32_t>;
+
   struct Peers : HazptrObject<Peers> {
-    std::map<std::uint64_t, Endpoint> peers_circle_;
+    std::vector<Endpoint> peers;
+    // Sorted. For virtual nodes of the same hash, the one of the peer comes
+    // first in `peers` wins.
+    std::vector<VirtualNode> ring;
   };
 
+  void AddVirtualNodes(const Endpoint& addr, std::uint32_t index,
+                       std::vector<VirtualNode>* nodes) const;
+
   std::atomic<Peers*> endpoints_{std::make_unique<Peers>().release()};
   std::hash<std::string> hash_;
   static constexpr std::uint64_t kVirtualNodePeerEndpoint = 100;
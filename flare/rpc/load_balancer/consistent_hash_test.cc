@@ -65,4 +65,41 @@ TEST(ConsistentHash, Basic) {
   EXPECT_LE(error, requests * rate);
 }
 
+TEST(ConsistentHash, ApplyPeerDelta) {
+  std::vector<Endpoint> endpoints;
+  for (int i = 0; i != 100; ++i) {
+    endpoints.push_back(EndpointFromIpv4("192.0.2.1", 1000 + i));
+  }
+  load_balancer::ConsistentHash incremental;
+  incremental.SetPeers(endpoints);
+
+  PeerDelta delta;
+  for (int i = 0; i != 10; ++i) {
+    delta.removed.push_back(endpoints[i * 10]);
+    delta.added.emplace_back().address =
+        EndpointFromIpv4("192.0.2.2", 1000 + i);
+  }
+  ASSERT_TRUE(incremental.ApplyPeerDelta(delta));
+
+  std::vector<Endpoint> expected_endpoints;
+  for (int i = 0; i != 100; ++i) {
+    if (i % 10) {
+      expected_endpoints.push_back(endpoints[i]);
+    }
+  }
+  for (auto&& e : delta.added) {
+    expected_endpoints.push_back(e.address);
+  }
+  load_balancer::ConsistentHash expected;
+  expected.SetPeers(expected_endpoints);
+
+  for (int i = 0; i != 100000; ++i) {
+    std::uintptr_t ctx;
+    Endpoint x, y;
+    ASSERT_TRUE(incremental.GetPeer(i, &x, &ctx));
+    ASSERT_TRUE(expected.GetPeer(i, &y, &ctx));
+    ASSERT_EQ(y, x);
+  }
+}
+
 }  // namespace flare
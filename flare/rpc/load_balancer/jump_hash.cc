@@ -0,0 +1,118 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/jump_hash.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <utility>
+
+namespace flare::load_balancer {
+
+FLARE_RPC_REGISTER_LOAD_BALANCER("jump", JumpHash);
+
+namespace {
+
+// @sa: https://arxiv.org/abs/1406.2294
+std::uint32_t JumpConsistentHash(std::uint64_t key, std::uint32_t buckets) {
+  std::int64_t b = -1, j = 0;
+  while (j < buckets) {
+    b = j;
+    key = key * 2862933555777941757ULL + 1;
+    j = (b + 1) * (static_cast<double>(1LL << 31) /
+                   static_cast<double>((key >> 33) + 1));
+  }
+  return b;
+}
+
+}  // namespace
+
+JumpHash::~JumpHash() {
+  peers_.load()->Retire();  // Let it go.
+}
+
+void JumpHash::SetPeers(std::vector<Endpoint> addresses) {
+  // Each occurrence of a peer counts as one unit of weight.
+  std::vector<PeerInfo> peers(addresses.size());
+  for (std::size_t i = 0; i != addresses.size(); ++i) {
+    peers[i].address = std::move(addresses[i]);
+    peers[i].weight = 1;
+  }
+  SetPeersWithAttributes(std::move(peers));
+}
+
+void JumpHash::SetPeersWithAttributes(std::vector<PeerInfo> peers) {
+  std::vector<std::pair<std::string, PeerInfo*>> sorted;
+  for (auto&& e : peers) {
+    sorted.emplace_back(e.address.ToString(), &e);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](auto&& x, auto&& y) { return x.first < y.first; });
+
+  // Duplicates are merged and their weights summed up.
+  std::vector<Endpoint> merged;
+  std::vector<std::uint32_t> weights;
+  for (std::size_t i = 0; i != sorted.size(); ++i) {
+    if (i && sorted[i].first == sorted[i - 1].first) {
+      weights.back() += sorted[i].second->weight;
+    } else {
+      merged.push_back(std::move(sorted[i].second->address));
+      weights.push_back(sorted[i].second->weight);
+    }
+  }
+
+  // Peers of weight 0 receive no traffic, unless all peers are of weight 0.
+  // Weights are divided by their greatest common divisor to keep number of
+  // buckets small.
+  bool all_zero = std::all_of(weights.begin(), weights.end(),
+                              [](auto w) { return w == 0; });
+  std::uint32_t divisor = 0;
+  for (auto&& e : weights) {
+    divisor = std::gcd(divisor, all_zero ? 1 : e);
+  }
+
+  auto new_peers = std::make_unique<Peers>();
+  for (std::size_t i = 0; i != merged.size(); ++i) {
+    auto buckets = all_zero ? 1 : weights[i] / divisor;
+    if (!buckets) {
+      continue;
+    }
+    new_peers->peers.push_back(std::move(merged[i]));
+    new_peers->buckets.insert(new_peers->buckets.end(), buckets,
+                              new_peers->peers.size() - 1);
+  }
+  peers_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+}
+
+bool JumpHash::GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+
+  *ctx = 0;  // Not used.
+  if (FLARE_UNLIKELY(kept->buckets.empty())) {
+    return false;
+  }
+  *addr = kept->peers[kept->buckets[JumpConsistentHash(
+      key, kept->buckets.size())]];
+  return true;
+}
+
+void JumpHash::Report(const Endpoint& addr, Status status,
+                      std::chrono::nanoseconds time_cost, std::uintptr_t ctx) {
+  // Nothing to do.
+}
+
+}  // namespace flare::load_balancer
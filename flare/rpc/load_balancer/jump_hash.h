@@ -0,0 +1,70 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_LOAD_BALANCER_JUMP_HASH_H_
+#define FLARE_RPC_LOAD_BALANCER_JUMP_HASH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "flare/base/hazptr.h"
+#include "flare/rpc/load_balancer/load_balancer.h"
+
+namespace flare::load_balancer {
+
+// Consistent hashing using "jump consistent hash".
+//
+// @sa: https://arxiv.org/abs/1406.2294
+//
+// No lookup table (other than a flat array of peers) is needed at all, and
+// the peers are evenly balanced. However, it only remaps minimal number of
+// keys if peers are added to / removed from the end of the list. Peers are
+// sorted by their addresses, so this holds as long as new peers have "larger"
+// addresses. Otherwise `Maglev` should be preferred.
+//
+// Peers are weighted by `PeerInfo::weight`. Peers appearing multiple times are
+// merged and their weights summed up (in `SetPeers`, each occurrence counts as
+// one unit of weight). A peer takes as many buckets as its weight (divided by
+// the greatest common divisor of all weights), so weights should be kept
+// small.
+class JumpHash : public LoadBalancer {
+ public:
+  ~JumpHash();
+
+  void SetPeers(std::vector<Endpoint> addresses) override;
+  void SetPeersWithAttributes(std::vector<PeerInfo> peers) override;
+
+  bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
+
+ private:
+  struct Peers : HazptrObject<Peers> {
+    std::vector<Endpoint> peers;
+
+    // Each bucket is an index into `peers`. A peer with weight N has N
+    // buckets.
+    std::vector<std::uint32_t> buckets;
+  };
+
+  std::atomic<Peers*> peers_{std::make_unique<Peers>().release()};
+};
+
+}  // namespace flare::load_balancer
+
+#endif  // FLARE_RPC_LOAD_BALANCER_JUMP_HASH_H_
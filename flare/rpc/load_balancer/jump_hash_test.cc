@@ -0,0 +1,132 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/jump_hash.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/net/endpoint.h"
+#include "flare/rpc/load_balancer/testing.h"
+
+namespace flare::load_balancer {
+
+namespace {
+
+std::unordered_map<std::uint64_t, std::uint16_t> Lookup(JumpHash* lb,
+                                                        int keys) {
+  std::unordered_map<std::uint64_t, std::uint16_t> result;
+  for (int i = 0; i != keys; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    EXPECT_TRUE(lb->GetPeer(i, &peer, &ctx));
+    result[i] = EndpointGetPort(peer);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(JumpHash, Empty) {
+  JumpHash lb;
+  Endpoint peer;
+  std::uintptr_t ctx;
+  EXPECT_FALSE(lb.GetPeer(0, &peer, &ctx));
+}
+
+TEST(JumpHash, Context) {
+  JumpHash lb;
+  lb.SetPeers(MakePeers(10));
+  Endpoint peer;
+  std::uintptr_t ctx = 12345;
+  ASSERT_TRUE(lb.GetPeer(0, &peer, &ctx));
+  EXPECT_EQ(0, ctx);
+}
+
+TEST(JumpHash, Balanced) {
+  JumpHash lb;
+  lb.SetPeers(MakePeers(100));
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 1000000)) {
+    ++received[v];
+  }
+  ASSERT_EQ(100, received.size());
+  for (auto&& [k, v] : received) {
+    EXPECT_NEAR(10000, v, 1000);
+  }
+}
+
+TEST(JumpHash, Consistent) {
+  JumpHash lb;
+  auto peers = MakePeers(100);
+  lb.SetPeers(peers);
+  auto before = Lookup(&lb, 100000);
+
+  // Adding a peer (to the end) only moves keys to the new one.
+  peers.push_back(EndpointFromIpv4("192.0.2.1", 2000));
+  lb.SetPeers(peers);
+  auto after = Lookup(&lb, 100000);
+  int remapped = 0;
+  for (auto&& [k, v] : before) {
+    if (after[k] != v) {
+      EXPECT_EQ(2000, after[k]);
+      ++remapped;
+    }
+  }
+  EXPECT_NEAR(100000 / 101, remapped, 200);
+}
+
+TEST(JumpHash, Weighted) {
+  JumpHash lb;
+  auto peers = MakePeers(2);
+  peers.push_back(peers[0]);
+  peers.push_back(peers[0]);  // Weight of the first peer is 3.
+  lb.SetPeers(peers);
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(75000, received[1000], 2000);
+  EXPECT_NEAR(25000, received[1001], 2000);
+}
+
+TEST(JumpHash, WeightedByAttributes) {
+  JumpHash lb;
+  auto peers = MakePeers(3);
+  lb.SetPeersWithAttributes({{.address = peers[0], .weight = 300},
+                             {.address = peers[1], .weight = 100},
+                             {.address = peers[2], .weight = 0}});
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(75000, received[1000], 2000);
+  EXPECT_NEAR(25000, received[1001], 2000);
+  EXPECT_EQ(0, received[1002]);  // Weight 0, no traffic.
+
+  // Unless everyone is of weight 0.
+  lb.SetPeersWithAttributes(
+      {{.address = peers[0], .weight = 0}, {.address = peers[1], .weight = 0}});
+  received.clear();
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(50000, received[1000], 2000);
+  EXPECT_NEAR(50000, received[1001], 2000);
+}
+
+}  // namespace flare::load_balancer
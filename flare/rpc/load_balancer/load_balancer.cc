@@ -14,8 +14,21 @@
 
 #include "flare/rpc/load_balancer/load_balancer.h"
 
+#include <utility>
+
 namespace flare {
 
 FLARE_DEFINE_CLASS_DEPENDENCY_REGISTRY(load_balancer_registry, LoadBalancer);
 
+void LoadBalancer::SetPeersWithAttributes(std::vector<PeerInfo> peers) {
+  std::vector<Endpoint> addresses;
+  addresses.reserve(peers.size());
+  for (auto&& e : peers) {
+    addresses.push_back(std::move(e.address));
+  }
+  SetPeers(std::move(addresses));
+}
+
+bool LoadBalancer::ApplyPeerDelta(const PeerDelta& delta) { return false; }
+
 }
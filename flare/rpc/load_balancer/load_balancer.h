@@ -21,6 +21,7 @@
 
 #include "flare/base/dependency_registry.h"
 #include "flare/base/net/endpoint.h"
+#include "flare/rpc/name_resolver/peer_info.h"
 
 namespace flare {
 
@@ -44,14 +45,32 @@ class LoadBalancer {
   // makes no sense in doing so.
   virtual void SetPeers(std::vector<Endpoint> addresses) = 0;
 
+  // Same as `SetPeers`, except that attributes (weight, zone, etc.) of peers
+  // are provided as well.
+  //
+  // The default implementation ignores the attributes and calls `SetPeers`.
+  // Load balancers that make use of the attributes (e.g., `LocalityAware`)
+  // should override this method.
+  virtual void SetPeersWithAttributes(std::vector<PeerInfo> peers);
+
+  // Applies changes to peers in place, without rebuilding everything from
+  // scratch.
+  //
+  // Returns `false` if not supported, in which case the caller falls back to
+  // `SetPeersWithAttributes`. Same as `SetPeers`, it's undefined to call this
+  // method concurrently with `SetPeers` or itself.
+  //
+  // Peers in `delta.added` may already be present (e.g., if the name resolver
+  // can't return its peers and their version atomically). The implementation
+  // should not add them again.
+  virtual bool ApplyPeerDelta(const PeerDelta& delta);
+
   virtual bool GetPeer(std::uint64_t key, Endpoint* addr,
                        std::uintptr_t* ctx) = 0;
 
-  enum class Status {
-    Success,
-    Overloaded,  // Not implemented at this time.
-    Failed
-  };
+  // Not all load balancers make use of these feedbacks. `RoundRobin`, for
+  // example, ignores them altogether. @sa: `PowerOfTwoChoices`.
+  enum class Status { Success, Overloaded, Failed };
 
   virtual void Report(const Endpoint& addr, Status status,
                       std::chrono::nanoseconds time_cost,
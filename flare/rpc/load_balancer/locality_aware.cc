@@ -0,0 +1,280 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/locality_aware.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "gflags/gflags.h"
+
+#include "flare/base/chrono.h"
+#include "flare/base/random.h"
+
+DEFINE_string(flare_rpc_load_balancer_local_zone, "",
+              "Zone we're in. Load balancer `locality` prefers peers in this "
+              "zone. If empty, locality is not taken into consideration.");
+DEFINE_int32(flare_rpc_load_balancer_locality_spillover_threshold, 70,
+             "If less than this percentage (by weight) of peers in local zone "
+             "are healthy, load balancer `locality` starts spilling traffic "
+             "over to other zones proportionally.");
+
+namespace flare::load_balancer {
+
+FLARE_RPC_REGISTER_LOAD_BALANCER("locality", LocalityAware);
+FLARE_REGISTER_CLASS_DEPENDENCY_FACTORY(load_balancer_registry, "wrr", [] {
+  return std::make_unique<LocalityAware>(LocalityAware::Options());
+});
+
+namespace {
+
+// Weights are scaled down if the schedule would be longer than this.
+constexpr std::uint64_t kMaxScheduleSize = 65536;
+
+// Health of local peers is re-evaluated at this interval.
+constexpr auto kLocalHealthRefreshInterval = std::chrono::milliseconds(100);
+
+// Number of subsequent peers in the schedule we try before giving up looking
+// for a healthy one.
+constexpr std::size_t kMaxAttempts = 8;
+
+std::chrono::nanoseconds Now() {
+  return ReadCoarseSteadyClock().time_since_epoch();
+}
+
+LocalityAware::Options GetDefaultOptions() {
+  LocalityAware::Options opts;
+  opts.local_zone = FLAGS_flare_rpc_load_balancer_local_zone;
+  opts.spillover_threshold =
+      FLAGS_flare_rpc_load_balancer_locality_spillover_threshold;
+  return opts;
+}
+
+// Builds a "smooth" weighted round-robin schedule, in earliest-deadline-first
+// fashion: The `n`-th (0-based) turn of peer `i` is scheduled at "time"
+// `(n + 0.5) / weights[i]`, i.e., turns of each peer are evenly spaced in the
+// cycle.
+//
+// Peers of weight 0 are not scheduled, unless all peers are of weight 0.
+std::vector<std::uint32_t> BuildSchedule(std::vector<std::uint32_t> weights) {
+  if (std::all_of(weights.begin(), weights.end(),
+                  [](auto w) { return w == 0; })) {
+    std::fill(weights.begin(), weights.end(), 1);
+  }
+  std::uint64_t total = std::accumulate(weights.begin(), weights.end(), 0ULL);
+  if (total > kMaxScheduleSize) {
+    for (auto&& e : weights) {
+      if (e) {
+        e = std::max<std::uint64_t>(e * kMaxScheduleSize / total, 1);
+      }
+    }
+  }
+  // Peers of the same weight (which is the common case) need not to be
+  // scheduled several times each.
+  auto gcd = std::accumulate(weights.begin(), weights.end(), 0U,
+                             [](auto x, auto y) { return std::gcd(x, y); });
+  for (auto&& e : weights) {
+    e /= gcd;
+  }
+
+  // (Turns taken so far, index).
+  using Entry = std::pair<std::uint64_t, std::uint32_t>;
+  auto later = [&](const Entry& x, const Entry& y) {
+    // Compare `(x.first + 0.5) / weights[x.second]` with that of `y`.
+    auto xd = (x.first * 2 + 1) * weights[y.second];
+    auto yd = (y.first * 2 + 1) * weights[x.second];
+    return std::tie(xd, x.second) > std::tie(yd, y.second);
+  };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(later)> queue(later);
+  std::uint64_t size = 0;
+  for (std::uint32_t i = 0; i != weights.size(); ++i) {
+    if (weights[i]) {
+      queue.emplace(0, i);
+      size += weights[i];
+    }
+  }
+
+  std::vector<std::uint32_t> schedule;
+  schedule.reserve(size);
+  while (schedule.size() != size) {
+    auto [turns, index] = queue.top();
+    queue.pop();
+    schedule.push_back(index);
+    if (turns + 1 != weights[index]) {
+      queue.emplace(turns + 1, index);
+    }
+  }
+  return schedule;
+}
+
+}  // namespace
+
+LocalityAware::LocalityAware() : LocalityAware(GetDefaultOptions()) {}
+
+LocalityAware::LocalityAware(const Options& options) : options_(options) {}
+
+LocalityAware::~LocalityAware() {
+  peers_.load()->Retire();  // Let it go.
+}
+
+void LocalityAware::SetPeers(std::vector<Endpoint> addresses) {
+  std::vector<PeerInfo> peers(addresses.size());
+  for (std::size_t i = 0; i != addresses.size(); ++i) {
+    peers[i].address = std::move(addresses[i]);
+  }
+  SetPeersWithAttributes(std::move(peers));
+}
+
+void LocalityAware::SetPeersWithAttributes(std::vector<PeerInfo> peers) {
+  // Health of peers we already know is kept. It's safe to access `peers_`
+  // here, as no one else replaces it concurrently.
+  std::unordered_map<std::string, RefPtr<PeerState>> known;
+  auto&& current = *peers_.load(std::memory_order_acquire);
+  for (auto&& group : {&current.local, &current.remote}) {
+    for (auto&& e : group->peers) {
+      known[e->address.ToString()] = e;
+    }
+  }
+
+  auto new_peers = std::make_unique<Peers>();
+  for (auto&& e : peers) {
+    auto&& group = options_.local_zone.empty() || e.zone == options_.local_zone
+                       ? new_peers->local
+                       : new_peers->remote;
+    // Duplicate addresses share their state, so that `Report` sees them.
+    auto&& state = known[e.address.ToString()];
+    if (!state) {
+      state = MakeRefCounted<PeerState>();
+      state->address = std::move(e.address);
+    }
+    group.peers.push_back(state);
+    new_peers->index[group.peers.back()->address] = group.peers.back().Get();
+    group.weights.push_back(e.weight);
+    group.total_weight += e.weight;
+  }
+  for (auto&& group : {&new_peers->local, &new_peers->remote}) {
+    group->schedule = BuildSchedule(group->weights);
+    // Don't let all the clients start from the same peer.
+    group->next.store(Random(), std::memory_order_relaxed);
+  }
+  peers_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+}
+
+bool LocalityAware::GetPeer(std::uint64_t key, Endpoint* addr,
+                            std::uintptr_t* ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+  auto now = Now();
+
+  MaybeRefreshLocalHealth(kept, now);
+  auto group = ChooseGroup(kept);
+  if (FLARE_UNLIKELY(!group)) {
+    return false;
+  }
+  auto chosen = ChoosePeer(group, now);
+  *addr = chosen->address;
+  // Not used. The peer is looked up by its address in `Report`, so that we
+  // don't leak anything even if the caller never reports.
+  *ctx = 0;
+  return true;
+}
+
+void LocalityAware::Report(const Endpoint& addr, Status status,
+                           std::chrono::nanoseconds time_cost,
+                           std::uintptr_t ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+  auto iter = kept->index.find(addr);
+  if (FLARE_UNLIKELY(iter == kept->index.end())) {
+    return;  // Not a peer returned by us, or it has been removed since then.
+  }
+  auto state = iter->second;
+  if (status == Status::Success) {
+    state->consecutive_failures.store(0, std::memory_order_relaxed);
+    return;
+  }
+  // Overloaded peers are treated as failed ones.
+  if (state->consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1 <
+      options_.unhealthy_consecutive_failures) {
+    return;
+  }
+  state->consecutive_failures.store(0, std::memory_order_relaxed);
+  state->unhealthy_until.store(Now() + options_.unhealthy_time,
+                               std::memory_order_relaxed);
+
+  // Let `GetPeer` re-evaluate health of local peers ASAP.
+  kept->next_refresh.store({}, std::memory_order_relaxed);
+}
+
+bool LocalityAware::IsUnhealthy(const PeerState& state,
+                                std::chrono::nanoseconds now) const {
+  return state.unhealthy_until.load(std::memory_order_relaxed) > now;
+}
+
+void LocalityAware::MaybeRefreshLocalHealth(Peers* peers,
+                                            std::chrono::nanoseconds now) {
+  auto next = peers->next_refresh.load(std::memory_order_relaxed);
+  if (next > now || !peers->next_refresh.compare_exchange_strong(
+                        next, now + kLocalHealthRefreshInterval,
+                        std::memory_order_relaxed)) {
+    return;  // Not yet, or someone else is refreshing it.
+  }
+  auto&& local = peers->local;
+  std::uint64_t healthy = 0;
+  for (std::size_t i = 0; i != local.peers.size(); ++i) {
+    if (!IsUnhealthy(*local.peers[i], now)) {
+      healthy += local.weights[i];
+    }
+  }
+  peers->local_healthy_percent.store(
+      local.total_weight ? healthy * 100 / local.total_weight : 100,
+      std::memory_order_relaxed);
+}
+
+LocalityAware::Group* LocalityAware::ChooseGroup(Peers* peers) const {
+  if (peers->local.schedule.empty() || peers->remote.schedule.empty()) {
+    if (peers->local.schedule.empty() && peers->remote.schedule.empty()) {
+      return nullptr;
+    }
+    return peers->local.schedule.empty() ? &peers->remote : &peers->local;
+  }
+  auto healthy = peers->local_healthy_percent.load(std::memory_order_relaxed);
+  auto threshold = static_cast<std::uint32_t>(options_.spillover_threshold);
+  if (healthy >= threshold || Random(threshold - 1) < healthy) {
+    return &peers->local;
+  }
+  return &peers->remote;
+}
+
+LocalityAware::PeerState* LocalityAware::ChoosePeer(
+    Group* group, std::chrono::nanoseconds now) const {
+  auto&& schedule = group->schedule;
+  auto start = group->next.fetch_add(1, std::memory_order_relaxed);
+  for (std::size_t i = 0; i != std::min(kMaxAttempts, schedule.size()); ++i) {
+    auto peer = group->peers[schedule[(start + i) % schedule.size()]].Get();
+    if (!IsUnhealthy(*peer, now)) {
+      return peer;
+    }
+  }
+  // Proceed with what we have.
+  return group->peers[schedule[start % schedule.size()]].Get();
+}
+
+}  // namespace flare::load_balancer
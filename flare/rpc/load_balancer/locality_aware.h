@@ -0,0 +1,130 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_LOAD_BALANCER_LOCALITY_AWARE_H_
+#define FLARE_RPC_LOAD_BALANCER_LOCALITY_AWARE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gflags/gflags_declare.h"
+
+#include "flare/base/hazptr.h"
+#include "flare/base/ref_ptr.h"
+#include "flare/rpc/load_balancer/load_balancer.h"
+
+DECLARE_string(flare_rpc_load_balancer_local_zone);
+DECLARE_int32(flare_rpc_load_balancer_locality_spillover_threshold);
+
+namespace flare::load_balancer {
+
+// Weighted round-robin load balancer that prefers peers in the same zone as
+// us.
+//
+// Peers are chosen in a "smooth" weighted round-robin fashion, i.e., each peer
+// is chosen (roughly) proportional to its weight, and its turns are spread
+// evenly instead of being bursty. The sequence is precomputed on `SetPeers`,
+// so choosing a peer is lock-free.
+//
+// Peers in `local_zone` are preferred. If less than `spillover_threshold`
+// percent (by weight) of them are healthy, a proportional share of traffic is
+// spilled over to other zones. (e.g., if only 35% of local peers are healthy
+// and the threshold is 70%, half of the calls go to other zones.) Peers that
+// failed `unhealthy_consecutive_failures` times in a row are considered as
+// unhealthy for `unhealthy_time`, and are avoided if possible.
+//
+// Weight and zone of peers are provided by name resolver (@sa: `PeerInfo`).
+// Peers set via `SetPeers` are of default weight and unknown zone (i.e., not
+// local).
+class LocalityAware : public LoadBalancer {
+ public:
+  struct Options {
+    // If empty, locality is not taken into consideration at all, and this
+    // class degenerates to a (smooth) weighted round-robin load balancer.
+    std::string local_zone;
+
+    // In percent.
+    int spillover_threshold = 70;
+
+    int unhealthy_consecutive_failures = 5;
+    std::chrono::nanoseconds unhealthy_time = std::chrono::seconds(1);
+  };
+
+  // Options are initialized from `flare_rpc_load_balancer_local_zone` and
+  // `flare_rpc_load_balancer_locality_spillover_threshold`.
+  LocalityAware();
+  explicit LocalityAware(const Options& options);
+  ~LocalityAware();
+
+  void SetPeers(std::vector<Endpoint> addresses) override;
+  void SetPeersWithAttributes(std::vector<PeerInfo> peers) override;
+
+  // `key` is ignored.
+  bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
+
+ private:
+  struct PeerState : RefCounted<PeerState> {
+    Endpoint address;
+    std::atomic<std::uint32_t> consecutive_failures{0};
+
+    // Time since epoch of steady clock.
+    std::atomic<std::chrono::nanoseconds> unhealthy_until{};
+  };
+
+  struct Group {
+    std::vector<RefPtr<PeerState>> peers;
+    std::vector<std::uint32_t> weights;
+    std::uint64_t total_weight = 0;
+
+    // Each element is an index into `peers`, in the order they should be
+    // chosen.
+    std::vector<std::uint32_t> schedule;
+    std::atomic<std::size_t> next;
+  };
+
+  struct Peers : HazptrObject<Peers> {
+    Group local, remote;
+
+    // Percentage (by weight) of healthy peers in `local`. Refreshed
+    // periodically (or once a peer is found unhealthy) by `GetPeer`.
+    std::atomic<std::uint32_t> local_healthy_percent{100};
+    std::atomic<std::chrono::nanoseconds> next_refresh{};
+
+    // For looking up `PeerState` in `Report`. Pointers are owned by `local` or
+    // `remote`.
+    std::unordered_map<Endpoint, PeerState*, EndpointHash> index;
+  };
+
+  bool IsUnhealthy(const PeerState& state, std::chrono::nanoseconds now) const;
+  void MaybeRefreshLocalHealth(Peers* peers, std::chrono::nanoseconds now);
+  Group* ChooseGroup(Peers* peers) const;
+  PeerState* ChoosePeer(Group* group, std::chrono::nanoseconds now) const;
+
+ private:
+  Options options_;
+  std::atomic<Peers*> peers_{std::make_unique<Peers>().release()};
+};
+
+}  // namespace flare::load_balancer
+
+#endif  // FLARE_RPC_LOAD_BALANCER_LOCALITY_AWARE_H_
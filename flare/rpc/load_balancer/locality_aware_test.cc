@@ -0,0 +1,167 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/locality_aware.h"
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/net/endpoint.h"
+
+using namespace std::literals;
+
+namespace flare::load_balancer {
+
+namespace {
+
+PeerInfo MakePeer(std::uint16_t port, std::uint32_t weight,
+                  const std::string& zone = "") {
+  PeerInfo peer;
+  peer.address = EndpointFromIpv4("192.0.2.1", port);
+  peer.weight = weight;
+  peer.zone = zone;
+  return peer;
+}
+
+// Makes `calls` calls, returns number of calls each peer received.
+template <class F>
+std::unordered_map<std::uint16_t, int> Simulate(LocalityAware* lb, int calls,
+                                                F&& failed) {
+  std::unordered_map<std::uint16_t, int> received;
+  for (int i = 0; i != calls; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    EXPECT_TRUE(lb->GetPeer(0, &peer, &ctx));
+    auto port = EndpointGetPort(peer);
+    ++received[port];
+    lb->Report(peer,
+               failed(port) ? LoadBalancer::Status::Failed
+                            : LoadBalancer::Status::Success,
+               1ms, ctx);
+  }
+  return received;
+}
+
+std::unordered_map<std::uint16_t, int> Simulate(LocalityAware* lb,
+                                                int calls) {
+  return Simulate(lb, calls, [](auto) { return false; });
+}
+
+}  // namespace
+
+TEST(LocalityAware, Empty) {
+  LocalityAware lb;
+  Endpoint peer;
+  std::uintptr_t ctx;
+  EXPECT_FALSE(lb.GetPeer(0, &peer, &ctx));
+}
+
+TEST(LocalityAware, RoundRobin) {
+  LocalityAware lb(LocalityAware::Options{});
+  lb.SetPeers({EndpointFromIpv4("192.0.2.1", 1000),
+               EndpointFromIpv4("192.0.2.1", 1001),
+               EndpointFromIpv4("192.0.2.1", 1002)});
+  auto received = Simulate(&lb, 3000);
+  ASSERT_EQ(3, received.size());
+  for (auto&& [k, v] : received) {
+    EXPECT_EQ(1000, v);
+  }
+}
+
+TEST(LocalityAware, Weighted) {
+  LocalityAware lb(LocalityAware::Options{});
+  lb.SetPeersWithAttributes(
+      {MakePeer(1000, 100), MakePeer(1001, 300), MakePeer(1002, 0)});
+  auto received = Simulate(&lb, 4000);
+  EXPECT_EQ(1000, received[1000]);
+  EXPECT_EQ(3000, received[1001]);
+  EXPECT_EQ(0, received[1002]);
+}
+
+TEST(LocalityAware, Smooth) {
+  LocalityAware lb(LocalityAware::Options{});
+  lb.SetPeersWithAttributes(
+      {MakePeer(1000, 900), MakePeer(1001, 100)});
+  std::uint16_t last = 0;
+  int run = 0, longest_run = 0;
+  for (int i = 0; i != 10000; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    ASSERT_TRUE(lb.GetPeer(0, &peer, &ctx));
+    lb.Report(peer, LoadBalancer::Status::Success, 1ms, ctx);
+    auto port = EndpointGetPort(peer);
+    run = port == last ? run + 1 : 1;
+    last = port;
+    longest_run = std::max(longest_run, run);
+  }
+  // The light one is scheduled in the middle of each cycle, rather than at
+  // the end, so the heavy one never gets more than its share of a cycle in a
+  // row.
+  EXPECT_LE(longest_run, 9);
+}
+
+TEST(LocalityAware, PreferLocalZone) {
+  LocalityAware lb(LocalityAware::Options{.local_zone = "sh"});
+  lb.SetPeersWithAttributes({MakePeer(1000, 100, "sh"),
+                             MakePeer(1001, 100, "sh"),
+                             MakePeer(1002, 100, "gz"), MakePeer(1003, 100)});
+  auto received = Simulate(&lb, 10000);
+  EXPECT_EQ(5000, received[1000]);
+  EXPECT_EQ(5000, received[1001]);
+  EXPECT_EQ(0, received[1002]);
+  EXPECT_EQ(0, received[1003]);
+
+  // No peer in local zone at all.
+  lb.SetPeersWithAttributes({MakePeer(1002, 100, "gz")});
+  EXPECT_EQ(10000, Simulate(&lb, 10000)[1002]);
+}
+
+TEST(LocalityAware, Spillover) {
+  LocalityAware lb(LocalityAware::Options{.local_zone = "sh"});
+  lb.SetPeersWithAttributes({MakePeer(1000, 100, "sh"),
+                             MakePeer(1001, 100, "sh"),
+                             MakePeer(1002, 100, "gz")});
+
+  // 1000 keeps failing and is considered unhealthy.
+  Simulate(&lb, 100, [](auto port) { return port == 1000; });
+  auto received = Simulate(&lb, 10000);
+  // Only 50% (by weight) of local peers are healthy, so 50 / 70 of the calls
+  // stay local.
+  EXPECT_NEAR(10000 * 5 / 7, received[1001], 500);
+  EXPECT_NEAR(10000 * 2 / 7, received[1002], 500);
+  EXPECT_LT(received[1000], 100);
+
+  // Local zone is down.
+  Simulate(&lb, 100, [](auto port) { return port != 1002; });
+  received = Simulate(&lb, 10000);
+  EXPECT_EQ(10000, received[1002]);
+}
+
+TEST(LocalityAware, ReportRemovedPeer) {
+  LocalityAware lb;
+  lb.SetPeersWithAttributes({MakePeer(1000, 100), MakePeer(1001, 100)});
+  Endpoint peer;
+  std::uintptr_t ctx;
+  ASSERT_TRUE(lb.GetPeer(0, &peer, &ctx));
+  lb.SetPeersWithAttributes({});
+  // Silently ignored.
+  lb.Report(peer, LoadBalancer::Status::Failed, 1ms, ctx);
+}
+
+}  // namespace flare::load_balancer
@@ -0,0 +1,279 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/maglev.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace flare::load_balancer {
+
+FLARE_RPC_REGISTER_LOAD_BALANCER("maglev", Maglev);
+FLARE_REGISTER_CLASS_DEPENDENCY_FACTORY(
+    load_balancer_registry, "bounded_maglev", [] {
+      return std::make_unique<Maglev>(Maglev::Options{.bounded_load = true});
+    });
+
+namespace {
+
+// Size of the lookup table is at least so many times of number of peers.
+constexpr std::size_t kTableSizePerPeer = 100;
+constexpr std::size_t kMinimumTableSize = 4096;
+
+// Number of candidates examined before giving up looking for a peer that is
+// not overloaded.
+constexpr std::size_t kMaxProbesForBoundedLoad = 64;
+
+constexpr auto kEmptySlot = std::numeric_limits<std::uint32_t>::max();
+
+// @sa: https://xorshift.di.unimi.it/splitmix64.c
+std::uint64_t Mix(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+std::size_t NextPrime(std::size_t x) {
+  auto is_prime = [](std::size_t x) {
+    for (std::size_t i = 2; i * i <= x; ++i) {
+      if (x % i == 0) {
+        return false;
+      }
+    }
+    return true;
+  };
+  while (!is_prime(x)) {
+    ++x;
+  }
+  return x;
+}
+
+// Changing size of the table remaps almost all keys. Therefore the size is only
+// changed if number of peers changes significantly.
+std::size_t GetTableSize(std::size_t peers) {
+  std::size_t size = kMinimumTableSize;
+  while (size < peers * kTableSizePerPeer) {
+    size *= 2;
+  }
+  return NextPrime(size);
+}
+
+// Peers of weight 0 are removed, unless all peers are of weight 0, in which
+// case they're equally weighted. The rest are divided by their greatest common
+// divisor, so that a round in `BuildTable` is as short as possible.
+void NormalizeWeights(std::vector<Endpoint>* peers,
+                      std::vector<std::uint32_t>* weights) {
+  if (std::all_of(weights->begin(), weights->end(),
+                  [](auto w) { return w == 0; })) {
+    weights->assign(weights->size(), 1);
+    return;
+  }
+  std::size_t j = 0;
+  std::uint32_t divisor = 0;
+  for (std::size_t i = 0; i != peers->size(); ++i) {
+    if ((*weights)[i]) {
+      (*peers)[j] = std::move((*peers)[i]);
+      (*weights)[j] = (*weights)[i];
+      divisor = std::gcd(divisor, (*weights)[j]);
+      ++j;
+    }
+  }
+  peers->resize(j);
+  weights->resize(j);
+  for (auto&& e : *weights) {
+    e /= divisor;
+  }
+}
+
+// Populates Maglev lookup table. Each peer is given `weights[i]` turns in each
+// round.
+std::vector<std::uint32_t> BuildTable(const std::vector<Endpoint>& peers,
+                                      const std::vector<std::uint32_t>& weights,
+                                      std::size_t size) {
+  // Each peer's preference list is a permutation of table slots, determined
+  // by `offset` and `skip`. `size` being a prime guarantees that.
+  std::vector<std::uint64_t> offsets(peers.size()), skips(peers.size()),
+      next(peers.size());
+  for (std::size_t i = 0; i != peers.size(); ++i) {
+    auto hash = std::hash<std::string>()(peers[i].ToString());
+    offsets[i] = Mix(hash) % size;
+    skips[i] = Mix(hash ^ 0x9e3779b97f4a7c15) % (size - 1) + 1;
+  }
+
+  std::vector<std::uint32_t> table(size, kEmptySlot);
+  std::size_t filled = 0;
+  while (true) {
+    for (std::size_t i = 0; i != peers.size(); ++i) {
+      for (std::uint32_t w = 0; w != weights[i]; ++w) {
+        auto slot = (offsets[i] + next[i] * skips[i]) % size;
+        while (table[slot] != kEmptySlot) {
+          ++next[i];
+          slot = (offsets[i] + next[i] * skips[i]) % size;
+        }
+        table[slot] = i;
+        ++next[i];
+        if (++filled == size) {
+          return table;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+Maglev::Maglev() : Maglev(Options()) {}
+
+Maglev::Maglev(const Options& options) : options_(options) {}
+
+Maglev::~Maglev() {
+  peers_.load()->Retire();  // Let it go.
+}
+
+void Maglev::SetPeers(std::vector<Endpoint> addresses) {
+  // Each occurrence of a peer counts as one unit of weight.
+  std::vector<PeerInfo> peers(addresses.size());
+  for (std::size_t i = 0; i != addresses.size(); ++i) {
+    peers[i].address = std::move(addresses[i]);
+    peers[i].weight = 1;
+  }
+  SetPeersWithAttributes(std::move(peers));
+}
+
+void Maglev::SetPeersWithAttributes(std::vector<PeerInfo> peers) {
+  // Duplicates are merged and their weights summed up. Peers are sorted so that
+  // the resulting table does not depend on order of `peers`.
+  std::vector<std::pair<std::string, PeerInfo*>> sorted;
+  for (auto&& e : peers) {
+    sorted.emplace_back(e.address.ToString(), &e);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](auto&& x, auto&& y) { return x.first < y.first; });
+
+  auto new_peers = std::make_unique<Peers>();
+  for (std::size_t i = 0; i != sorted.size(); ++i) {
+    if (i && sorted[i].first == sorted[i - 1].first) {
+      new_peers->weights.back() += sorted[i].second->weight;
+    } else {
+      new_peers->peers.push_back(std::move(sorted[i].second->address));
+      new_peers->weights.push_back(sorted[i].second->weight);
+    }
+  }
+  NormalizeWeights(&new_peers->peers, &new_peers->weights);
+  for (auto&& e : new_peers->weights) {
+    new_peers->total_weight += e;
+  }
+
+  if (!new_peers->peers.empty()) {
+    new_peers->table =
+        BuildTable(new_peers->peers, new_peers->weights,
+                   GetTableSize(new_peers->peers.size()));
+  }
+
+  if (options_.bounded_load) {
+    // Outstanding calls to peers we already know are kept. It's safe to access
+    // `peers_` here, as no one else replaces it concurrently.
+    auto&& current = *peers_.load(std::memory_order_acquire);
+    std::unordered_map<Endpoint, RefPtr<PeerLoad>, EndpointHash> known;
+    for (std::size_t i = 0; i != current.peers.size(); ++i) {
+      known[current.peers[i]] = current.loads[i];
+    }
+    for (auto&& e : new_peers->peers) {
+      auto&& load = known[e];
+      new_peers->loads.push_back(load ? std::move(load)
+                                      : MakeRefCounted<PeerLoad>());
+      new_peers->index[e] = new_peers->loads.back().Get();
+    }
+    // Calls to peers that are gone are never reported back to us (or rather,
+    // we can't find them on report), stop counting them.
+    for (auto&& [_, load] : known) {
+      if (load) {
+        total_outstanding_.fetch_sub(
+            load->outstanding.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+      }
+    }
+  }
+
+  peers_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+}
+
+bool Maglev::GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+
+  // Not used. With `bounded_load`, the peer is looked up by its address in
+  // `Report`, so that we don't leak anything even if the caller never
+  // reports.
+  *ctx = 0;
+  if (FLARE_UNLIKELY(kept->table.empty())) {
+    return false;
+  }
+  auto hash = Mix(key);
+  if (FLARE_LIKELY(!options_.bounded_load)) {
+    *addr = kept->peers[kept->table[hash % kept->table.size()]];
+    return true;
+  }
+
+  auto index = GetPeerIndexBoundedLoad(*kept, hash);
+  kept->loads[index]->outstanding.fetch_add(1, std::memory_order_relaxed);
+  total_outstanding_.fetch_add(1, std::memory_order_relaxed);
+  *addr = kept->peers[index];
+  return true;
+}
+
+void Maglev::Report(const Endpoint& addr, Status status,
+                    std::chrono::nanoseconds time_cost, std::uintptr_t ctx) {
+  if (!options_.bounded_load) {
+    return;  // Load is not tracked.
+  }
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+  auto iter = kept->index.find(addr);
+  if (FLARE_UNLIKELY(iter == kept->index.end())) {
+    return;  // Not a peer returned by us, or it has been removed since then.
+  }
+  iter->second->outstanding.fetch_sub(1, std::memory_order_relaxed);
+  total_outstanding_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::uint32_t Maglev::GetPeerIndexBoundedLoad(const Peers& peers,
+                                              std::uint64_t hash) const {
+  auto&& table = peers.table;
+  auto start = hash % table.size();
+  // Including the call being made.
+  auto load_per_weight =
+      options_.load_factor *
+      (total_outstanding_.load(std::memory_order_relaxed) + 1) /
+      peers.total_weight;
+  for (std::size_t i = 0;
+       i != std::min(table.size(), kMaxProbesForBoundedLoad); ++i) {
+    auto index = table[(start + i) % table.size()];
+    auto capacity = std::ceil(load_per_weight * peers.weights[index]);
+    if (peers.loads[index]->outstanding.load(std::memory_order_relaxed) <
+        capacity) {
+      return index;
+    }
+  }
+  return table[start];  // Everyone is busy.
+}
+
+}  // namespace flare::load_balancer
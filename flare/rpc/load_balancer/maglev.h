@@ -0,0 +1,96 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_LOAD_BALANCER_MAGLEV_H_
+#define FLARE_RPC_LOAD_BALANCER_MAGLEV_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "flare/base/hazptr.h"
+#include "flare/base/ref_ptr.h"
+#include "flare/rpc/load_balancer/load_balancer.h"
+
+namespace flare::load_balancer {
+
+// Consistent hashing using Maglev lookup table.
+//
+// @sa: https://research.google/pubs/pub44824/
+//
+// Unlike `ConsistentHash`, peers are looked up in a flat table (of size at
+// least 100x number of peers), in O(1). Rebuilding the table is also cheaper
+// than rebuilding a (tree-based) hash ring.
+//
+// Peers are weighted by `PeerInfo::weight`. Peers appearing multiple times are
+// merged and their weights summed up (in `SetPeers`, each occurrence counts as
+// one unit of weight).
+//
+// If `bounded_load` is set, peers with more outstanding calls than
+// `load_factor` times (weighted) average are skipped, and the call is
+// "spilled" to the next candidate in the table ("consistent hashing with
+// bounded loads", @sa: https://arxiv.org/abs/1608.01350). This prevents hot
+// keys from overloading a single peer, at the cost of weaker affinity.
+class Maglev : public LoadBalancer {
+ public:
+  struct Options {
+    bool bounded_load = false;
+    double load_factor = 1.25;
+  };
+
+  Maglev();
+  explicit Maglev(const Options& options);
+  ~Maglev();
+
+  void SetPeers(std::vector<Endpoint> addresses) override;
+  void SetPeersWithAttributes(std::vector<PeerInfo> peers) override;
+
+  bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
+
+ private:
+  // Only used if `bounded_load` is set.
+  struct PeerLoad : RefCounted<PeerLoad> {
+    std::atomic<std::int64_t> outstanding{0};
+  };
+
+  struct Peers : HazptrObject<Peers> {
+    std::vector<Endpoint> peers;  // Distinct.
+    std::vector<std::uint32_t> weights;
+    std::vector<RefPtr<PeerLoad>> loads;
+    // For looking up `PeerLoad` in `Report`. Pointers are owned by `loads`.
+    std::unordered_map<Endpoint, PeerLoad*, EndpointHash> index;
+    std::uint64_t total_weight = 0;
+
+    // Maglev lookup table. Each element is an index into `peers`.
+    std::vector<std::uint32_t> table;
+  };
+
+  std::uint32_t GetPeerIndexBoundedLoad(const Peers& peers,
+                                        std::uint64_t hash) const;
+
+ private:
+  Options options_;
+  std::atomic<std::int64_t> total_outstanding_{0};
+  std::atomic<Peers*> peers_{std::make_unique<Peers>().release()};
+};
+
+}  // namespace flare::load_balancer
+
+#endif  // FLARE_RPC_LOAD_BALANCER_MAGLEV_H_
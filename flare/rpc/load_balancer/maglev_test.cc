@@ -0,0 +1,192 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/maglev.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/base/net/endpoint.h"
+#include "flare/rpc/load_balancer/testing.h"
+
+namespace flare::load_balancer {
+
+namespace {
+
+std::unordered_map<std::uint64_t, std::uint16_t> Lookup(Maglev* lb,
+                                                        int keys) {
+  std::unordered_map<std::uint64_t, std::uint16_t> result;
+  for (int i = 0; i != keys; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    EXPECT_TRUE(lb->GetPeer(i, &peer, &ctx));
+    result[i] = EndpointGetPort(peer);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(Maglev, Empty) {
+  Maglev lb;
+  Endpoint peer;
+  std::uintptr_t ctx;
+  EXPECT_FALSE(lb.GetPeer(0, &peer, &ctx));
+}
+
+TEST(Maglev, Balanced) {
+  Maglev lb;
+  lb.SetPeers(MakePeers(100));
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 1000000)) {
+    ++received[v];
+  }
+  ASSERT_EQ(100, received.size());
+  for (auto&& [k, v] : received) {
+    EXPECT_NEAR(10000, v, 1000);
+  }
+}
+
+TEST(Maglev, Consistent) {
+  Maglev lb;
+  auto peers = MakePeers(100);
+  lb.SetPeers(peers);
+  auto before = Lookup(&lb, 100000);
+
+  // Order of peers does not matter.
+  std::reverse(peers.begin(), peers.end());
+  lb.SetPeers(peers);
+  EXPECT_EQ(before, Lookup(&lb, 100000));
+
+  // Removing a peer only remaps keys it was responsible for, plus a few others
+  // (Maglev is not "perfectly" consistent).
+  peers.pop_back();
+  lb.SetPeers(peers);
+  auto after = Lookup(&lb, 100000);
+  int remapped = 0;
+  for (auto&& [k, v] : before) {
+    remapped += after[k] != v;
+  }
+  EXPECT_LT(remapped, 100000 / 100 * 3);
+}
+
+TEST(Maglev, Weighted) {
+  Maglev lb;
+  auto peers = MakePeers(2);
+  peers.push_back(peers[0]);
+  peers.push_back(peers[0]);  // Weight of the first peer is 3.
+  lb.SetPeers(peers);
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(75000, received[1000], 2000);
+  EXPECT_NEAR(25000, received[1001], 2000);
+}
+
+TEST(Maglev, BoundedLoad) {
+  Maglev lb(Maglev::Options{.bounded_load = true});
+  lb.SetPeers(MakePeers(10));
+
+  // All calls are made with the same (hot) key, and none of them completes.
+  std::vector<std::pair<Endpoint, std::uintptr_t>> outstanding;
+  std::unordered_map<std::uint16_t, int> received;
+  for (int i = 0; i != 1000; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    ASSERT_TRUE(lb.GetPeer(12345, &peer, &ctx));
+    ++received[EndpointGetPort(peer)];
+    outstanding.emplace_back(peer, ctx);
+  }
+  // The load is spread.
+  for (auto&& [k, v] : received) {
+    EXPECT_LE(v, 1000 / 10 * 1.25 + 1);
+  }
+  for (auto&& [peer, ctx] : outstanding) {
+    lb.Report(peer, LoadBalancer::Status::Success, {}, ctx);
+  }
+
+  // Once the load is gone, the same peer is chosen again and again.
+  received.clear();
+  for (int i = 0; i != 100; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    ASSERT_TRUE(lb.GetPeer(12345, &peer, &ctx));
+    ++received[EndpointGetPort(peer)];
+    lb.Report(peer, LoadBalancer::Status::Success, {}, ctx);
+  }
+  EXPECT_EQ(1, received.size());
+}
+
+TEST(Maglev, BoundedLoadUnreported) {
+  Maglev lb(Maglev::Options{.bounded_load = true});
+  auto peers = MakePeers(10);
+  lb.SetPeers(peers);
+
+  // Nothing is handed out via `ctx`, so calls that are never reported leak
+  // nothing.
+  for (int i = 0; i != 100; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx = 12345;
+    ASSERT_TRUE(lb.GetPeer(12345, &peer, &ctx));
+    EXPECT_EQ(0, ctx);
+  }
+
+  // Replacing all peers forgets calls made to the old ones, so the load on the
+  // new ones is not skewed by them.
+  peers = MakePeers(20);
+  peers.erase(peers.begin(), peers.begin() + 10);
+  lb.SetPeers(peers);
+  std::unordered_map<std::uint16_t, int> received;
+  for (int i = 0; i != 100; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    ASSERT_TRUE(lb.GetPeer(12345, &peer, &ctx));
+    ++received[EndpointGetPort(peer)];
+    lb.Report(peer, LoadBalancer::Status::Success, {}, ctx);
+  }
+  EXPECT_EQ(1, received.size());
+}
+
+TEST(Maglev, WeightedByAttributes) {
+  Maglev lb;
+  auto peers = MakePeers(3);
+  lb.SetPeersWithAttributes({{.address = peers[0], .weight = 300},
+                             {.address = peers[1], .weight = 100},
+                             {.address = peers[2], .weight = 0}});
+  std::unordered_map<std::uint16_t, int> received;
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(75000, received[1000], 2000);
+  EXPECT_NEAR(25000, received[1001], 2000);
+  EXPECT_EQ(0, received[1002]);  // Weight 0, no traffic.
+
+  // Unless everyone is of weight 0.
+  lb.SetPeersWithAttributes(
+      {{.address = peers[0], .weight = 0}, {.address = peers[1], .weight = 0}});
+  received.clear();
+  for (auto&& [k, v] : Lookup(&lb, 100000)) {
+    ++received[v];
+  }
+  EXPECT_NEAR(50000, received[1000], 2000);
+  EXPECT_NEAR(50000, received[1001], 2000);
+}
+
+}  // namespace flare::load_balancer
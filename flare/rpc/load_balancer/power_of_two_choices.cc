@@ -0,0 +1,239 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/power_of_two_choices.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "gflags/gflags.h"
+
+#include "flare/base/chrono.h"
+#include "flare/base/random.h"
+
+DEFINE_int32(flare_rpc_load_balancer_p2c_ejection_consecutive_failures, 5,
+             "Peers failing so many times in a row are ejected by load "
+             "balancer `p2c`.");
+DEFINE_int32(flare_rpc_load_balancer_p2c_ejection_error_rate, 50,
+             "Peers whose (moving average of) error rate exceeds this "
+             "percentage are ejected by load balancer `p2c`.");
+DEFINE_int32(flare_rpc_load_balancer_p2c_ejection_base_time_ms, 1000,
+             "Time for which an outlier is ejected by load balancer `p2c`, in "
+             "milliseconds. Doubled each time the peer is ejected again (up "
+             "to 32x).");
+DEFINE_int32(flare_rpc_load_balancer_p2c_max_ejection_percent, 50,
+             "At most so many percents of peers can be ejected by load "
+             "balancer `p2c` at the same time.");
+
+namespace flare::load_balancer {
+
+FLARE_RPC_REGISTER_LOAD_BALANCER("p2c", PowerOfTwoChoices);
+
+namespace {
+
+constexpr std::uint32_t kErrorRateOne = 1 << 16;
+
+// Error rate is averaged over (roughly) so many recent calls.
+constexpr std::uint32_t kErrorRateWindow = 16;
+
+std::chrono::nanoseconds Now() {
+  return ReadCoarseSteadyClock().time_since_epoch();
+}
+
+}  // namespace
+
+PowerOfTwoChoices::~PowerOfTwoChoices() {
+  peers_.load()->Retire();  // Let it go.
+}
+
+void PowerOfTwoChoices::SetPeers(std::vector<Endpoint> addresses) {
+  // Statistics of peers we already know are kept. It's safe to access
+  // `peers_` here, as no one else replaces it concurrently.
+  std::unordered_map<std::string, RefPtr<PeerState>> known;
+  for (auto&& e : peers_.load(std::memory_order_acquire)->peers) {
+    known[e->address.ToString()] = e;
+  }
+
+  auto new_peers = std::make_unique<Peers>();
+  for (auto&& e : addresses) {
+    if (auto iter = known.find(e.ToString()); iter != known.end()) {
+      new_peers->peers.push_back(iter->second);
+    } else {
+      auto state = MakeRefCounted<PeerState>();
+      state->address = std::move(e);
+      new_peers->peers.push_back(std::move(state));
+    }
+  }
+  for (auto&& e : new_peers->peers) {
+    new_peers->index[e->address] = e.Get();
+  }
+  peers_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+}
+
+bool PowerOfTwoChoices::GetPeer(std::uint64_t key, Endpoint* addr,
+                                std::uintptr_t* ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+  auto&& peers = kept->peers;
+
+  if (FLARE_UNLIKELY(peers.empty())) {
+    return false;
+  }
+
+  PeerState* chosen;
+  if (peers.size() == 1) {
+    chosen = peers[0].Get();
+  } else {
+    auto now = Now();
+    // Try a few times to find two peers that are not ejected. If we failed
+    // (quite unlikely given that at most
+    // `flare_rpc_load_balancer_p2c_max_ejection_percent` of peers are
+    // ejected), proceed with what we have.
+    PeerState *x, *y;
+    for (int i = 0; i != 4; ++i) {
+      auto a = Random(peers.size() - 1);
+      auto b = Random(peers.size() - 2);
+      if (b >= a) {
+        ++b;
+      }
+      x = peers[a].Get();
+      y = peers[b].Get();
+      auto x_ejected = IsEjected(*x, now), y_ejected = IsEjected(*y, now);
+      if (!x_ejected && !y_ejected) {
+        break;
+      }
+      if (x_ejected != y_ejected) {
+        y = x = x_ejected ? y : x;
+        break;
+      }
+    }
+    chosen = GetLoadScore(*x) <= GetLoadScore(*y) ? x : y;
+  }
+
+  chosen->outstanding.fetch_add(1, std::memory_order_relaxed);
+  *addr = chosen->address;
+  // Not used. The peer is looked up by its address in `Report`, so that we
+  // don't leak anything even if the caller never reports.
+  *ctx = 0;
+  return true;
+}
+
+void PowerOfTwoChoices::Report(const Endpoint& addr, Status status,
+                               std::chrono::nanoseconds time_cost,
+                               std::uintptr_t ctx) {
+  Hazptr hazptr;
+  auto kept = hazptr.Keep(&peers_);
+  auto iter = kept->index.find(addr);
+  if (FLARE_UNLIKELY(iter == kept->index.end())) {
+    return;  // Not a peer returned by us, or it has been removed since then.
+  }
+  auto state = iter->second;
+  state->outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+  auto error_rate = state->error_rate.load(std::memory_order_relaxed);
+  if (status == Status::Success) {
+    // Zero `time_cost` means latency is not applicable (e.g., streaming
+    // calls), it shouldn't make the peer look faster.
+    if (time_cost.count() > 0) {
+      auto latency = state->latency_ns.load(std::memory_order_relaxed);
+      auto cost = static_cast<std::uint64_t>(time_cost.count());
+      state->latency_ns.store(
+          latency ? latency - latency / 8 + cost / 8 : cost,
+          std::memory_order_relaxed);
+    }
+    state->error_rate.store(error_rate - error_rate / kErrorRateWindow,
+                            std::memory_order_relaxed);
+    state->consecutive_failures.store(0, std::memory_order_relaxed);
+
+    // Forgive the peer if it has been behaving well since it was (if ever)
+    // ejected last time.
+    if (state->ejections.load(std::memory_order_relaxed) &&
+        state->ejected_until.load(std::memory_order_relaxed) +
+                std::chrono::milliseconds(
+                    FLAGS_flare_rpc_load_balancer_p2c_ejection_base_time_ms) <
+            Now()) {
+      state->ejections.store(0, std::memory_order_relaxed);
+    }
+  } else {
+    // Overloaded peers are treated as failed ones, so that they get fewer
+    // requests (or ejected, if it's really overloaded).
+    state->error_rate.store(
+        error_rate + (kErrorRateOne - error_rate) / kErrorRateWindow,
+        std::memory_order_relaxed);
+    state->consecutive_failures.fetch_add(1, std::memory_order_relaxed);
+    MaybeEject(state, Now());
+  }
+}
+
+double PowerOfTwoChoices::GetLoadScore(const PeerState& state) const {
+  // Peers we know nothing about are preferred (and "probed" this way).
+  auto latency = state.latency_ns.load(std::memory_order_relaxed) + 1;
+  auto outstanding = std::max<std::int64_t>(
+      state.outstanding.load(std::memory_order_relaxed), 0);
+  auto error_rate = 1.0 * state.error_rate.load(std::memory_order_relaxed) /
+                    kErrorRateOne;
+  return static_cast<double>(latency) * (outstanding + 1) *
+         (1 + 4 * error_rate);
+}
+
+bool PowerOfTwoChoices::IsEjected(const PeerState& state,
+                                  std::chrono::nanoseconds now) const {
+  return state.ejected_until.load(std::memory_order_relaxed) > now;
+}
+
+void PowerOfTwoChoices::MaybeEject(PeerState* state,
+                                   std::chrono::nanoseconds now) {
+  if (IsEjected(*state, now)) {
+    return;  // Already ejected.
+  }
+  auto error_rate = state->error_rate.load(std::memory_order_relaxed);
+  if (state->consecutive_failures.load(std::memory_order_relaxed) <
+          FLAGS_flare_rpc_load_balancer_p2c_ejection_consecutive_failures &&
+      error_rate * 100ULL <
+          kErrorRateOne *
+              static_cast<std::uint64_t>(
+                  FLAGS_flare_rpc_load_balancer_p2c_ejection_error_rate)) {
+    return;  // Not an outlier (yet).
+  }
+
+  {
+    // Don't eject too many peers. Ejection should be rare, so scanning all the
+    // peers here is fine.
+    Hazptr hazptr;
+    auto kept = hazptr.Keep(&peers_);
+    std::size_t ejected = std::count_if(
+        kept->peers.begin(), kept->peers.end(),
+        [&](auto&& e) { return IsEjected(*e, now); });
+    auto max_percent = static_cast<std::size_t>(
+        FLAGS_flare_rpc_load_balancer_p2c_max_ejection_percent);
+    if ((ejected + 1) * 100 > kept->peers.size() * max_percent) {
+      return;
+    }
+  }
+
+  auto ejections = state->ejections.fetch_add(1, std::memory_order_relaxed);
+  auto duration =
+      std::chrono::milliseconds(
+          FLAGS_flare_rpc_load_balancer_p2c_ejection_base_time_ms) *
+      (1 << std::min<std::uint32_t>(ejections, 5));
+  state->ejected_until.store(now + duration, std::memory_order_relaxed);
+  state->consecutive_failures.store(0, std::memory_order_relaxed);
+  // Give it a fresh start once it's back.
+  state->error_rate.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace flare::load_balancer
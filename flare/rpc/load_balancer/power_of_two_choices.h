@@ -0,0 +1,95 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_LOAD_BALANCER_POWER_OF_TWO_CHOICES_H_
+#define FLARE_RPC_LOAD_BALANCER_POWER_OF_TWO_CHOICES_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "gflags/gflags_declare.h"
+
+#include "flare/base/hazptr.h"
+#include "flare/base/ref_ptr.h"
+#include "flare/rpc/load_balancer/load_balancer.h"
+
+DECLARE_int32(flare_rpc_load_balancer_p2c_ejection_consecutive_failures);
+DECLARE_int32(flare_rpc_load_balancer_p2c_ejection_error_rate);
+DECLARE_int32(flare_rpc_load_balancer_p2c_ejection_base_time_ms);
+DECLARE_int32(flare_rpc_load_balancer_p2c_max_ejection_percent);
+
+namespace flare::load_balancer {
+
+// Load balancer that takes health of peers into account.
+//
+// For each peer, (exponentially weighted moving average of) latency and error
+// rate, as well as number of outstanding calls, are tracked from `Report`s.
+// On selecting a peer, two peers are chosen randomly, and the one with a lower
+// load score (roughly, latency x outstanding calls, penalized by error rate)
+// wins ("power of two choices").
+//
+// Peers failing consecutively (or having a high error rate) are considered as
+// outliers, and are ejected for a period of time. The period grows
+// exponentially each time the peer is ejected again. At most
+// `flare_rpc_load_balancer_p2c_max_ejection_percent` percent of peers can be
+// ejected at the same time.
+class PowerOfTwoChoices : public LoadBalancer {
+ public:
+  ~PowerOfTwoChoices();
+
+  void SetPeers(std::vector<Endpoint> addresses) override;
+
+  // `key` is ignored, peers are chosen randomly.
+  bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
+
+ private:
+  // Fields are updated without synchronization (w/o CAS). They're only hints
+  // anyway.
+  struct PeerState : RefCounted<PeerState> {
+    Endpoint address;
+    std::atomic<std::uint64_t> latency_ns{0};  // 0 if not known yet.
+    std::atomic<std::uint32_t> error_rate{0};  // Scaled by `kErrorRateOne`.
+    std::atomic<std::int64_t> outstanding{0};
+    std::atomic<std::uint32_t> consecutive_failures{0};
+
+    // Time since epoch of steady clock.
+    std::atomic<std::chrono::nanoseconds> ejected_until{};
+    std::atomic<std::uint32_t> ejections{0};  // Ejected how many times.
+  };
+
+  struct Peers : HazptrObject<Peers> {
+    std::vector<RefPtr<PeerState>> peers;
+    // For looking up `PeerState` in `Report`. Pointers are owned by `peers`.
+    std::unordered_map<Endpoint, PeerState*, EndpointHash> index;
+  };
+
+  double GetLoadScore(const PeerState& state) const;
+  bool IsEjected(const PeerState& state, std::chrono::nanoseconds now) const;
+  void MaybeEject(PeerState* state, std::chrono::nanoseconds now);
+
+ private:
+  std::atomic<Peers*> peers_{std::make_unique<Peers>().release()};
+};
+
+}  // namespace flare::load_balancer
+
+#endif  // FLARE_RPC_LOAD_BALANCER_POWER_OF_TWO_CHOICES_H_
@@ -0,0 +1,156 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/load_balancer/power_of_two_choices.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+#include "flare/base/net/endpoint.h"
+#include "flare/base/string.h"
+#include "flare/rpc/load_balancer/testing.h"
+
+using namespace std::literals;
+
+namespace flare::load_balancer {
+
+namespace {
+
+// Makes `calls` calls, returns number of calls each peer received.
+template <class F>
+std::unordered_map<std::uint16_t, int> Simulate(PowerOfTwoChoices* lb,
+                                                int calls, F&& outcome) {
+  std::unordered_map<std::uint16_t, int> received;
+  for (int i = 0; i != calls; ++i) {
+    Endpoint peer;
+    std::uintptr_t ctx;
+    EXPECT_TRUE(lb->GetPeer(0, &peer, &ctx));
+    auto port = EndpointGetPort(peer);
+    ++received[port];
+    auto&& [status, latency] = outcome(port);
+    lb->Report(peer, status, latency, ctx);
+  }
+  return received;
+}
+
+}  // namespace
+
+TEST(PowerOfTwoChoices, Empty) {
+  PowerOfTwoChoices lb;
+  Endpoint peer;
+  std::uintptr_t ctx;
+  EXPECT_FALSE(lb.GetPeer(0, &peer, &ctx));
+}
+
+TEST(PowerOfTwoChoices, Balanced) {
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(10));
+  auto received = Simulate(&lb, 100000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Success, 1ms);
+  });
+  ASSERT_EQ(10, received.size());
+  for (auto&& [k, v] : received) {
+    EXPECT_NEAR(10000, v, 2000);
+  }
+}
+
+TEST(PowerOfTwoChoices, SlowPeer) {
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(10));
+  auto received = Simulate(&lb, 100000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Success,
+                     port == 1000 ? 100ms : 1ms);
+  });
+  // The slow one is only chosen when it's paired with itself (impossible) or,
+  // it's not measured yet.
+  EXPECT_LT(received[1000], 100);
+}
+
+TEST(PowerOfTwoChoices, ZeroTimeCost) {
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(10));
+  Simulate(&lb, 10000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Success,
+                     port == 1000 ? 100ms : 1ms);
+  });
+  // Calls without latency information (e.g., streaming calls) shouldn't make
+  // the slow peer look fast.
+  auto received = Simulate(&lb, 100000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Success,
+                     port == 1000 ? 0ns : 1ms);
+  });
+  EXPECT_LT(received[1000], 100);
+}
+
+TEST(PowerOfTwoChoices, ReportRemovedPeer) {
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(2));
+  Endpoint peer;
+  std::uintptr_t ctx;
+  ASSERT_TRUE(lb.GetPeer(0, &peer, &ctx));
+  lb.SetPeers(MakePeers(1));
+  lb.SetPeers({});
+  // Silently ignored.
+  lb.Report(peer, LoadBalancer::Status::Failed, 1ms, ctx);
+}
+
+TEST(PowerOfTwoChoices, Ejection) {
+  FLAGS_flare_rpc_load_balancer_p2c_ejection_base_time_ms = 500;
+
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(10));
+  auto failing = [](auto port) {
+    return std::pair(port == 1000 ? LoadBalancer::Status::Failed
+                                  : LoadBalancer::Status::Success,
+                     1ms);
+  };
+  Simulate(&lb, 10000, failing);  // The failing one should have been ejected.
+  EXPECT_EQ(0, Simulate(&lb, 10000, failing)[1000]);
+
+  // Statistics of existing peers are kept on update.
+  lb.SetPeers(MakePeers(10));
+  EXPECT_EQ(0, Simulate(&lb, 10000, failing)[1000]);
+
+  // It's given another chance later.
+  std::this_thread::sleep_for(600ms);
+  auto received = Simulate(&lb, 10000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Success, 1ms);
+  });
+  EXPECT_GT(received[1000], 0);
+}
+
+TEST(PowerOfTwoChoices, MaxEjection) {
+  FLAGS_flare_rpc_load_balancer_p2c_ejection_base_time_ms = 10000;
+
+  PowerOfTwoChoices lb;
+  lb.SetPeers(MakePeers(2));
+  // Both of them are failing, but only one of them can be ejected.
+  auto received = Simulate(&lb, 1000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Failed, 1ms);
+  });
+  EXPECT_EQ(2, received.size());
+  received = Simulate(&lb, 1000, [](auto port) {
+    return std::pair(LoadBalancer::Status::Failed, 1ms);
+  });
+  EXPECT_EQ(1, received.size());
+}
+
+}  // namespace flare::load_balancer
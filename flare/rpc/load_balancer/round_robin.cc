@@ -15,6 +15,8 @@
 #include "flare/rpc/load_balancer/round_robin.h"
 
 #include <memory>
+#include <string>
+#include <unordered_set>
 #include <utility>
 
 namespace flare::load_balancer {
@@ -31,6 +33,37 @@ void RoundRobin::SetPeers(std::vector<Endpoint> addresses) {
   endpoints_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
 }
 
+bool RoundRobin::ApplyPeerDelta(const PeerDelta& delta) {
+  // Attributes of peers are not used by us, so `delta.updated` is ignored.
+  std::unordered_set<std::string> removed;
+  for (auto&& e : delta.removed) {
+    removed.insert(e.ToString());
+  }
+
+  // It's safe to access `endpoints_` here, as no one else replaces it
+  // concurrently.
+  auto&& current = endpoints_.load(std::memory_order_acquire)->peers;
+  auto new_peers = std::make_unique<Peers>();
+  std::unordered_set<std::string> present;
+  new_peers->peers.reserve(current.size() + delta.added.size());
+  for (auto&& e : current) {
+    auto key = e.ToString();
+    if (removed.empty() || !removed.count(key)) {
+      new_peers->peers.push_back(e);
+      present.insert(std::move(key));
+    }
+  }
+  for (auto&& e : delta.added) {
+    // The peer can be there already if the delta overlaps with what we were
+    // given last time. Don't add it twice.
+    if (present.insert(e.address.ToString()).second) {
+      new_peers->peers.push_back(e.address);
+    }
+  }
+  endpoints_.exchange(new_peers.release(), std::memory_order_acq_rel)->Retire();
+  return true;
+}
+
 bool RoundRobin::GetPeer(std::uint64_t key, Endpoint* addr,
                          std::uintptr_t* ctx) {
   Hazptr hazptr;
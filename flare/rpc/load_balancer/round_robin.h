@@ -32,6 +32,7 @@ class RoundRobin : public LoadBalancer {
   ~RoundRobin();
 
   void SetPeers(std::vector<Endpoint> addresses) override;
+  bool ApplyPeerDelta(const PeerDelta& delta) override;
 
   // `key` is ignored, as we select endpoints in a round-robin fashion.
   bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
@@ -0,0 +1,27 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/load_balancer/testing.h"
+
+namespace flare::load_balancer {
+
+std::vector<Endpoint> MakePeers(int n) {
+  std::vector<Endpoint> result;
+  for (int i = 0; i != n; ++i) {
+    result.push_back(EndpointFromIpv4("192.0.2.1", 1000 + i));
+  }
+  return result;
+}
+
+}  // namespace flare::load_balancer
@@ -0,0 +1,32 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_LOAD_BALANCER_TESTING_H_
+#define FLARE_RPC_LOAD_BALANCER_TESTING_H_
+
+#include <vector>
+
+#include "flare/base/net/endpoint.h"
+
+// Some testing utilities shared by UTs of load balancers go here.
+
+namespace flare::load_balancer {
+
+// FOR TESTING PURPOSE ONLY. Makes `n` distinct peers, "192.0.2.1:1000",
+// "192.0.2.1:1001", ....
+std::vector<Endpoint> MakePeers(int n);
+
+}  // namespace flare::load_balancer
+
+#endif  // FLARE_RPC_LOAD_BALANCER_TESTING_H_
@@ -26,26 +26,30 @@ namespace flare::message_dispatcher {
 Composited::Composited(NameResolver* nr, std::unique_ptr<LoadBalancer> lb)
     : nr_(nr), lb_(std::move(lb)) {}
 
+Composited::~Composited() {
+  // Stop watching changes before `lb_` is destroyed. This must be done while
+  // `nrv_` is still accessible, as a callback running concurrently uses it.
+  if (nrv_) {
+    nrv_->Unwatch();
+  }
+}
+
 bool Composited::Open(const std::string& name) {
   nrv_ = nr_->StartResolving(name);
   if (!nrv_) {
     return false;
   }
   service_name_ = name;
+  // If supported, changes are applied as soon as they come, instead of being
+  // applied (while holding a lock) by the first `GetPeer` that notices them.
+  nrv_->Watch([this] { UpdatePeers(); });
   return true;
 }
 
 bool Composited::GetPeer(std::uint64_t key, Endpoint* addr,
                          std::uintptr_t* ctx) {
-  auto version = nrv_->GetVersion();
-  if (version != last_version_.load(std::memory_order_relaxed)) {
-    std::scoped_lock _(reset_peers_lock_);
-    if (version != last_version_.load(std::memory_order_relaxed)) {  // DCLP.
-      std::vector<Endpoint> peers;
-      nrv_->GetPeers(&peers);
-      lb_->SetPeers(std::move(peers));
-      last_version_.store(version, std::memory_order_relaxed);
-    }
+  if (nrv_->GetVersion() != last_version_.load(std::memory_order_relaxed)) {
+    UpdatePeers();
   }
 
   return lb_->GetPeer(key, addr, ctx);
@@ -57,4 +61,34 @@ void Composited::Report(const Endpoint& addr, Status status,
   lb_->Report(addr, status, time_cost, ctx);
 }
 
+void Composited::UpdatePeers() {
+  std::scoped_lock _(reset_peers_lock_);
+  auto version = nrv_->GetVersion();
+  auto last_version = last_version_.load(std::memory_order_relaxed);
+  if (version == last_version) {  // DCLP.
+    return;
+  }
+
+  // Apply only what has changed if both the resolver and the load balancer
+  // support it. Versions of special meaning (negative ones) are not
+  // comparable, and are always handled by a full update.
+  if (version >= 0 && last_version >= 0) {
+    PeerDelta delta;
+    std::int64_t new_version;
+    if (nrv_->GetPeerDelta(last_version, &delta, &new_version) &&
+        lb_->ApplyPeerDelta(delta)) {
+      last_version_.store(new_version, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  // The version is re-read along with the peers. Had we used `version` above,
+  // changes made between the two reads would be delivered once more by the
+  // next `GetPeerDelta`.
+  std::vector<PeerInfo> peers;
+  nrv_->GetPeersWithAttributes(&peers, &version);
+  lb_->SetPeersWithAttributes(std::move(peers));
+  last_version_.store(version, std::memory_order_relaxed);
+}
+
 }  // namespace flare::message_dispatcher
@@ -31,12 +31,17 @@ namespace flare::message_dispatcher {
 class Composited : public MessageDispatcher {
  public:
   Composited(NameResolver* nr, std::unique_ptr<LoadBalancer> lb);
+  ~Composited();
 
   bool Open(const std::string& name) override;
   bool GetPeer(std::uint64_t key, Endpoint* addr, std::uintptr_t* ctx) override;
   void Report(const Endpoint& addr, Status status,
               std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override;
 
+ private:
+  // Applies changes in resolution result (if any) to `lb_`.
+  void UpdatePeers();
+
  private:
   NameResolver* nr_;
   std::unique_ptr<NameResolutionView> nrv_;
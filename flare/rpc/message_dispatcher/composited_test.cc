@@ -0,0 +1,220 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/message_dispatcher/composited.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "flare/rpc/name_resolver/name_resolver_impl.h"
+
+namespace flare::message_dispatcher {
+
+class PushingNs : public name_resolver::NameResolverImpl {
+ public:
+  PushingNs() { updater_ = GetUpdater(); }
+
+  void Push(const std::string& name, const PeerDelta& delta) {
+    ApplyRouteDelta(name, delta);
+  }
+
+ private:
+  bool GetRouteTable(const std::string& name, const std::string& old_signature,
+                     std::vector<Endpoint>* new_address,
+                     std::string* new_signature) override {
+    *new_address = {EndpointFromIpv4("192.0.2.1", 80)};
+    return true;
+  }
+};
+
+class AnyPeer : public LoadBalancer {
+ public:
+  void SetPeers(std::vector<Endpoint> addresses) override {
+    std::scoped_lock _(lock_);
+    peers_ = std::move(addresses);
+  }
+
+  bool ApplyPeerDelta(const PeerDelta& delta) override { return true; }
+
+  bool GetPeer(std::uint64_t key, Endpoint* addr,
+               std::uintptr_t* ctx) override {
+    std::scoped_lock _(lock_);
+    if (peers_.empty()) {
+      return false;
+    }
+    *addr = peers_.front();
+    return true;
+  }
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override {
+  }
+
+ private:
+  std::mutex lock_;
+  std::vector<Endpoint> peers_;
+};
+
+// Keeps track of the peers it's given, and complains if a delta re-adds a
+// peer that is already there.
+class StrictPeers : public LoadBalancer {
+ public:
+  void SetPeers(std::vector<Endpoint> addresses) override {
+    peers_.clear();
+    for (auto&& e : addresses) {
+      peers_.insert(e.ToString());
+    }
+  }
+
+  bool ApplyPeerDelta(const PeerDelta& delta) override {
+    for (auto&& e : delta.removed) {
+      peers_.erase(e.ToString());
+    }
+    for (auto&& e : delta.added) {
+      EXPECT_TRUE(peers_.insert(e.address.ToString()).second)
+          << "Peer " << e.address.ToString() << " is delivered twice.";
+    }
+    return true;
+  }
+
+  bool GetPeer(std::uint64_t key, Endpoint* addr,
+               std::uintptr_t* ctx) override {
+    return false;
+  }
+
+  void Report(const Endpoint& addr, Status status,
+              std::chrono::nanoseconds time_cost, std::uintptr_t ctx) override {
+  }
+
+  std::set<std::string> peers_;
+};
+
+// Pushes a change right before peers are read, i.e., after `Composited` has
+// checked the version.
+class RacingView : public NameResolutionView {
+ public:
+  RacingView(std::unique_ptr<NameResolutionView> view,
+             Function<void()> before_read)
+      : view_(std::move(view)), before_read_(std::move(before_read)) {}
+
+  std::int64_t GetVersion() override { return view_->GetVersion(); }
+  void GetPeers(std::vector<Endpoint>* addresses) override {
+    before_read_();
+    view_->GetPeers(addresses);
+  }
+  void GetPeersWithAttributes(std::vector<PeerInfo>* peers) override {
+    before_read_();
+    view_->GetPeersWithAttributes(peers);
+  }
+  void GetPeersWithAttributes(std::vector<PeerInfo>* peers,
+                              std::int64_t* version) override {
+    before_read_();
+    view_->GetPeersWithAttributes(peers, version);
+  }
+  bool GetPeerDelta(std::int64_t version, PeerDelta* delta,
+                    std::int64_t* new_version) override {
+    return view_->GetPeerDelta(version, delta, new_version);
+  }
+
+ private:
+  std::unique_ptr<NameResolutionView> view_;
+  Function<void()> before_read_;
+};
+
+class RacingNs : public NameResolver {
+ public:
+  explicit RacingNs(Function<void()> before_read)
+      : before_read_(std::move(before_read)) {}
+
+  std::unique_ptr<NameResolutionView> StartResolving(
+      const std::string& name) override {
+    return std::make_unique<RacingView>(ns.StartResolving(name),
+                                        std::move(before_read_));
+  }
+
+  PushingNs ns;
+
+ private:
+  Function<void()> before_read_;
+};
+
+TEST(Composited, UpdateBetweenVersionAndPeers) {
+  bool pushed = false;
+  RacingNs racing([&] {
+    if (!std::exchange(pushed, true)) {
+      PeerDelta delta;
+      delta.added.emplace_back().address = EndpointFromIpv4("192.0.2.2", 80);
+      racing.ns.Push("svc", delta);
+    }
+  });
+  auto lb = std::make_unique<StrictPeers>();
+  auto lb_ptr = lb.get();
+  Composited composited(&racing, std::move(lb));
+  ASSERT_TRUE(composited.Open("svc"));
+
+  Endpoint ep;
+  std::uintptr_t ctx;
+  composited.GetPeer(0, &ep, &ctx);  // Full update, raced with a change.
+  ASSERT_TRUE(pushed);
+  EXPECT_EQ((std::set<std::string>{"192.0.2.1:80", "192.0.2.2:80"}),
+            lb_ptr->peers_);
+
+  PeerDelta delta;
+  delta.added.emplace_back().address = EndpointFromIpv4("192.0.2.3", 80);
+  racing.ns.Push("svc", delta);
+  composited.GetPeer(0, &ep, &ctx);  // Incremental update.
+  EXPECT_EQ((std::set<std::string>{"192.0.2.1:80", "192.0.2.2:80",
+                                   "192.0.2.3:80"}),
+            lb_ptr->peers_);
+}
+
+TEST(Composited, DestroyWhileUpdating) {
+  PushingNs ns;
+  std::atomic<bool> leaving{false};
+  // Keep the name being resolved even if no `Composited` is alive.
+  auto view = ns.StartResolving("svc");
+
+  std::thread pusher([&] {
+    for (int i = 0; !leaving.load(std::memory_order_relaxed); ++i) {
+      PeerDelta delta;
+      if (i % 2 == 0) {
+        delta.added.emplace_back().address = EndpointFromIpv4("192.0.2.2", 80);
+      } else {
+        delta.removed.push_back(EndpointFromIpv4("192.0.2.2", 80));
+      }
+      ns.Push("svc", delta);
+    }
+  });
+
+  for (int i = 0; i != 100000; ++i) {
+    Composited composited(&ns, std::make_unique<AnyPeer>());
+    ASSERT_TRUE(composited.Open("svc"));
+    Endpoint ep;
+    std::uintptr_t ctx;
+    EXPECT_TRUE(composited.GetPeer(0, &ep, &ctx));
+    // `composited` is destroyed while changes are being pushed.
+  }
+  leaving = true;
+  pusher.join();
+}
+
+}  // namespace flare::message_dispatcher
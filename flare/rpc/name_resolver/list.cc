@@ -14,6 +14,9 @@
 
 #include "flare/rpc/name_resolver/list.h"
 
+#include <string_view>
+#include <utility>
+
 #include "flare/base/logging.h"
 #include "flare/base/string.h"
 #include "flare/rpc/name_resolver/util/domain_name_resolver.h"
@@ -31,6 +34,41 @@ bool SplitAddr(std::string_view addr, std::string* hostname, uint16_t* port) {
   return false;
 }
 
+// Splits `addr` into address and attributes (if any).
+std::pair<std::string_view, std::string_view> SplitAttributes(
+    std::string_view addr) {
+  auto pos = addr.find('?');
+  if (pos == std::string_view::npos) {
+    return {addr, {}};
+  }
+  return {addr.substr(0, pos), addr.substr(pos + 1)};
+}
+
+bool ParseAttributes(std::string_view attrs, PeerInfo* peer) {
+  for (auto&& e : Split(attrs, '&')) {
+    auto pos = e.find('=');
+    if (pos == std::string_view::npos) {
+      return false;
+    }
+    auto key = e.substr(0, pos);
+    auto value = e.substr(pos + 1);
+    if (key == "weight") {
+      auto weight = TryParse<std::uint32_t>(value);
+      if (!weight) {
+        return false;
+      }
+      peer->weight = *weight;
+    } else if (key == "zone") {
+      peer->zone = std::string(value);
+    } else if (key == "tag") {
+      peer->tags.emplace_back(value);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 FLARE_RPC_REGISTER_NAME_RESOLVER("list", List);
@@ -39,7 +77,13 @@ List::List() { updater_ = GetUpdater(); }
 
 bool List::CheckValid(const std::string& name) {
   auto addrs = Split(name, ',');
-  for (auto&& e : addrs) {
+  for (auto&& addr : addrs) {
+    auto [e, attrs] = SplitAttributes(addr);
+    PeerInfo peer;
+    if (!ParseAttributes(attrs, &peer)) {
+      FLARE_LOG_ERROR("Attributes invalid {}", addr);
+      return false;
+    }
     std::string hostname;
     uint16_t port;
     if (!SplitAddr(e, &hostname, &port)) {
@@ -63,19 +107,39 @@ bool List::GetRouteTable(const std::string& name,
                          const std::string& old_signature,
                          std::vector<Endpoint>* new_address,
                          std::string* new_signature) {
+  std::vector<PeerInfo> peers;
+  if (!GetRouteTableWithAttributes(name, old_signature, &peers,
+                                   new_signature)) {
+    return false;
+  }
+  for (auto&& e : peers) {
+    new_address->push_back(std::move(e.address));
+  }
+  return true;
+}
+
+bool List::GetRouteTableWithAttributes(const std::string& name,
+                                       const std::string& old_signature,
+                                       std::vector<PeerInfo>* new_peers,
+                                       std::string* new_signature) {
   auto addrs = Split(name, ",");
-  for (auto&& e : addrs) {
+  for (auto&& addr : addrs) {
+    auto [e, attrs] = SplitAttributes(addr);
+    PeerInfo peer;
     std::string hostname;
     uint16_t port;
-    FLARE_CHECK(SplitAddr(e, &hostname, &port),
+    FLARE_CHECK(ParseAttributes(attrs, &peer) &&
+                    SplitAddr(e, &hostname, &port),
                 "Addr should already be checked");
     if (hostname.size() > 2 && e.find('[') != std::string_view::npos) {
       // hostname ex : [2001:db8::1]
-      new_address->push_back(
-          EndpointFromIpv6(hostname.substr(1, hostname.size() - 2), port));
+      peer.address =
+          EndpointFromIpv6(hostname.substr(1, hostname.size() - 2), port);
+      new_peers->push_back(std::move(peer));
     } else if (hostname.size() > 2 && isdigit(hostname[0]) &&
                isdigit(hostname.back())) {
-      new_address->push_back(EndpointFromIpv4(hostname, port));
+      peer.address = EndpointFromIpv4(hostname, port);
+      new_peers->push_back(std::move(peer));
     } else {
       std::vector<Endpoint> domain_address;
       if (!flare::name_resolver::util::ResolveDomain(hostname, port,
@@ -83,8 +147,11 @@ bool List::GetRouteTable(const std::string& name,
         return false;
       }
 
-      new_address->insert(new_address->end(), domain_address.begin(),
-                          domain_address.end());
+      // Attributes apply to all addresses the domain is resolved to.
+      for (auto&& ep : domain_address) {
+        peer.address = std::move(ep);
+        new_peers->push_back(peer);
+      }
     }
   }
   return true;
@@ -26,6 +26,9 @@ namespace flare::name_resolver {
 // name e.g.: 192.0.2.1:80,192.0.2.2:8080,[2001:db8::1]:8088,www.qq.com:443
 //
 // IP (v4 / v6) and domain.
+//
+// Attributes of peers can be specified after the address, e.g.:
+// 192.0.2.1:80?weight=200&zone=sh-1&tag=canary,192.0.2.2:80?zone=gz-2
 class List : public NameResolverImpl {
  public:
   List();
@@ -36,6 +39,10 @@ class List : public NameResolverImpl {
   bool GetRouteTable(const std::string& name, const std::string& old_signature,
                      std::vector<Endpoint>* new_address,
                      std::string* new_signature) override;
+  bool GetRouteTableWithAttributes(const std::string& name,
+                                   const std::string& old_signature,
+                                   std::vector<PeerInfo>* new_peers,
+                                   std::string* new_signature) override;
 };
 
 }  // namespace flare::name_resolver
@@ -52,4 +52,35 @@ TEST(ListNameResolver, StartResolving) {
   EXPECT_NE(it, peers.end());
 }
 
+TEST(ListNameResolver, Attributes) {
+  auto list_name_resolver_factory = name_resolver_registry.Get("list");
+
+  ASSERT_FALSE(list_name_resolver_factory->StartResolving(
+      "192.0.2.1:80?weight=abc"));
+  ASSERT_FALSE(list_name_resolver_factory->StartResolving(
+      "192.0.2.1:80?unknown=1"));
+
+  auto list_view = list_name_resolver_factory->StartResolving(
+      "192.0.2.2:80?zone=gz-2,192.0.2.1:80?weight=200&zone=sh-1&tag=canary&"
+      "tag=ssd");
+  ASSERT_TRUE(!!list_view);
+
+  std::vector<PeerInfo> peers;
+  list_view->GetPeersWithAttributes(&peers);
+  ASSERT_EQ(2, peers.size());
+  EXPECT_EQ("192.0.2.1:80", peers[0].address.ToString());
+  EXPECT_EQ(200, peers[0].weight);
+  EXPECT_EQ("sh-1", peers[0].zone);
+  EXPECT_EQ((std::vector<std::string>{"canary", "ssd"}), peers[0].tags);
+  EXPECT_EQ("192.0.2.2:80", peers[1].address.ToString());
+  EXPECT_EQ(PeerInfo::kDefaultWeight, peers[1].weight);
+  EXPECT_EQ("gz-2", peers[1].zone);
+  EXPECT_TRUE(peers[1].tags.empty());
+
+  std::vector<Endpoint> addresses;
+  list_view->GetPeers(&addresses);
+  ASSERT_EQ(2, addresses.size());
+  EXPECT_EQ("192.0.2.1:80", addresses[0].ToString());
+}
+
 }  // namespace flare::name_resolver
@@ -14,9 +14,35 @@
 
 #include "flare/rpc/name_resolver/name_resolver.h"
 
+#include <utility>
+
 namespace flare {
 
 FLARE_DEFINE_OBJECT_DEPENDENCY_REGISTRY(name_resolver_registry,
                                         flare::NameResolver);
 
+void NameResolutionView::GetPeersWithAttributes(std::vector<PeerInfo>* peers) {
+  std::vector<Endpoint> addresses;
+  GetPeers(&addresses);
+  peers->clear();
+  for (auto&& e : addresses) {
+    peers->emplace_back().address = std::move(e);
+  }
+}
+
+void NameResolutionView::GetPeersWithAttributes(std::vector<PeerInfo>* peers,
+                                                std::int64_t* version) {
+  *version = GetVersion();
+  GetPeersWithAttributes(peers);
+}
+
+bool NameResolutionView::GetPeerDelta(std::int64_t version, PeerDelta* delta,
+                                      std::int64_t* new_version) {
+  return false;
+}
+
+bool NameResolutionView::Watch(Function<void()> on_change) { return false; }
+
+void NameResolutionView::Unwatch() {}
+
 }
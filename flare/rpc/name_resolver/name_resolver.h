@@ -20,7 +20,9 @@
 #include <vector>
 
 #include "flare/base/dependency_registry.h"
+#include "flare/base/function.h"
 #include "flare/base/net/endpoint.h"
+#include "flare/rpc/name_resolver/peer_info.h"
 
 namespace flare {
 
@@ -61,6 +63,52 @@ class NameResolutionView {
   // However, since we also implemented our own "generic" cache, it's allowed
   // for the implementation not to implement cache behavior at all.
   virtual void GetPeers(std::vector<Endpoint>* addresses) = 0;
+
+  // Same as `GetPeers`, except that attributes (weight, zone, etc.) of peers
+  // are returned as well.
+  //
+  // The default implementation returns peers returned by `GetPeers` with
+  // default attributes. Implementations that know more about their peers
+  // should override this method.
+  virtual void GetPeersWithAttributes(std::vector<PeerInfo>* peers);
+
+  // Same as above, except that the version the peers correspond to is
+  // returned via `version` as well.
+  //
+  // Unlike calling `GetVersion` and `GetPeersWithAttributes` separately, the
+  // implementation should return the two atomically, so that changes after
+  // `version` (as returned by `GetPeerDelta`) are never already reflected in
+  // `peers`. The default implementation calls `GetVersion` before
+  // `GetPeersWithAttributes`, in which case such changes may be delivered
+  // again later.
+  virtual void GetPeersWithAttributes(std::vector<PeerInfo>* peers,
+                                      std::int64_t* version);
+
+  // Returns changes since `version` (a value previously returned by
+  // `GetVersion()`). The version the changes lead to is returned via
+  // `new_version`.
+  //
+  // Returns `false` if changes are not available (e.g., `version` is too old,
+  // or this method is not supported by the implementation at all.) In this
+  // case the caller should fall back to `GetPeersWithAttributes`.
+  virtual bool GetPeerDelta(std::int64_t version, PeerDelta* delta,
+                            std::int64_t* new_version);
+
+  // Registers a callback that is called (in an unspecified thread) each time
+  // the resolution result changes. This allows the caller to apply changes
+  // as soon as they come, instead of checking `GetVersion()` on its own.
+  //
+  // Returns `false` if not supported by the implementation. Otherwise it's
+  // guaranteed that the callback is not called after this object is
+  // destroyed.
+  virtual bool Watch(Function<void()> on_change);
+
+  // Unregisters the callback registered by `Watch`. If the callback is running
+  // concurrently, this method waits for it to return. The callback is never
+  // called once this method returns.
+  //
+  // The callback must not call this method itself.
+  virtual void Unwatch();
 };
 
 // `NameResolver` is responsible for resolving name to a list of
@@ -15,6 +15,12 @@
 #include "flare/rpc/name_resolver/name_resolver_impl.h"
 
 #include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "gflags/gflags.h"
 
@@ -27,6 +33,85 @@ using namespace std::literals;
 
 namespace flare::name_resolver {
 
+namespace {
+
+// Number of recent changes kept for `GetPeerDelta`.
+constexpr std::size_t kMaxDeltas = 16;
+
+std::vector<std::string> GetKeys(const std::vector<PeerInfo>& peers) {
+  std::vector<std::string> keys;
+  keys.reserve(peers.size());
+  for (auto&& e : peers) {
+    keys.push_back(e.address.ToString());
+  }
+  return keys;
+}
+
+// Both `from` and `to` must be sorted by string of endpoint.
+PeerDelta DiffPeers(const std::vector<PeerInfo>& from,
+                    const std::vector<PeerInfo>& to) {
+  auto from_keys = GetKeys(from), to_keys = GetKeys(to);
+  PeerDelta delta;
+  std::size_t i = 0, j = 0;
+  while (i != from.size() || j != to.size()) {
+    if (j == to.size() || (i != from.size() && from_keys[i] < to_keys[j])) {
+      delta.removed.push_back(from[i++].address);
+    } else if (i == from.size() || to_keys[j] < from_keys[i]) {
+      delta.added.push_back(to[j++]);
+    } else {
+      if (from[i] != to[j]) {
+        delta.updated.push_back(to[j]);
+      }
+      ++i, ++j;
+    }
+  }
+  return delta;
+}
+
+// Applies `delta` to `peers`, which is kept sorted by string of endpoint.
+void ApplyDelta(const PeerDelta& delta, std::vector<PeerInfo>* peers) {
+  std::unordered_set<std::string> removed;
+  for (auto&& e : delta.removed) {
+    removed.insert(e.ToString());
+  }
+  peers->erase(std::remove_if(peers->begin(), peers->end(),
+                              [&](auto&& e) {
+                                return removed.count(e.address.ToString());
+                              }),
+               peers->end());
+  for (auto&& list : {&delta.added, &delta.updated}) {
+    for (auto&& e : *list) {
+      auto key = e.address.ToString();
+      auto iter = std::lower_bound(
+          peers->begin(), peers->end(), key,
+          [](auto&& x, auto&& y) { return x.address.ToString() < y; });
+      if (iter != peers->end() && iter->address == e.address) {
+        *iter = e;
+      } else {
+        peers->insert(iter, e);
+      }
+    }
+  }
+}
+
+// Called with `route_mutex` held.
+void RecordDelta(NameResolverImpl::RouteInfo* route_info, PeerDelta delta) {
+  auto version = route_info->version.fetch_add(1, std::memory_order_relaxed);
+  route_info->deltas.emplace_back(version + 1, std::move(delta));
+  if (route_info->deltas.size() > kMaxDeltas) {
+    route_info->deltas.pop_front();
+  }
+}
+
+void NotifyWatchers(NameResolverImpl::RouteInfo* route_info) {
+  std::scoped_lock lk(route_info->watchers_mutex);
+  for (auto&& [_, cb] : route_info->watchers) {
+    cb();
+  }
+}
+
+}  // namespace
+
 NameResolverImpl::~NameResolverImpl() {
   if (updater_) {
     updater_->Stop();
@@ -75,12 +160,13 @@ std::unique_ptr<NameResolutionView> NameResolverImpl::StartResolving(
 
 void NameResolverImpl::UpdateRoute(const std::string& name,
                                    std::shared_ptr<RouteInfo> route_info) {
-  std::vector<Endpoint> new_address_table;
+  std::vector<PeerInfo> new_address_table;
   std::string old_signature, new_signature;
   if (name_signatures_.find(name) != name_signatures_.end()) {
     old_signature = name_signatures_[name];
   }
-  if (!GetRouteTable(name, old_signature, &new_address_table, &new_signature)) {
+  if (!GetRouteTableWithAttributes(name, old_signature, &new_address_table,
+                                   &new_signature)) {
     return;
   }
   if (!new_signature.empty()) {
@@ -93,13 +179,50 @@ void NameResolverImpl::UpdateRoute(const std::string& name,
   }
   std::sort(new_address_table.begin(), new_address_table.end(),
             [](auto&& left, auto&& right) {
-              return left.ToString() < right.ToString();
+              return left.address.ToString() < right.address.ToString();
             });
-  std::scoped_lock lk(route_info->route_mutex);
-  if (new_address_table != route_info->route_table) {
+  {
+    std::scoped_lock lk(route_info->route_mutex);
+    if (new_address_table == route_info->route_table) {
+      return;
+    }
+    auto delta = DiffPeers(route_info->route_table, new_address_table);
     route_info->route_table = std::move(new_address_table);
-    route_info->version.fetch_add(1, std::memory_order_relaxed);
+    RecordDelta(route_info.get(), std::move(delta));
   }
+  NotifyWatchers(route_info.get());
+}
+
+void NameResolverImpl::ApplyRouteDelta(const std::string& name,
+                                       const PeerDelta& delta) {
+  std::shared_ptr<RouteInfo> route_info;
+  {
+    std::shared_lock lk(name_mutex_);
+    if (auto iter = name_route_.find(name); iter != name_route_.end()) {
+      route_info = iter->second;
+    } else {
+      return;
+    }
+  }
+  {
+    std::scoped_lock lk(route_info->route_mutex);
+    ApplyDelta(delta, &route_info->route_table);
+    RecordDelta(route_info.get(), delta);
+  }
+  NotifyWatchers(route_info.get());
+}
+
+bool NameResolverImpl::GetRouteTableWithAttributes(
+    const std::string& name, const std::string& old_signature,
+    std::vector<PeerInfo>* new_peers, std::string* new_signature) {
+  std::vector<Endpoint> new_address;
+  if (!GetRouteTable(name, old_signature, &new_address, new_signature)) {
+    return false;
+  }
+  for (auto&& e : new_address) {
+    new_peers->emplace_back().address = std::move(e);
+  }
+  return true;
 }
 
 NameResolverUpdater* NameResolverImpl::GetUpdater() {
@@ -112,7 +235,7 @@ NameResolutionViewImpl::NameResolutionViewImpl(
     std::shared_ptr<NameResolverImpl::RouteInfo> route)
     : route_(std::move(route)) {}
 
-NameResolutionViewImpl::~NameResolutionViewImpl() {}
+NameResolutionViewImpl::~NameResolutionViewImpl() { Unwatch(); }
 
 std::int64_t NameResolutionViewImpl::GetVersion() {
   return route_->version.load(std::memory_order_relaxed);
@@ -120,7 +243,95 @@ std::int64_t NameResolutionViewImpl::GetVersion() {
 
 void NameResolutionViewImpl::GetPeers(std::vector<Endpoint>* addresses) {
   std::scoped_lock lk(route_->route_mutex);
-  addresses->assign(route_->route_table.begin(), route_->route_table.end());
+  addresses->clear();
+  for (auto&& e : route_->route_table) {
+    addresses->push_back(e.address);
+  }
+}
+
+void NameResolutionViewImpl::GetPeersWithAttributes(
+    std::vector<PeerInfo>* peers) {
+  std::scoped_lock lk(route_->route_mutex);
+  peers->assign(route_->route_table.begin(), route_->route_table.end());
+}
+
+void NameResolutionViewImpl::GetPeersWithAttributes(
+    std::vector<PeerInfo>* peers, std::int64_t* version) {
+  // `version` is only bumped with `route_mutex` held, so the two are
+  // consistent with each other.
+  std::scoped_lock lk(route_->route_mutex);
+  peers->assign(route_->route_table.begin(), route_->route_table.end());
+  *version = route_->version.load(std::memory_order_relaxed);
+}
+
+bool NameResolutionViewImpl::GetPeerDelta(std::int64_t version,
+                                          PeerDelta* delta,
+                                          std::int64_t* new_version) {
+  std::scoped_lock lk(route_->route_mutex);
+  auto&& deltas = route_->deltas;
+  auto current = route_->version.load(std::memory_order_relaxed);
+  *delta = {};
+  *new_version = current;
+  if (version == current) {
+    return true;
+  }
+  if (version < 0 || version > current || deltas.empty() ||
+      deltas.front().first > version + 1) {
+    return false;  // Not known to us.
+  }
+
+  // Merge changes made since `version`, peer by peer.
+  struct Change {
+    bool existed;  // Whether the peer existed in `version`.
+    Endpoint address;
+    std::optional<PeerInfo> now;
+  };
+  std::map<std::string, Change> changes;
+  for (auto&& [v, d] : deltas) {
+    if (v <= version) {
+      continue;
+    }
+    for (auto&& e : d.added) {
+      auto [iter, inserted] = changes.try_emplace(e.address.ToString(),
+                                                  Change{false, e.address});
+      iter->second.now = e;
+    }
+    for (auto&& e : d.updated) {
+      auto [iter, inserted] =
+          changes.try_emplace(e.address.ToString(), Change{true, e.address});
+      iter->second.now = e;
+    }
+    for (auto&& e : d.removed) {
+      auto [iter, inserted] =
+          changes.try_emplace(e.ToString(), Change{true, e});
+      iter->second.now = std::nullopt;
+    }
+  }
+  for (auto&& [_, change] : changes) {
+    if (!change.now) {
+      if (change.existed) {
+        delta->removed.push_back(change.address);
+      }
+    } else if (change.existed) {
+      delta->updated.push_back(*change.now);
+    } else {
+      delta->added.push_back(*change.now);
+    }
+  }
+  return true;
+}
+
+bool NameResolutionViewImpl::Watch(Function<void()> on_change) {
+  std::scoped_lock lk(route_->watchers_mutex);
+  route_->watchers[this] = std::move(on_change);
+  return true;
+}
+
+void NameResolutionViewImpl::Unwatch() {
+  // `NotifyWatchers` holds this lock while calling the callbacks, so once we
+  // grabbed it, no callback of us is running.
+  std::scoped_lock lk(route_->watchers_mutex);
+  route_->watchers.erase(this);
 }
 
 }  // namespace flare::name_resolver
@@ -16,8 +16,10 @@
 #define FLARE_RPC_NAME_RESOLVER_NAME_RESOLVER_IMPL_H_
 
 #include <atomic>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string>
@@ -25,9 +27,11 @@
 #include <utility>
 #include <vector>
 
+#include "flare/base/function.h"
 #include "flare/base/net/endpoint.h"
 #include "flare/rpc/name_resolver/name_resolver.h"
 #include "flare/rpc/name_resolver/name_resolver_updater.h"
+#include "flare/rpc/name_resolver/peer_info.h"
 
 namespace flare::name_resolver {
 
@@ -38,9 +42,16 @@ class NameResolverImpl : public NameResolver {
   struct RouteInfo {
     RouteInfo() = default;
     // Sorted by string of endpoint.
-    std::vector<Endpoint> route_table;
+    std::vector<PeerInfo> route_table;
     std::atomic<int64_t> version = 0;
     std::shared_mutex route_mutex;
+    // Recent changes to `route_table`, along with the version each of them
+    // leads to. Oldest first. Protected by `route_mutex`.
+    std::deque<std::pair<std::int64_t, PeerDelta>> deltas;
+
+    std::mutex watchers_mutex;
+    // Keyed by the view watching changes.
+    std::unordered_map<const void*, Function<void()>> watchers;
   };
   virtual ~NameResolverImpl();
   std::unique_ptr<NameResolutionView> StartResolving(
@@ -57,6 +68,10 @@ class NameResolverImpl : public NameResolver {
   // UpdateRouteTable
   void UpdateRoute(const std::string& name,
                    std::shared_ptr<RouteInfo> route_info_ptr);
+  // Sub-class whose backend pushes changes (instead of being polled) can
+  // apply the changes by calling this method. Does nothing if `name` is not
+  // being resolved.
+  void ApplyRouteDelta(const std::string& name, const PeerDelta& delta);
   // Sub-class can do custom pre-check if needed.
   virtual bool CheckValid(const std::string& name) { return true; }
   // Signature is the optional field that may be used by child class.
@@ -68,6 +83,14 @@ class NameResolverImpl : public NameResolver {
                              const std::string& old_signature,
                              std::vector<Endpoint>* new_address,
                              std::string* new_signature) = 0;
+  // Same as `GetRouteTable`, except that attributes of peers (weight, zone,
+  // etc.) are returned as well. Sub-classes that know about attributes should
+  // override this method as well. By default peers returned by
+  // `GetRouteTable` are used, with default attributes.
+  virtual bool GetRouteTableWithAttributes(const std::string& name,
+                                           const std::string& old_signature,
+                                           std::vector<PeerInfo>* new_peers,
+                                           std::string* new_signature);
 
  protected:
   std::shared_mutex name_mutex_;
@@ -84,6 +107,13 @@ class NameResolutionViewImpl : public NameResolutionView {
   virtual ~NameResolutionViewImpl();
   std::int64_t GetVersion() override;
   void GetPeers(std::vector<Endpoint>* addresses) override;
+  void GetPeersWithAttributes(std::vector<PeerInfo>* peers) override;
+  void GetPeersWithAttributes(std::vector<PeerInfo>* peers,
+                              std::int64_t* version) override;
+  bool GetPeerDelta(std::int64_t version, PeerDelta* delta,
+                    std::int64_t* new_version) override;
+  bool Watch(Function<void()> on_change) override;
+  void Unwatch() override;
 
  private:
   std::shared_ptr<NameResolverImpl::RouteInfo> route_;
@@ -29,6 +29,9 @@ class MockNs : public NameResolverImpl {
     std::scoped_lock _(lock_);
     address_ = std::move(new_addr);
   }
+  void PushDelta(const std::string& name, const PeerDelta& delta) {
+    ApplyRouteDelta(name, delta);
+  }
 
  private:
   bool GetRouteTable(const std::string& name, const std::string& old_signature,
@@ -90,4 +93,63 @@ TEST(NsImplTest, TestAll) {
   EXPECT_EQ("192.0.2.3:12345", resolved_address[0].ToString());
 }
 
+TEST(NsImplTest, PeerDelta) {
+  MockNs mock_ns;
+  mock_ns.SetNewAddress({EndpointFromIpv4("192.0.2.1", 80),
+                         EndpointFromIpv4("192.0.2.2", 80)});
+  auto view = mock_ns.StartResolving("delta");
+  ASSERT_TRUE(!!view);
+  ASSERT_EQ(1, view->GetVersion());
+  int changes = 0;
+  ASSERT_TRUE(view->Watch([&] { ++changes; }));
+
+  PeerDelta delta;
+  std::int64_t version;
+  ASSERT_TRUE(view->GetPeerDelta(1, &delta, &version));
+  EXPECT_EQ(1, version);
+  EXPECT_TRUE(delta.added.empty() && delta.removed.empty());
+
+  // Pushed by the resolver.
+  PeerDelta pushed;
+  pushed.added.emplace_back().address = EndpointFromIpv4("192.0.2.3", 80);
+  pushed.removed.push_back(EndpointFromIpv4("192.0.2.1", 80));
+  mock_ns.PushDelta("delta", pushed);
+  EXPECT_EQ(1, changes);
+  EXPECT_EQ(2, view->GetVersion());
+
+  pushed = {};
+  pushed.updated.emplace_back().address = EndpointFromIpv4("192.0.2.2", 80);
+  pushed.updated.back().weight = 10;
+  pushed.removed.push_back(EndpointFromIpv4("192.0.2.3", 80));
+  mock_ns.PushDelta("delta", pushed);
+  EXPECT_EQ(2, changes);
+  EXPECT_EQ(3, view->GetVersion());
+
+  std::vector<PeerInfo> peers;
+  view->GetPeersWithAttributes(&peers);
+  ASSERT_EQ(1, peers.size());
+  EXPECT_EQ("192.0.2.2:80", peers[0].address.ToString());
+  EXPECT_EQ(10, peers[0].weight);
+
+  // Changes since version 1 are merged. 192.0.2.3 is added and removed
+  // afterwards, so it's not there at all.
+  ASSERT_TRUE(view->GetPeerDelta(1, &delta, &version));
+  EXPECT_EQ(3, version);
+  EXPECT_TRUE(delta.added.empty());
+  ASSERT_EQ(1, delta.removed.size());
+  EXPECT_EQ("192.0.2.1:80", delta.removed[0].ToString());
+  ASSERT_EQ(1, delta.updated.size());
+  EXPECT_EQ("192.0.2.2:80", delta.updated[0].address.ToString());
+
+  // Too old a version.
+  for (int i = 0; i != 100; ++i) {
+    mock_ns.PushDelta("delta", pushed);
+  }
+  EXPECT_FALSE(view->GetPeerDelta(1, &delta, &version));
+
+  view = nullptr;
+  mock_ns.PushDelta("delta", pushed);
+  EXPECT_EQ(102, changes);  // Not called once the view is destroyed.
+}
+
 }  // namespace flare::name_resolver
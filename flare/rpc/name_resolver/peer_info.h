@@ -0,0 +1,68 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_NAME_RESOLVER_PEER_INFO_H_
+#define FLARE_RPC_NAME_RESOLVER_PEER_INFO_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "flare/base/net/endpoint.h"
+
+namespace flare {
+
+// A peer resolved by `NameResolver`, along with its attributes.
+//
+// Name resolvers that know nothing about these attributes leave them as
+// default.
+struct PeerInfo {
+  // Peers with no weight specified are given this weight.
+  static constexpr std::uint32_t kDefaultWeight = 100;
+
+  Endpoint address;
+
+  // Relative capacity of this peer. Peers of weight 0 receive no traffic
+  // (unless all peers are of weight 0) from load balancers respecting weight.
+  std::uint32_t weight = kDefaultWeight;
+
+  // Zone (availability zone, IDC, etc.) this peer is in. Empty if not known.
+  std::string zone;
+
+  // Arbitrary tags (e.g., `canary`) attached to this peer.
+  std::vector<std::string> tags;
+};
+
+inline bool operator==(const PeerInfo& left, const PeerInfo& right) {
+  return left.address == right.address && left.weight == right.weight &&
+         left.zone == right.zone && left.tags == right.tags;
+}
+
+inline bool operator!=(const PeerInfo& left, const PeerInfo& right) {
+  return !(left == right);
+}
+
+// Changes in resolution result between two versions.
+struct PeerDelta {
+  std::vector<PeerInfo> added;
+  std::vector<Endpoint> removed;
+
+  // Peers whose attributes (but not address) have changed.
+  std::vector<PeerInfo> updated;
+};
+
+}  // namespace flare
+
+#endif  // FLARE_RPC_NAME_RESOLVER_PEER_INFO_H_
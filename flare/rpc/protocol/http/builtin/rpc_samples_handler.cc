@@ -0,0 +1,96 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/http/builtin/rpc_samples_handler.h"
+
+#include <limits>
+#include <string>
+
+#include "jsoncpp/json.h"
+
+#include "flare/net/http/query_string.h"
+#include "flare/rpc/internal/rpc_samples.h"
+
+FLARE_RPC_SERVER_REGISTER_BUILTIN_HTTP_HANDLER(
+    flare::rpc::builtin::RpcSamplesHandler, "/inspect/rpc_samples");
+
+using namespace std::literals;
+
+namespace flare::rpc::builtin {
+
+namespace {
+
+bool IsMethodMatched(const google::protobuf::MethodDescriptor* method,
+                     std::string_view expected) {
+  return method->full_name() == expected ||
+         method->service()->full_name() == expected;
+}
+
+Json::Value ToJson(const detail::RpcSample& sample) {
+  Json::Value jsv;
+  jsv["timestamp_ms"] = static_cast<Json::UInt64>(
+      sample.timestamp.time_since_epoch() / 1ms);
+  jsv["method"] = sample.method->full_name();
+  jsv["remote_peer"] = sample.remote_peer;
+  jsv["status"] = sample.status;
+  jsv["request_size"] = static_cast<Json::UInt64>(sample.request_size);
+  jsv["response_size"] = static_cast<Json::UInt64>(sample.response_size);
+
+  auto&& latency = jsv["latency_us"];
+  latency["queueing"] = static_cast<Json::UInt64>(sample.queueing / 1us);
+  latency["parsing"] = static_cast<Json::UInt64>(sample.parsing / 1us);
+  latency["processing"] = static_cast<Json::UInt64>(sample.processing / 1us);
+  latency["total"] = static_cast<Json::UInt64>(sample.total / 1us);
+  return jsv;
+}
+
+}  // namespace
+
+void RpcSamplesHandler::OnGet(const HttpRequest& request,
+                              HttpResponse* response,
+                              HttpServerContext* context) {
+  auto qs = TryParseQueryStringFromUri(request.uri());
+  if (!qs) {
+    GenerateDefaultResponsePage(HttpStatus::BadRequest, response);
+    return;
+  }
+  auto method = qs->TryGet("method");
+  auto min_latency = qs->TryGet<std::uint64_t>("min_latency_us");
+  auto limit = qs->TryGet<std::size_t>("limit");
+  if ((qs->TryGet("min_latency_us") && !min_latency) ||
+      (qs->TryGet("limit") && !limit)) {
+    GenerateDefaultResponsePage(HttpStatus::BadRequest, response);
+    return;
+  }
+
+  Json::Value jsv(Json::arrayValue);
+  for (auto&& e : detail::RpcSamples::Instance()->GetSamples()) {
+    if (jsv.size() >= limit.value_or(std::numeric_limits<std::size_t>::max())) {
+      break;
+    }
+    if (method && !IsMethodMatched(e.method, *method)) {
+      continue;
+    }
+    if (min_latency && e.total < *min_latency * 1us) {
+      continue;
+    }
+    jsv.append(ToJson(e));
+  }
+
+  response->set_status(HttpStatus::OK);
+  response->headers()->Append("Content-Type", "application/json");
+  response->set_body(Json::StyledWriter().write(jsv));
+}
+
+}  // namespace flare::rpc::builtin
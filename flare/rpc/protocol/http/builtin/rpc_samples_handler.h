@@ -0,0 +1,50 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_PROTOCOL_HTTP_BUILTIN_RPC_SAMPLES_HANDLER_H_
+#define FLARE_RPC_PROTOCOL_HTTP_BUILTIN_RPC_SAMPLES_HANDLER_H_
+
+#include "flare/rpc/http_handler.h"
+
+namespace flare {
+
+class Server;
+
+}  // namespace flare
+
+namespace flare::rpc::builtin {
+
+// Handler of `/inspect/rpc_samples`. Automatically registered by `Server`.
+//
+// Returns recently sampled RPCs (@sa: `flare_rpc_samples_interval`), most
+// recent first. The following query parameters are recognized:
+//
+// - `method`: Only calls to this method (or methods of this service, if a
+//   service name is given) are returned.
+// - `min_latency_us`: Only calls took at least so long are returned.
+// - `limit`: Return at most so many samples.
+//
+// As with `/inspect/rpc_stats`, samples of all servers in this process are
+// returned.
+class RpcSamplesHandler : public HttpHandler {
+ public:
+  explicit RpcSamplesHandler(Server* owner = nullptr) {}
+
+  void OnGet(const HttpRequest& request, HttpResponse* response,
+             HttpServerContext* context) override;
+};
+
+}  // namespace flare::rpc::builtin
+
+#endif  // FLARE_RPC_PROTOCOL_HTTP_BUILTIN_RPC_SAMPLES_HANDLER_H_
@@ -0,0 +1,124 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/http/builtin/rpc_samples_handler.h"
+
+#include <chrono>
+#include <thread>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "jsoncpp/json.h"
+
+#include "flare/init/override_flag.h"
+#include "flare/net/http/http_client.h"
+#include "flare/rpc/rpc_channel.h"
+#include "flare/rpc/rpc_client_controller.h"
+#include "flare/rpc/rpc_server_controller.h"
+#include "flare/rpc/server.h"
+#include "flare/testing/echo_service.flare.pb.h"
+#include "flare/testing/endpoint.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+DECLARE_int32(flare_rpc_samples_interval);
+
+FLARE_OVERRIDE_FLAG(flare_rpc_samples_interval, 1);
+
+namespace flare::rpc::builtin {
+
+namespace {
+
+class Impl : public testing::SyncEchoService {
+ public:
+  void Echo(const testing::EchoRequest& request,
+            testing::EchoResponse* response,
+            RpcServerController* controller) override {
+    if (request.body() == "slow") {
+      std::this_thread::sleep_for(50ms);
+    }
+    response->set_body(request.body());
+  }
+};
+
+}  // namespace
+
+TEST(RpcSamplesHandler, All) {
+  auto ep = testing::PickAvailableEndpoint();
+  Impl svc_impl;
+  Server server;
+  server.AddProtocols({"flare", "http"});
+  server.AddService(MaybeOwning(non_owning, &svc_impl));
+  server.ListenOn(ep);
+  server.Start();
+
+  RpcChannel channel;
+  CHECK(channel.Open("flare://" + ep.ToString(),
+                     RpcChannel::Options{.override_nslb = "list+rr"}));
+  testing::EchoService_SyncStub stub(&channel);
+  for (auto&& body : {"fast", "slow", "fast"}) {
+    RpcClientController ctlr;
+    testing::EchoRequest req;
+    req.set_body(body);
+    ASSERT_EQ(body, stub.Echo(req, &ctlr)->body());
+    std::this_thread::sleep_for(20ms);  // Wait for the next sampling quota.
+  }
+
+  HttpClient client;
+  auto get = [&](const std::string& query) {
+    auto resp = client.Get("http://" + ep.ToString() + "/inspect/rpc_samples" +
+                           query);
+    EXPECT_TRUE(resp);
+    EXPECT_EQ(HttpStatus::OK, resp->status());
+    Json::Value jsv;
+    EXPECT_TRUE(Json::Reader().parse(*resp->body(), jsv));
+    return jsv;
+  };
+
+  auto jsv = get("");
+  ASSERT_EQ(3, jsv.size());
+  for (auto&& e : jsv) {
+    EXPECT_EQ("flare.testing.EchoService.Echo", e["method"].asString());
+    EXPECT_EQ(0, e["status"].asInt());
+    EXPECT_GT(e["request_size"].asUInt64(), 0);
+    EXPECT_GT(e["response_size"].asUInt64(), 0);
+    EXPECT_FALSE(e["remote_peer"].asString().empty());
+    EXPECT_GE(e["latency_us"]["total"].asUInt64(),
+              e["latency_us"]["processing"].asUInt64());
+  }
+  // Most recent first.
+  EXPECT_GE(jsv[0]["timestamp_ms"].asUInt64(),
+            jsv[2]["timestamp_ms"].asUInt64());
+
+  EXPECT_EQ(3, get("?method=flare.testing.EchoService.Echo").size());
+  EXPECT_EQ(3, get("?method=flare.testing.EchoService").size());
+  EXPECT_EQ(0, get("?method=flare.testing.EchoService.Echo2").size());
+  EXPECT_EQ(1, get("?limit=1").size());
+
+  jsv = get("?min_latency_us=50000");
+  ASSERT_EQ(1, jsv.size());
+  EXPECT_GE(jsv[0]["latency_us"]["processing"].asUInt64(), 50000);
+
+  auto resp = client.Get("http://" + ep.ToString() +
+                         "/inspect/rpc_samples?min_latency_us=abc");
+  EXPECT_EQ(HttpStatus::BadRequest, resp->status());
+
+  server.Stop();
+  server.Join();
+}
+
+}  // namespace flare::rpc::builtin
+
+FLARE_TEST_MAIN
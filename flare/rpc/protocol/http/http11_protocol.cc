@@ -52,8 +52,10 @@ struct OnWireMessage : public Message {
 
 // HACK here. We'll use a more generic way to exclude several HTTP request
 // being handled by others.
-const std::string_view kClobberedStartLines[] = {"POST /rpc/"sv,
-                                                 "POST /__rpc_service__"sv};
+const std::string_view kClobberedStartLines[] = {
+    "POST /rpc/"sv, "POST /__rpc_service__"sv,
+    // HTTP/2 connection preface, handled by `Http2Protocol`.
+    "PRI * HTTP/2.0"sv};
 
 bool IsMessageClobbered(std::string_view view) {
   for (auto&& e : kClobberedStartLines) {
@@ -0,0 +1,223 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/http/http2_protocol.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "flare/base/string.h"
+#include "flare/rpc/protocol/http/message.h"
+
+using namespace std::literals;
+
+namespace flare::http {
+
+FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG("http2", Http2Protocol,
+                                                   true);
+FLARE_RPC_REGISTER_CLIENT_SIDE_STREAM_PROTOCOL_ARG("http2", Http2Protocol,
+                                                   false);
+
+namespace {
+
+struct OnWireMessage : public Message {
+  OnWireMessage() { SetRuntimeTypeTo<OnWireMessage>(); }
+  std::uint64_t GetCorrelationId() const noexcept override {
+    return message.correlation_id;
+  }
+  Type GetType() const noexcept override { return Type::Single; }
+
+  Http2Session::Message message;
+};
+
+// Same hack as `Http11Protocol`: These requests are handled by
+// `ProtoOverHttpProtocol` (its HTTP/2 variant).
+const std::string_view kClobberedPaths[] = {"/rpc/"sv, "/__rpc_service__"sv};
+
+bool IsRequestClobbered(const Http2Session::PseudoHeaders& pseudo_headers) {
+  if (pseudo_headers.method != "POST") {
+    return false;
+  }
+  for (auto&& e : kClobberedPaths) {
+    if (StartsWith(pseudo_headers.path, e)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Requests the server failed to handle (e.g., due to overload) are answered
+// with 503, otherwise the stream would be left open until the client gives up.
+class OverloadedResponseFactory : public MessageFactory {
+ public:
+  std::unique_ptr<Message> Create(Type type, std::uint64_t correlation_id,
+                                  bool stream) const override {
+    if (type != Type::Overloaded) {
+      return nullptr;
+    }
+    auto msg = std::make_unique<HttpResponseMessage>();
+    msg->set_correlation_id(correlation_id);
+    msg->response()->set_status(HttpStatus::ServiceUnavailable);
+    return msg;
+  }
+};
+
+const OverloadedResponseFactory overloaded_response_factory;
+
+NoncontiguousBuffer GetBody(HttpBaseMessage* message) {
+  if (auto nb = message->noncontiguous_body()) {
+    return *nb;
+  }
+  return CreateBufferSlow(*message->body());
+}
+
+}  // namespace
+
+const StreamProtocol::Characteristics& Http2Protocol::GetCharacteristics()
+    const {
+  static const Characteristics cs = {.name = "HTTP/2",
+                                     .stateful_writes = true};
+  return cs;
+}
+
+const MessageFactory* Http2Protocol::GetMessageFactory() const {
+  if (server_side_) {
+    return &overloaded_response_factory;
+  }
+  return MessageFactory::null_factory;
+}
+
+const ControllerFactory* Http2Protocol::GetControllerFactory() const {
+  return ControllerFactory::null_factory;
+}
+
+StreamProtocol::MessageCutStatus Http2Protocol::TryCutMessage(
+    NoncontiguousBuffer* buffer, std::unique_ptr<Message>* message) {
+  if (server_side_ && FLARE_UNLIKELY(!identified_)) {
+    // Nothing is consumed until we're sure the connection is ours.
+    Http2Session::PseudoHeaders pseudo_headers;
+    HttpHeaders headers;
+    auto status =
+        Http2Session::PeekFirstRequest(*buffer, &pseudo_headers, &headers);
+    if (status == Http2Session::PeekStatus::NeedMore) {
+      return MessageCutStatus::NotIdentified;
+    } else if (status == Http2Session::PeekStatus::Mismatch) {
+      return MessageCutStatus::ProtocolMismatch;
+    } else if (status == Http2Session::PeekStatus::Error) {
+      return MessageCutStatus::Error;
+    }
+    if (IsRequestClobbered(pseudo_headers)) {
+      return MessageCutStatus::ProtocolMismatch;
+    }
+    identified_ = true;
+  }
+
+  Http2Session::Message msg;
+  auto rc = session_.TryCutMessage(buffer, &msg);
+  if (rc == Http2Session::CutStatus::NeedMore) {
+    return MessageCutStatus::NeedMore;
+  } else if (rc == Http2Session::CutStatus::Error) {
+    return MessageCutStatus::Error;
+  }
+  auto on_wire = std::make_unique<OnWireMessage>();
+  on_wire->message = std::move(msg);
+  *message = std::move(on_wire);
+  return MessageCutStatus::Cut;
+}
+
+bool Http2Protocol::TryParse(std::unique_ptr<Message>* message,
+                             Controller* controller) {
+  auto&& msg = cast<OnWireMessage>(**message)->message;
+  auto&& pseudo_headers = msg.pseudo_headers;
+
+  if (server_side_) {
+    auto method = flare::TryParse<HttpMethod>(pseudo_headers.method);
+    if (!method) {
+      FLARE_LOG_WARNING_EVERY_SECOND("Unrecognized HTTP method [{}].",
+                                     pseudo_headers.method);
+      return false;
+    }
+    auto parsed = std::make_unique<HttpRequestMessage>();
+    parsed->set_correlation_id(msg.correlation_id);
+    parsed->request()->set_version(HttpVersion::V_2);
+    parsed->request()->set_method(*method);
+    parsed->request()->set_uri(std::move(pseudo_headers.path));
+    *parsed->headers() = std::move(msg.headers);
+    // Handlers written for HTTP/1.1 may rely on it.
+    if (!pseudo_headers.authority.empty() &&
+        !parsed->headers()->TryGet("Host")) {
+      parsed->headers()->Append("Host", std::move(pseudo_headers.authority));
+    }
+    parsed->request()->set_body(std::move(msg.body));
+    *message = std::move(parsed);
+    return true;
+  } else {
+    if (msg.reset) {
+      FLARE_LOG_WARNING_EVERY_SECOND(
+          "HTTP/2 stream was reset by the server with error {}.",
+          msg.reset_error_code);
+      return false;
+    }
+    auto parsed = std::make_unique<HttpResponseMessage>();
+    parsed->set_correlation_id(msg.correlation_id);
+    parsed->response()->set_version(HttpVersion::V_2);
+    parsed->response()->set_status(
+        static_cast<HttpStatus>(pseudo_headers.status));
+    *parsed->headers() = std::move(msg.headers);
+    parsed->response()->set_body(std::move(msg.body));
+    *message = std::move(parsed);
+    return true;
+  }
+}
+
+void Http2Protocol::WriteMessage(const Message& message,
+                                 NoncontiguousBuffer* buffer,
+                                 Controller* controller) {
+  Http2Session::PseudoHeaders pseudo_headers;
+  // `HttpBaseMessage`'s accessors are non-const (for stringifying body
+  // lazily).
+  auto&& msg = const_cast<HttpBaseMessage&>(*cast<HttpBaseMessage>(message));
+
+  if (auto p = dyn_cast<HttpRequestMessage>(msg)) {
+    FLARE_CHECK(!server_side_);
+    pseudo_headers.method = std::string(ToStringView(p->request()->method()));
+    pseudo_headers.scheme = "http";
+    pseudo_headers.authority =
+        std::string(p->headers()->TryGet("Host").value_or(""));
+    pseudo_headers.path = p->request()->uri().empty() ? "/"s
+                                                       : p->request()->uri();
+  } else if (auto p = dyn_cast<HttpResponseMessage>(msg)) {
+    FLARE_CHECK(server_side_);
+    pseudo_headers.status = underlying_value(p->response()->status());
+  } else {
+    FLARE_CHECK(0, "Unexpected message type [{}].", GetTypeName(message));
+  }
+  (void)session_.WriteMessage(message.GetCorrelationId(), pseudo_headers,
+                              *msg.headers(), GetBody(&msg), buffer);
+}
+
+bool Http2Protocol::TryGetPendingBytes(NoncontiguousBuffer* buffer) {
+  return session_.TryGetPendingBytes(buffer);
+}
+
+void Http2Protocol::OnCallAbandoned(std::uint64_t correlation_id) {
+  session_.ResetStream(correlation_id);
+}
+
+bool Http2Protocol::AcceptsNewCalls() {
+  return session_.AcceptsNewStreams();
+}
+
+}  // namespace flare::http
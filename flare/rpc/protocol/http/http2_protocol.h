@@ -0,0 +1,56 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_PROTOCOL_HTTP_HTTP2_PROTOCOL_H_
+#define FLARE_RPC_PROTOCOL_HTTP_HTTP2_PROTOCOL_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "flare/rpc/protocol/http/http2_session.h"
+#include "flare/rpc/protocol/stream_protocol.h"
+
+namespace flare::http {
+
+// HTTP/2 over cleartext TCP, with prior knowledge (`h2c`).
+//
+// Requests are multiplexed on the connection, each of them is handled by
+// `HttpHandler`s in the same way as HTTP/1.1 requests.
+class Http2Protocol : public flare::StreamProtocol {
+ public:
+  explicit Http2Protocol(bool server_side)
+      : server_side_(server_side), session_(server_side) {}
+
+  const Characteristics& GetCharacteristics() const override;
+  const MessageFactory* GetMessageFactory() const override;
+  const ControllerFactory* GetControllerFactory() const override;
+  MessageCutStatus TryCutMessage(NoncontiguousBuffer* buffer,
+                                 std::unique_ptr<Message>* message) override;
+  bool TryParse(std::unique_ptr<Message>* message,
+                Controller* controller) override;
+  void WriteMessage(const Message& message, NoncontiguousBuffer* buffer,
+                    Controller* controller) override;
+  bool TryGetPendingBytes(NoncontiguousBuffer* buffer) override;
+  void OnCallAbandoned(std::uint64_t correlation_id) override;
+  bool AcceptsNewCalls() override;
+
+ private:
+  bool server_side_;
+  bool identified_ = false;  // Server side only.
+  Http2Session session_;
+};
+
+}  // namespace flare::http
+
+#endif  // FLARE_RPC_PROTOCOL_HTTP_HTTP2_PROTOCOL_H_
@@ -0,0 +1,318 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/http/http2_protocol.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+#include "flare/base/string.h"
+#include "flare/rpc/protocol/http/message.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+DECLARE_int32(flare_http2_max_concurrent_streams);
+
+namespace flare::http {
+
+// Simulates one side of a connection. Bytes written by the peer are appended
+// to `received`.
+struct Endpoint {
+  explicit Endpoint(bool server_side) : protocol(server_side) {}
+
+  Http2Protocol protocol;
+  NoncontiguousBuffer received;
+};
+
+// Flush whatever `from` has to say to `to`.
+void FlushPending(Endpoint* from, Endpoint* to) {
+  NoncontiguousBuffer nb;
+  if (from->protocol.TryGetPendingBytes(&nb)) {
+    to->received.Append(std::move(nb));
+  }
+}
+
+void Write(Endpoint* from, Endpoint* to, const Message& msg) {
+  NoncontiguousBuffer nb;
+  from->protocol.WriteMessage(msg, &nb, nullptr);
+  to->received.Append(std::move(nb));
+}
+
+// Cut and parse all messages available, acknowledgements are flushed to
+// `peer`.
+std::vector<std::unique_ptr<Message>> ReadAll(Endpoint* self, Endpoint* peer) {
+  std::vector<std::unique_ptr<Message>> result;
+  while (true) {
+    std::unique_ptr<Message> msg;
+    auto rc = self->protocol.TryCutMessage(&self->received, &msg);
+    if (rc != StreamProtocol::MessageCutStatus::Cut) {
+      EXPECT_TRUE(rc == StreamProtocol::MessageCutStatus::NeedMore ||
+                  rc == StreamProtocol::MessageCutStatus::NotIdentified);
+      break;
+    }
+    EXPECT_TRUE(self->protocol.TryParse(&msg, nullptr));
+    result.push_back(std::move(msg));
+  }
+  FlushPending(self, peer);
+  return result;
+}
+
+HttpRequestMessage MakeRequest(std::uint64_t correlation_id,
+                               const std::string& uri, std::string body) {
+  HttpRequestMessage msg;
+  msg.set_correlation_id(correlation_id);
+  msg.request()->set_method(HttpMethod::Post);
+  msg.request()->set_uri(uri);
+  msg.headers()->Append("Host", "192.0.2.1");
+  msg.request()->set_body(std::move(body));
+  return msg;
+}
+
+HttpResponseMessage MakeResponse(const HttpRequestMessage& request,
+                                 std::string body) {
+  HttpResponseMessage msg;
+  msg.set_correlation_id(request.GetCorrelationId());
+  msg.response()->set_status(HttpStatus::OK);
+  msg.headers()->Append("Content-Type", "text/plain");
+  msg.response()->set_body(std::move(body));
+  return msg;
+}
+
+TEST(Http2Protocol, RoundTrip) {
+  Endpoint client(false), server(true);
+
+  Write(&client, &server, MakeRequest(1, "/path/to/echo", "hello"));
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(1, requests.size());
+  auto req = cast<HttpRequestMessage>(requests[0].get());
+  EXPECT_EQ(HttpVersion::V_2, req->request()->version());
+  EXPECT_EQ(HttpMethod::Post, req->request()->method());
+  EXPECT_EQ("/path/to/echo", req->request()->uri());
+  EXPECT_EQ("192.0.2.1", *req->headers()->TryGet("Host"));
+  EXPECT_EQ("hello", *req->request()->body());
+
+  Write(&server, &client, MakeResponse(*req, "world"));
+  auto responses = ReadAll(&client, &server);
+  ASSERT_EQ(1, responses.size());
+  auto resp = cast<HttpResponseMessage>(responses[0].get());
+  EXPECT_EQ(1, resp->GetCorrelationId());
+  EXPECT_EQ(HttpStatus::OK, resp->response()->status());
+  EXPECT_EQ("text/plain", *resp->headers()->TryGet("Content-Type"));
+  EXPECT_EQ("world", *resp->response()->body());
+}
+
+TEST(Http2Protocol, Multiplexing) {
+  Endpoint client(false), server(true);
+
+  for (int i = 0; i != 10; ++i) {
+    Write(&client, &server, MakeRequest(100 + i, "/", std::to_string(i)));
+  }
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(10, requests.size());
+
+  // Responded in reverse order.
+  for (int i = 9; i >= 0; --i) {
+    auto req = cast<HttpRequestMessage>(requests[i].get());
+    EXPECT_EQ(std::to_string(i), *req->request()->body());
+    Write(&server, &client, MakeResponse(*req, "resp " + std::to_string(i)));
+  }
+  auto responses = ReadAll(&client, &server);
+  ASSERT_EQ(10, responses.size());
+  for (int i = 0; i != 10; ++i) {
+    auto resp = cast<HttpResponseMessage>(responses[i].get());
+    EXPECT_EQ(109 - i, resp->GetCorrelationId());
+    EXPECT_EQ("resp " + std::to_string(9 - i), *resp->response()->body());
+  }
+}
+
+TEST(Http2Protocol, FlowControl) {
+  Endpoint client(false), server(true);
+  // Far beyond the initial window (64K) of HTTP/2.
+  std::string large_body(4 * 1024 * 1024, 'a');
+
+  Write(&client, &server, MakeRequest(1, "/", large_body));
+  std::vector<std::unique_ptr<Message>> requests;
+  for (int i = 0; i != 1000 && requests.empty(); ++i) {
+    requests = ReadAll(&server, &client);
+    EXPECT_TRUE(ReadAll(&client, &server).empty());  // Window updates.
+  }
+  ASSERT_EQ(1, requests.size());
+  auto req = cast<HttpRequestMessage>(requests[0].get());
+  EXPECT_EQ(large_body, *req->request()->body());
+
+  Write(&server, &client, MakeResponse(*req, large_body));
+  std::vector<std::unique_ptr<Message>> responses;
+  for (int i = 0; i != 1000 && responses.empty(); ++i) {
+    responses = ReadAll(&client, &server);
+    EXPECT_TRUE(ReadAll(&server, &client).empty());
+  }
+  ASSERT_EQ(1, responses.size());
+  EXPECT_EQ(large_body,
+            *cast<HttpResponseMessage>(responses[0].get())->response()->body());
+}
+
+TEST(Http2Protocol, MaxConcurrentStreams) {
+  FLAGS_flare_http2_max_concurrent_streams = 1;
+  Endpoint client(false), server(true);
+  FLAGS_flare_http2_max_concurrent_streams = 1024;
+
+  // Let the client know the server's limit.
+  Write(&client, &server, MakeRequest(1, "/", "1"));
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(1, requests.size());
+  EXPECT_TRUE(ReadAll(&client, &server).empty());
+
+  // Queued until the first stream is closed.
+  Write(&client, &server, MakeRequest(2, "/", "2"));
+  Write(&client, &server, MakeRequest(3, "/", "3"));
+  EXPECT_TRUE(ReadAll(&server, &client).empty());
+
+  for (int i = 1; i != 4; ++i) {
+    ASSERT_EQ(1, requests.size());
+    auto req = cast<HttpRequestMessage>(requests[0].get());
+    EXPECT_EQ(std::to_string(i), *req->request()->body());
+    Write(&server, &client, MakeResponse(*req, ""));
+    auto responses = ReadAll(&client, &server);  // Next request is sent.
+    ASSERT_EQ(1, responses.size());
+    EXPECT_EQ(i, responses[0]->GetCorrelationId());
+    requests = ReadAll(&server, &client);
+  }
+  EXPECT_TRUE(requests.empty());
+}
+
+TEST(Http2Protocol, GoAway) {
+  Endpoint client(false), server(true);
+
+  for (int i = 0; i != 3; ++i) {
+    Write(&client, &server, MakeRequest(1 + i, "/", ""));
+  }
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(3, requests.size());
+  EXPECT_TRUE(ReadAll(&client, &server).empty());
+  EXPECT_TRUE(client.protocol.AcceptsNewCalls());
+
+  // GOAWAY, with stream #1 (the first request) being the last one processed.
+  const char kGoAwayFrame[] = {0, 0, 8, 7, 0, 0, 0, 0, 0,
+                               0, 0, 0, 1, 0, 0, 0, 0};
+  client.received.Append(
+      CreateBufferSlow(std::string_view(kGoAwayFrame, sizeof(kGoAwayFrame))));
+
+  // The rest are failed immediately.
+  std::vector<std::uint64_t> failed;
+  while (true) {
+    std::unique_ptr<Message> msg;
+    if (client.protocol.TryCutMessage(&client.received, &msg) !=
+        StreamProtocol::MessageCutStatus::Cut) {
+      break;
+    }
+    failed.push_back(msg->GetCorrelationId());
+    EXPECT_FALSE(client.protocol.TryParse(&msg, nullptr));
+  }
+  std::sort(failed.begin(), failed.end());
+  EXPECT_EQ((std::vector<std::uint64_t>{2, 3}), failed);
+
+  // No more requests can be made.
+  EXPECT_FALSE(client.protocol.AcceptsNewCalls());
+  NoncontiguousBuffer nb;
+  client.protocol.WriteMessage(MakeRequest(4, "/", ""), &nb, nullptr);
+  EXPECT_TRUE(nb.Empty());
+
+  // Requests already accepted are still served.
+  Write(&server, &client,
+        MakeResponse(*cast<HttpRequestMessage>(requests[0].get()), "ok"));
+  auto responses = ReadAll(&client, &server);
+  ASSERT_EQ(1, responses.size());
+  EXPECT_EQ(1, responses[0]->GetCorrelationId());
+}
+
+TEST(Http2Protocol, CallAbandoned) {
+  Endpoint client(false), server(true);
+
+  Write(&client, &server, MakeRequest(1, "/", ""));
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(1, requests.size());
+
+  // Timed out on client side, RST_STREAM is sent.
+  client.protocol.OnCallAbandoned(1);
+  FlushPending(&client, &server);
+  EXPECT_TRUE(ReadAll(&server, &client).empty());
+
+  // So the response is dropped.
+  NoncontiguousBuffer nb;
+  server.protocol.WriteMessage(
+      MakeResponse(*cast<HttpRequestMessage>(requests[0].get()), ""), &nb,
+      nullptr);
+  EXPECT_TRUE(nb.Empty());
+
+  // Requests dropped by the server are reset as well.
+  Write(&client, &server, MakeRequest(2, "/", ""));
+  requests = ReadAll(&server, &client);
+  ASSERT_EQ(1, requests.size());
+  server.protocol.OnCallAbandoned(requests[0]->GetCorrelationId());
+  FlushPending(&server, &client);
+  std::unique_ptr<Message> msg;
+  ASSERT_EQ(StreamProtocol::MessageCutStatus::Cut,
+            client.protocol.TryCutMessage(&client.received, &msg));
+  EXPECT_EQ(2, msg->GetCorrelationId());
+  EXPECT_FALSE(client.protocol.TryParse(&msg, nullptr));
+}
+
+TEST(Http2Protocol, Overloaded) {
+  Endpoint client(false), server(true);
+
+  Write(&client, &server, MakeRequest(1, "/", ""));
+  auto requests = ReadAll(&server, &client);
+  ASSERT_EQ(1, requests.size());
+
+  auto overloaded = server.protocol.GetMessageFactory()->Create(
+      MessageFactory::Type::Overloaded, 1, false);
+  ASSERT_TRUE(overloaded);
+  Write(&server, &client, *overloaded);
+  auto responses = ReadAll(&client, &server);
+  ASSERT_EQ(1, responses.size());
+  EXPECT_EQ(1, responses[0]->GetCorrelationId());
+  EXPECT_EQ(HttpStatus::ServiceUnavailable,
+            cast<HttpResponseMessage>(responses[0].get())->response()->status());
+}
+
+TEST(Http2Protocol, ProtocolMismatch) {
+  {
+    Http2Protocol server(true);
+    auto buffer = CreateBufferSlow("GET / HTTP/1.1\r\n\r\n");
+    std::unique_ptr<Message> msg;
+    EXPECT_EQ(StreamProtocol::MessageCutStatus::ProtocolMismatch,
+              server.TryCutMessage(&buffer, &msg));
+    EXPECT_EQ(18, buffer.ByteSize());  // Left untouched.
+  }
+  {
+    // Handled by Protocol Buffers over HTTP/2.
+    Endpoint client(false), server(true);
+    Write(&client, &server, MakeRequest(1, "/rpc/a.b.c", ""));
+    auto size = server.received.ByteSize();
+    std::unique_ptr<Message> msg;
+    EXPECT_EQ(StreamProtocol::MessageCutStatus::ProtocolMismatch,
+              server.protocol.TryCutMessage(&server.received, &msg));
+    EXPECT_EQ(size, server.received.ByteSize());
+  }
+}
+
+}  // namespace flare::http
+
+FLARE_TEST_MAIN
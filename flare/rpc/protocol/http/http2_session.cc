@@ -0,0 +1,1006 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/http/http2_session.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "nghttp2/nghttp2.h"
+
+#include "flare/base/logging.h"
+#include "flare/base/string.h"
+
+using namespace std::literals;
+
+DEFINE_int32(flare_http2_max_concurrent_streams, 1024,
+             "Maximum number of concurrent streams the peer may open on a "
+             "server-side HTTP/2 connection. Streams beyond this limit are "
+             "refused.");
+DEFINE_int32(flare_http2_stream_window, 1024 * 1024,
+             "Initial flow control window (in bytes) of each HTTP/2 stream "
+             "advertised to the peer. Values below 65535 are rounded up.");
+DEFINE_int32(flare_http2_connection_window, 16 * 1024 * 1024,
+             "Flow control window (in bytes) of each HTTP/2 connection "
+             "advertised to the peer. Values below 65535 are rounded up.");
+
+DECLARE_int32(flare_http_max_header_size);
+
+namespace flare::http {
+
+namespace {
+
+constexpr auto kClientPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"sv;
+constexpr std::size_t kFrameHeaderSize = 9;
+// We never advertise a larger `SETTINGS_MAX_FRAME_SIZE`.
+constexpr std::size_t kMaxFrameSize = 16384;
+constexpr std::int64_t kDefaultWindow = 65535;
+constexpr std::int64_t kMaxWindow = 0x7fff'ffff;
+constexpr std::uint32_t kMaxStreamId = 0x7fff'ffff;
+// Dynamic table size of our HPACK encoder, the default one.
+constexpr std::size_t kHeaderTableSize = 4096;
+
+// Frame types.
+constexpr std::uint8_t kData = 0x0;
+constexpr std::uint8_t kHeaders = 0x1;
+constexpr std::uint8_t kPriority = 0x2;
+constexpr std::uint8_t kRstStream = 0x3;
+constexpr std::uint8_t kSettings = 0x4;
+constexpr std::uint8_t kPushPromise = 0x5;
+constexpr std::uint8_t kPing = 0x6;
+constexpr std::uint8_t kGoAway = 0x7;
+constexpr std::uint8_t kWindowUpdate = 0x8;
+constexpr std::uint8_t kContinuation = 0x9;
+
+// Frame flags.
+constexpr std::uint8_t kFlagEndStream = 0x1;
+constexpr std::uint8_t kFlagAck = 0x1;
+constexpr std::uint8_t kFlagEndHeaders = 0x4;
+constexpr std::uint8_t kFlagPadded = 0x8;
+constexpr std::uint8_t kFlagPriority = 0x20;
+
+// Settings.
+constexpr std::uint16_t kSettingsHeaderTableSize = 0x1;
+constexpr std::uint16_t kSettingsEnablePush = 0x2;
+constexpr std::uint16_t kSettingsMaxConcurrentStreams = 0x3;
+constexpr std::uint16_t kSettingsInitialWindowSize = 0x4;
+constexpr std::uint16_t kSettingsMaxFrameSize = 0x5;
+
+// Error codes.
+constexpr std::uint32_t kNoError = 0x0;
+constexpr std::uint32_t kProtocolError = 0x1;
+constexpr std::uint32_t kFlowControlError = 0x3;
+constexpr std::uint32_t kStreamClosed = 0x5;
+constexpr std::uint32_t kFrameSizeError = 0x6;
+constexpr std::uint32_t kRefusedStream = 0x7;
+constexpr std::uint32_t kCancel = 0x8;
+constexpr std::uint32_t kCompressionError = 0x9;
+
+std::uint32_t ReadUInt32(const void* ptr) {
+  auto p = reinterpret_cast<const std::uint8_t*>(ptr);
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+         (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+void AppendUInt16(std::string* s, std::uint16_t value) {
+  s->push_back(static_cast<char>(value >> 8));
+  s->push_back(static_cast<char>(value));
+}
+
+void AppendUInt32(std::string* s, std::uint32_t value) {
+  AppendUInt16(s, value >> 16);
+  AppendUInt16(s, value);
+}
+
+void AppendSetting(std::string* s, std::uint16_t id, std::uint32_t value) {
+  AppendUInt16(s, id);
+  AppendUInt32(s, value);
+}
+
+// RFC 7540, Section 8.1.2.2.
+bool IsConnectionSpecificHeader(std::string_view name, std::string_view value) {
+  static constexpr std::string_view kHeaders[] = {
+      "connection"sv, "keep-alive"sv, "proxy-connection"sv,
+      "transfer-encoding"sv, "upgrade"sv,
+      // Carried in `:authority` instead.
+      "host"sv};
+  if (name == "te") {
+    return !IEquals(value, "trailers");
+  }
+  return std::find(std::begin(kHeaders), std::end(kHeaders), name) !=
+         std::end(kHeaders);
+}
+
+}  // namespace
+
+Http2Session::Http2Session(bool server_side)
+    : server_side_(server_side),
+      local_stream_window_(
+          std::max<std::int64_t>(FLAGS_flare_http2_stream_window,
+                                 kDefaultWindow)),
+      local_connection_window_(
+          std::max<std::int64_t>(FLAGS_flare_http2_connection_window,
+                                 kDefaultWindow)),
+      local_max_concurrent_streams_(
+          std::max(FLAGS_flare_http2_max_concurrent_streams, 1)) {
+  FLARE_CHECK_EQ(nghttp2_hd_deflate_new(&deflater_, kHeaderTableSize), 0);
+  FLARE_CHECK_EQ(nghttp2_hd_inflate_new(&inflater_), 0);
+
+  // The client speaks first, without waiting for the server.
+  if (!server_side_) {
+    pending_.Append(CreateBufferSlow(kClientPreface));
+    WriteInitialFrames();
+  }
+}
+
+Http2Session::~Http2Session() {
+  nghttp2_hd_deflate_del(deflater_);
+  nghttp2_hd_inflate_del(inflater_);
+}
+
+Http2Session::PeekStatus Http2Session::PeekFirstRequest(
+    const NoncontiguousBuffer& buffer, PseudoHeaders* pseudo_headers,
+    HttpHeaders* headers) {
+  auto prefix_size = std::min(buffer.ByteSize(), kClientPreface.size());
+  if (FlattenSlow(buffer, prefix_size) !=
+      kClientPreface.substr(0, prefix_size)) {
+    return PeekStatus::Mismatch;
+  }
+
+  // Feed a scratch session with a copy of the bytes, it stops as soon as
+  // headers of the first request is seen.
+  Http2Session session(true);
+  session.peeking_ = true;
+  NoncontiguousBuffer copy = buffer;
+  Message msg;
+  auto rc = session.TryCutMessage(&copy, &msg);
+  if (rc == CutStatus::NeedMore) {
+    return PeekStatus::NeedMore;
+  } else if (rc == CutStatus::Error) {
+    return PeekStatus::Error;
+  }
+  *pseudo_headers = std::move(msg.pseudo_headers);
+  *headers = std::move(msg.headers);
+  return PeekStatus::Identified;
+}
+
+Http2Session::CutStatus Http2Session::TryCutMessage(NoncontiguousBuffer* buffer,
+                                                    Message* message) {
+  std::scoped_lock _(lock_);
+
+  if (server_side_ && !preface_seen_) {
+    if (buffer->ByteSize() < kClientPreface.size()) {
+      return CutStatus::NeedMore;
+    }
+    if (FlattenSlow(*buffer, kClientPreface.size()) != kClientPreface) {
+      FLARE_LOG_WARNING_EVERY_SECOND("Invalid HTTP/2 connection preface.");
+      return CutStatus::Error;
+    }
+    buffer->Skip(kClientPreface.size());
+    preface_seen_ = true;
+    WriteInitialFrames();
+  }
+
+  while (true) {
+    if (FLARE_UNLIKELY(!ready_.empty())) {
+      *message = std::move(ready_.front());
+      ready_.pop_front();
+      return CutStatus::Cut;
+    }
+    if (buffer->ByteSize() < kFrameHeaderSize) {
+      return CutStatus::NeedMore;
+    }
+    std::uint8_t header[kFrameHeaderSize];
+    FlattenToSlow(*buffer, header, kFrameHeaderSize);
+    std::size_t length = (header[0] << 16) | (header[1] << 8) | header[2];
+    if (length > kMaxFrameSize) {
+      return ConnectionError(kFrameSizeError, "Frame too large.");
+    }
+    if (buffer->ByteSize() < kFrameHeaderSize + length) {
+      return CutStatus::NeedMore;
+    }
+    buffer->Skip(kFrameHeaderSize);
+    auto rc = ProcessFrame(header[3], header[4],
+                           ReadUInt32(header + 5) & kMaxStreamId,
+                           buffer->Cut(length), message);
+    if (rc != CutStatus::NeedMore) {
+      return rc;
+    }
+  }
+}
+
+bool Http2Session::WriteMessage(std::uint64_t correlation_id,
+                                const PseudoHeaders& pseudo_headers,
+                                const HttpHeaders& headers,
+                                NoncontiguousBuffer body,
+                                NoncontiguousBuffer* buffer) {
+  std::scoped_lock _(lock_);
+
+  if (!server_side_) {
+    if (!CanOpenStream()) {
+      FLARE_LOG_WARNING_EVERY_SECOND(
+          "No more stream can be opened on this HTTP/2 connection.");
+      return false;
+    }
+    if (streams_.size() >= peer_max_concurrent_streams_) {
+      queued_.push_back(QueuedRequest{.correlation_id = correlation_id,
+                                      .pseudo_headers = pseudo_headers,
+                                      .headers = headers,
+                                      .body = std::move(body)});
+    } else {
+      OpenStream(correlation_id, pseudo_headers, headers, std::move(body));
+    }
+    *buffer = std::exchange(pending_, {});
+    return true;
+  }
+
+  auto iter = streams_.find(correlation_id);
+  if (iter == streams_.end() || iter->second.local_closed) {
+    FLARE_VLOG(10, "Stream #{} has gone, response is dropped.",
+               correlation_id);
+    return false;
+  }
+  auto&& stream = iter->second;
+  auto id = stream.id;
+  WriteHeaders(id, pseudo_headers, headers, body.Empty());
+  if (body.Empty()) {
+    stream.local_closed = true;
+  } else {
+    stream.pending_data = std::move(body);
+    FlushStreamData(&stream);
+  }
+  ConsiderRemoveStream(id);
+  *buffer = std::exchange(pending_, {});
+  return true;
+}
+
+bool Http2Session::TryGetPendingBytes(NoncontiguousBuffer* buffer) {
+  std::scoped_lock _(lock_);
+  if (pending_.Empty()) {
+    return false;
+  }
+  *buffer = std::exchange(pending_, {});
+  return true;
+}
+
+void Http2Session::ResetStream(std::uint64_t correlation_id) {
+  std::scoped_lock _(lock_);
+  if (server_side_) {
+    auto iter = streams_.find(correlation_id);
+    if (iter != streams_.end() && !iter->second.local_closed) {
+      WriteRstStream(iter->first, kCancel);
+      RemoveStream(iter);
+    }
+    return;
+  }
+
+  // Calls are not abandoned often, linear scan should be fine.
+  for (auto iter = queued_.begin(); iter != queued_.end(); ++iter) {
+    if (iter->correlation_id == correlation_id) {
+      queued_.erase(iter);
+      return;
+    }
+  }
+  for (auto iter = streams_.begin(); iter != streams_.end(); ++iter) {
+    if (iter->second.correlation_id == correlation_id) {
+      if (!iter->second.local_closed || !iter->second.remote_closed) {
+        WriteRstStream(iter->first, kCancel);
+      }
+      RemoveStream(iter);
+      return;
+    }
+  }
+}
+
+bool Http2Session::AcceptsNewStreams() {
+  std::scoped_lock _(lock_);
+  return server_side_ || CanOpenStream();
+}
+
+Http2Session::CutStatus Http2Session::ProcessFrame(std::uint8_t type,
+                                                   std::uint8_t flags,
+                                                   std::uint32_t stream_id,
+                                                   NoncontiguousBuffer payload,
+                                                   Message* message) {
+  // Header block must be transmitted as a contiguous sequence of frames.
+  if (continuing_stream_ &&
+      (type != kContinuation || stream_id != continuing_stream_)) {
+    return ConnectionError(kProtocolError, "Expecting CONTINUATION.");
+  }
+
+  if (type == kData) {
+    return OnData(flags, stream_id, std::move(payload), message);
+  }
+  auto flatten = FlattenSlow(payload);
+  switch (type) {
+    case kHeaders:
+      return OnHeaders(flags, stream_id, flatten, message);
+    case kContinuation:
+      if (!continuing_stream_) {
+        return ConnectionError(kProtocolError, "Unexpected CONTINUATION.");
+      }
+      if (header_block_.size() + flatten.size() >
+          static_cast<std::size_t>(FLAGS_flare_http_max_header_size)) {
+        return ConnectionError(kProtocolError, "Header block too large.");
+      }
+      header_block_ += flatten;
+      if (flags & kFlagEndHeaders) {
+        return OnHeaderBlock(message);
+      }
+      return CutStatus::NeedMore;
+    case kPriority:
+      if (!stream_id || flatten.size() != 5) {
+        return ConnectionError(kProtocolError, "Malformed PRIORITY.");
+      }
+      return CutStatus::NeedMore;  // Ignored.
+    case kRstStream:
+      return OnRstStream(stream_id, flatten, message);
+    case kSettings:
+      return OnSettings(flags, stream_id, flatten);
+    case kPushPromise:
+      // We never enable server push, and clients never push.
+      return ConnectionError(kProtocolError, "Unexpected PUSH_PROMISE.");
+    case kPing:
+      return OnPing(flags, stream_id, flatten);
+    case kGoAway:
+      return OnGoAway(stream_id, flatten);
+    case kWindowUpdate:
+      return OnWindowUpdate(stream_id, flatten);
+    default:
+      return CutStatus::NeedMore;  // Unknown frames are ignored.
+  }
+}
+
+Http2Session::CutStatus Http2Session::OnData(std::uint8_t flags,
+                                             std::uint32_t stream_id,
+                                             NoncontiguousBuffer payload,
+                                             Message* message) {
+  if (!stream_id) {
+    return ConnectionError(kProtocolError, "DATA on stream 0.");
+  }
+
+  // Padding is subject to flow control as well.
+  std::int64_t size = payload.ByteSize();
+  if (size > conn_recv_window_) {
+    return ConnectionError(kFlowControlError, "Connection window overdrawn.");
+  }
+  conn_recv_window_ -= size;
+  if (conn_recv_window_ <= local_connection_window_ / 2) {
+    WriteWindowUpdate(0, local_connection_window_ - conn_recv_window_);
+    conn_recv_window_ = local_connection_window_;
+  }
+
+  std::size_t padding = 0;
+  if (flags & kFlagPadded) {
+    std::uint8_t pad_length;
+    if (payload.Empty()) {
+      return ConnectionError(kProtocolError, "Malformed DATA.");
+    }
+    FlattenToSlow(payload, &pad_length, 1);
+    payload.Skip(1);
+    padding = pad_length;
+    if (padding > payload.ByteSize()) {
+      return ConnectionError(kProtocolError, "Malformed DATA.");
+    }
+  }
+
+  auto iter = streams_.find(stream_id);
+  if (iter == streams_.end() || iter->second.remote_closed) {
+    if (stream_id > last_stream_id_) {
+      return ConnectionError(kProtocolError, "DATA on idle stream.");
+    }
+    // The stream has been closed (likely reset by us), ignored.
+    return CutStatus::NeedMore;
+  }
+  auto&& stream = iter->second;
+  if (!stream.headers_received) {
+    return ConnectionError(kProtocolError, "DATA before HEADERS.");
+  }
+  if (size > stream.recv_window) {
+    return ConnectionError(kFlowControlError, "Stream window overdrawn.");
+  }
+  stream.recv_window -= size;
+  stream.body.Append(payload.Cut(payload.ByteSize() - padding));
+
+  if (flags & kFlagEndStream) {
+    return OnStreamEnd(&stream, message) ? CutStatus::Cut
+                                         : CutStatus::NeedMore;
+  }
+  if (stream.recv_window <= local_stream_window_ / 2) {
+    WriteWindowUpdate(stream_id, local_stream_window_ - stream.recv_window);
+    stream.recv_window = local_stream_window_;
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnHeaders(std::uint8_t flags,
+                                                std::uint32_t stream_id,
+                                                std::string_view payload,
+                                                Message* message) {
+  if (!stream_id) {
+    return ConnectionError(kProtocolError, "HEADERS on stream 0.");
+  }
+  std::size_t padding = 0;
+  if (flags & kFlagPadded) {
+    if (payload.empty()) {
+      return ConnectionError(kProtocolError, "Malformed HEADERS.");
+    }
+    padding = static_cast<std::uint8_t>(payload[0]);
+    payload.remove_prefix(1);
+  }
+  if (flags & kFlagPriority) {  // Ignored.
+    if (payload.size() < 5) {
+      return ConnectionError(kProtocolError, "Malformed HEADERS.");
+    }
+    payload.remove_prefix(5);
+  }
+  if (padding > payload.size()) {
+    return ConnectionError(kProtocolError, "Malformed HEADERS.");
+  }
+  payload.remove_suffix(padding);
+  if (payload.size() >
+      static_cast<std::size_t>(FLAGS_flare_http_max_header_size)) {
+    return ConnectionError(kProtocolError, "Header block too large.");
+  }
+
+  continuing_stream_ = stream_id;
+  continuing_flags_ = flags;
+  header_block_.assign(payload.data(), payload.size());
+  if (flags & kFlagEndHeaders) {
+    return OnHeaderBlock(message);
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnHeaderBlock(Message* message) {
+  auto stream_id = std::exchange(continuing_stream_, 0);
+  bool end_stream = continuing_flags_ & kFlagEndStream;
+  PseudoHeaders pseudo_headers;
+  HttpHeaders headers;
+
+  // The block must be decoded even if we're not interested in it, otherwise
+  // the HPACK decoder would be out of sync with the peer's encoder.
+  if (!DecodeHeaderBlock(header_block_, &pseudo_headers, &headers)) {
+    return ConnectionError(kCompressionError, "Failed to decode headers.");
+  }
+  header_block_.clear();
+
+  auto iter = streams_.find(stream_id);
+  if (iter == streams_.end()) {
+    if (!server_side_ || stream_id % 2 == 0) {
+      if (stream_id > last_stream_id_) {
+        return ConnectionError(kProtocolError, "HEADERS on idle stream.");
+      }
+      return CutStatus::NeedMore;  // The stream has gone.
+    }
+    if (stream_id <= last_stream_id_) {
+      WriteRstStream(stream_id, kStreamClosed);
+      return CutStatus::NeedMore;
+    }
+    last_stream_id_ = stream_id;
+    if (streams_.size() >= local_max_concurrent_streams_) {
+      FLARE_LOG_WARNING_EVERY_SECOND(
+          "Too many concurrent HTTP/2 streams. Refusing new ones.");
+      WriteRstStream(stream_id, kRefusedStream);
+      return CutStatus::NeedMore;
+    }
+    if (pseudo_headers.method.empty() || pseudo_headers.path.empty()) {
+      WriteRstStream(stream_id, kProtocolError);
+      return CutStatus::NeedMore;
+    }
+    if (peeking_) {  // That's all we want.
+      message->pseudo_headers = std::move(pseudo_headers);
+      message->headers = std::move(headers);
+      return CutStatus::Cut;
+    }
+    auto&& stream = streams_[stream_id];
+    stream.id = stream_id;
+    stream.correlation_id = stream_id;
+    stream.headers_received = true;
+    stream.send_window = peer_initial_window_;
+    stream.recv_window = local_stream_window_;
+    stream.pseudo_headers = std::move(pseudo_headers);
+    stream.headers = std::move(headers);
+    iter = streams_.find(stream_id);
+  } else {
+    auto&& stream = iter->second;
+    if (stream.remote_closed) {
+      WriteRstStream(stream_id, kStreamClosed);
+      return CutStatus::NeedMore;
+    }
+    if (!stream.headers_received) {
+      if (pseudo_headers.status >= 100 && pseudo_headers.status < 200) {
+        return CutStatus::NeedMore;  // Informational responses are ignored.
+      }
+      if (!pseudo_headers.status) {
+        return ConnectionError(kProtocolError, "Missing `:status`.");
+      }
+      stream.headers_received = true;
+      stream.pseudo_headers = std::move(pseudo_headers);
+      stream.headers = std::move(headers);
+    } else {
+      if (!end_stream) {
+        return ConnectionError(kProtocolError, "Trailers without END_STREAM.");
+      }
+      for (auto&& [k, v] : headers) {
+        stream.headers.Append(std::string(k), std::string(v));
+      }
+    }
+  }
+
+  if (end_stream) {
+    return OnStreamEnd(&iter->second, message) ? CutStatus::Cut
+                                               : CutStatus::NeedMore;
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnSettings(std::uint8_t flags,
+                                                 std::uint32_t stream_id,
+                                                 std::string_view payload) {
+  if (stream_id) {
+    return ConnectionError(kProtocolError, "SETTINGS on non-zero stream.");
+  }
+  if (flags & kFlagAck) {
+    if (!payload.empty()) {
+      return ConnectionError(kFrameSizeError, "Malformed SETTINGS ACK.");
+    }
+    return CutStatus::NeedMore;
+  }
+  if (payload.size() % 6) {
+    return ConnectionError(kFrameSizeError, "Malformed SETTINGS.");
+  }
+
+  std::int64_t window_delta = 0;
+  for (std::size_t i = 0; i != payload.size(); i += 6) {
+    auto id = (static_cast<std::uint8_t>(payload[i]) << 8) |
+              static_cast<std::uint8_t>(payload[i + 1]);
+    auto value = ReadUInt32(payload.data() + i + 2);
+    if (id == kSettingsHeaderTableSize) {
+      FLARE_CHECK_EQ(nghttp2_hd_deflate_change_table_size(
+                         deflater_, std::min<std::size_t>(value,
+                                                          kHeaderTableSize)),
+                     0);
+    } else if (id == kSettingsEnablePush) {
+      if (value > 1) {
+        return ConnectionError(kProtocolError, "Invalid ENABLE_PUSH.");
+      }
+    } else if (id == kSettingsInitialWindowSize) {
+      if (value > kMaxWindow) {
+        return ConnectionError(kFlowControlError, "Invalid window size.");
+      }
+      window_delta += value - peer_initial_window_;
+      peer_initial_window_ = value;
+    } else if (id == kSettingsMaxFrameSize) {
+      if (value < 16384 || value > 0xff'ffff) {
+        return ConnectionError(kProtocolError, "Invalid MAX_FRAME_SIZE.");
+      }
+      peer_max_frame_size_ = value;
+    } else if (id == kSettingsMaxConcurrentStreams) {
+      // Only streams opened by us are counted, it's meaningless to servers as
+      // clients never push.
+      peer_max_concurrent_streams_ = value;
+    }
+    // `MAX_HEADER_LIST_SIZE` and unknown ones are ignored.
+  }
+  WriteFrame(kSettings, kFlagAck, 0, {});
+  if (!server_side_) {
+    OpenQueuedStreams();  // The limit may have been raised.
+  }
+
+  if (window_delta) {
+    for (auto&& [id, stream] : streams_) {
+      stream.send_window += window_delta;
+      if (stream.send_window > kMaxWindow) {
+        return ConnectionError(kFlowControlError, "Window overflow.");
+      }
+    }
+    FlushBlockedStreams();
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnPing(std::uint8_t flags,
+                                             std::uint32_t stream_id,
+                                             std::string_view payload) {
+  if (stream_id || payload.size() != 8) {
+    return ConnectionError(kProtocolError, "Malformed PING.");
+  }
+  if (!(flags & kFlagAck)) {
+    WriteFrame(kPing, kFlagAck, 0, payload);
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnGoAway(std::uint32_t stream_id,
+                                               std::string_view payload) {
+  if (stream_id || payload.size() < 8) {
+    return ConnectionError(kProtocolError, "Malformed GOAWAY.");
+  }
+  auto error_code = ReadUInt32(payload.data() + 4);
+  if (error_code != kNoError) {
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "HTTP/2 connection is closed by the peer with error {}.", error_code);
+    return CutStatus::Error;
+  }
+  // Streams already opened are still served by the peer. It's up to the peer
+  // to close the connection once they're done.
+  goaway_seen_ = true;
+  if (!server_side_) {
+    // Streams beyond the last one the peer processes, as well as requests not
+    // sent yet, are never going to be served. Fail them so that they can be
+    // retried elsewhere.
+    auto last_stream_id = ReadUInt32(payload.data()) & kMaxStreamId;
+    for (auto iter = streams_.begin(); iter != streams_.end();) {
+      if (iter->first > last_stream_id) {
+        FailCall(iter->second.correlation_id);
+        iter = streams_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    OpenQueuedStreams();
+  }
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnWindowUpdate(std::uint32_t stream_id,
+                                                     std::string_view payload) {
+  if (payload.size() != 4) {
+    return ConnectionError(kFrameSizeError, "Malformed WINDOW_UPDATE.");
+  }
+  auto increment = ReadUInt32(payload.data()) & 0x7fff'ffff;
+  if (!increment) {
+    return ConnectionError(kProtocolError, "Zero window increment.");
+  }
+  if (!stream_id) {
+    conn_send_window_ += increment;
+    if (conn_send_window_ > kMaxWindow) {
+      return ConnectionError(kFlowControlError, "Window overflow.");
+    }
+    FlushBlockedStreams();
+    return CutStatus::NeedMore;
+  }
+
+  auto iter = streams_.find(stream_id);
+  if (iter == streams_.end()) {
+    return CutStatus::NeedMore;
+  }
+  iter->second.send_window += increment;
+  if (iter->second.send_window > kMaxWindow) {
+    return ConnectionError(kFlowControlError, "Window overflow.");
+  }
+  FlushStreamData(&iter->second);
+  ConsiderRemoveStream(stream_id);
+  return CutStatus::NeedMore;
+}
+
+Http2Session::CutStatus Http2Session::OnRstStream(std::uint32_t stream_id,
+                                                  std::string_view payload,
+                                                  Message* message) {
+  if (!stream_id) {
+    return ConnectionError(kProtocolError, "RST_STREAM on stream 0.");
+  }
+  if (payload.size() != 4) {
+    return ConnectionError(kFrameSizeError, "Malformed RST_STREAM.");
+  }
+  auto iter = streams_.find(stream_id);
+  if (iter == streams_.end()) {
+    return CutStatus::NeedMore;
+  }
+  if (server_side_ || iter->second.remote_closed) {
+    // On server side, response to this stream (if any) is dropped.
+    RemoveStream(iter);
+    return CutStatus::NeedMore;
+  }
+  // Let the caller fail the call early.
+  message->correlation_id = iter->second.correlation_id;
+  RemoveStream(iter);
+  message->reset = true;
+  message->reset_error_code = ReadUInt32(payload.data());
+  return CutStatus::Cut;
+}
+
+bool Http2Session::OnStreamEnd(Stream* stream, Message* message) {
+  stream->remote_closed = true;
+  message->correlation_id = stream->correlation_id;
+  message->pseudo_headers = std::move(stream->pseudo_headers);
+  message->headers = std::move(stream->headers);
+  message->body = std::move(stream->body);
+
+  // The server responded before the request is fully sent, the rest of the
+  // request is not needed (RFC 7540, Section 8.1).
+  if (!server_side_ && !stream->local_closed) {
+    stream->pending_data.Clear();
+    stream->local_closed = true;
+    WriteRstStream(stream->id, kNoError);
+  }
+  ConsiderRemoveStream(stream->id);
+  return true;
+}
+
+bool Http2Session::CanOpenStream() const {
+  return !goaway_seen_ && last_stream_id_ + 2 <= kMaxStreamId;
+}
+
+void Http2Session::OpenStream(std::uint64_t correlation_id,
+                              const PseudoHeaders& pseudo_headers,
+                              const HttpHeaders& headers,
+                              NoncontiguousBuffer body) {
+  auto id = last_stream_id_ ? last_stream_id_ + 2 : 1;
+  last_stream_id_ = id;
+  auto&& stream = streams_[id];
+  stream.id = id;
+  stream.correlation_id = correlation_id;
+  stream.send_window = peer_initial_window_;
+  stream.recv_window = local_stream_window_;
+
+  WriteHeaders(id, pseudo_headers, headers, body.Empty());
+  if (body.Empty()) {
+    stream.local_closed = true;
+  } else {
+    stream.pending_data = std::move(body);
+    FlushStreamData(&stream);
+  }
+}
+
+void Http2Session::OpenQueuedStreams() {
+  while (!queued_.empty() && streams_.size() < peer_max_concurrent_streams_) {
+    auto req = std::move(queued_.front());
+    queued_.pop_front();
+    if (CanOpenStream()) {
+      OpenStream(req.correlation_id, req.pseudo_headers, req.headers,
+                 std::move(req.body));
+    } else {
+      FailCall(req.correlation_id);
+    }
+  }
+  if (!CanOpenStream()) {
+    for (auto&& e : std::exchange(queued_, {})) {
+      FailCall(e.correlation_id);
+    }
+  }
+}
+
+void Http2Session::FailCall(std::uint64_t correlation_id) {
+  auto&& msg = ready_.emplace_back();
+  msg.correlation_id = correlation_id;
+  msg.reset = true;
+  msg.reset_error_code = kRefusedStream;
+}
+
+bool Http2Session::DecodeHeaderBlock(std::string_view block,
+                                     PseudoHeaders* pseudo_headers,
+                                     HttpHeaders* headers) {
+  auto in = reinterpret_cast<const std::uint8_t*>(block.data());
+  auto size = block.size();
+  while (true) {
+    nghttp2_nv nv;
+    int inflate_flags = 0;
+    auto rv = nghttp2_hd_inflate_hd2(inflater_, &nv, &inflate_flags, in, size,
+                                     1 /* Last block. */);
+    if (rv < 0) {
+      return false;
+    }
+    in += rv;
+    size -= rv;
+
+    if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+      std::string_view name(reinterpret_cast<const char*>(nv.name),
+                            nv.namelen);
+      std::string value(reinterpret_cast<const char*>(nv.value), nv.valuelen);
+      if (name.empty() || name[0] != ':') {
+        headers->Append(std::string(name), std::move(value));
+      } else if (name == ":method") {
+        pseudo_headers->method = std::move(value);
+      } else if (name == ":scheme") {
+        pseudo_headers->scheme = std::move(value);
+      } else if (name == ":authority") {
+        pseudo_headers->authority = std::move(value);
+      } else if (name == ":path") {
+        pseudo_headers->path = std::move(value);
+      } else if (name == ":status") {
+        pseudo_headers->status = TryParse<int>(value).value_or(0);
+      }  // Unknown pseudo headers are ignored.
+    }
+    if (inflate_flags & NGHTTP2_HD_INFLATE_FINAL) {
+      nghttp2_hd_inflate_end_headers(inflater_);
+      return true;
+    }
+    if (!(inflate_flags & NGHTTP2_HD_INFLATE_EMIT) && !size) {
+      return false;  // Truncated.
+    }
+  }
+}
+
+void Http2Session::WriteHeaders(std::uint32_t stream_id,
+                                const PseudoHeaders& pseudo_headers,
+                                const HttpHeaders& headers, bool end_stream) {
+  std::vector<nghttp2_nv> nva;
+  std::deque<std::string> names;  // Lower-cased.
+  auto add = [&](std::string_view name, std::string_view value) {
+    nva.push_back(nghttp2_nv{
+        .name = reinterpret_cast<std::uint8_t*>(const_cast<char*>(name.data())),
+        .value =
+            reinterpret_cast<std::uint8_t*>(const_cast<char*>(value.data())),
+        .namelen = name.size(),
+        .valuelen = value.size(),
+        .flags = NGHTTP2_NV_FLAG_NONE});
+  };
+
+  // Pseudo headers must precede regular ones.
+  auto status = std::to_string(pseudo_headers.status);
+  if (server_side_) {
+    add(":status", status);
+  } else {
+    add(":method", pseudo_headers.method);
+    add(":scheme", pseudo_headers.scheme);
+    if (!pseudo_headers.authority.empty()) {
+      add(":authority", pseudo_headers.authority);
+    }
+    add(":path", pseudo_headers.path);
+  }
+  for (auto&& [k, v] : headers) {
+    auto&& name = names.emplace_back(ToLower(k));
+    if (IsConnectionSpecificHeader(name, v)) {
+      continue;
+    }
+    add(name, v);
+  }
+
+  std::string block(
+      nghttp2_hd_deflate_bound(deflater_, nva.data(), nva.size()), 0);
+  auto size = nghttp2_hd_deflate_hd(
+      deflater_, reinterpret_cast<std::uint8_t*>(block.data()), block.size(),
+      nva.data(), nva.size());
+  FLARE_CHECK_GE(size, 0, "Failed to encode HTTP/2 headers: {}.",
+                 nghttp2_strerror(size));
+  block.resize(size);
+
+  // Split into HEADERS and CONTINUATION (if necessary).
+  std::string_view rest = block;
+  std::uint8_t type = kHeaders;
+  std::uint8_t flags = end_stream ? kFlagEndStream : 0;
+  do {
+    auto fragment = rest.substr(0, peer_max_frame_size_);
+    rest.remove_prefix(fragment.size());
+    WriteFrame(type, flags | (rest.empty() ? kFlagEndHeaders : 0), stream_id,
+               fragment);
+    type = kContinuation;
+    flags = 0;
+  } while (!rest.empty());
+}
+
+void Http2Session::FlushStreamData(Stream* stream) {
+  while (!stream->pending_data.Empty()) {
+    auto size = std::min<std::int64_t>(
+        {static_cast<std::int64_t>(stream->pending_data.ByteSize()),
+         peer_max_frame_size_, conn_send_window_, stream->send_window});
+    if (size <= 0) {
+      if (!stream->blocked) {
+        stream->blocked = true;
+        blocked_.push_back(stream->id);
+      }
+      return;
+    }
+    conn_send_window_ -= size;
+    stream->send_window -= size;
+    auto data = stream->pending_data.Cut(size);
+    WriteFrameHeader(size, kData,
+                     stream->pending_data.Empty() ? kFlagEndStream : 0,
+                     stream->id);
+    pending_.Append(std::move(data));
+  }
+  stream->local_closed = true;
+}
+
+void Http2Session::FlushBlockedStreams() {
+  // Each stream is visited at most once, streams still blocked are requeued.
+  for (auto n = blocked_.size(); n && conn_send_window_ > 0; --n) {
+    auto id = blocked_.front();
+    blocked_.pop_front();
+    auto iter = streams_.find(id);
+    if (iter == streams_.end()) {
+      continue;
+    }
+    iter->second.blocked = false;
+    FlushStreamData(&iter->second);
+    ConsiderRemoveStream(id);
+  }
+}
+
+void Http2Session::ConsiderRemoveStream(std::uint32_t stream_id) {
+  auto iter = streams_.find(stream_id);
+  if (iter != streams_.end() && iter->second.local_closed &&
+      iter->second.remote_closed) {
+    RemoveStream(iter);
+  }
+}
+
+void Http2Session::RemoveStream(
+    std::unordered_map<std::uint32_t, Stream>::iterator iter) {
+  streams_.erase(iter);
+  if (!server_side_) {
+    OpenQueuedStreams();  // A slot is freed.
+  }
+}
+
+void Http2Session::WriteInitialFrames() {
+  std::string settings;
+  if (server_side_) {
+    AppendSetting(&settings, kSettingsMaxConcurrentStreams,
+                  local_max_concurrent_streams_);
+  } else {
+    AppendSetting(&settings, kSettingsEnablePush, 0);
+  }
+  AppendSetting(&settings, kSettingsInitialWindowSize, local_stream_window_);
+  WriteFrame(kSettings, 0, 0, settings);
+
+  // The connection window can only be enlarged by WINDOW_UPDATE.
+  conn_recv_window_ = local_connection_window_;
+  if (local_connection_window_ > kDefaultWindow) {
+    WriteWindowUpdate(0, local_connection_window_ - kDefaultWindow);
+  }
+}
+
+void Http2Session::WriteFrameHeader(std::size_t length, std::uint8_t type,
+                                    std::uint8_t flags,
+                                    std::uint32_t stream_id) {
+  std::string header;
+  header.push_back(static_cast<char>(length >> 16));
+  AppendUInt16(&header, length);
+  header.push_back(static_cast<char>(type));
+  header.push_back(static_cast<char>(flags));
+  AppendUInt32(&header, stream_id);
+  pending_.Append(CreateBufferSlow(header));
+}
+
+void Http2Session::WriteFrame(std::uint8_t type, std::uint8_t flags,
+                              std::uint32_t stream_id,
+                              std::string_view payload) {
+  WriteFrameHeader(payload.size(), type, flags, stream_id);
+  if (!payload.empty()) {
+    pending_.Append(CreateBufferSlow(payload));
+  }
+}
+
+void Http2Session::WriteWindowUpdate(std::uint32_t stream_id,
+                                     std::uint32_t increment) {
+  std::string payload;
+  AppendUInt32(&payload, increment);
+  WriteFrame(kWindowUpdate, 0, stream_id, payload);
+}
+
+void Http2Session::WriteRstStream(std::uint32_t stream_id,
+                                  std::uint32_t error_code) {
+  std::string payload;
+  AppendUInt32(&payload, error_code);
+  WriteFrame(kRstStream, 0, stream_id, payload);
+}
+
+Http2Session::CutStatus Http2Session::ConnectionError(
+    std::uint32_t error_code, std::string_view reason) {
+  FLARE_LOG_WARNING_EVERY_SECOND("HTTP/2 connection error {}: {}", error_code,
+                                 reason);
+  std::string payload;
+  AppendUInt32(&payload, server_side_ ? last_stream_id_ : 0);
+  AppendUInt32(&payload, error_code);
+  WriteFrame(kGoAway, 0, 0, payload);
+  return CutStatus::Error;
+}
+
+}  // namespace flare::http
@@ -0,0 +1,259 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_PROTOCOL_HTTP_HTTP2_SESSION_H_
+#define FLARE_RPC_PROTOCOL_HTTP_HTTP2_SESSION_H_
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "flare/base/buffer.h"
+#include "flare/net/http/http_headers.h"
+
+struct nghttp2_hd_deflater;
+struct nghttp2_hd_inflater;
+
+namespace flare::http {
+
+// State of an HTTP/2 (RFC 7540) connection: framing, HPACK, stream lifecycle
+// and flow control. It's shared by protocols (`Http2Protocol`, HTTP/2 variant
+// of `ProtoOverHttpProtocol`) that carry their own messages over HTTP/2.
+//
+// Only HTTP/2 over cleartext TCP with prior knowledge (`h2c`, RFC 7540 Section
+// 3.4) is supported. `Upgrade: h2c`, TLS (ALPN), server push and priorities
+// are not.
+//
+// Messages are delivered to the user only after they're fully received
+// (`END_STREAM` is seen). Flow control windows are granted as soon as DATA is
+// received, so they don't throttle the peer beyond what's buffered here.
+//
+// This class is thread-safe.
+class Http2Session {
+ public:
+  struct PseudoHeaders {
+    std::string method;  // Requests only.
+    std::string scheme;
+    std::string authority;
+    std::string path;
+    int status = 0;  // Responses only.
+  };
+
+  struct Message {
+    // On server side, this is the stream ID. On client side this is the
+    // correlation ID given to `WriteMessage`.
+    std::uint64_t correlation_id;
+
+    // Set if the stream was reset before it completes (client side only),
+    // either by the peer or by us (e.g., the peer is going away before the
+    // request is processed). Nothing else is meaningful in this case.
+    bool reset = false;
+    std::uint32_t reset_error_code = 0;
+
+    PseudoHeaders pseudo_headers;
+    HttpHeaders headers;  // Trailers, if any, are appended here.
+    NoncontiguousBuffer body;
+  };
+
+  enum class CutStatus { Cut, NeedMore, Error };
+
+  enum class PeekStatus {
+    NeedMore,    // More bytes are needed to tell.
+    Mismatch,    // Not a (prior-knowledge) HTTP/2 connection.
+    Identified,  // Headers of the first request is returned.
+    Error
+  };
+
+  explicit Http2Session(bool server_side);
+  ~Http2Session();
+
+  // Inspect the bytes received on a server-side connection without consuming
+  // them. If headers of the first request are available, they're returned.
+  //
+  // This is used by protocols sharing the same port to decide whom the
+  // connection belongs to.
+  static PeekStatus PeekFirstRequest(const NoncontiguousBuffer& buffer,
+                                     PseudoHeaders* pseudo_headers,
+                                     HttpHeaders* headers);
+
+  // Process frames in `buffer` until a message is fully received. Frames
+  // consumed are removed from `buffer`, and bytes to be sent in reply to them
+  // (SETTINGS ACK, WINDOW_UPDATE, ...) can be retrieved via
+  // `TryGetPendingBytes`.
+  CutStatus TryCutMessage(NoncontiguousBuffer* buffer, Message* message);
+
+  // Serialize a message (a request on client side, a response on server side)
+  // into `buffer`. Bytes pending in this session are prepended.
+  //
+  // On client side a new stream is opened, and the response will be returned
+  // with `correlation_id`. On server side `correlation_id` is the stream ID
+  // the request was received on.
+  //
+  // Body that cannot be sent due to flow control is kept, and is sent (via
+  // `TryGetPendingBytes`) once the peer grants us more window. Likewise, on
+  // client side, requests beyond the peer's `SETTINGS_MAX_CONCURRENT_STREAMS`
+  // are queued until other streams complete.
+  //
+  // Returns `false` if the message is dropped (e.g., the stream has been reset
+  // by the peer, or the peer is going away). Nothing is written to `buffer` in
+  // this case, bytes pending are left for `TryGetPendingBytes`.
+  bool WriteMessage(std::uint64_t correlation_id,
+                    const PseudoHeaders& pseudo_headers,
+                    const HttpHeaders& headers, NoncontiguousBuffer body,
+                    NoncontiguousBuffer* buffer);
+
+  // Move bytes that should be sent to the peer into `buffer`, if any.
+  bool TryGetPendingBytes(NoncontiguousBuffer* buffer);
+
+  // Abandon the stream identified by `correlation_id` (@sa: `Message`): The
+  // peer is told so via RST_STREAM (retrieved by `TryGetPendingBytes`), and
+  // whatever received on the stream afterwards is ignored. Requests that have
+  // not been sent yet are simply dropped.
+  //
+  // This is used for requests that won't be responded to (server side), and
+  // calls whose response is not of interest any more (client side).
+  void ResetStream(std::uint64_t correlation_id);
+
+  // Client side only. Returns `false` once no more stream can be opened on
+  // this connection (e.g., GOAWAY is received).
+  bool AcceptsNewStreams();
+
+ private:
+  struct Stream {
+    std::uint32_t id;
+    std::uint64_t correlation_id;
+    bool headers_received = false;  // Final (i.e., non-1xx) headers.
+    bool remote_closed = false;
+    bool local_closed = false;
+    bool blocked = false;  // In `blocked_`.
+    std::int64_t send_window;
+    std::int64_t recv_window;
+    PseudoHeaders pseudo_headers;
+    HttpHeaders headers;
+    NoncontiguousBuffer body;
+    // Body not sent yet due to flow control. `END_STREAM` is sent with its
+    // last byte.
+    NoncontiguousBuffer pending_data;
+  };
+
+  // Request waiting for the peer's concurrency limit (client side only).
+  struct QueuedRequest {
+    std::uint64_t correlation_id;
+    PseudoHeaders pseudo_headers;
+    HttpHeaders headers;
+    NoncontiguousBuffer body;
+  };
+
+  CutStatus ProcessFrame(std::uint8_t type, std::uint8_t flags,
+                         std::uint32_t stream_id, NoncontiguousBuffer payload,
+                         Message* message);
+  CutStatus OnData(std::uint8_t flags, std::uint32_t stream_id,
+                   NoncontiguousBuffer payload, Message* message);
+  CutStatus OnHeaders(std::uint8_t flags, std::uint32_t stream_id,
+                      std::string_view payload, Message* message);
+  CutStatus OnHeaderBlock(Message* message);
+  CutStatus OnSettings(std::uint8_t flags, std::uint32_t stream_id,
+                       std::string_view payload);
+  CutStatus OnPing(std::uint8_t flags, std::uint32_t stream_id,
+                   std::string_view payload);
+  CutStatus OnGoAway(std::uint32_t stream_id, std::string_view payload);
+  CutStatus OnWindowUpdate(std::uint32_t stream_id, std::string_view payload);
+  CutStatus OnRstStream(std::uint32_t stream_id, std::string_view payload,
+                        Message* message);
+
+  // Returns `true` if a message is ready for delivery.
+  bool OnStreamEnd(Stream* stream, Message* message);
+
+  // Client side only.
+  bool CanOpenStream() const;
+  void OpenStream(std::uint64_t correlation_id,
+                  const PseudoHeaders& pseudo_headers,
+                  const HttpHeaders& headers, NoncontiguousBuffer body);
+  // Open streams for queued requests as the peer's concurrency limit permits.
+  // If no more stream can be opened, they're failed instead.
+  void OpenQueuedStreams();
+  // Fail the call locally, as if the stream is refused by the peer.
+  void FailCall(std::uint64_t correlation_id);
+
+  bool DecodeHeaderBlock(std::string_view block, PseudoHeaders* pseudo_headers,
+                         HttpHeaders* headers);
+  void WriteHeaders(std::uint32_t stream_id,
+                    const PseudoHeaders& pseudo_headers,
+                    const HttpHeaders& headers, bool end_stream);
+
+  // Send as much `pending_data` as flow control permits.
+  void FlushStreamData(Stream* stream);
+  void FlushBlockedStreams();
+  void ConsiderRemoveStream(std::uint32_t stream_id);
+  void RemoveStream(std::unordered_map<std::uint32_t, Stream>::iterator iter);
+
+  void WriteInitialFrames();
+  void WriteFrameHeader(std::size_t length, std::uint8_t type,
+                        std::uint8_t flags, std::uint32_t stream_id);
+  void WriteFrame(std::uint8_t type, std::uint8_t flags,
+                  std::uint32_t stream_id, std::string_view payload);
+  void WriteWindowUpdate(std::uint32_t stream_id, std::uint32_t increment);
+  void WriteRstStream(std::uint32_t stream_id, std::uint32_t error_code);
+  CutStatus ConnectionError(std::uint32_t error_code, std::string_view reason);
+
+ private:
+  const bool server_side_;
+  std::mutex lock_;
+  nghttp2_hd_deflater* deflater_ = nullptr;
+  nghttp2_hd_inflater* inflater_ = nullptr;
+
+  bool peeking_ = false;       // @sa: `PeekFirstRequest`.
+  bool preface_seen_ = false;  // Server side only.
+  bool goaway_seen_ = false;
+  NoncontiguousBuffer pending_;  // Bytes to be sent.
+
+  // HEADERS (and CONTINUATION) being received.
+  std::uint32_t continuing_stream_ = 0;
+  std::uint8_t continuing_flags_ = 0;
+  std::string header_block_;
+
+  // Our settings.
+  std::int64_t local_stream_window_;
+  std::int64_t local_connection_window_;
+  std::uint32_t local_max_concurrent_streams_;
+
+  // The peer's settings.
+  std::int64_t peer_initial_window_ = 65535;
+  std::uint32_t peer_max_frame_size_ = 16384;
+  std::uint32_t peer_max_concurrent_streams_ = 0xffff'ffff;  // Unlimited.
+
+  // Flow control windows of the connection.
+  std::int64_t conn_send_window_ = 65535;
+  std::int64_t conn_recv_window_ = 65535;
+
+  // Last stream ID received (server side) or allocated (client side).
+  std::uint32_t last_stream_id_ = 0;
+  std::unordered_map<std::uint32_t, Stream> streams_;
+
+  // Streams with `pending_data`. Streams that have gone are skipped lazily.
+  std::deque<std::uint32_t> blocked_;
+
+  // Client side only.
+  std::deque<QueuedRequest> queued_;
+  // Messages ready for delivery without further bytes from the peer (calls
+  // failed locally, @sa: `FailCall`).
+  std::deque<Message> ready_;
+};
+
+}  // namespace flare::http
+
+#endif  // FLARE_RPC_PROTOCOL_HTTP_HTTP2_SESSION_H_
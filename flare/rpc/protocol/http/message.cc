@@ -26,7 +26,7 @@ HttpRequestMessage::HttpRequestMessage(HttpRequest http_request)
 }
 
 std::uint64_t HttpRequestMessage::GetCorrelationId() const noexcept {
-  return 0;
+  return correlation_id_;
 }
 
 Message::Type HttpRequestMessage::GetType() const noexcept {
@@ -41,7 +41,7 @@ HttpResponseMessage::HttpResponseMessage(HttpResponse http_response)
 }
 
 std::uint64_t HttpResponseMessage::GetCorrelationId() const noexcept {
-  return 0;  // 0 is regard as a invalid rpc sequence number.
+  return correlation_id_;  // 0 unless set (by HTTP/2).
 }
 
 Message::Type HttpResponseMessage::GetType() const noexcept {
@@ -60,6 +60,10 @@ class HttpRequestMessage : public HttpBaseMessage {
   std::uint64_t GetCorrelationId() const noexcept override;
   Type GetType() const noexcept override;
 
+  // Only meaningful for multiplexed protocols (i.e., HTTP/2), where it
+  // identifies the stream.
+  void set_correlation_id(std::uint64_t id) noexcept { correlation_id_ = id; }
+
   HttpHeaders* headers() override { return request()->headers(); }
   NoncontiguousBuffer* noncontiguous_body() override {
     return request()->noncontiguous_body();
@@ -77,6 +81,7 @@ class HttpRequestMessage : public HttpBaseMessage {
   }
 
  private:
+  std::uint64_t correlation_id_ = 0;
   HttpRequest http_request_;
 };
 
@@ -91,6 +96,9 @@ class HttpResponseMessage : public HttpBaseMessage {
   std::uint64_t GetCorrelationId() const noexcept override;
   Type GetType() const noexcept override;
 
+  // Must match the request's if the protocol is multiplexed (HTTP/2).
+  void set_correlation_id(std::uint64_t id) noexcept { correlation_id_ = id; }
+
   HttpHeaders* headers() override { return response()->headers(); }
   NoncontiguousBuffer* noncontiguous_body() override {
     return response()->noncontiguous_body();
@@ -108,6 +116,7 @@ class HttpResponseMessage : public HttpBaseMessage {
   }
 
  private:
+  std::uint64_t correlation_id_ = 0;
   HttpResponse http_response_;
 };
 
@@ -84,7 +84,9 @@ void CompressResponseIfNecessary(const HttpRequest& request,
 }
 
 void FillMissingHeaders(const HttpRequest& request, HttpResponse* response) {
-  if (!response->headers()->TryGet(kConnection)) {
+  // `Connection` is meaningless (and prohibited) in HTTP/2.
+  if (request.version() != HttpVersion::V_2 &&
+      !response->headers()->TryGet(kConnection)) {
     if (auto opt = request.headers()->TryGet(kConnection); opt) {
       response->headers()->Append(std::string(kConnection), std::string(*opt));
     } else {
@@ -206,6 +208,9 @@ StreamService::ProcessingStatus Service::FastCall(
   auto&& http_response = http_response_msg.response();
   HttpServerContext http_context;
 
+  // Used by HTTP/2 for locating the stream.
+  http_response_msg.set_correlation_id(http_request_msg->GetCorrelationId());
+
   http_context.remote_peer = context->remote_peer;
   http_context.received_at = TimestampFromTsc(context->received_tsc);
   http_context.dispatched_at = TimestampFromTsc(context->dispatched_tsc);
@@ -238,6 +243,11 @@ StreamService::ProcessingStatus Service::FastCall(
 
   CompleteBinlogPostOperation(*http_request, *http_response, http_context);
 
+  // HTTP/2 connections are multiplexed, they're never closed on a per-request
+  // basis.
+  if (http_request->version() == HttpVersion::V_2) {
+    return ProcessingStatus::Processed;
+  }
   return IEquals(http_response->headers()->TryGet("Connection").value_or(""),
                  "keep-alive")
              ? ProcessingStatus::Processed
@@ -32,4 +32,23 @@ class NullFactory : public MessageFactory {
 const MessageFactory* MessageFactory::null_factory =
     internal::LazyInit<NullFactory>();
 
+StreamWindowUpdateMessage::StreamWindowUpdateMessage(
+    std::uint64_t correlation_id, std::uint64_t increment)
+    : correlation_id_(correlation_id), increment_(increment) {
+  SetRuntimeTypeTo<StreamWindowUpdateMessage>();
+}
+
+std::uint64_t StreamWindowUpdateMessage::GetCorrelationId() const noexcept {
+  return correlation_id_;
+}
+
+Message::Type StreamWindowUpdateMessage::GetType() const noexcept {
+  return Type::Stream;
+}
+
+std::uint64_t StreamWindowUpdateMessage::GetStreamWindowUpdate()
+    const noexcept {
+  return increment_;
+}
+
 }  // namespace flare
@@ -90,6 +90,32 @@ class Message : public ExactMatchCastable {
 
   // Returns type of this message. @sa: `Type`.
   virtual Type GetType() const noexcept = 0;
+
+  // Streaming RPC flow control credit (in bytes) the sender of this message
+  // grants to us, for the stream this message belongs to. The first credit
+  // received in a stream is the initial window, later ones are increments.
+  //
+  // Protocols not supporting flow control need not override this.
+  virtual std::uint64_t GetStreamWindowUpdate() const noexcept { return 0; }
+};
+
+// A message carrying nothing but flow control credit of a stream. It's produced
+// and consumed by the framework, and is never delivered to the user.
+//
+// The framework only sends this message to a peer that has ever granted us
+// credit, therefore protocols not supporting flow control never see it.
+class StreamWindowUpdateMessage : public Message {
+ public:
+  StreamWindowUpdateMessage(std::uint64_t correlation_id,
+                            std::uint64_t increment);
+
+  std::uint64_t GetCorrelationId() const noexcept override;
+  Type GetType() const noexcept override;
+  std::uint64_t GetStreamWindowUpdate() const noexcept override;
+
+ private:
+  std::uint64_t correlation_id_;
+  std::uint64_t increment_;
 };
 
 // Factory for producing "special" messages.
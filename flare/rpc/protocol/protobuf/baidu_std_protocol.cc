@@ -20,6 +20,7 @@
 #include "flare/base/down_cast.h"
 #include "flare/base/endian.h"
 #include "flare/rpc/protocol/protobuf/baidu_std_rpc_meta.pb.h"
+#include "flare/rpc/protocol/protobuf/call_arena.h"
 #include "flare/rpc/protocol/protobuf/call_context.h"
 #include "flare/rpc/protocol/protobuf/call_context_factory.h"
 #include "flare/rpc/protocol/protobuf/compression.h"
@@ -182,6 +183,7 @@ bool BaiduStdProtocol::TryParse(std::unique_ptr<Message>* message,
   auto on_wire = cast<OnWireMessage>(message->get());
   auto&& brpc_meta = on_wire->meta;
   auto meta = object_pool::Get<rpc::RpcMeta>();
+  PooledPtr<CallArena> arena;  // Set if `unpack_to` is allocated on it.
   MaybeOwning<google::protobuf::Message> unpack_to;
   bool accept_msg_in_bytes;
 
@@ -209,6 +211,9 @@ bool BaiduStdProtocol::TryParse(std::unique_ptr<Message>* message,
     if (brpc_meta.request().has_log_id()) {
       req_meta.set_request_id(brpc_meta.request().log_id());
     }
+    if (brpc_meta.request().timeout_ms() > 0) {
+      req_meta.set_timeout(brpc_meta.request().timeout_ms());
+    }
     auto&& method = meta->request_meta().method_name();
     auto desc = ServiceMethodLocator::Instance()->TryGetMethodDesc(
         protocol_ids::standard, method);
@@ -227,8 +232,8 @@ bool BaiduStdProtocol::TryParse(std::unique_ptr<Message>* message,
     req_meta.set_acceptable_compression_algorithms(
         acceptable_compression_algorithms);
 
-    unpack_to = std::unique_ptr<google::protobuf::Message>(
-        desc->request_prototype->New());
+    unpack_to = NewMessageMaybeOnArena(*desc->request_prototype,
+                                       desc->use_arena, &arena);
     accept_msg_in_bytes = false;  // TODO(luobogao): Implementation.
   } else {
     FLARE_CHECK(brpc_meta.has_response());  // Checked before.
@@ -249,6 +254,7 @@ bool BaiduStdProtocol::TryParse(std::unique_ptr<Message>* message,
 
   auto parsed = std::make_unique<ProtoMessage>();
 
+  parsed->arena = std::move(arena);
   parsed->meta = std::move(meta);
   parsed->attachment = std::move(on_wire->attach);
   if (FLARE_UNLIKELY(accept_msg_in_bytes)) {
@@ -262,8 +268,8 @@ bool BaiduStdProtocol::TryParse(std::unique_ptr<Message>* message,
           parsed->meta->correlation_id());
       return false;
     }
-    NoncontiguousBufferInputStream nbis(buffer);
-    if (!unpack_to->ParseFromZeroCopyStream(&nbis)) {
+    if (!ParseWithZeroCopyBytes(std::move(*buffer), unpack_to.Get(),
+                                &parsed->zero_copy_bytes)) {
       FLARE_LOG_WARNING_EVERY_SECOND(
           "Failed to parse message (correlation id {}).",
           brpc_meta.correlation_id());
@@ -320,6 +326,9 @@ void BaiduStdProtocol::WriteMessage(const Message& message,
                   req_meta.method_name());
       breq_meta.set_service_name(req_meta.method_name().substr(0, last_dot));
       breq_meta.set_method_name(req_meta.method_name().substr(last_dot + 1));
+      if (req_meta.timeout()) {
+        breq_meta.set_timeout_ms(req_meta.timeout());
+      }
     }
     hdr.body_size = hdr.meta_size = brpc_meta.ByteSizeLong();
     FLARE_CHECK(brpc_meta.SerializeToZeroCopyStream(&nbos));
@@ -0,0 +1,83 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/protobuf/call_arena.h"
+
+#include <atomic>
+
+namespace flare::protobuf {
+
+namespace {
+
+constexpr std::size_t kMinInitialBlockSize = 4096;
+constexpr std::size_t kMaxInitialBlockSize = 1024 * 1024;
+
+// Exponentially-weighted moving average of bytes used by recent calls. It's
+// updated in a racy way (w/o CAS), it's only a hint anyway.
+std::atomic<std::size_t> recent_usage{kMinInitialBlockSize};
+
+std::size_t GetDesiredInitialBlockSize() {
+  auto usage = recent_usage.load(std::memory_order_relaxed);
+  auto desired = usage + usage / 4;  // Leave some headroom.
+  std::size_t size = kMinInitialBlockSize;
+  while (size < desired && size < kMaxInitialBlockSize) {
+    size *= 2;
+  }
+  return size;
+}
+
+}  // namespace
+
+CallArena::CallArena() { Reinitialize(GetDesiredInitialBlockSize()); }
+
+void CallArena::OnGet() {
+  auto desired = GetDesiredInitialBlockSize();
+  // Shrink the initial block only if it's way too large, so that we don't
+  // thrash on fluctuation.
+  if (desired > initial_block_size_ || desired * 4 <= initial_block_size_) {
+    Reinitialize(desired);
+  }
+}
+
+void CallArena::OnPut() {
+  auto used = arena_->SpaceUsed();
+  auto usage = recent_usage.load(std::memory_order_relaxed);
+  recent_usage.store(usage - usage / 8 + used / 8, std::memory_order_relaxed);
+
+  // Objects are destroyed and all blocks except for the initial one are freed.
+  arena_->Reset();
+}
+
+void CallArena::Reinitialize(std::size_t size) {
+  arena_ = std::nullopt;  // Must be destroyed before its initial block.
+  initial_block_.reset(new char[size]);  // Not zero-initialized.
+  initial_block_size_ = size;
+
+  google::protobuf::ArenaOptions opts;
+  opts.initial_block = initial_block_.get();
+  opts.initial_block_size = initial_block_size_;
+  arena_.emplace(opts);
+}
+
+MaybeOwning<google::protobuf::Message> NewMessageMaybeOnArena(
+    const google::protobuf::Message& prototype, bool use_arena,
+    PooledPtr<CallArena>* arena) {
+  if (!use_arena) {
+    return MaybeOwning(owning, prototype.New());
+  }
+  *arena = object_pool::Get<CallArena>();
+  return MaybeOwning(non_owning, (*arena)->New(prototype));
+}
+
+}  // namespace flare::protobuf
@@ -0,0 +1,104 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_PROTOCOL_PROTOBUF_CALL_ARENA_H_
+#define FLARE_RPC_PROTOCOL_PROTOBUF_CALL_ARENA_H_
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <optional>
+
+#include "google/protobuf/arena.h"
+#include "google/protobuf/message.h"
+
+#include "flare/base/maybe_owning.h"
+#include "flare/base/object_pool.h"
+
+namespace flare::protobuf {
+
+// Arena for allocating messages (request & response) of a single RPC.
+//
+// For methods with large, deeply nested messages, allocating (and freeing)
+// sub-objects one by one can be costly. Allocating them from an arena and
+// dropping them altogether at the end of the call avoids that.
+//
+// Objects of this type are pooled (@sa: `PoolTraits<CallArena>`). The size of
+// the initial block of each arena is adjusted from recent usage, so that in
+// most cases the whole call is served by the initial block, without touching
+// `malloc` at all.
+class CallArena {
+ public:
+  CallArena();
+
+  // Arena to allocate messages from.
+  google::protobuf::Arena* Get() noexcept { return &*arena_; }
+
+  // Allocates a new message of the same type as `prototype` on this arena.
+  google::protobuf::Message* New(const google::protobuf::Message& prototype) {
+    return prototype.New(Get());
+  }
+
+  // Size of initial block of this arena.
+  std::size_t GetInitialBlockSize() const noexcept {
+    return initial_block_size_;
+  }
+
+ private:
+  friend struct PoolTraits<CallArena>;
+
+  // Called when this arena is retrieved from / returned to the pool.
+  void OnGet();
+  void OnPut();
+
+  // (Re)initialize `arena_` with an initial block of `size` bytes.
+  void Reinitialize(std::size_t size);
+
+ private:
+  std::unique_ptr<char[]> initial_block_;
+  std::size_t initial_block_size_ = 0;
+  std::optional<google::protobuf::Arena> arena_;
+};
+
+// Creates a new message of the same type as `prototype`.
+//
+// If `use_arena` is set, the message is allocated on a pooled `CallArena`,
+// which is returned via `arena`. In this case the message is NOT owned by the
+// resulting `MaybeOwning`, and is only valid as long as `*arena` is alive.
+MaybeOwning<google::protobuf::Message> NewMessageMaybeOnArena(
+    const google::protobuf::Message& prototype, bool use_arena,
+    PooledPtr<CallArena>* arena);
+
+}  // namespace flare::protobuf
+
+namespace flare {
+
+template <>
+struct PoolTraits<protobuf::CallArena> {
+  static constexpr auto kType = PoolType::MemoryNodeShared;
+  static constexpr auto kLowWaterMark = 128;
+  static constexpr auto kHighWaterMark =
+      std::numeric_limits<std::size_t>::max();
+  static constexpr auto kMaxIdle = std::chrono::seconds(10);
+  static constexpr auto kMinimumThreadCacheSize = 64;
+  static constexpr auto kTransferBatchSize = 64;
+
+  static void OnGet(protobuf::CallArena* p) { p->OnGet(); }
+  static void OnPut(protobuf::CallArena* p) { p->OnPut(); }
+};
+
+}  // namespace flare
+
+#endif  // FLARE_RPC_PROTOCOL_PROTOBUF_CALL_ARENA_H_
@@ -0,0 +1,65 @@
+// Copyright (C) 2019 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/protobuf/call_arena.h"
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/echo_service.pb.h"
+#include "flare/testing/main.h"
+
+namespace flare::protobuf {
+
+TEST(CallArena, NoArena) {
+  PooledPtr<CallArena> arena;
+  auto msg = NewMessageMaybeOnArena(testing::EchoRequest::default_instance(),
+                                    false, &arena);
+  ASSERT_FALSE(arena);
+  ASSERT_TRUE(msg.Get());
+  ASSERT_EQ(nullptr, msg->GetArena());
+}
+
+TEST(CallArena, OnArena) {
+  PooledPtr<CallArena> arena;
+  auto msg = NewMessageMaybeOnArena(testing::EchoRequest::default_instance(),
+                                    true, &arena);
+  ASSERT_TRUE(arena);
+  ASSERT_EQ(arena->Get(), msg->GetArena());
+  ASSERT_TRUE(dynamic_cast<testing::EchoRequest*>(msg.Get()));
+  static_cast<testing::EchoRequest*>(msg.Get())->set_body("hello");
+  ASSERT_EQ("hello", static_cast<testing::EchoRequest*>(msg.Get())->body());
+}
+
+TEST(CallArena, AdaptiveInitialBlock) {
+  std::size_t initial_size;
+  {
+    auto arena = object_pool::Get<CallArena>();
+    initial_size = arena->GetInitialBlockSize();
+  }
+
+  // Keep using much more space than the initial block.
+  for (int i = 0; i != 1000; ++i) {
+    auto arena = object_pool::Get<CallArena>();
+    arena->New(testing::EchoRequest::default_instance());
+    google::protobuf::Arena::CreateArray<char>(arena->Get(), initial_size * 4);
+  }
+
+  // The arena should have grown.
+  auto arena = object_pool::Get<CallArena>();
+  ASSERT_GT(arena->GetInitialBlockSize(), initial_size);
+}
+
+}  // namespace flare::protobuf
+
+FLARE_TEST_MAIN
@@ -74,13 +74,15 @@ std::size_t CompressBodyIfNeeded(const rpc::RpcMeta& meta,
   if (meta.has_compression_algorithm() &&
       meta.compression_algorithm() != rpc::COMPRESSION_ALGORITHM_NONE) {
     NoncontiguousBufferBuilder nbb;
-    if (WriteTo(msg.msg_or_buffer, &nbb)) {
+    if (WriteTo(msg.msg_or_buffer, &nbb) +
+        WriteZeroCopyBytes(msg.zero_copy_bytes, &nbb)) {
       return CompressBufferIfNeeded(meta, nbb.DestructiveGet(), builder);
     } else {
       return 0;
     }
   }
-  return WriteTo(msg.msg_or_buffer, builder);
+  return WriteTo(msg.msg_or_buffer, builder) +
+         WriteZeroCopyBytes(msg.zero_copy_bytes, builder);
 }
 
 std::size_t CompressBufferIfNeeded(const rpc::RpcMeta& meta,
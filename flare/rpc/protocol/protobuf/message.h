@@ -24,7 +24,9 @@
 #include "flare/base/maybe_owning.h"
 #include "flare/base/object_pool.h"
 #include "flare/rpc/protocol/message.h"
+#include "flare/rpc/protocol/protobuf/call_arena.h"
 #include "flare/rpc/protocol/protobuf/rpc_meta.pb.h"
+#include "flare/rpc/protocol/protobuf/zero_copy_bytes.h"
 
 namespace flare::protobuf {
 
@@ -72,10 +74,19 @@ struct ProtoMessage : Message {
   }
   Type GetType() const noexcept override;
 
+  // Set if the message body (`msg_or_buffer`) is allocated on an arena. It's
+  // declared first so that it outlives everything else in this message.
+  PooledPtr<CallArena> arena;
+
   PooledPtr<rpc::RpcMeta> meta;
   MessageOrBytes msg_or_buffer;
   NoncontiguousBuffer attachment;
 
+  // For incoming messages, fields cut off from the body when parsing it. For
+  // outgoing ones, fields to be written after `msg_or_buffer`. @sa:
+  // `zero_copy_bytes.h`.
+  ZeroCopyBytesFields zero_copy_bytes;
+
   // Set if `attachment` is already compressed using algorithm specified in
   // `meta`.
   bool precompressed_attachment = false;
@@ -14,12 +14,15 @@
 
 #include "flare/rpc/protocol/protobuf/poppy_protocol.h"
 
+#include <algorithm>
+#include <limits>
 #include <string>
 
 #include "flare/base/buffer/zero_copy_stream.h"
 #include "flare/base/down_cast.h"
 #include "flare/base/endian.h"
 #include "flare/base/string.h"
+#include "flare/rpc/protocol/protobuf/call_arena.h"
 #include "flare/rpc/protocol/protobuf/call_context.h"
 #include "flare/rpc/protocol/protobuf/call_context_factory.h"
 #include "flare/rpc/protocol/protobuf/compression.h"
@@ -165,6 +168,7 @@ bool PoppyProtocol::TryParse(std::unique_ptr<Message>* message,
   auto on_wire = cast<OnWireMessage>(message->get());
   auto&& poppy_meta = on_wire->meta;
   auto meta = object_pool::Get<rpc::RpcMeta>();
+  PooledPtr<CallArena> arena;  // Set if `unpack_to` is allocated on it.
   MaybeOwning<google::protobuf::Message> unpack_to;
   bool accept_msg_in_bytes;
 
@@ -187,6 +191,10 @@ bool PoppyProtocol::TryParse(std::unique_ptr<Message>* message,
   if (server_side_) {
     auto&& req_meta = *meta->mutable_request_meta();
     req_meta.set_method_name(poppy_meta.method());
+    if (poppy_meta.timeout() > 0) {
+      req_meta.set_timeout(std::min<std::int64_t>(
+          poppy_meta.timeout(), std::numeric_limits<std::uint32_t>::max()));
+    }
     auto&& method = meta->request_meta().method_name();
     auto desc = ServiceMethodLocator::Instance()->TryGetMethodDesc(
         protocol_ids::standard, method);
@@ -206,8 +214,8 @@ bool PoppyProtocol::TryParse(std::unique_ptr<Message>* message,
     req_meta.set_acceptable_compression_algorithms(
         kAcceptableCompressionAlgorithms);
 
-    unpack_to = std::unique_ptr<google::protobuf::Message>(
-        desc->request_prototype->New());
+    unpack_to = NewMessageMaybeOnArena(*desc->request_prototype,
+                                       desc->use_arena, &arena);
     accept_msg_in_bytes = false;  // TODO(luobogao): Implementation.
   } else {
     auto ctx = cast<ProactiveCallContext>(controller);
@@ -229,6 +237,7 @@ bool PoppyProtocol::TryParse(std::unique_ptr<Message>* message,
 
   auto parsed = std::make_unique<ProtoMessage>();
 
+  parsed->arena = std::move(arena);
   parsed->meta = std::move(meta);
   if (FLARE_UNLIKELY(accept_msg_in_bytes)) {
     parsed->msg_or_buffer = std::move(on_wire->body);
@@ -241,8 +250,8 @@ bool PoppyProtocol::TryParse(std::unique_ptr<Message>* message,
           parsed->meta->correlation_id());
       return false;
     }
-    NoncontiguousBufferInputStream nbis(buffer);
-    if (!unpack_to->ParseFromZeroCopyStream(&nbis)) {
+    if (!ParseWithZeroCopyBytes(std::move(*buffer), unpack_to.Get(),
+                                &parsed->zero_copy_bytes)) {
       FLARE_LOG_WARNING_EVERY_SECOND(
           "Failed to parse message (correlation id {}).",
           poppy_meta.sequence_id());
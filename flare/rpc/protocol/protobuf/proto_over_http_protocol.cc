@@ -93,8 +93,43 @@ FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG(
     "http+pb", ProtoOverHttpProtocol,
     ProtoOverHttpProtocol::ContentType::kProtobuf, true);
 
+// Same as above, carried by HTTP/2 (`h2c`).
+FLARE_RPC_REGISTER_CLIENT_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+gdt-json", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kApplicationJson, false, true);
+FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+gdt-json", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kApplicationJson, true, true);
+FLARE_RPC_REGISTER_CLIENT_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+proto3-json", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kProto3Json, false, true);
+FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+proto3-json", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kProto3Json, true, true);
+FLARE_RPC_REGISTER_CLIENT_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+pb-text", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kDebugString, false, true);
+FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+pb-text", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kDebugString, true, true);
+FLARE_RPC_REGISTER_CLIENT_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+pb", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kProtobuf, false, true);
+FLARE_RPC_REGISTER_SERVER_SIDE_STREAM_PROTOCOL_ARG(
+    "http2+pb", ProtoOverHttpProtocol,
+    ProtoOverHttpProtocol::ContentType::kProtobuf, true, true);
+
 namespace {
 
+// For non-successful responses, failure should be reflected on HTTP status
+// code.
+const std::unordered_map<int, std::pair<int, std::string>> kHttpStatusMapping =
+    {
+        {rpc::STATUS_SUCCESS, {200, "OK"}},
+        {rpc::STATUS_METHOD_NOT_FOUND, {404, "Not Found"}},
+        {rpc::STATUS_SERVICE_NOT_FOUND, {404, "Not Found"}},
+};
+
 // This message is generated by `TryCutMessage`, and will soon be fully parsed
 // by `TryParse`.
 class OnWireMessage : public Message {
@@ -301,8 +336,12 @@ static StreamProtocol::Characteristics characteristics_debug_str = {
 static StreamProtocol::Characteristics characteristics_proto = {
     .name = "Protocol Buffers", .no_connection_reuse_in_streaming_rpcs = true};
 
+// Shared by all content types.
+static StreamProtocol::Characteristics characteristics_http2 = {
+    .name = "Protocol Buffers (HTTP/2)", .stateful_writes = true};
+
 ProtoOverHttpProtocol::ProtoOverHttpProtocol(ContentType content_type,
-                                             bool server_side)
+                                             bool server_side, bool http2)
     : content_type_(content_type), server_side_(server_side) {
   static const std::unordered_map<
       ContentType, std::pair<std::string, const Characteristics*>>
@@ -317,6 +356,10 @@ ProtoOverHttpProtocol::ProtoOverHttpProtocol(ContentType content_type,
            {kContentTypeProtobuf, &characteristics_proto}}};
   std::tie(expecting_content_type_, characteristics_) =
       kExpectedContentTypes.at(content_type_);
+  if (http2) {
+    characteristics_ = &characteristics_http2;
+    http2_session_ = std::make_unique<http::Http2Session>(server_side_);
+  }
 }
 
 const StreamProtocol::Characteristics&
@@ -334,6 +377,9 @@ const ControllerFactory* ProtoOverHttpProtocol::GetControllerFactory() const {
 
 StreamProtocol::MessageCutStatus ProtoOverHttpProtocol::TryCutMessage(
     NoncontiguousBuffer* buffer, std::unique_ptr<Message>* message) {
+  if (http2_session_) {
+    return TryCutHttp2Message(buffer, message);
+  }
   if (current_stream_) {  // A stream is being parsed.
     return TryKeepParsingStream(buffer, message);
   }
@@ -363,33 +409,9 @@ StreamProtocol::MessageCutStatus ProtoOverHttpProtocol::TryCutMessage(
   //
   // This also helps us to parse messages responded by server that does not fill
   // `Content-Type` (presumably due to their QoI).
-  if (server_side_) {
-    auto content_type = TryGetHeaderRoughly(header, kContentType);
-    if (FLARE_LIKELY(content_type == expecting_content_type_)) {
-      // NOTHING.
-    } else if (expecting_content_type_ == kContentTypeApplicationJson) {
-      // `kContentTypeApplicationJson` is special in that it uses standard
-      // content type `application/json`.
-      //
-      // Per spec, `charset` is allowed to be specified for this content type.
-      // Therefore, in case the content-type isn't a exact-match, we need to do
-      // extra check for possible `charset` at the tail.
-
-      // This is likely to be an exact match if `charset` is specified by the
-      // client. If this matches, we don't have to do heavy-lifting string parse
-      // of `Content-Type`.
-      constexpr auto kApplicationJsonCharsetUtf8 =
-          "application/json; charset=utf-8"sv;
-      if (FLARE_LIKELY(content_type == kApplicationJsonCharsetUtf8)) {
-        // NOTHING.
-      } else if (FLARE_LIKELY(IsContentTypeApplicationJsonSlow(content_type))) {
-        // NOTHING.
-      } else {
-        return MessageCutStatus::ProtocolMismatch;
-      }
-    } else {
-      return MessageCutStatus::ProtocolMismatch;
-    }
+  if (server_side_ &&
+      !IsExpectedContentType(TryGetHeaderRoughly(header, kContentType))) {
+    return MessageCutStatus::ProtocolMismatch;
   }
 
   // Translate the headers into `RpcMeta` first.
@@ -520,6 +542,9 @@ void ProtoOverHttpProtocol::WriteMessage(const Message& message,
                               controller->IsTraceForciblySampled(),
                           "Passing tracing context is not supported by "
                           "Protocol-Buffers-over-HTTP protocol.");
+  if (http2_session_) {
+    return WriteHttp2Message(message, buffer);
+  }
 
   if (auto msg = dyn_cast<ProtoMessage>(&message)) {
     FLARE_LOG_ERROR_IF_ONCE(
@@ -553,6 +578,195 @@ void ProtoOverHttpProtocol::WriteMessage(const Message& message,
   FLARE_CHECK(0, "Unexpected message type [{}].", GetTypeName(message));
 }
 
+bool ProtoOverHttpProtocol::TryGetPendingBytes(NoncontiguousBuffer* buffer) {
+  return http2_session_ && http2_session_->TryGetPendingBytes(buffer);
+}
+
+void ProtoOverHttpProtocol::OnCallAbandoned(std::uint64_t correlation_id) {
+  if (http2_session_) {
+    http2_session_->ResetStream(correlation_id);
+  }
+}
+
+bool ProtoOverHttpProtocol::AcceptsNewCalls() {
+  return !http2_session_ || http2_session_->AcceptsNewStreams();
+}
+
+bool ProtoOverHttpProtocol::IsExpectedContentType(
+    std::string_view content_type) const {
+  if (FLARE_LIKELY(content_type == expecting_content_type_)) {
+    return true;
+  } else if (expecting_content_type_ == kContentTypeApplicationJson) {
+    // `kContentTypeApplicationJson` is special in that it uses standard
+    // content type `application/json`.
+    //
+    // Per spec, `charset` is allowed to be specified for this content type.
+    // Therefore, in case the content-type isn't a exact-match, we need to do
+    // extra check for possible `charset` at the tail.
+
+    // This is likely to be an exact match if `charset` is specified by the
+    // client. If this matches, we don't have to do heavy-lifting string parse
+    // of `Content-Type`.
+    constexpr auto kApplicationJsonCharsetUtf8 =
+        "application/json; charset=utf-8"sv;
+    return content_type == kApplicationJsonCharsetUtf8 ||
+           IsContentTypeApplicationJsonSlow(content_type);
+  }
+  return false;
+}
+
+ProtoOverHttpProtocol::MessageCutStatus
+ProtoOverHttpProtocol::TryCutHttp2Message(NoncontiguousBuffer* buffer,
+                                          std::unique_ptr<Message>* message) {
+  if (server_side_ && FLARE_UNLIKELY(!http2_identified_)) {
+    // Nothing is consumed until we're sure the connection is ours.
+    http::Http2Session::PseudoHeaders pseudo_headers;
+    HttpHeaders headers;
+    auto status = http::Http2Session::PeekFirstRequest(
+        *buffer, &pseudo_headers, &headers);
+    if (status == http::Http2Session::PeekStatus::NeedMore) {
+      return MessageCutStatus::NotIdentified;
+    } else if (status == http::Http2Session::PeekStatus::Mismatch) {
+      return MessageCutStatus::ProtocolMismatch;
+    } else if (status == http::Http2Session::PeekStatus::Error) {
+      return MessageCutStatus::Error;
+    }
+    if (pseudo_headers.method != "POST" ||
+        !StartsWith(pseudo_headers.path, kUriPrefix) ||
+        !IsExpectedContentType(headers.TryGet(kContentType).value_or(""))) {
+      return MessageCutStatus::ProtocolMismatch;
+    }
+    http2_identified_ = true;
+  }
+
+  http::Http2Session::Message msg;
+  auto rc = http2_session_->TryCutMessage(buffer, &msg);
+  if (rc == http::Http2Session::CutStatus::NeedMore) {
+    return MessageCutStatus::NeedMore;
+  } else if (rc == http::Http2Session::CutStatus::Error) {
+    return MessageCutStatus::Error;
+  }
+
+  auto meta = object_pool::Get<rpc::RpcMeta>();
+  meta->set_correlation_id(msg.correlation_id);
+  meta->set_method_type(rpc::METHOD_TYPE_SINGLE);
+  auto&& pseudo_headers = msg.pseudo_headers;
+
+  if (server_side_) {
+    if (pseudo_headers.method != "POST" ||
+        !StartsWith(pseudo_headers.path, kUriPrefix)) {
+      *message = std::make_unique<EarlyErrorMessage>(
+          msg.correlation_id, rpc::STATUS_FAILED, "Invalid request.");
+      return MessageCutStatus::Cut;
+    }
+    auto&& req_meta = *meta->mutable_request_meta();
+    req_meta.set_method_name(pseudo_headers.path.substr(kUriPrefix.size()));
+    if (auto timeout_opt =
+            msg.headers.TryGet<std::uint64_t>(kRpcHttpHeaderRpcTimeout)) {
+      req_meta.set_timeout(*timeout_opt);
+    }
+    auto desc = ServiceMethodLocator::Instance()->TryGetMethodDesc(
+        protocol_ids::standard, req_meta.method_name());
+    if (!desc) {
+      *message = std::make_unique<EarlyErrorMessage>(
+          msg.correlation_id, rpc::STATUS_METHOD_NOT_FOUND,
+          fmt::format("Method [{}] is not recognized.",
+                      req_meta.method_name()));
+      return MessageCutStatus::Cut;
+    }
+    if (IsClientStreamingMethod(desc->method_desc) ||
+        IsServerStreamingMethod(desc->method_desc)) {
+      *message = std::make_unique<EarlyErrorMessage>(
+          msg.correlation_id, rpc::STATUS_INVALID_TRANSFER_MODE,
+          "Streaming RPC is not supported over HTTP/2.");
+      return MessageCutStatus::Cut;
+    }
+  } else {
+    auto&& resp_meta = *meta->mutable_response_meta();
+    if (msg.reset) {
+      // The server refuses streams beyond its concurrency limit.
+      resp_meta.set_status(msg.reset_error_code == 0x7 /* REFUSED_STREAM */
+                               ? rpc::STATUS_OVERLOADED
+                               : rpc::STATUS_FAILED);
+      resp_meta.set_description(
+          fmt::format("HTTP/2 stream was reset by the server with error {}.",
+                      msg.reset_error_code));
+    } else if (pseudo_headers.status == 200) {
+      resp_meta.set_status(rpc::STATUS_SUCCESS);
+    } else {
+      // Unlike HTTP/1.1, we don't close the connection (which is shared by
+      // other calls) on malformed response.
+      resp_meta.set_status(static_cast<rpc::Status>(
+          msg.headers.TryGet<int>(kRpcHttpHeaderErrorCode)
+              .value_or(rpc::STATUS_FAILED)));
+      if (resp_meta.status() == rpc::STATUS_SUCCESS) {
+        resp_meta.set_status(rpc::STATUS_FAILED);
+      }
+      resp_meta.set_description(
+          std::string(msg.headers.TryGet(kRpcHttpHeaderErrorReason)
+                          .value_or(Format("HTTP status {}.",
+                                           pseudo_headers.status))));
+    }
+  }
+
+  *message =
+      std::make_unique<OnWireMessage>(std::move(meta), std::move(msg.body));
+  return MessageCutStatus::Cut;
+}
+
+void ProtoOverHttpProtocol::WriteHttp2Message(const Message& message,
+                                              NoncontiguousBuffer* buffer) {
+  http::Http2Session::PseudoHeaders pseudo_headers;
+  HttpHeaders headers;
+  NoncontiguousBuffer body;
+
+  headers.Append(kContentType, expecting_content_type_);
+  if (auto msg = dyn_cast<ProtoMessage>(&message)) {
+    FLARE_LOG_ERROR_IF_ONCE(
+        !msg->attachment.Empty(),
+        "Attachment is not supported by HTTP protocol. Dropped silently.");
+    if (FLARE_UNLIKELY(msg->GetType() != Message::Type::Single)) {
+      FLARE_LOG_ERROR_ONCE("Streaming RPC is not supported over HTTP/2.");
+      return;  // Dropped.
+    }
+    auto&& meta = *msg->meta;
+    if (server_side_) {
+      auto&& resp_meta = meta.response_meta();
+      auto iter = kHttpStatusMapping.find(resp_meta.status());
+      pseudo_headers.status =
+          iter != kHttpStatusMapping.end() ? iter->second.first : 500;
+      if (resp_meta.status() == rpc::STATUS_SUCCESS) {
+        body = SerializeMessage(*msg);
+      } else {
+        headers.Append(kRpcHttpHeaderErrorCode,
+                       std::to_string(resp_meta.status()));
+        if (resp_meta.has_description()) {
+          headers.Append(kRpcHttpHeaderErrorReason, resp_meta.description());
+        }
+      }
+    } else {
+      auto&& req_meta = meta.request_meta();
+      pseudo_headers.method = "POST";
+      pseudo_headers.scheme = "http";
+      pseudo_headers.path = kUriPrefix + req_meta.method_name();
+      if (req_meta.has_timeout()) {
+        headers.Append(kRpcHttpHeaderRpcTimeout,
+                       std::to_string(req_meta.timeout()));
+      }
+      body = SerializeMessage(*msg);
+    }
+  } else if (auto msg = dyn_cast<EarlyErrorMessage>(&message)) {
+    pseudo_headers.status =
+        msg->GetStatus() == rpc::STATUS_METHOD_NOT_FOUND ? 404 : 400;
+    body = CreateBufferSlow(msg->GetDescription());
+  } else {
+    FLARE_CHECK(0, "Unexpected message type [{}].", GetTypeName(message));
+  }
+  (void)http2_session_->WriteMessage(message.GetCorrelationId(),
+                                     pseudo_headers, headers, std::move(body),
+                                     buffer);
+}
+
 ProtoOverHttpProtocol::MessageCutStatus
 ProtoOverHttpProtocol::TryCutMessageFromChunkedEncoding(
     const std::string& header, PooledPtr<rpc::RpcMeta> meta,
@@ -757,13 +971,6 @@ void ProtoOverHttpProtocol::WriteRequest(const ProtoMessage& message,
 void ProtoOverHttpProtocol::WriteResponse(const ProtoMessage& message,
                                           NoncontiguousBuffer* buffer,
                                           Controller* controller) {
-  static const std::unordered_map<int, std::pair<int, std::string>>
-      kHttpStatusMapping = {
-          {rpc::STATUS_SUCCESS, {200, "OK"}},
-          {rpc::STATUS_METHOD_NOT_FOUND, {404, "Not Found"}},
-          {rpc::STATUS_SERVICE_NOT_FOUND, {404, "Not Found"}},
-      };
-
   auto&& meta = *message.meta;
   FLARE_CHECK(meta.has_response_meta());
   auto&& resp_meta = meta.response_meta();
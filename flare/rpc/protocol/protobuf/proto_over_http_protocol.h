@@ -15,11 +15,13 @@
 #ifndef FLARE_RPC_PROTOCOL_PROTOBUF_PROTO_OVER_HTTP_PROTOCOL_H_
 #define FLARE_RPC_PROTOCOL_PROTOBUF_PROTO_OVER_HTTP_PROTOCOL_H_
 
+#include <memory>
 #include <optional>
 #include <string>
 
 #include "flare/base/buffer.h"
 #include "flare/base/maybe_owning.h"
+#include "flare/rpc/protocol/http/http2_session.h"
 #include "flare/rpc/protocol/protobuf/call_context.h"
 #include "flare/rpc/protocol/protobuf/message.h"
 #include "flare/rpc/protocol/protobuf/rpc_meta.pb.h"
@@ -34,6 +36,10 @@ class HttpBaseMessage;
 namespace flare::protobuf {
 
 // Translates HTTP messages to `ProtoMessage`.
+//
+// If `http2` is set, messages are carried by HTTP/2 (`h2c` with prior
+// knowledge) instead of HTTP/1.1, and calls are multiplexed on the connection.
+// Streaming RPCs are not supported in this case.
 class ProtoOverHttpProtocol : public StreamProtocol {
  public:
   enum class ContentType {
@@ -43,7 +49,8 @@ class ProtoOverHttpProtocol : public StreamProtocol {
     kProtobuf
   };
 
-  ProtoOverHttpProtocol(ContentType content_type, bool server_side);
+  ProtoOverHttpProtocol(ContentType content_type, bool server_side,
+                        bool http2 = false);
 
   const Characteristics& GetCharacteristics() const override;
 
@@ -59,6 +66,10 @@ class ProtoOverHttpProtocol : public StreamProtocol {
   void WriteMessage(const Message& message, NoncontiguousBuffer* buffer,
                     Controller* controller) override;
 
+  bool TryGetPendingBytes(NoncontiguousBuffer* buffer) override;
+  void OnCallAbandoned(std::uint64_t correlation_id) override;
+  bool AcceptsNewCalls() override;
+
  private:
   enum class MetaParseStatus {
     Success,
@@ -71,6 +82,17 @@ class ProtoOverHttpProtocol : public StreamProtocol {
       const std::string& header, PooledPtr<rpc::RpcMeta> meta,
       NoncontiguousBuffer* buffer, std::unique_ptr<Message>* message);
 
+  // Tests if `content_type` is what we're expecting (i.e., the request is
+  // ours).
+  bool IsExpectedContentType(std::string_view content_type) const;
+
+  // Cuts message off from HTTP/2 frames, and translates it into `RpcMeta`.
+  MessageCutStatus TryCutHttp2Message(NoncontiguousBuffer* buffer,
+                                      std::unique_ptr<Message>* message);
+
+  // Repacks message to an HTTP/2 request / response.
+  void WriteHttp2Message(const Message& message, NoncontiguousBuffer* buffer);
+
   // Fill `meta` with info from `msg` and `base_msg`.
   MetaParseStatus TryExtractRpcMeta(const std::string& header,
                                     rpc::RpcMeta* meta) const;
@@ -131,6 +153,10 @@ class ProtoOverHttpProtocol : public StreamProtocol {
   std::string expecting_content_type_;  // Determined by `content_type_`.
   std::optional<rpc::RpcMeta> current_stream_;  // `std::nullopt` is no stream
                                                 // is currently being parsed.
+
+  // Non-null if the messages are carried by HTTP/2.
+  std::unique_ptr<http::Http2Session> http2_session_;
+  bool http2_identified_ = false;  // Server side only.
 };
 
 }  // namespace flare::protobuf
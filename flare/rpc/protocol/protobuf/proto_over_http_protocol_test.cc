@@ -303,6 +303,67 @@ TEST(ProtoOverHttpProtocol, MethodNotFound) {
   ASSERT_TRUE(!!dyn_cast<EarlyErrorMessage>(cut.get()));
 }
 
+TEST(ProtoOverHttpProtocol, Http2RoundTrip) {
+  ProtoOverHttpProtocol client_prot(
+      ProtoOverHttpProtocol::ContentType::kProtobuf, false, true),
+      server_prot(ProtoOverHttpProtocol::ContentType::kProtobuf, true, true);
+  NoncontiguousBuffer to_server, to_client;
+
+  auto req_meta = object_pool::Get<rpc::RpcMeta>();
+  req_meta->set_correlation_id(1);
+  req_meta->set_method_type(rpc::METHOD_TYPE_SINGLE);
+  req_meta->mutable_request_meta()->set_method_name(
+      "flare.testing.EchoService.Echo");
+  testing::EchoRequest req;
+  req.set_body("asdf");
+  ProactiveCallContext pcc;
+  pcc.accept_response_in_bytes = false;
+  pcc.expecting_stream = false;
+  pcc.method = dummy.GetDescriptor()->FindMethodByName("Echo");
+  client_prot.WriteMessage(
+      ProtoMessage(std::move(req_meta), MaybeOwning(non_owning, &req), {}),
+      &to_server, &pcc);
+
+  std::unique_ptr<Message> cut;
+  ASSERT_EQ(StreamProtocol::MessageCutStatus::Cut,
+            server_prot.TryCutMessage(&to_server, &cut));
+  EXPECT_TRUE(to_server.Empty());
+  auto passive_ctx = server_prot.GetControllerFactory()->Create(false);
+  ASSERT_TRUE(server_prot.TryParse(&cut, passive_ctx.get()));
+  auto parsed_req = cast<ProtoMessage>(cut.get());
+  EXPECT_EQ("flare.testing.EchoService.Echo",
+            parsed_req->meta->request_meta().method_name());
+  EXPECT_EQ("asdf", flare::down_cast<testing::EchoRequest>(
+                        std::get<1>(parsed_req->msg_or_buffer).Get())
+                        ->body());
+
+  // SETTINGS ACK, etc.
+  ASSERT_TRUE(server_prot.TryGetPendingBytes(&to_client));
+
+  auto resp_meta = object_pool::Get<rpc::RpcMeta>();
+  resp_meta->set_correlation_id(parsed_req->meta->correlation_id());
+  resp_meta->set_method_type(rpc::METHOD_TYPE_SINGLE);
+  resp_meta->mutable_response_meta()->set_status(rpc::STATUS_SUCCESS);
+  testing::EchoResponse resp;
+  resp.set_body("abcd");
+  NoncontiguousBuffer resp_bytes;
+  server_prot.WriteMessage(
+      ProtoMessage(std::move(resp_meta), MaybeOwning(non_owning, &resp), {}),
+      &resp_bytes, passive_ctx.get());
+  to_client.Append(std::move(resp_bytes));
+
+  testing::EchoResponse unpack_to;
+  pcc.response_ptr = &unpack_to;
+  ASSERT_EQ(StreamProtocol::MessageCutStatus::Cut,
+            client_prot.TryCutMessage(&to_client, &cut));
+  EXPECT_TRUE(to_client.Empty());
+  ASSERT_TRUE(client_prot.TryParse(&cut, &pcc));
+  auto parsed_resp = cast<ProtoMessage>(cut.get());
+  EXPECT_EQ(1, parsed_resp->meta->correlation_id());
+  EXPECT_EQ(rpc::STATUS_SUCCESS, parsed_resp->meta->response_meta().status());
+  EXPECT_EQ("abcd", unpack_to.body());
+}
+
 }  // namespace flare::protobuf
 
 FLARE_TEST_MAIN
@@ -21,6 +21,7 @@
 #include "flare/base/down_cast.h"
 #include "flare/base/likely.h"
 #include "flare/base/overloaded.h"
+#include "flare/rpc/protocol/protobuf/call_arena.h"
 #include "flare/rpc/protocol/protobuf/call_context.h"
 #include "flare/rpc/protocol/protobuf/call_context_factory.h"
 #include "flare/rpc/protocol/protobuf/detail/qzone_header.h"
@@ -215,7 +216,8 @@ bool QZoneProtocol::TryParse(std::unique_ptr<Message>* message,
     // req_meta.set_method_name(desc->normalized_method_name);
     req_meta.mutable_method_name()->assign(desc->normalized_method_name.begin(),
                                            desc->normalized_method_name.end());
-    unpack_to = MaybeOwning(owning, desc->request_prototype->New());
+    unpack_to = NewMessageMaybeOnArena(*desc->request_prototype,
+                                       desc->use_arena, &msg->arena);
   } else {
     // For client side, we have no idea if it belongs to a stream. So we believe
     // what we were told.
@@ -251,8 +253,9 @@ bool QZoneProtocol::TryParse(std::unique_ptr<Message>* message,
     msg->msg_or_buffer = std::move(on_wire->payload);
   } else {
     if (FLARE_LIKELY(unpack_to)) {
-      NoncontiguousBufferInputStream nbis(&on_wire->payload);
-      if (FLARE_UNLIKELY(!unpack_to->ParseFromZeroCopyStream(&nbis))) {
+      if (FLARE_UNLIKELY(!ParseWithZeroCopyBytes(std::move(on_wire->payload),
+                                                 unpack_to.Get(),
+                                                 &msg->zero_copy_bytes))) {
         FLARE_LOG_WARNING_EVERY_SECOND(
             "Failed to parse message (correlation id {}).",
             meta->correlation_id());
@@ -326,6 +329,7 @@ void QZoneProtocol::WriteMessage(const Message& message,
   NoncontiguousBufferBuilder builder;
   auto header_ptr = builder.Reserve(sizeof(header));
   header.head.len += WriteTo(msg->msg_or_buffer, &builder);
+  header.head.len += WriteZeroCopyBytes(msg->zero_copy_bytes, &builder);
   FLARE_LOG_ERROR_IF_ONCE(
       !msg->attachment.Empty(),
       "Attachment is not supported by QZone protocol. Dropped silently.");
@@ -0,0 +1,208 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/protocol/protobuf/response_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "gflags/gflags.h"
+
+#include "flare/base/chrono.h"
+#include "flare/base/logging.h"
+#include "flare/base/never_destroyed.h"
+#include "flare/rpc/rpc_options.pb.h"
+
+DEFINE_int32(flare_rpc_client_response_cache_size_mb, 64,
+             "Maximum memory (roughly) used by client-side response cache, in "
+             "megabytes. @sa: `flare.client_cache_ttl_ms`.");
+
+namespace flare::protobuf {
+
+namespace {
+
+// Bookkeeping overhead of each entry (list node, hash map node, etc.), roughly.
+constexpr std::size_t kEntryOverhead = 128;
+
+}  // namespace
+
+ResponseCache::ResponseCache(const Options& options)
+    : shards_(std::make_unique<Shard[]>(options.shards)),
+      shard_count_(options.shards) {
+  FLARE_CHECK_GT(shard_count_, 0);
+  max_bytes_per_shard_ = options.max_bytes / shard_count_;
+  if (!options.exposed_var_path.empty()) {
+    exposer_ = std::make_unique<ExposedVarDynamic<Json::Value>>(
+        options.exposed_var_path, [this] { return Dump(); });
+  }
+}
+
+ResponseCache* ResponseCache::Instance() {
+  static NeverDestroyed<ResponseCache> cache(Options{
+      .max_bytes = static_cast<std::size_t>(
+                       FLAGS_flare_rpc_client_response_cache_size_mb) *
+                   1024 * 1024,
+      .exposed_var_path = "flare/rpc/client/response_cache"});
+  return cache.Get();
+}
+
+std::chrono::milliseconds ResponseCache::GetTtl(
+    const google::protobuf::MethodDescriptor* method) {
+  // Descriptors never change, so a thread-local cache works without locking.
+  thread_local std::unordered_map<const google::protobuf::MethodDescriptor*,
+                                  std::chrono::milliseconds>
+      cache;
+  auto&& [iter, inserted] = cache.try_emplace(method);
+  if (inserted) {
+    iter->second = std::chrono::milliseconds(std::max(
+        method->options().GetExtension(flare::client_cache_ttl_ms), 0));
+  }
+  return iter->second;
+}
+
+std::string ResponseCache::MakeKey(
+    std::string_view address, const google::protobuf::MethodDescriptor* method,
+    const google::protobuf::Message& request) {
+  std::string key;
+  key.reserve(address.size() + method->full_name().size() + 2 +
+              request.ByteSizeLong());
+  key.append(address);
+  key.push_back('\0');
+  key.append(method->full_name());
+  key.push_back('\0');
+  if (!request.AppendToString(&key)) {
+    return {};
+  }
+  return key;
+}
+
+bool ResponseCache::TryGet(const google::protobuf::MethodDescriptor* method,
+                           const std::string& key,
+                           google::protobuf::Message* response) {
+  auto&& stats = GetStats(method);
+  auto&& shard = GetShard(key);
+  std::string value;
+  {
+    std::scoped_lock _(shard->lock);
+    auto iter = shard->index.find(key);
+    if (iter == shard->index.end()) {
+      stats->misses.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (iter->second->expires_at < ReadCoarseSteadyClock()) {
+      RemoveLocked(shard, iter->second);
+      stats->misses.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    shard->lru.splice(shard->lru.begin(), shard->lru, iter->second);
+    value = iter->second->value;
+  }
+  // Parsing is done without holding the lock.
+  if (!response->ParseFromString(value)) {
+    // Shouldn't happen, as the value was serialized from a message of the same
+    // type.
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Failed to parse cached response of method [{}].", method->full_name());
+    stats->misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  stats->hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void ResponseCache::Put(const google::protobuf::MethodDescriptor* method,
+                        std::string key,
+                        const google::protobuf::Message& response,
+                        std::chrono::nanoseconds ttl) {
+  std::string value;
+  if (!response.SerializeToString(&value)) {
+    return;
+  }
+  auto size = key.size() + value.size() + kEntryOverhead;
+  if (size > max_bytes_per_shard_) {
+    return;  // Too large to be cached.
+  }
+
+  auto expires_at = ReadCoarseSteadyClock() + ttl;
+  auto&& shard = GetShard(key);
+  std::scoped_lock _(shard->lock);
+  if (auto iter = shard->index.find(key); iter != shard->index.end()) {
+    RemoveLocked(shard, iter->second);
+  }
+  // Make room for the new entry.
+  while (shard->bytes + size > max_bytes_per_shard_) {
+    FLARE_CHECK(!shard->lru.empty());
+    RemoveLocked(shard, std::prev(shard->lru.end()));
+  }
+  shard->lru.push_front(Entry{.key = std::move(key),
+                              .value = std::move(value),
+                              .expires_at = expires_at});
+  shard->index[shard->lru.front().key] = shard->lru.begin();
+  shard->bytes += size;
+}
+
+Json::Value ResponseCache::Dump() const {
+  Json::Value jsv;
+  std::size_t bytes = 0, entries = 0;
+  for (std::size_t i = 0; i != shard_count_; ++i) {
+    std::scoped_lock _(shards_[i].lock);
+    bytes += shards_[i].bytes;
+    entries += shards_[i].lru.size();
+  }
+  jsv["bytes"] = static_cast<Json::UInt64>(bytes);
+  jsv["entries"] = static_cast<Json::UInt64>(entries);
+
+  Json::Value methods(Json::objectValue);
+  std::shared_lock _(stats_lock_);
+  for (auto&& [k, v] : stats_) {
+    auto&& e = methods[k->full_name()];
+    e["hits"] =
+        static_cast<Json::UInt64>(v->hits.load(std::memory_order_relaxed));
+    e["misses"] =
+        static_cast<Json::UInt64>(v->misses.load(std::memory_order_relaxed));
+  }
+  jsv["methods"] = methods;
+  return jsv;
+}
+
+ResponseCache::Shard* ResponseCache::GetShard(const std::string& key) {
+  return &shards_[std::hash<std::string>{}(key) % shard_count_];
+}
+
+ResponseCache::MethodStats* ResponseCache::GetStats(
+    const google::protobuf::MethodDescriptor* method) {
+  {
+    std::shared_lock _(stats_lock_);
+    if (auto iter = stats_.find(method); iter != stats_.end()) {
+      return iter->second.get();
+    }
+  }
+  std::scoped_lock _(stats_lock_);
+  auto&& ptr = stats_[method];
+  if (!ptr) {
+    ptr = std::make_unique<MethodStats>();
+  }
+  return ptr.get();
+}
+
+void ResponseCache::RemoveLocked(Shard* shard,
+                                 std::list<Entry>::iterator iter) {
+  shard->bytes -= iter->key.size() + iter->value.size() + kEntryOverhead;
+  shard->index.erase(iter->key);
+  shard->lru.erase(iter);
+}
+
+}  // namespace flare::protobuf
@@ -0,0 +1,134 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#ifndef FLARE_RPC_PROTOCOL_PROTOBUF_RESPONSE_CACHE_H_
+#define FLARE_RPC_PROTOCOL_PROTOBUF_RESPONSE_CACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "gflags/gflags_declare.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "jsoncpp/value.h"
+
+#include "flare/base/align.h"
+#include "flare/base/exposed_var.h"
+
+DECLARE_int32(flare_rpc_client_response_cache_size_mb);
+
+namespace flare::protobuf {
+
+// Client-side cache of responses of methods marked with
+// `flare.client_cache_ttl_ms` (@sa: `rpc_options.proto`). It's used by
+// `RpcChannel` to complete calls without touching the network at all.
+//
+// Responses are stored in their serialized form, in a sharded LRU list. Memory
+// usage (roughly, keys and serialized responses) is bounded by `max_bytes`.
+// Expired responses are dropped lazily (i.e., when they're looked up, or when
+// they're evicted).
+//
+// This class is thread-safe.
+class ResponseCache {
+ public:
+  struct Options {
+    std::size_t max_bytes;
+    std::size_t shards = 16;
+
+    // If non-empty, statistics of the cache is exposed at this path.
+    std::string exposed_var_path;
+  };
+
+  explicit ResponseCache(const Options& options);
+
+  // Cache shared by all `RpcChannel`s. Its size is controlled by
+  // `flare_rpc_client_response_cache_size_mb`.
+  static ResponseCache* Instance();
+
+  // Returns TTL of responses of `method`, or zero if they shouldn't be cached.
+  static std::chrono::milliseconds GetTtl(
+      const google::protobuf::MethodDescriptor* method);
+
+  // Identifies a request to `method` made to `address`. An empty string is
+  // returned if `request` cannot be serialized.
+  static std::string MakeKey(std::string_view address,
+                             const google::protobuf::MethodDescriptor* method,
+                             const google::protobuf::Message& request);
+
+  // Looks up a cached response by `key` (@sa: `MakeKey`). If found (and not
+  // expired yet), it's parsed into `response` and `true` is returned.
+  //
+  // `method` is only used for statistics.
+  bool TryGet(const google::protobuf::MethodDescriptor* method,
+              const std::string& key, google::protobuf::Message* response);
+
+  // Caches `response` for `ttl`.
+  void Put(const google::protobuf::MethodDescriptor* method, std::string key,
+           const google::protobuf::Message& response,
+           std::chrono::nanoseconds ttl);
+
+  // Dumps statistics for exposition.
+  Json::Value Dump() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string value;  // Serialized response.
+    std::chrono::steady_clock::time_point expires_at;
+  };
+
+  struct alignas(hardware_destructive_interference_size) Shard {
+    std::mutex lock;
+    std::list<Entry> lru;  // Most recently used ones go first.
+    // Keys reference `Entry::key` in `lru`.
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    std::size_t bytes = 0;
+  };
+
+  struct MethodStats {
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+  };
+
+  Shard* GetShard(const std::string& key);
+  MethodStats* GetStats(const google::protobuf::MethodDescriptor* method);
+
+  // Removes `iter` from `shard`. `shard->lock` must be held.
+  static void RemoveLocked(Shard* shard, std::list<Entry>::iterator iter);
+
+ private:
+  std::size_t max_bytes_per_shard_;
+  std::unique_ptr<Shard[]> shards_;
+  std::size_t shard_count_;
+
+  mutable std::shared_mutex stats_lock_;
+  std::unordered_map<const google::protobuf::MethodDescriptor*,
+                     std::unique_ptr<MethodStats>>
+      stats_;
+
+  std::unique_ptr<ExposedVarDynamic<Json::Value>> exposer_;
+};
+
+}  // namespace flare::protobuf
+
+#endif  // FLARE_RPC_PROTOCOL_PROTOBUF_RESPONSE_CACHE_H_
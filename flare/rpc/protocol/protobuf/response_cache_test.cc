@@ -0,0 +1,125 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/protocol/protobuf/response_cache.h"
+
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/echo_service.pb.h"
+#include "flare/testing/main.h"
+
+using namespace std::literals;
+
+namespace flare::protobuf {
+
+namespace {
+
+const google::protobuf::MethodDescriptor* GetMethod(const std::string& name) {
+  return testing::EchoService::descriptor()->FindMethodByName(name);
+}
+
+std::string MakeKey(const std::string& body) {
+  testing::EchoRequest req;
+  req.set_body(body);
+  return ResponseCache::MakeKey("mock://addr", GetMethod("Echo"), req);
+}
+
+testing::EchoResponse MakeResponse(const std::string& body) {
+  testing::EchoResponse resp;
+  resp.set_body(body);
+  return resp;
+}
+
+}  // namespace
+
+TEST(ResponseCache, GetTtl) {
+  EXPECT_EQ(1000ms, ResponseCache::GetTtl(GetMethod("EchoWithClientCache")));
+  EXPECT_EQ(0ms, ResponseCache::GetTtl(GetMethod("Echo")));
+}
+
+TEST(ResponseCache, MakeKey) {
+  EXPECT_NE(MakeKey("a"), MakeKey("b"));
+  EXPECT_EQ(MakeKey("a"), MakeKey("a"));
+
+  testing::EchoRequest req;
+  req.set_body("a");
+  EXPECT_NE(MakeKey("a"),
+            ResponseCache::MakeKey("mock://another", GetMethod("Echo"), req));
+}
+
+TEST(ResponseCache, GetPut) {
+  ResponseCache cache(ResponseCache::Options{.max_bytes = 1048576});
+  auto method = GetMethod("Echo");
+  testing::EchoResponse resp;
+
+  EXPECT_FALSE(cache.TryGet(method, MakeKey("a"), &resp));
+  cache.Put(method, MakeKey("a"), MakeResponse("resp a"), 10s);
+  ASSERT_TRUE(cache.TryGet(method, MakeKey("a"), &resp));
+  EXPECT_EQ("resp a", resp.body());
+  EXPECT_FALSE(cache.TryGet(method, MakeKey("b"), &resp));
+
+  // Overwritten.
+  cache.Put(method, MakeKey("a"), MakeResponse("resp a2"), 10s);
+  ASSERT_TRUE(cache.TryGet(method, MakeKey("a"), &resp));
+  EXPECT_EQ("resp a2", resp.body());
+
+  auto stats = cache.Dump();
+  EXPECT_EQ(1, stats["entries"].asUInt64());
+  EXPECT_EQ(2, stats["methods"][method->full_name()]["hits"].asUInt64());
+  EXPECT_EQ(2, stats["methods"][method->full_name()]["misses"].asUInt64());
+}
+
+TEST(ResponseCache, Expiration) {
+  ResponseCache cache(ResponseCache::Options{.max_bytes = 1048576});
+  auto method = GetMethod("Echo");
+  testing::EchoResponse resp;
+
+  cache.Put(method, MakeKey("a"), MakeResponse("resp a"), 100ms);
+  EXPECT_TRUE(cache.TryGet(method, MakeKey("a"), &resp));
+  std::this_thread::sleep_for(200ms);
+  EXPECT_FALSE(cache.TryGet(method, MakeKey("a"), &resp));
+  EXPECT_EQ(0, cache.Dump()["entries"].asUInt64());
+}
+
+TEST(ResponseCache, Eviction) {
+  // Single shard, so that eviction order is deterministic.
+  ResponseCache cache(
+      ResponseCache::Options{.max_bytes = 4096, .shards = 1});
+  auto method = GetMethod("Echo");
+  testing::EchoResponse resp;
+
+  cache.Put(method, MakeKey("a"), MakeResponse(std::string(1000, 'a')), 10s);
+  cache.Put(method, MakeKey("b"), MakeResponse(std::string(1000, 'b')), 10s);
+  cache.Put(method, MakeKey("c"), MakeResponse(std::string(1000, 'c')), 10s);
+  EXPECT_TRUE(cache.TryGet(method, MakeKey("a"), &resp));  // Touch `a`.
+  // `b` is least recently used and is evicted.
+  cache.Put(method, MakeKey("d"), MakeResponse(std::string(1000, 'd')), 10s);
+  EXPECT_TRUE(cache.TryGet(method, MakeKey("a"), &resp));
+  EXPECT_FALSE(cache.TryGet(method, MakeKey("b"), &resp));
+  EXPECT_TRUE(cache.TryGet(method, MakeKey("c"), &resp));
+  EXPECT_TRUE(cache.TryGet(method, MakeKey("d"), &resp));
+  EXPECT_LE(cache.Dump()["bytes"].asUInt64(), 4096);
+
+  // Too large to be cached at all.
+  cache.Put(method, MakeKey("e"), MakeResponse(std::string(8192, 'e')), 10s);
+  EXPECT_FALSE(cache.TryGet(method, MakeKey("e"), &resp));
+}
+
+}  // namespace flare::protobuf
+
+FLARE_TEST_MAIN
@@ -17,8 +17,10 @@
 
 #include "flare/rpc/protocol/protobuf/rpc_channel.h"
 
+#include <algorithm>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -33,6 +35,7 @@
 #include "flare/base/buffer/zero_copy_stream.h"
 #include "flare/base/callback.h"
 #include "flare/base/endian.h"
+#include "flare/base/exposed_var.h"
 #include "flare/base/function.h"
 #include "flare/base/internal/annotation.h"
 #include "flare/base/net/endpoint.h"
@@ -50,6 +53,7 @@
 #include "flare/rpc/protocol/protobuf/binlog.pb.h"
 #include "flare/rpc/protocol/protobuf/message.h"
 #include "flare/rpc/protocol/protobuf/mock_channel.h"
+#include "flare/rpc/protocol/protobuf/response_cache.h"
 #include "flare/rpc/protocol/protobuf/rpc_channel_for_dry_run.h"
 #include "flare/rpc/protocol/protobuf/rpc_client_controller.h"
 #include "flare/rpc/protocol/protobuf/rpc_meta.pb.h"
@@ -60,6 +64,10 @@
 
 DEFINE_int32(flare_rpc_channel_max_packet_size, 4 * 1024 * 1024,
              "Default maximum packet size of `RpcChannel`.");
+DEFINE_bool(flare_rpc_channel_inherit_deadline, true,
+            "If set, when making RPCs while serving another one, timeout of "
+            "the outgoing RPC is capped by deadline of the RPC being served "
+            "(if the caller of the latter specified one).");
 
 using namespace std::literals;
 using flare::rpc::internal::StreamCallGate;
@@ -79,6 +87,25 @@ struct FastCallContext {
   bool multiplexable;
 };
 
+// Identical calls waiting for an in-flight one. @sa:
+// `RpcChannel::Options::coalesce_identical_calls`.
+struct CoalescedCall {
+  struct Waiter {
+    RpcClientController* controller;
+    google::protobuf::Message* response;
+    google::protobuf::Closure* done;
+  };
+
+  // Timeout of the call being made.
+  std::chrono::steady_clock::time_point timeout;
+  std::vector<Waiter> waiters;
+};
+
+ExposedCounter<std::uint64_t> call_coalescing_hits(
+    "flare/rpc/client/call_coalescing_hits");
+ExposedCounter<std::uint64_t> call_coalescing_misses(
+    "flare/rpc/client/call_coalescing_misses");
+
 protobuf::detail::MockChannel* mock_channel;
 
 bool IsMockAddress(const std::string& address) {
@@ -224,6 +251,18 @@ LoadBalancer::Status RpcStatusToNslbStatus(int rpc_status) {
   return LoadBalancer::Status::Failed;
 }
 
+// If we're serving an RPC whose caller will give up earlier than `ctlr`'s
+// timeout, there's no point in waiting for the outgoing RPC that long.
+void CapTimeoutByInheritedDeadline(RpcClientController* ctlr) {
+  if (!FLAGS_flare_rpc_channel_inherit_deadline) {
+    return;
+  }
+  if (auto deadline = rpc::GetSessionDeadline();
+      deadline && *deadline < ctlr->GetTimeout()) {
+    ctlr->SetTimeout(*deadline);
+  }
+}
+
 }  // namespace
 
 struct RpcChannel::RpcCompletionDesc {
@@ -247,6 +286,11 @@ struct RpcChannel::Impl {
   std::unique_ptr<MessageDispatcher> message_dispatcher;
   Factory<StreamProtocol> protocol_factory;
   rpc::internal::StreamCallGatePool* call_gate_pool;
+
+  // Calls in progress, keyed by method name and serialized request. Only used
+  // if `Options::coalesce_identical_calls` is set.
+  std::mutex coalescing_lock;
+  std::unordered_map<std::string, CoalescedCall> coalescing_calls;
 };
 
 RpcChannel::RpcChannel() { impl_ = std::make_unique<Impl>(); }
@@ -321,6 +365,7 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
                             google::protobuf::Closure* done) {
   auto ctlr = flare::down_cast<RpcClientController>(controller);
   ctlr->PrecheckForNewRpc();
+  CapTimeoutByInheritedDeadline(ctlr);
 
   bool is_streaming_rpc = protobuf::IsStreamingMethod(method);
   if (is_streaming_rpc) {
@@ -334,9 +379,11 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
   }
 
   if (!is_streaming_rpc) {
-    CallMethodWritingBinlog(method,
-                            flare::down_cast<RpcClientController>(controller),
-                            request, response, done);
+    if (auto ttl = protobuf::ResponseCache::GetTtl(method);
+        FLARE_UNLIKELY(ttl.count())) {
+      return CallMethodCached(method, ctlr, request, response, done, ttl);
+    }
+    CallMethodMaybeCoalesced(method, ctlr, request, response, done);
   } else {
     FLARE_LOG_ERROR_IF_ONCE(
         rpc::IsBinlogDumpContextPresent(),
@@ -423,6 +470,170 @@ void RpcChannel::CallMethodWritingBinlog(
   }
 }
 
+void RpcChannel::CallMethodCached(
+    const google::protobuf::MethodDescriptor* method,
+    RpcClientController* controller, const google::protobuf::Message* request,
+    google::protobuf::Message* response, google::protobuf::Closure* done,
+    std::chrono::nanoseconds ttl) {
+  // Same as coalescing, payloads not in the message itself are not taken into
+  // account, and calls being dumped are always made.
+  if (controller->HasRequestRawBytes() ||
+      !controller->GetRequestAttachment().Empty() ||
+      !controller->GetRequestZeroCopyBytes().empty() ||
+      controller->GetAcceptResponseRawBytes() || !response ||
+      rpc::IsBinlogDumpContextPresent()) {
+    return CallMethodMaybeCoalesced(method, controller, request, response,
+                                    done);
+  }
+  auto key = protobuf::ResponseCache::MakeKey(address_, method, *request);
+  if (key.empty()) {
+    // Let `CallMethodWritingBinlog` handle (i.e., fail) it.
+    return CallMethodWritingBinlog(method, controller, request, response, done);
+  }
+
+  auto&& cache = protobuf::ResponseCache::Instance();
+  if (cache->TryGet(method, key, response)) {
+    // The call is never made, so there's no peer / attachment to fill.
+    auto now = ReadTsc();
+    for (auto ts : {RpcClientController::Timestamp::Sent,
+                    RpcClientController::Timestamp::Received,
+                    RpcClientController::Timestamp::Parsed}) {
+      controller->SetTimestamp(ts, now);
+    }
+    // `NotifyCompletion` runs the completion synchronously, so for blocking
+    // calls there's nothing to wait for.
+    controller->SetCompletion(done ? done : flare::NewCallback([] {}));
+    controller->NotifyCompletion(Status());
+    return;
+  }
+
+  fiber::Latch latch(1);
+  auto cb = [controller, response, done, ttl, method, key = std::move(key),
+             &latch]() mutable {
+    if (!controller->Failed()) {
+      protobuf::ResponseCache::Instance()->Put(method, std::move(key),
+                                               *response, ttl);
+    }
+    if (done) {
+      done->Run();
+    } else {
+      latch.count_down();
+    }
+  };
+  CallMethodMaybeCoalesced(method, controller, request, response,
+                           flare::NewCallback(std::move(cb)));
+  if (!done) {  // It was a blocking call.
+    latch.wait();
+  }
+}
+
+void RpcChannel::CallMethodMaybeCoalesced(
+    const google::protobuf::MethodDescriptor* method,
+    RpcClientController* controller, const google::protobuf::Message* request,
+    google::protobuf::Message* response, google::protobuf::Closure* done) {
+  if (FLARE_UNLIKELY(options_.coalesce_identical_calls)) {
+    return CallMethodCoalesced(method, controller, request, response, done);
+  }
+  CallMethodWritingBinlog(method, controller, request, response, done);
+}
+
+void RpcChannel::CallMethodCoalesced(
+    const google::protobuf::MethodDescriptor* method,
+    RpcClientController* controller, const google::protobuf::Message* request,
+    google::protobuf::Message* response, google::protobuf::Closure* done) {
+  // Payloads not in the message itself are not taken into account below, so
+  // don't bother coalescing such calls. Nor do we coalesce calls being dumped,
+  // otherwise the binlog would miss the calls coalesced.
+  if (controller->HasRequestRawBytes() ||
+      !controller->GetRequestAttachment().Empty() ||
+      !controller->GetRequestZeroCopyBytes().empty() ||
+      controller->GetAcceptResponseRawBytes() || !response ||
+      rpc::IsBinlogDumpContextPresent()) {
+    return CallMethodWritingBinlog(method, controller, request, response, done);
+  }
+
+  // Calls are identified by method and serialized request.
+  std::string key = method->full_name();
+  key.push_back('\0');
+  if (!request->AppendToString(&key)) {
+    // Let `CallMethodWritingBinlog` handle (i.e., fail) it.
+    return CallMethodWritingBinlog(method, controller, request, response, done);
+  }
+
+  fiber::Latch latch(1);
+  {
+    std::unique_lock lk(impl_->coalescing_lock);
+    auto&& [iter, inserted] = impl_->coalescing_calls.try_emplace(key);
+    if (!inserted) {
+      if (controller->GetTimeout() < iter->second.timeout) {
+        // We can't wait that long, make the call on our own then.
+        lk.unlock();
+        call_coalescing_misses->Increment();
+        return CallMethodWritingBinlog(method, controller, request, response,
+                                       done);
+      }
+
+      // Wait for the in-flight one.
+      iter->second.waiters.push_back(CoalescedCall::Waiter{
+          .controller = controller,
+          .response = response,
+          .done = done ? done : flare::NewCallback([&] { latch.count_down(); })});
+      lk.unlock();
+      call_coalescing_hits->Increment();
+      if (!done) {  // It was a blocking call.
+        latch.wait();
+      }
+      return;
+    }
+    iter->second.timeout = controller->GetTimeout();
+  }
+  call_coalescing_misses->Increment();
+
+  // We're the one making the call. Once it completes, copy the result to
+  // whoever is waiting for us.
+  auto cb = [this, controller, response, done, key = std::move(key), &latch] {
+    CoalescedCall call;
+    {
+      std::scoped_lock _(impl_->coalescing_lock);
+      auto iter = impl_->coalescing_calls.find(key);
+      FLARE_CHECK(iter != impl_->coalescing_calls.end());
+      call = std::move(iter->second);
+      impl_->coalescing_calls.erase(iter);
+    }
+
+    auto failed = controller->Failed();
+    for (auto&& e : call.waiters) {
+      auto&& ctlr = e.controller;
+      ctlr->SetRemotePeer(controller->GetRemotePeer());
+      for (auto ts : {RpcClientController::Timestamp::Sent,
+                      RpcClientController::Timestamp::Received,
+                      RpcClientController::Timestamp::Parsed}) {
+        ctlr->SetTimestamp(ts, controller->GetTimestampTsc(ts));
+      }
+      ctlr->SetResponseAttachment(controller->GetResponseAttachment());
+      ctlr->SetResponseZeroCopyBytes(controller->GetResponseZeroCopyBytes());
+      if (!failed) {
+        e.response->CopyFrom(*response);
+      }
+      ctlr->SetCompletion(e.done);
+      ctlr->NotifyCompletion(
+          failed ? Status(controller->ErrorCode(), controller->ErrorText())
+                 : Status());
+    }
+
+    if (done) {
+      done->Run();
+    } else {
+      latch.count_down();
+    }
+  };
+  CallMethodWritingBinlog(method, controller, request, response,
+                          flare::NewCallback(std::move(cb)));
+  if (!done) {  // It was a blocking call.
+    latch.wait();
+  }
+}
+
 void RpcChannel::CallMethodWithRetry(
     const google::protobuf::MethodDescriptor* method,
     RpcClientController* controller, const google::protobuf::Message* request,
@@ -468,8 +679,8 @@ void RpcChannel::CallMethodNoRetry(
   // Find a peer to call.
   std::uintptr_t nslb_ctx;
   Endpoint remote_peer;
-  if (FLARE_UNLIKELY(!GetPeerOrFailEarlyForFastCall(*method, &remote_peer,
-                                                    &nslb_ctx, cb))) {
+  if (FLARE_UNLIKELY(!GetPeerOrFailEarlyForFastCall(
+          *method, controller, &remote_peer, &nslb_ctx, cb))) {
     return;
   }
 
@@ -574,8 +785,12 @@ void RpcChannel::CallStreamingMethod(
         address_);
     early_failure = true;
   }
-  if (FLARE_UNLIKELY(!impl_->message_dispatcher->GetPeer(
-          GetNextPseudoRandomKey(), &remote_peer, &nslb_ctx))) {
+  if (FLARE_UNLIKELY(controller->GetTimeout() <= ReadSteadyClock())) {
+    early_failure = true;  // @sa: `GetPeerOrFailEarlyForFastCall`.
+  }
+  if (FLARE_UNLIKELY(!early_failure &&
+                     !impl_->message_dispatcher->GetPeer(
+                         GetNextPseudoRandomKey(), &remote_peer, &nslb_ctx))) {
     FLARE_LOG_WARNING_EVERY_SECOND(
         "No peer available for calling method [{}] on [{}].",
         method->service()->full_name(), address_);
@@ -645,8 +860,17 @@ void RpcChannel::CallStreamingMethod(
   meta->set_correlation_id(correlation_id);
   meta->set_method_type(rpc::METHOD_TYPE_STREAM);
   meta->mutable_request_meta()->set_method_name(method->full_name());
-  meta->mutable_request_meta()->set_timeout(controller->GetRelativeTimeout() /
-                                            1ms);
+  // The remaining time can be less than 1ms if it's capped by an inherited
+  // deadline (an already-passed one fails the call above).
+  meta->mutable_request_meta()->set_timeout(
+      std::max<std::chrono::nanoseconds>(controller->GetRelativeTimeout(),
+                                         1ms) /
+      1ms);
+  // Advertise our flow control window in the first message. It's cleared from
+  // subsequent ones by `RpcClientController`.
+  if (FLAGS_flare_rpc_client_stream_window > 0) {
+    meta->set_window_update(FLAGS_flare_rpc_client_stream_window);
+  }
   // `type` is filled by `RpcClientController` itself.
   controller->SetRpcMetaPrototype(*meta);
 
@@ -670,6 +894,9 @@ void RpcChannel::CallStreamingMethod(
                              rpc::MESSAGE_FLAGS_END_OF_STREAM);
     req_msg->meta->mutable_request_meta()->mutable_method_name()->assign(
         method->full_name().begin(), method->full_name().end());
+    if (meta->has_window_update()) {
+      req_msg->meta->set_window_update(meta->window_update());
+    }
     req_msg->msg_or_buffer = MaybeOwning(non_owning, request);
 
     // Blocking may occur here if the connection fails before our data is
@@ -698,7 +925,8 @@ void RpcChannel::CallStreamingMethod(
 
 template <class F>
 bool RpcChannel::GetPeerOrFailEarlyForFastCall(
-    const google::protobuf::MethodDescriptor& method, Endpoint* peer,
+    const google::protobuf::MethodDescriptor& method,
+    const RpcClientController& controller, Endpoint* peer,
     std::uintptr_t* nslb_ctx, F&& cb) {
   if (FLARE_UNLIKELY(!impl_->opened)) {
     FLARE_LOG_WARNING_EVERY_SECOND(
@@ -707,6 +935,12 @@ bool RpcChannel::GetPeerOrFailEarlyForFastCall(
     cb(RpcCompletionDesc{.status = rpc::STATUS_INVALID_CHANNEL});
     return false;
   }
+  // The deadline (likely inherited from the call we're serving) has passed
+  // already. Neither the peer nor the load balancer should be bothered.
+  if (FLARE_UNLIKELY(controller.GetTimeout() <= ReadSteadyClock())) {
+    cb(RpcCompletionDesc{.status = rpc::STATUS_TIMEOUT});
+    return false;
+  }
   if (FLARE_UNLIKELY(!impl_->message_dispatcher->GetPeer(
           GetNextPseudoRandomKey(), peer, nslb_ctx))) {
     FLARE_LOG_WARNING_EVERY_SECOND(
@@ -736,8 +970,9 @@ void RpcChannel::CreateNativeRequestForFastCall(
   meta->set_method_type(rpc::METHOD_TYPE_SINGLE);
   meta->mutable_request_meta()->mutable_method_name()->assign(
       method.full_name().begin(), method.full_name().end());
-  meta->mutable_request_meta()->set_timeout(controller.GetRelativeTimeout() /
-                                            1ms);
+  meta->mutable_request_meta()->set_timeout(
+      std::max<std::chrono::nanoseconds>(controller.GetRelativeTimeout(), 1ms) /
+      1ms);
   meta->mutable_request_meta()->set_acceptable_compression_algorithms(
       kAcceptableCompressionAlgorithms);
   if (auto compression_algorithm = controller.GetCompressionAlgorithm();
@@ -757,6 +992,9 @@ void RpcChannel::CreateNativeRequestForFastCall(
 
   // And (optionally) the attachment.
   to->attachment = controller.GetRequestAttachment();
+
+  // And fields to be written as is.
+  to->zero_copy_bytes = controller.GetRequestZeroCopyBytes();
 }
 
 inline std::uint32_t RpcChannel::NextCorrelationId() const noexcept {
@@ -861,6 +1099,9 @@ void RpcChannel::CopyInterestedFieldsFromMessageToController(
                      completion_desc.timestamps->parsed_tsc);
   if (auto msg = completion_desc.msg) {
     ctlr->SetResponseAttachment(msg->attachment);
+    if (FLARE_UNLIKELY(!msg->zero_copy_bytes.empty())) {
+      ctlr->SetResponseZeroCopyBytes(std::move(msg->zero_copy_bytes));
+    }
     if (ctlr->GetAcceptResponseRawBytes()) {
       if (msg->msg_or_buffer.index() == 2) {
         ctlr->SetResponseRawBytes(std::move(std::get<2>(msg->msg_or_buffer)));
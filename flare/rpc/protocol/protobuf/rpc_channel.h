@@ -19,6 +19,7 @@
 #warning Use `flare/rpc/rpc_channel.h` instead.
 #endif
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -92,6 +93,20 @@ class RpcChannel : public google::protobuf::RpcChannel {
     // If non-empty, NSLB specified here will be used in place of the default
     // NSLB mechanism of protocol being used.
     std::string override_nslb;
+
+    // If set, concurrent calls to the same method with byte-identical requests
+    // are coalesced: Only the first one is actually sent, the others wait for
+    // its completion and receive a copy of its response (or its failure).
+    //
+    // This can greatly reduce load on the server if a handful of "hot" keys
+    // are being requested concurrently. But it's only safe for idempotent
+    // (read-only) methods, so it's disabled by default.
+    //
+    // A call is only coalesced with an in-flight one whose timeout is no
+    // later than its own. Calls with request attachment (or other forms of
+    // out-of-message payload), or accepting response in raw bytes, are never
+    // coalesced.
+    bool coalesce_identical_calls = false;
   };
 
   RpcChannel();
@@ -143,6 +158,31 @@ class RpcChannel : public google::protobuf::RpcChannel {
                                google::protobuf::Message* response,
                                google::protobuf::Closure* done);
 
+  // Coalesce this call with an identical in-flight one, if there is any.
+  // Otherwise the call is made as usual (via `CallMethodWritingBinlog`), and
+  // its result is shared with identical calls made in the meantime.
+  void CallMethodCoalesced(const google::protobuf::MethodDescriptor* method,
+                           RpcClientController* controller,
+                           const google::protobuf::Message* request,
+                           google::protobuf::Message* response,
+                           google::protobuf::Closure* done);
+
+  // Complete this call with a cached response if there's one. Otherwise the
+  // call is made as usual, and its response is cached on success. @sa:
+  // `flare.client_cache_ttl_ms` in `rpc_options.proto`.
+  void CallMethodCached(const google::protobuf::MethodDescriptor* method,
+                        RpcClientController* controller,
+                        const google::protobuf::Message* request,
+                        google::protobuf::Message* response,
+                        google::protobuf::Closure* done,
+                        std::chrono::nanoseconds ttl);
+
+  // Makes the call, coalescing it with identical ones if requested.
+  void CallMethodMaybeCoalesced(
+      const google::protobuf::MethodDescriptor* method,
+      RpcClientController* controller, const google::protobuf::Message* request,
+      google::protobuf::Message* response, google::protobuf::Closure* done);
+
   void CallMethodWithRetry(const google::protobuf::MethodDescriptor* method,
                            RpcClientController* controller,
                            const google::protobuf::Message* request,
@@ -181,7 +221,8 @@ class RpcChannel : public google::protobuf::RpcChannel {
 
   template <class F>
   bool GetPeerOrFailEarlyForFastCall(
-      const google::protobuf::MethodDescriptor& method, Endpoint* peer,
+      const google::protobuf::MethodDescriptor& method,
+      const RpcClientController& controller, Endpoint* peer,
       std::uintptr_t* nslb_ctx, F&& cb);
 
   void CreateNativeRequestForFastCall(
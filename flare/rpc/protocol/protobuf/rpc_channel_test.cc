@@ -21,7 +21,10 @@
 #include <thread>
 #include <vector>
 
+#include "flare/base/callback.h"
+#include "flare/base/chrono.h"
 #include "flare/fiber/async.h"
+#include "flare/fiber/latch.h"
 #include "flare/fiber/this_fiber.h"
 #include "flare/rpc/protocol/protobuf/message.h"
 #include "flare/rpc/rpc_client_controller.h"
@@ -42,6 +45,9 @@ class ServiceImpl : public testing::SyncEchoService {
             testing::EchoResponse* response,
             RpcServerController* controller) override {
     std::this_thread::sleep_for(10ms);
+    if (auto gate = echo_gate_.load()) {
+      gate->wait();
+    }
     if (++call_counter_ < 3) {
       controller->SetFailed(rpc::STATUS_OVERLOADED, "failed");
     } else {
@@ -53,6 +59,13 @@ class ServiceImpl : public testing::SyncEchoService {
     }
   }
 
+  void EchoWithClientCache(const testing::EchoRequest& request,
+                           testing::EchoResponse* response,
+                           RpcServerController* controller) override {
+    ++cached_call_counter_;
+    response->set_body(request.body());
+  }
+
   void EchoStreamResponse(const testing::EchoRequest& request,
                           StreamWriter<testing::EchoResponse> writer,
                           RpcServerController* controller) override {
@@ -66,6 +79,10 @@ class ServiceImpl : public testing::SyncEchoService {
 
  public:
   std::atomic<std::size_t> call_counter_{};
+  std::atomic<std::size_t> cached_call_counter_{};
+
+  // If set, `Echo` does not return until it's counted down.
+  std::atomic<fiber::Latch*> echo_gate_{};
 };
 
 class EchoServiceImpl : public testing::SyncEchoService {
@@ -145,6 +162,17 @@ TEST_F(ChannelTest, Timeout) {
             stub.Echo(testing::EchoRequest(), &ctlr).error().code());
 }
 
+TEST_F(ChannelTest, ExpiredDeadline) {
+  testing::EchoService_SyncStub stub("flare://" + endpoint_.ToString());
+  RpcClientController ctlr;
+  ctlr.SetTimeout(ReadSteadyClock() - 1s);
+  service_impl_.call_counter_ = 0;
+  // Failed locally, the request is not sent.
+  EXPECT_EQ(rpc::STATUS_TIMEOUT,
+            stub.Echo(testing::EchoRequest(), &ctlr).error().code());
+  EXPECT_EQ(0, service_impl_.call_counter_);
+}
+
 TEST_F(ChannelTest, UriNormalization) {
   for (auto scheme : {"qzone"s, "http"s}) {
     RpcChannel channel;
@@ -179,6 +207,75 @@ TEST_F(ChannelTest, Attachment) {
             FlattenSlow(ctlr.GetResponseAttachment()));
 }
 
+TEST_F(ChannelTest, CoalesceIdenticalCalls) {
+  RpcChannel channel;
+  CHECK(channel.Open("flare://" + endpoint_.ToString(),
+                     RpcChannel::Options{.coalesce_identical_calls = true}));
+  testing::EchoService_Stub stub(&channel);
+  testing::EchoRequest req1, req2;
+  req1.set_body("hot key");
+  req2.set_body("another key");
+
+  constexpr auto kCalls = 10;
+  std::vector<RpcClientController> ctlrs(kCalls * 2);
+  std::vector<testing::EchoResponse> resps(kCalls * 2);
+  fiber::Latch latch(kCalls * 2);
+  // `ServiceImpl::Echo` fails the first two calls it sees. Skip them.
+  service_impl_.call_counter_ = 10;
+  // Hold the calls reaching the server until all calls have been issued, so
+  // that none of them completes before its duplicates are made.
+  fiber::Latch gate(1);
+  service_impl_.echo_gate_ = &gate;
+  for (int i = 0; i != kCalls * 2; ++i) {
+    stub.Echo(&ctlrs[i], i % 2 ? &req2 : &req1, &resps[i],
+              flare::NewCallback([&] { latch.count_down(); }));
+  }
+  gate.count_down();
+  latch.wait();
+  service_impl_.echo_gate_ = nullptr;
+
+  // Only one call per distinct request actually reached the server.
+  EXPECT_EQ(10 + 2, service_impl_.call_counter_);
+  for (int i = 0; i != kCalls * 2; ++i) {
+    ASSERT_FALSE(ctlrs[i].Failed());
+    EXPECT_EQ(i % 2 ? "another key" : "hot key", resps[i].body());
+  }
+
+  // Calls are no longer coalesced once completed.
+  RpcClientController ctlr;
+  testing::EchoResponse resp;
+  stub.Echo(&ctlr, &req1, &resp, nullptr);
+  ASSERT_FALSE(ctlr.Failed());
+  EXPECT_EQ(10 + 3, service_impl_.call_counter_);
+}
+
+TEST_F(ChannelTest, ClientCache) {
+  testing::EchoService_SyncStub stub("flare://" + endpoint_.ToString());
+  testing::EchoRequest req;
+  req.set_body("cached");
+
+  for (int i = 0; i != 10; ++i) {
+    RpcClientController ctlr;
+    auto result = stub.EchoWithClientCache(req, &ctlr);
+    ASSERT_TRUE(result);
+    EXPECT_EQ("cached", result->body());
+  }
+  // Only the first one reached the server, the rest were served from cache.
+  EXPECT_EQ(1, service_impl_.cached_call_counter_);
+
+  // Different request, cache miss.
+  req.set_body("another");
+  RpcClientController ctlr;
+  EXPECT_EQ("another", stub.EchoWithClientCache(req, &ctlr)->body());
+  EXPECT_EQ(2, service_impl_.cached_call_counter_);
+
+  // Cached responses expire.
+  std::this_thread::sleep_for(1100ms);
+  ctlr.Reset();
+  EXPECT_EQ("another", stub.EchoWithClientCache(req, &ctlr)->body());
+  EXPECT_EQ(3, service_impl_.cached_call_counter_);
+}
+
 TEST_F(ChannelTest, ImplicitOpen) {
   RpcChannel channel("flare://" + endpoint_.ToString());
   testing::EchoService_SyncStub stub(&channel);
@@ -95,6 +95,14 @@ class RpcClientController : public protobuf::RpcControllerCommon {
   using RpcControllerCommon::GetResponseAttachment;
   using RpcControllerCommon::SetRequestAttachment;
 
+  // Large `bytes` fields (or pre-serialized sub-messages) can be sent / received
+  // without copying them into (or out of) the message. Buffers added here are
+  // written out as the given field, after the request message. For response,
+  // fields marked with `zero_copy_bytes` (@sa: `rpc_options.proto`) are
+  // available here instead of in the response message.
+  using RpcControllerCommon::AddRequestZeroCopyBytes;
+  using RpcControllerCommon::GetResponseZeroCopyBytes;
+
   // If `SetAcceptResponseRawBytes` was set when issuing this RPC, you can get
   // the response in its serialized form from this method.
   //
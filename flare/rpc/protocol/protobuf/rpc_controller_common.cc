@@ -60,6 +60,8 @@ void RpcControllerCommon::Reset() {
   tscs_[underlying_value(Timestamp::Start)] = ReadTsc();
   request_attachment_.Clear();
   response_attachment_.Clear();
+  request_zero_copy_bytes_.clear();
+  response_zero_copy_bytes_.clear();
   request_bytes_.reset();
   response_bytes_.reset();
   input_stream_ = std::nullopt;
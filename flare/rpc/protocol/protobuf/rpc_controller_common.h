@@ -92,6 +92,33 @@ class RpcControllerCommon : public google::protobuf::RpcController {
     return response_attachment_;
   }
 
+  // Fields of request / response that are kept as `NoncontiguousBuffer`
+  // instead of being (de)serialized by Protocol Buffers. @sa:
+  // `zero_copy_bytes.h`.
+  //
+  // For incoming messages, these are fields marked as `zero_copy_bytes`. For
+  // outgoing messages, buffers added here are appended to the serialized
+  // message as is. The corresponding field in the message itself should be left
+  // empty.
+  void AddRequestZeroCopyBytes(int field_number, NoncontiguousBuffer bytes) {
+    request_zero_copy_bytes_.emplace_back(field_number, std::move(bytes));
+  }
+  void SetRequestZeroCopyBytes(ZeroCopyBytesFields fields) noexcept {
+    request_zero_copy_bytes_ = std::move(fields);
+  }
+  const ZeroCopyBytesFields& GetRequestZeroCopyBytes() const noexcept {
+    return request_zero_copy_bytes_;
+  }
+  void AddResponseZeroCopyBytes(int field_number, NoncontiguousBuffer bytes) {
+    response_zero_copy_bytes_.emplace_back(field_number, std::move(bytes));
+  }
+  void SetResponseZeroCopyBytes(ZeroCopyBytesFields fields) noexcept {
+    response_zero_copy_bytes_ = std::move(fields);
+  }
+  const ZeroCopyBytesFields& GetResponseZeroCopyBytes() const noexcept {
+    return response_zero_copy_bytes_;
+  }
+
   // In certain cases (e.g., for perf. reasons.), it may be desired that request
   // / response should not be parsed until the last minute (if ever). In this
   // case, the message is stored here in its serialized format. In case we're
@@ -245,6 +272,11 @@ class RpcControllerCommon : public google::protobuf::RpcController {
     FLARE_CHECK_LT(x, underlying_value(Timestamp::Count));
     return TimestampFromTsc(tscs_[x]);
   }
+  std::uint64_t GetTimestampTsc(Timestamp ts) const noexcept {
+    std::uint32_t x = underlying_value(ts);
+    FLARE_CHECK_LT(x, underlying_value(Timestamp::Count));
+    return tscs_[x];
+  }
 
   // For internal use.
 
@@ -292,6 +324,10 @@ class RpcControllerCommon : public google::protobuf::RpcController {
   NoncontiguousBuffer request_attachment_;
   NoncontiguousBuffer response_attachment_;
 
+  // Fields of request / response carried as-is.
+  ZeroCopyBytesFields request_zero_copy_bytes_;
+  ZeroCopyBytesFields response_zero_copy_bytes_;
+
   // If present, they are / should be used instead of the corresponding message.
   std::optional<NoncontiguousBuffer> request_bytes_;
   std::optional<NoncontiguousBuffer> response_bytes_;
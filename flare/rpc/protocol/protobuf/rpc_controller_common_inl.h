@@ -90,6 +90,8 @@ std::unique_ptr<Message> TypedOutputStreamProvider<T>::TranslateMessage(
     msg->meta->set_flags(rpc::MESSAGE_FLAGS_START_OF_STREAM);
   } else {
     FLARE_CHECK(!(msg->meta->flags() & rpc::MESSAGE_FLAGS_START_OF_STREAM));
+    // Initial flow control window is only advertised in the first message.
+    msg->meta->clear_window_update();
   }
 
   if (eos) {
@@ -112,6 +114,8 @@ void TypedOutputStreamProvider<T>::WriteEosMarker(Function<void()> cb) {
     // This should be rare, if we take this branch, the user close the stream
     // without sending out anything.
     meta->set_flags(meta->flags() | rpc::MESSAGE_FLAGS_START_OF_STREAM);
+  } else {
+    meta->clear_window_update();
   }
   if (ctlr_->server_side_) {
     FLARE_CHECK(!meta->has_request_meta());
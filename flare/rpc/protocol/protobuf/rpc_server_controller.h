@@ -19,6 +19,7 @@
 #warning Use `flare/rpc/rpc_server_controller.h` instead.
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <mutex>
 #include <string>
@@ -26,6 +27,7 @@
 #include <utility>
 #include <vector>
 
+#include "flare/base/chrono.h"
 #include "flare/base/internal/test_prod.h"
 #include "flare/base/string.h"
 #include "flare/rpc/protocol/protobuf/rpc_controller_common.h"
@@ -82,6 +84,15 @@ class RpcServerController : public protobuf::RpcControllerCommon {
   std::optional<std::chrono::steady_clock::time_point> GetTimeout()
       const noexcept;
 
+  // Returns time left before the timeout above is reached, or zero if it has
+  // already passed. This is handy for deciding whether some optional (but
+  // expensive) work should be done.
+  //
+  // Timeout of RPCs made (via `RpcChannel`) while serving this one is capped by
+  // the caller's timeout automatically (unless
+  // `--flare_rpc_channel_inherit_deadline` is turned off).
+  std::optional<std::chrono::nanoseconds> GetRemainingTime() const noexcept;
+
   // Returns compression algorithms acceptable by the client.
   //
   // Indexed by `flare::rpc::CompressionAlgorithm`.
@@ -113,6 +124,15 @@ class RpcServerController : public protobuf::RpcControllerCommon {
   using RpcControllerCommon::GetResponseAttachment;
   using RpcControllerCommon::SetResponseAttachment;
 
+  // Large `bytes` fields can be received / sent without copying them into (or
+  // out of) the message. For request, fields marked with `zero_copy_bytes`
+  // (@sa: `rpc_options.proto`) are available here (by field number) instead of
+  // in the request message. For response, buffers added here are written out
+  // as the given field, after the response message. Not all protocols support
+  // this.
+  using RpcControllerCommon::AddResponseZeroCopyBytes;
+  using RpcControllerCommon::GetRequestZeroCopyBytes;
+
   // Get the request in its serialized form. This method is only available if
   // you've set `accept_request_raw_bytes` on the method being called (otherwise
   // the framework does not have a clue whether it shouldn't do deserialization
@@ -344,6 +364,15 @@ RpcServerController::GetTimeout() const noexcept {
   return timeout_from_caller_;
 }
 
+inline std::optional<std::chrono::nanoseconds>
+RpcServerController::GetRemainingTime() const noexcept {
+  if (!timeout_from_caller_) {
+    return std::nullopt;
+  }
+  return std::max<std::chrono::nanoseconds>(
+      *timeout_from_caller_ - ReadSteadyClock(), std::chrono::nanoseconds(0));
+}
+
 std::chrono::steady_clock::time_point inline RpcServerController::
     GetTimestampReceived() const noexcept {
   return RpcControllerCommon::GetTimestamp(Timestamp::Received);
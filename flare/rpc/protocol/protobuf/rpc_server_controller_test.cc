@@ -95,6 +95,16 @@ TEST(RpcServerController, Timeout) {
   ASSERT_FALSE(ctlr.GetTimeout());
 }
 
+TEST(RpcServerController, RemainingTime) {
+  RpcServerController ctlr;
+  ASSERT_FALSE(ctlr.GetRemainingTime());
+  ctlr.SetTimeout(ReadSteadyClock() + 1s);
+  ASSERT_TRUE(ctlr.GetRemainingTime());
+  EXPECT_NEAR(*ctlr.GetRemainingTime() / 1ms, 1s / 1ms, 100);
+  ctlr.SetTimeout(ReadSteadyClock() - 1s);
+  EXPECT_EQ(0ns, *ctlr.GetRemainingTime());
+}
+
 TEST(RpcServerController, Compression) {
   RpcServerController ctlr;
   ctlr.SetAcceptableCompressionAlgorithm(
@@ -229,6 +239,37 @@ TEST_F(RpcServerControllerTest, TimeoutFromClient) {
   ASSERT_EQ("aaa", sync_stub_->Echo(req, &ctlr)->body());
 }
 
+TEST_F(RpcServerControllerTest, DeadlinePropagation) {
+  dummy.write_response_in_bytes_ = true;
+  testing::EchoRequest req;
+  req.set_body("aaa");
+
+  std::atomic<int> depth = 0;
+  dummy.test_cb_ = [&](auto&&, auto&&, RpcServerController* ctlr) {
+    ASSERT_TRUE(ctlr->GetTimeout());
+    if (depth++) {
+      // Capped by the outermost call.
+      EXPECT_NEAR(*ctlr->GetRemainingTime() / 1ms, 1s / 1ms, 100);
+      return;
+    }
+    EXPECT_NEAR(*ctlr->GetRemainingTime() / 1ms, 1s / 1ms, 100);
+
+    // Call ourselves with a much larger timeout.
+    RpcClientController nested_ctlr;
+    nested_ctlr.SetTimeout(10s);
+    testing::EchoRequest nested_req;
+    nested_req.set_body("bbb");
+    ASSERT_EQ("bbb", sync_stub_->Echo(nested_req, &nested_ctlr)->body());
+    EXPECT_LE(nested_ctlr.GetTimeout(), *ctlr->GetTimeout());
+  };
+
+  RpcClientController ctlr;
+  ctlr.SetTimeout(1s);
+  ASSERT_EQ("aaa", sync_stub_->Echo(req, &ctlr)->body());
+  EXPECT_EQ(2, depth);
+  dummy.test_cb_ = nullptr;
+}
+
 }  // namespace flare
 
 FLARE_TEST_MAIN
@@ -17,6 +17,7 @@
 #include "flare/rpc/protocol/protobuf/service.h"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <memory>
 #include <utility>
@@ -25,10 +26,15 @@
 #include "google/protobuf/descriptor.h"
 
 #include "flare/base/callback.h"
+#include "flare/base/chrono.h"
 #include "flare/base/down_cast.h"
+#include "flare/base/enum.h"
+#include "flare/base/likely.h"
 #include "flare/base/string.h"
+#include "flare/base/tsc.h"
 #include "flare/rpc/internal/fast_latch.h"
 #include "flare/rpc/internal/rpc_metrics.h"
+#include "flare/rpc/internal/rpc_samples.h"
 #include "flare/rpc/internal/session_context.h"
 #include "flare/rpc/protocol/protobuf/binlog.h"
 #include "flare/rpc/protocol/protobuf/binlog.pb.h"
@@ -51,6 +57,12 @@ DEFINE_string(flare_rpc_server_protocol_buffers_max_ongoing_requests_per_method,
               "Echo2:5000`. If both this option and Protocol Buffers option "
               "`flare.max_ongoing_requests` are applicable, the smaller one "
               "is respected.");
+DEFINE_bool(flare_rpc_server_protocol_buffers_adaptive_concurrency_limit,
+            false,
+            "If set, concurrent requests of each method is limited adaptively "
+            "based on observed latency, as if Protocol Buffers option "
+            "`flare.adaptive_max_ongoing_requests` is applied to all methods. "
+            "Static limits (if any) still apply.");
 
 namespace flare::protobuf {
 
@@ -90,6 +102,58 @@ std::unordered_map<std::string, std::uint32_t> ParseMaxOngoingRequestFlag() {
   return result;
 }
 
+void ReportFastCallMetrics(const google::protobuf::MethodDescriptor* method,
+                           const RpcServerController& ctlr,
+                           const StreamService::Context& ctx,
+                           std::uint64_t handled_tsc,
+                           std::size_t response_size) {
+  using Stage = rpc::detail::RpcMetrics::Stage;
+
+  rpc::detail::RpcMetrics::CallRecord record;
+  record.error_code = ctlr.ErrorCode();
+  record.elapsed = ctlr.GetElapsedTime();
+  record.pkt_size_in = ctx.incoming_packet_size;
+  record.pkt_size_out = response_size;
+  if (FLARE_LIKELY(ctx.written_tsc)) {  // Not the case in dry-run environment.
+    auto&& stages = record.stages;
+    stages[underlying_value(Stage::Queueing)] =
+        DurationFromTsc(ctx.received_tsc, ctx.dispatched_tsc);
+    stages[underlying_value(Stage::Parsing)] =
+        DurationFromTsc(ctx.dispatched_tsc, ctx.parsed_tsc);
+    stages[underlying_value(Stage::Handling)] =
+        DurationFromTsc(ctx.parsed_tsc, handled_tsc);
+    stages[underlying_value(Stage::Serializing)] =
+        DurationFromTsc(handled_tsc, ctx.serialized_tsc);
+    stages[underlying_value(Stage::Writing)] =
+        DurationFromTsc(ctx.serialized_tsc, ctx.written_tsc);
+    record.has_stages = true;
+  }
+  rpc::detail::RpcMetrics::Instance()->Report(method, record);
+}
+
+// Saves metadata of a (sampled) call for `/inspect/rpc_samples`.
+void SaveRpcSample(const google::protobuf::MethodDescriptor* method,
+                   const RpcServerController& ctlr,
+                   const StreamService::Context& ctx,
+                   std::size_t response_size) {
+  auto now = ReadTsc();
+  rpc::detail::RpcSample sample;
+  sample.timestamp = ReadSystemClock();
+  sample.method = method;
+  auto peer = ctlr.GetRemotePeer().ToString();
+  auto peer_size = std::min(peer.size(), sizeof(sample.remote_peer) - 1);
+  memcpy(sample.remote_peer, peer.data(), peer_size);
+  sample.remote_peer[peer_size] = 0;
+  sample.status = ctlr.ErrorCode();
+  sample.request_size = ctx.incoming_packet_size;
+  sample.response_size = response_size;
+  sample.queueing = DurationFromTsc(ctx.received_tsc, ctx.dispatched_tsc);
+  sample.parsing = DurationFromTsc(ctx.dispatched_tsc, ctx.parsed_tsc);
+  sample.processing = DurationFromTsc(ctx.parsed_tsc, now);
+  sample.total = DurationFromTsc(ctx.received_tsc, now);
+  rpc::detail::RpcSamples::Instance()->Report(sample);
+}
+
 }  // namespace
 
 Service::~Service() {
@@ -141,10 +205,35 @@ void Service::AddService(MaybeOwning<google::protobuf::Service> impl) {
     if (e.max_ongoing_requests != std::numeric_limits<std::uint32_t>::max()) {
       e.ongoing_requests = std::make_unique<AlignedInt>();
     }
+    if (method->options().GetExtension(flare::adaptive_max_ongoing_requests) ||
+        FLAGS_flare_rpc_server_protocol_buffers_adaptive_concurrency_limit) {
+      rpc::detail::AdaptiveConcurrencyLimiter::Options opts;
+      if (e.ongoing_requests) {  // Capped by the static limit.
+        opts.max_limit = e.max_ongoing_requests;
+        opts.min_limit = std::min(opts.min_limit, opts.max_limit);
+      }
+      e.concurrency_limiter =
+          std::make_unique<rpc::detail::AdaptiveConcurrencyLimiter>(opts);
+    }
 
     rpc::detail::RpcMetrics::Instance()->RegisterMethod(method);
   }
 
+  if (!concurrency_limiter_exposer_) {
+    concurrency_limiter_exposer_ =
+        std::make_unique<ExposedVarDynamic<Json::Value>>(
+            Format("flare/rpc/protobuf/concurrency_limiter/{}", fmt::ptr(this)),
+            [this] {
+              Json::Value jsv(Json::objectValue);
+              for (auto&& [k, v] : method_descs_) {
+                if (v.concurrency_limiter) {
+                  jsv[k] = v.concurrency_limiter->Dump();
+                }
+              }
+              return jsv;
+            });
+  }
+
   services_.push_back(std::move(impl));
   ServiceMethodLocator::Instance()->AddService(
       services_.back()->GetDescriptor());
@@ -299,6 +388,7 @@ StreamService::ProcessingStatus Service::StreamCall(
     // can still be plenty of time elapsed on the network.
     rpc_controller.SetTimeout(TimestampFromTsc(context->received_tsc) +
                               v * 1ms);
+    rpc::session_context->deadline = rpc_controller.GetTimeout();
   }
   if (auto&& ctx = rpc::session_context->binlog;
       FLARE_UNLIKELY(ctx.dry_runner)) {
@@ -394,6 +484,8 @@ StreamService::ProcessingStatus Service::StreamCall(
       0, 0);
   FLARE_CHECK(rpc_controller.GetResponseAttachment().Empty(),
               "Attachment is not supported in streaming RPC.");
+  FLARE_CHECK(rpc_controller.GetResponseZeroCopyBytes().empty(),
+              "Zero-copy bytes is not supported in streaming RPC.");
   FLARE_CHECK(!rpc_controller.HasResponseRawBytes(),
               "Sending response from bytes is not supported in streaming RPC.");
 
@@ -516,10 +608,15 @@ void Service::InitializeServerControllerForFastCall(const ProtoMessage& msg,
     // `received_tsc` is the most accurate timestamp we can get. However, there
     // can still be plenty of time elapsed on the network.
     ctlr->SetTimeout(TimestampFromTsc(ctx.received_tsc) + v * 1ms);
+    // Propagated to RPCs made by the user (@sa: `RpcChannel`).
+    rpc::session_context->deadline = ctlr->GetTimeout();
   }
   if (FLARE_UNLIKELY(!msg.attachment.Empty())) {
     ctlr->SetRequestAttachment(msg.attachment);
   }
+  if (FLARE_UNLIKELY(!msg.zero_copy_bytes.empty())) {
+    ctlr->SetRequestZeroCopyBytes(msg.zero_copy_bytes);
+  }
 
   // Set binlog flags if necessary.
   if (auto&& ctx = rpc::session_context->binlog;
@@ -541,22 +638,33 @@ void Service::InvokeUserMethodForFastCall(
     ProtoMessage* resp_msg, RpcServerController* ctlr,
     const FunctionView<std::size_t(const Message&)>& writer, Context* ctx) {
   // Prepare response message.
-  auto resp_ptr = std::unique_ptr<google::protobuf::Message>(
-      method.response_prototype->New());
+  //
+  // If the request was allocated on an arena (@sa: `flare.use_arena`), the
+  // response is allocated on the same arena. `req_msg` (and therefore the
+  // arena) outlives `resp_msg`.
+  MaybeOwning<google::protobuf::Message> resp_ptr;
+  if (req_msg.arena) {
+    resp_ptr = MaybeOwning(non_owning,
+                           req_msg.arena->New(*method.response_prototype));
+  } else {
+    resp_ptr = MaybeOwning(owning, method.response_prototype->New());
+  }
 
   // For better responsiveness, we allow the user to write response early via
   // `RpcServerController::WriteResponseImmediately` (or, if not called, once
   // `done` is called, so we have to provide a callback to fill and write the
   // response.
   internal::LocalCallback write_resp_callback([&] {
+    auto handled_tsc = ReadTsc();
     CreateNativeResponse(method, req_msg, std::move(resp_ptr), ctlr, resp_msg);
 
     // Note that `writer` does not mutate `resp_msg`, we rely on this as we'll
     // still need the response later.
     auto bytes = writer(*resp_msg);
-    rpc::detail::RpcMetrics::Instance()->Report(
-        method.method, ctlr->ErrorCode(), ctlr->GetElapsedTime() / 1ms,
-        ctx->incoming_packet_size, bytes);
+    ReportFastCallMetrics(method.method, *ctlr, *ctx, handled_tsc, bytes);
+    if (rpc::detail::RpcSamples::Instance()->ShouldSample()) {
+      SaveRpcSample(method.method, *ctlr, *ctx, bytes);
+    }
   });
   ctlr->SetEarlyWriteResponseCallback(&write_resp_callback);
 
@@ -577,7 +685,7 @@ void Service::InvokeUserMethodForFastCall(
                              FLARE_LIKELY(req_msg.msg_or_buffer.index() == 1)
                                  ? std::get<1>(req_msg.msg_or_buffer).Get()
                                  : nullptr,
-                             resp_ptr.get(), &done_callback);
+                             resp_ptr.Get(), &done_callback);
   done_latch.wait();
 
   // Save the result for later use.
@@ -622,13 +730,17 @@ void Service::CompleteBinlogPostOperationForFastCall(
 Deferred Service::AcquireProcessingQuotaOrReject(const ProtoMessage& msg,
                                                  const MethodDesc& method,
                                                  const Context& ctx) {
-  auto max_queueing_delay = method.max_queueing_delay;
-  if (auto v = msg.meta->request_meta().timeout()) {
-    max_queueing_delay =
-        std::min<std::chrono::nanoseconds>(max_queueing_delay, v * 1ms);
+  auto queueing_delay = DurationFromTsc(ctx.received_tsc, ReadTsc());
+  if (auto v = msg.meta->request_meta().timeout();
+      FLARE_UNLIKELY(v && queueing_delay > v * 1ms)) {
+    // The caller has given up, processing it is simply a waste.
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Dropping call to [{}] from [{}]: Caller's deadline ({} ms) has passed "
+        "before the call is dispatched.",
+        msg.meta->request_meta().method_name(), ctx.remote_peer.ToString(), v);
+    return Deferred();
   }
-  if (FLARE_UNLIKELY(DurationFromTsc(ctx.received_tsc, ReadTsc()) >
-                     max_queueing_delay)) {
+  if (FLARE_UNLIKELY(queueing_delay > method.max_queueing_delay)) {
     FLARE_LOG_WARNING_EVERY_SECOND(
         "Rejecting call to [{}] from [{}]: It has been in queue for too long.",
         msg.meta->request_meta().method_name(), ctx.remote_peer.ToString());
@@ -647,18 +759,37 @@ Deferred Service::AcquireProcessingQuotaOrReject(const ProtoMessage& msg,
     return Deferred();
   }
 
-  return Deferred([ongoing_req_ptr] {
+  auto limiter = method.concurrency_limiter.get();
+  if (FLARE_UNLIKELY(limiter && !limiter->TryAcquire())) {
+    if (ongoing_req_ptr) {
+      ongoing_req_ptr->value.fetch_sub(1, std::memory_order_relaxed);
+    }
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Rejecting call to [{}] from [{}]: Too many concurrent requests "
+        "(adaptively limited to {}).",
+        msg.meta->request_meta().method_name(), ctx.remote_peer.ToString(),
+        limiter->GetLimit());
+    return Deferred();
+  }
+
+  return Deferred([ongoing_req_ptr, limiter, received_tsc = ctx.received_tsc,
+                   streaming = method.is_streaming] {
     // Restore ongoing request counter.
     if (ongoing_req_ptr) {
       FLARE_CHECK_GE(
           ongoing_req_ptr->value.fetch_sub(1, std::memory_order_relaxed), 0);
     }
+    if (limiter) {
+      // Latency of streaming calls does not make much sense.
+      limiter->Release(streaming ? 0ns
+                                 : DurationFromTsc(received_tsc, ReadTsc()));
+    }
   });
 }
 
 void Service::CreateNativeResponse(
     const MethodDesc& method_desc, const ProtoMessage& request,
-    std::unique_ptr<google::protobuf::Message> resp_ptr,
+    MaybeOwning<google::protobuf::Message> resp_ptr,
     RpcServerController* ctlr, ProtoMessage* response) {
   // Message meta goes first.
   auto meta = object_pool::Get<rpc::RpcMeta>();
@@ -711,6 +842,9 @@ void Service::CreateNativeResponse(
     response->precompressed_attachment =
         ctlr->GetResponseAttachmentPrecompressed();
   }
+
+  // And fields to be written as is.
+  response->zero_copy_bytes = ctlr->GetResponseZeroCopyBytes();
 }
 
 inline const Service::MethodDesc* Service::FindHandler(
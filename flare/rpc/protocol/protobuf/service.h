@@ -25,9 +25,11 @@
 #include "jsoncpp/value.h"
 
 #include "flare/base/deferred.h"
+#include "flare/base/exposed_var.h"
 #include "flare/base/internal/hash_map.h"
 #include "flare/base/internal/test_prod.h"
 #include "flare/base/maybe_owning.h"
+#include "flare/rpc/internal/adaptive_concurrency_limiter.h"
 #include "flare/rpc/protocol/stream_service.h"
 
 namespace flare {
@@ -102,6 +104,10 @@ class Service : public StreamService {  // Only `StreamService` is supported
 
     // Applicable only `max_ongoing_request` is not 0.
     std::unique_ptr<AlignedInt> ongoing_requests;
+
+    // Set if concurrency of this method is limited adaptively.
+    std::unique_ptr<rpc::detail::AdaptiveConcurrencyLimiter>
+        concurrency_limiter;
   };
 
   // Returns [nullptr, nullptr] if the request is rejected.
@@ -139,7 +145,7 @@ class Service : public StreamService {  // Only `StreamService` is supported
 
   void CreateNativeResponse(const MethodDesc& method_desc,
                             const ProtoMessage& request,
-                            std::unique_ptr<google::protobuf::Message> resp_ptr,
+                            MaybeOwning<google::protobuf::Message> resp_ptr,
                             RpcServerController* ctlr, ProtoMessage* response);
   const MethodDesc* FindHandler(const std::string& method_name) const;
 
@@ -162,6 +168,9 @@ class Service : public StreamService {  // Only `StreamService` is supported
 
   // Keyed by `MethodDescriptor::full_name()`.
   internal::HashMap<std::string, MethodDesc> method_descs_;
+
+  // Exposes state of adaptive concurrency limiters (if any) of our methods.
+  std::unique_ptr<ExposedVarDynamic<Json::Value>> concurrency_limiter_exposer_;
 };
 
 }  // namespace flare::protobuf
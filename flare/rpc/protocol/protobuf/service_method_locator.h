@@ -38,6 +38,8 @@
 #include "flare/base/never_destroyed.h"
 #include "flare/base/type_index.h"
 #include "flare/init/on_init.h"
+#include "flare/rpc/protocol/protobuf/rpc_options.h"
+#include "flare/rpc/rpc_options.pb.h"
 
 namespace flare::protobuf {
 
@@ -88,6 +90,10 @@ class ServiceMethodLocator {
     const google::protobuf::MethodDescriptor* method_desc;
     const google::protobuf::Message* request_prototype;
     const google::protobuf::Message* response_prototype;
+
+    // Set if messages of this method should be allocated on an arena
+    // (@sa: `flare.use_arena` in `rpc_options.proto`).
+    bool use_arena;
   };
 
   static ServiceMethodLocator* Instance() {
@@ -227,6 +233,8 @@ class ServiceMethodLocator {
     rc.response_prototype =
         google::protobuf::MessageFactory::generated_factory()->GetPrototype(
             method_desc->output_type());
+    rc.use_arena = method_desc->options().GetExtension(flare::use_arena) &&
+                   !IsStreamingMethod(method_desc);
     return rc;
   }
 
@@ -17,6 +17,7 @@
 #include "flare/base/buffer/zero_copy_stream.h"
 #include "flare/base/down_cast.h"
 #include "flare/base/endian.h"
+#include "flare/rpc/protocol/protobuf/call_arena.h"
 #include "flare/rpc/protocol/protobuf/call_context.h"
 #include "flare/rpc/protocol/protobuf/call_context_factory.h"
 #include "flare/rpc/protocol/protobuf/compression.h"
@@ -70,6 +71,9 @@ struct OnWireMessage : public Message {
   Type GetType() const noexcept override {
     return FromWireType(meta->method_type(), meta->flags());
   }
+  std::uint64_t GetStreamWindowUpdate() const noexcept override {
+    return meta->window_update();
+  }
 
   PooledPtr<rpc::RpcMeta> meta;
   NoncontiguousBuffer body;
@@ -78,6 +82,31 @@ struct OnWireMessage : public Message {
 
 StreamProtocol::Characteristics characteristics = {.name = "FlareStd"};
 
+void WriteWindowUpdate(const StreamWindowUpdateMessage& update,
+                       NoncontiguousBuffer* buffer) {
+  rpc::RpcMeta meta;
+  meta.set_correlation_id(update.GetCorrelationId());
+  meta.set_method_type(rpc::METHOD_TYPE_STREAM);
+  meta.set_flags(rpc::MESSAGE_FLAGS_WINDOW_UPDATE |
+                 rpc::MESSAGE_FLAGS_NO_PAYLOAD);
+  meta.set_window_update(update.GetStreamWindowUpdate());
+
+  Header hdr = {.magic = kHeaderMagic,
+                .meta_size = static_cast<std::uint32_t>(meta.ByteSizeLong()),
+                .msg_size = 0,
+                .att_size = 0};
+  ToLittleEndian(&hdr.magic);
+  ToLittleEndian(&hdr.meta_size);
+
+  NoncontiguousBufferBuilder nbb;
+  nbb.Append(&hdr, sizeof(hdr));
+  {
+    NoncontiguousBufferOutputStream nbos(&nbb);
+    FLARE_CHECK(meta.SerializeToZeroCopyStream(&nbos));
+  }
+  buffer->Append(nbb.DestructiveGet());
+}
+
 }  // namespace
 
 const StreamProtocol::Characteristics& StdProtocol::GetCharacteristics() const {
@@ -145,6 +174,13 @@ StdProtocol::MessageCutStatus StdProtocol::TryCutMessage(
     return MessageCutStatus::Error;
   }
 
+  // Flow control credit is consumed by the framework, there's nothing to parse.
+  if (FLARE_UNLIKELY(meta->flags() & rpc::MESSAGE_FLAGS_WINDOW_UPDATE)) {
+    *message = std::make_unique<StreamWindowUpdateMessage>(
+        meta->correlation_id(), meta->window_update());
+    return MessageCutStatus::Cut;
+  }
+
   // We've cut the message then.
   auto msg = std::make_unique<OnWireMessage>();
   msg->meta = std::move(meta);
@@ -196,8 +232,8 @@ bool StdProtocol::TryParse(std::unique_ptr<Message>* message,
         meta->request_meta().tracing_context();
 
     // TODO(luobogao): Implement option `accept_request_raw_bytes`.
-    unpack_to = std::unique_ptr<google::protobuf::Message>(
-        desc->request_prototype->New());
+    unpack_to = NewMessageMaybeOnArena(*desc->request_prototype,
+                                       desc->use_arena, &parsed->arena);
   } else {
     FLARE_CHECK(meta->has_response_meta());  // Checked before.
     controller->SetTraceForciblySampled(
@@ -218,8 +254,8 @@ bool StdProtocol::TryParse(std::unique_ptr<Message>* message,
             meta->correlation_id());
         return false;
       }
-      NoncontiguousBufferInputStream nbis(&buffer);
-      if (!unpack_to->ParseFromZeroCopyStream(&nbis)) {
+      if (!ParseWithZeroCopyBytes(std::move(buffer), unpack_to.Get(),
+                                  &parsed->zero_copy_bytes)) {
         FLARE_LOG_WARNING_EVERY_SECOND(
             "Failed to parse message (correlation id {}).",
             meta->correlation_id());
@@ -254,6 +290,10 @@ bool StdProtocol::TryParse(std::unique_ptr<Message>* message,
 void StdProtocol::WriteMessage(const Message& message,
                                NoncontiguousBuffer* buffer,
                                Controller* controller) {
+  if (auto update = dyn_cast<StreamWindowUpdateMessage>(message)) {
+    return WriteWindowUpdate(*update, buffer);
+  }
+
   auto old_size = buffer->ByteSize();
   auto msg = cast<ProtoMessage>(&message);
   auto meta = *msg->meta;  // Copied, likely to be slow.
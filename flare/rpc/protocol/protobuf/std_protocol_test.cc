@@ -113,6 +113,26 @@ TEST(StdProtocol, ServerToClient) {
       *std::get<1>(parsed_casted->msg_or_buffer)));
 }
 
+TEST(StdProtocol, WindowUpdate) {
+  StdProtocol server_prot(true), client_prot(false);
+  NoncontiguousBuffer buffer;
+  PassiveCallContext passive_ctx;
+  server_prot.WriteMessage(StreamWindowUpdateMessage(12345, 1048576), &buffer,
+                           &passive_ctx);
+
+  std::unique_ptr<Message> parsed;
+  ASSERT_TRUE(client_prot.TryCutMessage(&buffer, &parsed) ==
+              StreamProtocol::MessageCutStatus::Cut);
+  ASSERT_EQ(0, buffer.ByteSize());
+
+  // It's consumed by the framework, no parsing is needed.
+  auto update = dyn_cast<StreamWindowUpdateMessage>(parsed.get());
+  ASSERT_TRUE(update);
+  EXPECT_EQ(12345, update->GetCorrelationId());
+  EXPECT_EQ(1048576, update->GetStreamWindowUpdate());
+  EXPECT_EQ(Message::Type::Stream, update->GetType());
+}
+
 }  // namespace flare::protobuf
 
 FLARE_TEST_MAIN
@@ -0,0 +1,223 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include "flare/rpc/protocol/protobuf/zero_copy_bytes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include "flare/base/buffer/zero_copy_stream.h"
+#include "flare/base/logging.h"
+#include "flare/rpc/rpc_options.pb.h"
+
+namespace flare::protobuf {
+
+namespace {
+
+constexpr std::size_t kMaxVarintSize = 10;
+
+// Wire types, @sa: https://developers.google.com/protocol-buffers/docs/encoding
+enum WireType {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+  kStartGroup = 3,
+  kEndGroup = 4,
+  kFixed32 = 5
+};
+
+// Reads a varint at the beginning of `buffer` without consuming it. Returns
+// number of bytes the varint occupies, or 0 if it's malformed.
+std::size_t PeekVarint(const NoncontiguousBuffer& buffer,
+                       std::uint64_t* value) {
+  if (FLARE_UNLIKELY(buffer.Empty())) {
+    return 0;
+  }
+  char copy[kMaxVarintSize];
+  auto size = std::min(buffer.ByteSize(), kMaxVarintSize);
+  const char* ptr;
+  if (FLARE_LIKELY(buffer.FirstContiguous().size() >= size)) {
+    ptr = buffer.FirstContiguous().data();
+  } else {
+    FlattenToSlow(buffer, copy, size);
+    ptr = copy;
+  }
+
+  *value = 0;
+  for (std::size_t i = 0; i != size; ++i) {
+    *value |= static_cast<std::uint64_t>(ptr[i] & 0x7f) << (7 * i);
+    if (!(ptr[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+std::size_t WriteVarint(std::uint64_t value, char* ptr) {
+  std::size_t size = 0;
+  while (value >= 0x80) {
+    ptr[size++] = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  ptr[size++] = static_cast<char>(value);
+  return size;
+}
+
+std::vector<int> FindZeroCopyBytesFields(
+    const google::protobuf::Descriptor* desc) {
+  std::vector<int> result;
+  for (int i = 0; i != desc->field_count(); ++i) {
+    auto field = desc->field(i);
+    if (!field->options().GetExtension(flare::zero_copy_bytes)) {
+      continue;
+    }
+    if (field->type() != google::protobuf::FieldDescriptor::TYPE_BYTES) {
+      FLARE_LOG_WARNING_ONCE(
+          "Option `zero_copy_bytes` is only applicable to `bytes` fields. "
+          "Ignored for field [{}].",
+          field->full_name());
+      continue;
+    }
+    result.push_back(field->number());
+  }
+  return result;
+}
+
+bool ParseFromBuffer(NoncontiguousBuffer buffer,
+                     google::protobuf::Message* msg) {
+  NoncontiguousBufferInputStream nbis(&buffer);
+  return msg->ParseFromZeroCopyStream(&nbis);
+}
+
+// Scans through `buffer`, cuts off fields in `zero_copy`. Everything else is
+// returned.
+//
+// Returns `std::nullopt` on malformed input, or if groups (which we don't
+// support) are encountered.
+std::optional<NoncontiguousBuffer> CutZeroCopyBytes(
+    NoncontiguousBuffer buffer, const std::vector<int>& zero_copy,
+    ZeroCopyBytesFields* fields) {
+  NoncontiguousBuffer rest;
+  NoncontiguousBuffer scanning = buffer;  // Cheap, only references are copied.
+  std::size_t pending = 0;  // Bytes to be moved from `buffer` to `rest`.
+
+  while (!scanning.Empty()) {
+    std::uint64_t tag;
+    auto tag_size = PeekVarint(scanning, &tag);
+    if (!tag_size) {
+      return std::nullopt;
+    }
+    scanning.Skip(tag_size);
+
+    std::uint64_t value;
+    std::size_t value_size;  // Including length prefix if there's one.
+    auto wire_type = tag & 7;
+    if (wire_type == kVarint) {
+      value_size = PeekVarint(scanning, &value);
+      if (!value_size) {
+        return std::nullopt;
+      }
+    } else if (wire_type == kFixed64) {
+      value_size = 8;
+    } else if (wire_type == kFixed32) {
+      value_size = 4;
+    } else if (wire_type == kLengthDelimited) {
+      auto prefix_size = PeekVarint(scanning, &value);
+      if (!prefix_size || value > scanning.ByteSize() - prefix_size) {
+        return std::nullopt;
+      }
+      if (std::find(zero_copy.begin(), zero_copy.end(), tag >> 3) !=
+          zero_copy.end()) {
+        rest.Append(buffer.Cut(pending));
+        pending = 0;
+        buffer.Skip(tag_size + prefix_size);
+        scanning.Skip(prefix_size + value);
+        fields->emplace_back(tag >> 3, buffer.Cut(value));
+        continue;
+      }
+      value_size = prefix_size + value;
+    } else {
+      return std::nullopt;
+    }
+    if (value_size > scanning.ByteSize()) {
+      return std::nullopt;
+    }
+    scanning.Skip(value_size);
+    pending += tag_size + value_size;
+  }
+  FLARE_CHECK_EQ(pending, buffer.ByteSize());
+  rest.Append(std::move(buffer));
+  return rest;
+}
+
+}  // namespace
+
+const std::vector<int>& GetZeroCopyBytesFields(
+    const google::protobuf::Descriptor* desc) {
+  // Descriptors never change, so a thread-local cache works without locking.
+  thread_local std::unordered_map<const google::protobuf::Descriptor*,
+                                  std::vector<int>>
+      cache;
+  auto&& [iter, inserted] = cache.try_emplace(desc);
+  if (inserted) {
+    iter->second = FindZeroCopyBytesFields(desc);
+  }
+  return iter->second;
+}
+
+bool ParseWithZeroCopyBytes(NoncontiguousBuffer buffer,
+                            google::protobuf::Message* msg,
+                            ZeroCopyBytesFields* fields) {
+  auto&& zero_copy = GetZeroCopyBytesFields(msg->GetDescriptor());
+  if (FLARE_LIKELY(zero_copy.empty())) {
+    return ParseFromBuffer(std::move(buffer), msg);
+  }
+
+  auto fields_was = fields->size();
+  if (auto rest = CutZeroCopyBytes(buffer, zero_copy, fields)) {
+    return ParseFromBuffer(std::move(*rest), msg);
+  }
+  // Let Protocol Buffers handle it (or fail) then.
+  fields->resize(fields_was);
+  return ParseFromBuffer(std::move(buffer), msg);
+}
+
+std::size_t WriteZeroCopyBytes(const ZeroCopyBytesFields& fields,
+                               NoncontiguousBufferBuilder* builder) {
+  std::size_t written = 0;
+  for (auto&& [number, payload] : fields) {
+    char header[kMaxVarintSize * 2];
+    auto size = WriteVarint(
+        static_cast<std::uint64_t>(number) << 3 | kLengthDelimited, header);
+    size += WriteVarint(payload.ByteSize(), header + size);
+    builder->Append(header, size);
+    builder->Append(payload);
+    written += size + payload.ByteSize();
+  }
+  return written;
+}
+
+const NoncontiguousBuffer* FindZeroCopyBytes(const ZeroCopyBytesFields& fields,
+                                             int field_number) {
+  for (auto&& [number, payload] : fields) {
+    if (number == field_number) {
+      return &payload;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace flare::protobuf
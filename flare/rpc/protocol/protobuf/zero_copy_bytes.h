@@ -0,0 +1,74 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef FLARE_RPC_PROTOCOL_PROTOBUF_ZERO_COPY_BYTES_H_
+#define FLARE_RPC_PROTOCOL_PROTOBUF_ZERO_COPY_BYTES_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+#include "flare/base/buffer.h"
+
+// Large `bytes` fields are normally copied into `std::string`s when being
+// parsed, and copied again when being serialized. For services relaying large
+// blobs, this can be costly.
+//
+// To avoid this, top-level `bytes` fields can be marked with
+// `[(flare.zero_copy_bytes) = true]`. Such fields are not parsed into the
+// message by the framework. Instead, they're cut off (without copying) from the
+// buffer received, and can be retrieved via `RpcServerController` (for
+// requests) or `RpcClientController` (for responses) as `NoncontiguousBuffer`s
+// referencing the buffer blocks received.
+//
+// Conversely, pre-serialized length-delimited fields (either `bytes` or
+// sub-messages) can be spliced into the message being sent, again, without
+// copying or re-encoding them.
+
+namespace flare::protobuf {
+
+// Field number -> payload. For repeated fields, payloads are in order of
+// their appearance.
+using ZeroCopyBytesFields = std::vector<std::pair<int, NoncontiguousBuffer>>;
+
+// Returns numbers of fields in `desc` marked as `zero_copy_bytes`.
+const std::vector<int>& GetZeroCopyBytesFields(
+    const google::protobuf::Descriptor* desc);
+
+// Parses `buffer` into `msg`. Fields marked as `zero_copy_bytes` are not parsed
+// into `msg`, but cut off into `fields` instead.
+//
+// Returns `false` if `buffer` is not a valid serialization of `msg`.
+bool ParseWithZeroCopyBytes(NoncontiguousBuffer buffer,
+                            google::protobuf::Message* msg,
+                            ZeroCopyBytesFields* fields);
+
+// Serializes `fields` as length-delimited fields into `builder`. Payloads are
+// not copied (unless they're really small).
+//
+// Returns number of bytes written.
+std::size_t WriteZeroCopyBytes(const ZeroCopyBytesFields& fields,
+                               NoncontiguousBufferBuilder* builder);
+
+// Returns first payload of field `field_number` in `fields`, or `nullptr` if
+// there's none.
+const NoncontiguousBuffer* FindZeroCopyBytes(const ZeroCopyBytesFields& fields,
+                                             int field_number);
+
+}  // namespace flare::protobuf
+
+#endif  // FLARE_RPC_PROTOCOL_PROTOBUF_ZERO_COPY_BYTES_H_
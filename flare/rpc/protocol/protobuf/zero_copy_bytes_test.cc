@@ -0,0 +1,116 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+
+#include "flare/rpc/protocol/protobuf/zero_copy_bytes.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "flare/testing/echo_service.pb.h"
+#include "flare/testing/main.h"
+
+namespace flare::protobuf {
+
+namespace {
+
+NoncontiguousBuffer SerializeToBuffer(const google::protobuf::Message& msg) {
+  NoncontiguousBufferBuilder builder;
+  auto str = msg.SerializeAsString();
+  builder.Append(str.data(), str.size());
+  return builder.DestructiveGet();
+}
+
+}  // namespace
+
+TEST(ZeroCopyBytes, GetFields) {
+  EXPECT_EQ((std::vector<int>{2, 3}),
+            GetZeroCopyBytesFields(testing::BlobMessage::descriptor()));
+  EXPECT_TRUE(
+      GetZeroCopyBytesFields(testing::EchoRequest::descriptor()).empty());
+}
+
+TEST(ZeroCopyBytes, Parse) {
+  testing::BlobMessage msg;
+  msg.set_id(12345);
+  msg.set_blob(std::string(1048576, 'x'));
+  msg.add_chunks("chunk 1");
+  msg.add_chunks("");
+  msg.add_chunks("chunk 3");
+  msg.mutable_nested()->set_body("nested");
+
+  testing::BlobMessage parsed;
+  ZeroCopyBytesFields fields;
+  ASSERT_TRUE(ParseWithZeroCopyBytes(SerializeToBuffer(msg), &parsed, &fields));
+  EXPECT_EQ(12345, parsed.id());
+  EXPECT_EQ("nested", parsed.nested().body());
+  EXPECT_TRUE(parsed.blob().empty());
+  EXPECT_EQ(0, parsed.chunks_size());
+
+  ASSERT_EQ(4, fields.size());
+  EXPECT_EQ(2, fields[0].first);
+  EXPECT_EQ(msg.blob(), FlattenSlow(fields[0].second));
+  EXPECT_EQ(3, fields[1].first);
+  EXPECT_EQ("chunk 1", FlattenSlow(fields[1].second));
+  EXPECT_EQ(3, fields[2].first);
+  EXPECT_EQ("", FlattenSlow(fields[2].second));
+  EXPECT_EQ(3, fields[3].first);
+  EXPECT_EQ("chunk 3", FlattenSlow(fields[3].second));
+  EXPECT_EQ(msg.blob(), FlattenSlow(*FindZeroCopyBytes(fields, 2)));
+  EXPECT_EQ(nullptr, FindZeroCopyBytes(fields, 4));
+}
+
+TEST(ZeroCopyBytes, ParseMalformed) {
+  testing::BlobMessage msg;
+  msg.set_blob("some bytes");
+  auto buffer = SerializeToBuffer(msg);
+  buffer = buffer.Cut(buffer.ByteSize() - 1);
+
+  testing::BlobMessage parsed;
+  ZeroCopyBytesFields fields;
+  EXPECT_FALSE(ParseWithZeroCopyBytes(buffer, &parsed, &fields));
+  EXPECT_TRUE(fields.empty());
+}
+
+TEST(ZeroCopyBytes, Write) {
+  testing::BlobMessage msg;
+  msg.set_id(1);
+
+  testing::EchoRequest nested;
+  nested.set_body("pre-serialized");
+  ZeroCopyBytesFields fields;
+  fields.emplace_back(2, CreateBufferSlow(std::string(1048576, 'y')));
+  fields.emplace_back(3, CreateBufferSlow("chunk"));
+  fields.emplace_back(4, SerializeToBuffer(nested));
+
+  NoncontiguousBufferBuilder builder;
+  auto str = msg.SerializeAsString();
+  builder.Append(str.data(), str.size());
+  auto written = WriteZeroCopyBytes(fields, &builder);
+  auto buffer = builder.DestructiveGet();
+  EXPECT_EQ(str.size() + written, buffer.ByteSize());
+
+  testing::BlobMessage parsed;
+  ASSERT_TRUE(parsed.ParseFromString(FlattenSlow(buffer)));
+  EXPECT_EQ(1, parsed.id());
+  EXPECT_EQ(std::string(1048576, 'y'), parsed.blob());
+  ASSERT_EQ(1, parsed.chunks_size());
+  EXPECT_EQ("chunk", parsed.chunks(0));
+  EXPECT_EQ("pre-serialized", parsed.nested().body());
+}
+
+}  // namespace flare::protobuf
+
+FLARE_TEST_MAIN
@@ -15,6 +15,7 @@
 #ifndef FLARE_RPC_PROTOCOL_STREAM_PROTOCOL_H_
 #define FLARE_RPC_PROTOCOL_STREAM_PROTOCOL_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -101,6 +102,16 @@ class StreamProtocol {
     // If set, this protocol does not support connection reuse for streaming
     // RPCs.
     bool no_connection_reuse_in_streaming_rpcs = false;
+
+    // If set, the protocol keeps connection-level state about bytes it writes
+    // (e.g., HPACK and flow control windows in HTTP/2), and may want to send
+    // bytes on its own (@sa: `TryGetPendingBytes`).
+    //
+    // In this case the framework serializes calls to `WriteMessage` on the
+    // connection, and bytes produced by it (and by `TryGetPendingBytes`) are
+    // written out in the same order as they're produced. If `WriteMessage`
+    // produces nothing, the message is considered dropped by the protocol.
+    bool stateful_writes = false;
   };
 
   // Arguably this should be a static method but it's impossible to mark a
@@ -154,6 +165,36 @@ class StreamProtocol {
   // Serialize `message` to `buffer`.
   virtual void WriteMessage(const Message& message, NoncontiguousBuffer* buffer,
                             Controller* controller) = 0;
+
+  // Some protocols need to send bytes that are not produced by `WriteMessage`,
+  // e.g., acknowledging peer's settings, granting flow control credit, or data
+  // held back by peer's flow control window until `TryCutMessage` sees more
+  // credit.
+  //
+  // For protocols with `Characteristics::stateful_writes` set, this method is
+  // called after `TryCutMessage` (once for each batch of bytes read) and after
+  // `WriteMessage`. Whatever returned is written to the connection.
+  //
+  // Returns `false` if there's nothing to send.
+  virtual bool TryGetPendingBytes(NoncontiguousBuffer* buffer) {
+    return false;
+  }
+
+  // For protocols with `Characteristics::stateful_writes` set, this method is
+  // called when the framework gives up a call without writing anything more
+  // for it. On server side the request is not going to be responded to (e.g.,
+  // it's dropped); on client side the response is no longer waited for (e.g.,
+  // the call timed out).
+  //
+  // The protocol may release state associated with the call and tell the peer
+  // about this (via `TryGetPendingBytes`).
+  virtual void OnCallAbandoned(std::uint64_t correlation_id) {}
+
+  // Client side only, for protocols with `Characteristics::stateful_writes`
+  // set. Once this method returns `false` (e.g., the peer is shutting the
+  // connection down gracefully), the framework stops making new calls on the
+  // connection.
+  virtual bool AcceptsNewCalls() { return true; }
 };
 
 FLARE_DECLARE_CLASS_DEPENDENCY_REGISTRY(client_side_stream_protocol_registry,
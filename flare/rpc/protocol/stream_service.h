@@ -64,6 +64,12 @@ class StreamService {
     std::uint64_t dispatched_tsc;  // Fiber dedicated to this RPC starts to run.
     std::uint64_t parsed_tsc;      // The request is fully parsed.
 
+    // Updated by the framework each time the `writer` passed to `FastCall` is
+    // called, so they're available once it returns. Not applicable to
+    // streaming RPC.
+    std::uint64_t serialized_tsc = 0;  // The response is serialized.
+    std::uint64_t written_tsc = 0;     // Handed to the connection for writing.
+
     // Size of the incoming packet. Not applicable to streaming RPC.
     std::size_t incoming_packet_size = 0;
 
@@ -14,6 +14,7 @@
 
 #include "flare/rpc/server.h"
 
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <utility>
@@ -33,6 +34,8 @@
 #include "flare/rpc/binlog/dry_runner.h"
 #include "flare/rpc/http_filter.h"
 #include "flare/rpc/http_handler.h"
+#include "flare/rpc/internal/adaptive_concurrency_limiter.h"
+#include "flare/rpc/internal/admission_queue.h"
 #include "flare/rpc/internal/dry_run_connection_handler.h"
 #include "flare/rpc/internal/normal_connection_handler.h"
 #include "flare/rpc/internal/stream_io_adaptor.h"
@@ -46,6 +49,18 @@ DEFINE_int32(
     "Maximum number of messages that is being or waiting for processing. "
     "Specifying a number too small may degrade overall performance if "
     "streaming rpcs and normal rpcs are performed on same connection.");
+DEFINE_int32(
+    flare_rpc_server_stream_window, 4 * 1024 * 1024,
+    "Flow control window (in bytes) of each streaming RPC, i.e., bytes the "
+    "client may send without them being read by the service. It's only "
+    "enforced if the client supports flow control. Setting it to 0 disables "
+    "flow control.");
+DEFINE_int32(
+    flare_rpc_server_connection_window, 64 * 1024 * 1024,
+    "Maximum bytes of streaming RPC messages received on a connection but not "
+    "read by the services yet. Once reached, reading from the connection is "
+    "suppressed until the services consume them. Setting it to 0 disables "
+    "this limit.");
 DEFINE_int32(flare_rpc_server_max_ongoing_calls, 10000,
              "Maximum number of unfinished calls. After this limit is reached, "
              "new calls are dropped unless an old one has finished.");
@@ -70,6 +85,24 @@ DEFINE_bool(flare_rpc_server_suppress_ephemeral_port_warning, false,
 DEFINE_bool(flare_rpc_server_no_builtin_pages, false,
             "Default value for Server::Options::no_builtin_pages. If set, "
             "everything in `/inspect` is disabled.");
+DEFINE_bool(flare_rpc_server_adaptive_concurrency_limit, false,
+            "Default value for Server::Options::adaptive_concurrency_limit. If "
+            "set, maximum concurrent calls is adjusted dynamically based on "
+            "observed latency, and calls exceeding the limit are rejected "
+            "early.");
+DEFINE_int32(flare_rpc_server_max_executing_requests, 0,
+             "Default value for Server::Options::max_executing_requests. If "
+             "non-zero, (non-streaming) requests exceeding this limit are "
+             "queued, and dropped if they're queued for too long when the "
+             "server is overloaded.");
+DEFINE_int32(flare_rpc_server_admission_queue_codel_target_ms, 5,
+             "If requests in the admission queue have been queued for longer "
+             "than this value for a while, the server is considered "
+             "overloaded. Requests queued for longer than twice this value "
+             "are dropped in this case. Applicable only if "
+             "`max_executing_requests` is non-zero.");
+DEFINE_int32(flare_rpc_server_admission_queue_codel_interval_ms, 100,
+             "Interval for evaluating if the admission queue is standing.");
 
 using namespace std::literals;
 
@@ -122,6 +155,22 @@ Server::Server(Options options)
       ReadSteadyClock(),
       FLAGS_flare_rpc_server_remove_idle_connection_interval * 1s,
       [this] { OnConnectionCleanupTimer(); });
+
+  if (options_.adaptive_concurrency_limit) {
+    rpc::detail::AdaptiveConcurrencyLimiter::Options opts;
+    opts.max_limit = std::max<std::size_t>(options_.max_concurrent_requests, 1);
+    opts.min_limit = std::min(opts.min_limit, opts.max_limit);
+    concurrency_limiter_ =
+        std::make_unique<rpc::detail::AdaptiveConcurrencyLimiter>(opts);
+  }
+  if (options_.max_executing_requests) {
+    rpc::detail::AdmissionQueue::Options opts;
+    opts.max_executing = options_.max_executing_requests;
+    opts.target = FLAGS_flare_rpc_server_admission_queue_codel_target_ms * 1ms;
+    opts.interval =
+        FLAGS_flare_rpc_server_admission_queue_codel_interval_ms * 1ms;
+    admission_queue_ = std::make_unique<rpc::detail::AdmissionQueue>(opts);
+  }
 }
 
 Server::~Server() {
@@ -339,6 +388,12 @@ Json::Value Server::DumpInternals() {
       static_cast<Json::UInt64>(ongoing_calls_.load(std::memory_order_relaxed));
   jsv["connections_alive"] =
       static_cast<Json::UInt64>(alive_conns_.load(std::memory_order_relaxed));
+  if (concurrency_limiter_) {
+    jsv["concurrency_limiter"] = concurrency_limiter_->Dump();
+  }
+  if (admission_queue_) {
+    jsv["admission_queue"] = admission_queue_->Dump();
+  }
 
   {
     std::scoped_lock _(conns_lock_);
@@ -393,6 +448,8 @@ void Server::OnConnection(Handle fd, Endpoint peer) {
   // Initialize the connection object.
   NativeStreamConnection::Options opts;
   opts.read_buffer_size = options_.maximum_packet_size;
+  opts.read_rate_limiter = RateLimiter::NewRxRateLimiterFor(peer);
+  opts.write_rate_limiter = RateLimiter::NewTxRateLimiterFor(peer);
   if (!binlog::GetDryRunner()) {  // If not dry-runner is present, we proceed as
                                   // normal.
     opts.handler = CreateNormalConnectionHandler(icc->conn_id, peer);
@@ -431,10 +488,21 @@ bool Server::OnNewCall() {
         options_.max_concurrent_requests);
     return false;
   }
+  if (concurrency_limiter_ &&
+      FLARE_UNLIKELY(!concurrency_limiter_->TryAcquire())) {
+    FLARE_CHECK_GT(ongoing_calls_.fetch_sub(1, std::memory_order_relaxed), 0);
+    FLARE_LOG_WARNING_EVERY_SECOND(
+        "Overloaded. Concurrent ongoing calls is (adaptively) capped to {}.",
+        concurrency_limiter_->GetLimit());
+    return false;
+  }
   return true;
 }
 
-void Server::OnCallCompletion() {
+void Server::OnCallCompletion(std::chrono::nanoseconds latency) {
+  if (concurrency_limiter_) {
+    concurrency_limiter_->Release(latency);
+  }
   FLARE_CHECK_GT(ongoing_calls_.fetch_sub(1, std::memory_order_relaxed), 0);
 }
 
@@ -16,6 +16,7 @@
 #define FLARE_RPC_SERVER_H_
 
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -45,10 +46,14 @@ DECLARE_int32(flare_rpc_server_max_connections);
 DECLARE_int32(flare_rpc_server_max_request_queueing_delay);
 DECLARE_int32(flare_rpc_server_max_packet_size);
 DECLARE_bool(flare_rpc_server_no_builtin_pages);
+DECLARE_bool(flare_rpc_server_adaptive_concurrency_limit);
+DECLARE_int32(flare_rpc_server_max_executing_requests);
 
 namespace flare {
 
 namespace rpc::detail {
+class AdaptiveConcurrencyLimiter;
+class AdmissionQueue;
 class ServerConnectionHandler;
 class DryRunConnectionHandler;
 class NormalConnectionHandler;
@@ -103,6 +108,24 @@ class Server {
     std::size_t max_concurrent_requests =
         FLAGS_flare_rpc_server_max_ongoing_calls;
 
+    // If set, concurrent requests are further limited by a limit derived from
+    // observed latency. Once requests start queueing (i.e., latency goes up),
+    // the limit is lowered and excessive requests are rejected early.
+    //
+    // `max_concurrent_requests` still applies, and caps the adaptive limit.
+    bool adaptive_concurrency_limit =
+        FLAGS_flare_rpc_server_adaptive_concurrency_limit;
+
+    // If non-zero, at most so many (non-streaming) requests are executed
+    // concurrently, the rest are held in an admission queue. Under overload,
+    // the queue switches to LIFO order and drops requests that have been queued
+    // for too long (CoDel), instead of letting every request wait in line
+    // until it times out.
+    //
+    // Requests held in the queue are counted as ongoing requests.
+    std::size_t max_executing_requests =
+        FLAGS_flare_rpc_server_max_executing_requests;
+
     // If we've had so many connections, new connections are rejected.
     std::size_t max_concurrent_connections =
         FLAGS_flare_rpc_server_max_connections;
@@ -237,8 +260,10 @@ class Server {
   // Returns false if the new call should be dropped.
   bool OnNewCall();
 
-  // Called when a call permitted by `OnNewCall` has completed.
-  void OnCallCompletion();
+  // Called when a call permitted by `OnNewCall` has completed. `latency` is
+  // used by adaptive concurrency limiter, zero should be passed if latency of
+  // the call is not meaningful (e.g., streaming calls).
+  void OnCallCompletion(std::chrono::nanoseconds latency = {});
 
   // Caller is responsible for removing connection from the event loop.
   void OnConnectionClosed(std::uint64_t id);
@@ -295,6 +320,12 @@ class Server {
   // Number of on-going calls.
   std::atomic<std::size_t> ongoing_calls_{0};
 
+  // Set if `Options::adaptive_concurrency_limit` is enabled.
+  std::unique_ptr<rpc::detail::AdaptiveConcurrencyLimiter> concurrency_limiter_;
+
+  // Set if `Options::max_executing_requests` is non-zero.
+  std::unique_ptr<rpc::detail::AdmissionQueue> admission_queue_;
+
   std::mutex conns_lock_;  // Likely to content for short-lived connections.
   // Using map here for easier removal (on connection close). ctx.id -> ctx*.
   std::unordered_map<std::uint64_t, std::unique_ptr<ConnectionContext>> conns_;